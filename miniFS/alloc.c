@@ -0,0 +1,300 @@
+// miniFS/alloc.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+#include "epoch.h"
+#include "fs.h"
+#include "metrics.h"
+
+#define NODES_PER_SLAB 256
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// Slab: cabeçalho seguido de um vetor de Nodes, preenchido por "bump"
+// (a cabeça da lista de slabs é sempre o slab mais novo)
+struct Slab {
+    Slab *next;
+    size_t used;
+    Node nodes[NODES_PER_SLAB];
+};
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t used;
+    size_t cap;
+    char data[];
+};
+
+// Cabeçalho de um bloco grande; o tamanho é múltiplo de 16 para
+// manter o alinhamento dos dados que vêm logo depois
+struct LargeBlock {
+    LargeBlock *next;
+    LargeBlock *prev;
+    size_t size;
+    size_t pad;
+};
+
+static void out_of_memory(void) {
+    perror("Failed to allocate file system memory");
+    exit(1);
+}
+
+// --- Nodes ---
+
+Node* alloc_node(FsAllocator *a) {
+    Node *node;
+    if (a->free_nodes) {
+        node = a->free_nodes;
+        a->free_nodes = node->next;
+    } else {
+        if (!a->slabs || a->slabs->used == NODES_PER_SLAB) {
+            Slab *slab = (Slab*)malloc(sizeof(Slab));
+            if (!slab) out_of_memory();
+            slab->used = 0;
+            slab->next = a->slabs;
+            a->slabs = slab;
+            a->slab_count++;
+        }
+        node = &a->slabs->nodes[a->slabs->used++];
+    }
+    memset(node, 0, sizeof(Node));
+    a->live_nodes++;
+    METRICS_ALLOC(sizeof(Node));
+    return node;
+}
+
+// Guarda uma liberação para depois do período de graça. As épocas só
+// crescem, então a lista fica ordenada e é concluída pelo começo
+static void defer_free(FsAllocator *a, void *ptr, size_t size) {
+    if (a->deferred_count == a->deferred_cap) {
+        size_t cap = a->deferred_cap ? a->deferred_cap * 2 : 256;
+        DeferredFree *grown = (DeferredFree*)realloc(a->deferred, cap * sizeof(DeferredFree));
+        if (!grown) out_of_memory();
+        a->deferred = grown;
+        a->deferred_cap = cap;
+    }
+    DeferredFree *d = &a->deferred[a->deferred_count++];
+    d->ptr = ptr;
+    d->size = size;
+    d->epoch = epoch_current();
+}
+
+static void push_free_node(FsAllocator *a, Node *node) {
+    if (!a->free_nodes) a->free_nodes_tail = node;
+    node->next = a->free_nodes;
+    a->free_nodes = node;
+}
+
+static void free_node_now(FsAllocator *a, Node *node) {
+    push_free_node(a, node);
+    a->live_nodes--;
+}
+
+void alloc_free_node(FsAllocator *a, Node *node) {
+    if (a->defer) defer_free(a, node, 0);
+    else free_node_now(a, node);
+}
+
+// --- Bytes (arena para pequenos, lista para grandes) ---
+
+static size_t size_class(size_t size) {
+    return size == 0 ? 0 : (size - 1) / 16;
+}
+
+void* alloc_bytes(FsAllocator *a, size_t size) {
+    METRICS_ALLOC(size);
+    if (size > ALLOC_SMALL_MAX) {
+        LargeBlock *blk = (LargeBlock*)malloc(sizeof(LargeBlock) + size);
+        if (!blk) out_of_memory();
+        blk->size = size;
+        blk->prev = NULL;
+        blk->next = a->large;
+        if (a->large) a->large->prev = blk;
+        a->large = blk;
+        a->large_count++;
+        a->large_live_bytes += size;
+        return blk + 1;
+    }
+
+    size_t cls = size_class(size);
+    size_t rounded = (cls + 1) * 16;
+    a->small_live_bytes += rounded;
+    if (a->free_small[cls]) {
+        void *p = a->free_small[cls];
+        a->free_small[cls] = *(void**)p;
+        a->small_free_bytes -= rounded;
+        return p;
+    }
+    if (!a->blocks || a->blocks->cap - a->blocks->used < rounded) {
+        ArenaBlock *blk = (ArenaBlock*)malloc(sizeof(ArenaBlock) + ARENA_BLOCK_SIZE);
+        if (!blk) out_of_memory();
+        blk->used = 0;
+        blk->cap = ARENA_BLOCK_SIZE;
+        blk->next = a->blocks;
+        a->blocks = blk;
+        a->block_count++;
+    }
+    void *p = a->blocks->data + a->blocks->used;
+    a->blocks->used += rounded;
+    return p;
+}
+
+static void free_bytes_now(FsAllocator *a, void *ptr, size_t size) {
+    if (size > ALLOC_SMALL_MAX) {
+        LargeBlock *blk = (LargeBlock*)ptr - 1;
+        if (blk->prev) blk->prev->next = blk->next;
+        else a->large = blk->next;
+        if (blk->next) blk->next->prev = blk->prev;
+        a->large_count--;
+        a->large_live_bytes -= blk->size;
+        free(blk);
+        return;
+    }
+    size_t cls = size_class(size);
+    size_t rounded = (cls + 1) * 16;
+    if (!a->free_small[cls]) a->free_small_tail[cls] = ptr;
+    *(void**)ptr = a->free_small[cls];
+    a->free_small[cls] = ptr;
+    a->small_live_bytes -= rounded;
+    a->small_free_bytes += rounded;
+}
+
+// O chamador informa o mesmo tamanho usado na alocação
+void alloc_free_bytes(FsAllocator *a, void *ptr, size_t size) {
+    if (!ptr) return;
+    // Pedidos de 0 bytes ocupam a menor classe, então size 0 marca um Node
+    if (a->defer || (a->local && size > ALLOC_SMALL_MAX)) defer_free(a, ptr, size ? size : 1);
+    else free_bytes_now(a, ptr, size);
+}
+
+void alloc_set_defer(FsAllocator *a, int defer) {
+    a->defer = defer;
+}
+
+size_t alloc_reclaim(FsAllocator *a, unsigned long long safe_epoch) {
+    size_t done = 0;
+    while (done < a->deferred_count && a->deferred[done].epoch < safe_epoch) {
+        DeferredFree *d = &a->deferred[done++];
+        if (d->size == 0) free_node_now(a, (Node*)d->ptr);
+        else free_bytes_now(a, d->ptr, d->size);
+    }
+    if (done == 0) return a->deferred_count;
+    a->deferred_count -= done;
+    memmove(a->deferred, a->deferred + done, a->deferred_count * sizeof(DeferredFree));
+    return a->deferred_count;
+}
+
+// --- Alocadores locais ---
+
+void alloc_init_local(FsAllocator *local, const FsAllocator *owner) {
+    memset(local, 0, sizeof(FsAllocator));
+    local->defer = owner->defer;
+    local->local = 1;
+}
+
+// Os slabs e blocos do local entram logo depois do slab/bloco atual do
+// dono, que continua sendo o usado pelas próximas alocações. O que sobrou
+// no slab atual do local vai para a lista de livres; o resto do bloco
+// atual da arena (menos de ARENA_BLOCK_SIZE) fica sem uso
+void alloc_merge(FsAllocator *owner, FsAllocator *local) {
+    if (local->slabs) {
+        Slab *head = local->slabs;
+        while (head->used < NODES_PER_SLAB) push_free_node(local, &head->nodes[head->used++]);
+        Slab *tail = head;
+        while (tail->next) tail = tail->next;
+        if (owner->slabs) {
+            tail->next = owner->slabs->next;
+            owner->slabs->next = head;
+        } else {
+            owner->slabs = head;
+        }
+        owner->slab_count += local->slab_count;
+    }
+    if (local->free_nodes) {
+        local->free_nodes_tail->next = owner->free_nodes;
+        if (!owner->free_nodes) owner->free_nodes_tail = local->free_nodes_tail;
+        owner->free_nodes = local->free_nodes;
+    }
+    owner->live_nodes += local->live_nodes;
+
+    if (local->blocks) {
+        ArenaBlock *tail = local->blocks;
+        while (tail->next) tail = tail->next;
+        if (owner->blocks) {
+            tail->next = owner->blocks->next;
+            owner->blocks->next = local->blocks;
+        } else {
+            owner->blocks = local->blocks;
+        }
+        owner->block_count += local->block_count;
+    }
+    for (size_t cls = 0; cls < ALLOC_CLASS_COUNT; cls++) {
+        if (!local->free_small[cls]) continue;
+        *(void**)local->free_small_tail[cls] = owner->free_small[cls];
+        if (!owner->free_small[cls]) owner->free_small_tail[cls] = local->free_small_tail[cls];
+        owner->free_small[cls] = local->free_small[cls];
+    }
+    owner->small_live_bytes += local->small_live_bytes;
+    owner->small_free_bytes += local->small_free_bytes;
+
+    if (local->large) {
+        LargeBlock *tail = local->large;
+        while (tail->next) tail = tail->next;
+        tail->next = owner->large;
+        if (owner->large) owner->large->prev = tail;
+        owner->large = local->large;
+        owner->large_count += local->large_count;
+        owner->large_live_bytes += local->large_live_bytes;
+    }
+
+    // Com o dono adiando, as liberações do local entram na lista dele com a
+    // época atual (nunca menor que a original, e a lista continua em
+    // ordem); sem adiar, só há blocos grandes na lista do local
+    for (size_t i = 0; i < local->deferred_count; i++) {
+        DeferredFree *d = &local->deferred[i];
+        if (owner->defer) defer_free(owner, d->ptr, d->size);
+        else free_bytes_now(owner, d->ptr, d->size);
+    }
+    free(local->deferred);
+    memset(local, 0, sizeof(FsAllocator));
+}
+
+// --- Liberação em bloco e estatísticas ---
+
+void alloc_release_all(FsAllocator *a) {
+    while (a->slabs) {
+        Slab *next = a->slabs->next;
+        free(a->slabs);
+        a->slabs = next;
+    }
+    while (a->blocks) {
+        ArenaBlock *next = a->blocks->next;
+        free(a->blocks);
+        a->blocks = next;
+    }
+    while (a->large) {
+        LargeBlock *next = a->large->next;
+        free(a->large);
+        a->large = next;
+    }
+    free(a->deferred);
+    int defer = a->defer;
+    memset(a, 0, sizeof(FsAllocator));
+    a->defer = defer;
+}
+
+void alloc_get_stats(const FsAllocator *a, AllocStats *out) {
+    memset(out, 0, sizeof(AllocStats));
+    out->live_nodes = a->live_nodes;
+    out->slab_count = a->slab_count;
+    out->slab_capacity = a->slab_count * NODES_PER_SLAB;
+    out->slab_utilization = out->slab_capacity ? (double)a->live_nodes / out->slab_capacity : 0.0;
+    out->arena_blocks = a->block_count;
+    out->arena_reserved_bytes = a->block_count * ARENA_BLOCK_SIZE;
+    out->small_live_bytes = a->small_live_bytes;
+    out->small_free_bytes = a->small_free_bytes;
+    out->large_count = a->large_count;
+    out->large_live_bytes = a->large_live_bytes;
+    out->total_live_bytes = a->live_nodes * sizeof(Node) + a->small_live_bytes + a->large_live_bytes;
+}
@@ -0,0 +1,102 @@
+// miniFS/alloc.h
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h> // Para size_t
+
+struct Node;
+
+// Pedidos de até este tamanho saem da arena (em classes múltiplas de 16);
+// os maiores vão para malloc, mas continuam registrados no alocador
+#define ALLOC_SMALL_MAX 256
+#define ALLOC_CLASS_COUNT (ALLOC_SMALL_MAX / 16)
+
+typedef struct Slab Slab;
+typedef struct ArenaBlock ArenaBlock;
+typedef struct LargeBlock LargeBlock;
+
+// Liberação adiada: o ponteiro, seu tamanho (0 = Node) e a época em que
+// foi liberado (ver epoch.h)
+typedef struct {
+    void *ptr;
+    size_t size;
+    unsigned long long epoch;
+} DeferredFree;
+
+// Alocador da árvore: slabs de Nodes com lista de livres, arena de blocos
+// para bytes pequenos (nomes, conteúdos curtos, índices) e uma lista de
+// blocos grandes. Tudo o que pertence à árvore sai daqui, então destruir
+// a árvore inteira é só liberar slabs, blocos e a lista de grandes.
+typedef struct FsAllocator {
+    Slab *slabs;
+    size_t slab_count;
+    struct Node *free_nodes;      // Nodes liberados, encadeados por 'next'
+    struct Node *free_nodes_tail; // Último da lista (para alloc_merge)
+    size_t live_nodes;
+
+    ArenaBlock *blocks;
+    size_t block_count;
+    void *free_small[ALLOC_CLASS_COUNT]; // Listas de livres por classe
+    void *free_small_tail[ALLOC_CLASS_COUNT];
+    size_t small_live_bytes;      // Bytes pequenos em uso (arredondados)
+    size_t small_free_bytes;      // Bytes pequenos nas listas de livres
+
+    LargeBlock *large;
+    size_t large_count;
+    size_t large_live_bytes;
+
+    // Com defer ligado (leitores sem travas), nada volta direto para as
+    // listas de livres: fica aqui até passar o período de graça
+    int defer;
+    DeferredFree *deferred;
+    size_t deferred_count;
+    size_t deferred_cap;
+
+    // Alocador local de uma tarefa paralela (alloc_init_local). Os blocos
+    // grandes que ele libera são do alocador dono, então também esperam na
+    // lista de adiados até alloc_merge
+    int local;
+} FsAllocator;
+
+// Estatísticas de uso expostas pela API (fs_alloc_stats)
+typedef struct {
+    size_t live_nodes;
+    size_t slab_count;
+    size_t slab_capacity;         // Nodes que cabem nos slabs existentes
+    double slab_utilization;      // live_nodes / slab_capacity
+    size_t arena_blocks;
+    size_t arena_reserved_bytes;  // Bytes reservados em blocos da arena
+    size_t small_live_bytes;
+    size_t small_free_bytes;
+    size_t large_count;
+    size_t large_live_bytes;
+    size_t total_live_bytes;      // Nodes + bytes pequenos + grandes em uso
+} AllocStats;
+
+struct Node* alloc_node(FsAllocator *a);
+void alloc_free_node(FsAllocator *a, struct Node *node);
+
+void* alloc_bytes(FsAllocator *a, size_t size);
+void alloc_free_bytes(FsAllocator *a, void *ptr, size_t size);
+
+// Liga/desliga as liberações adiadas
+void alloc_set_defer(FsAllocator *a, int defer);
+
+// Conclui as liberações adiadas de épocas menores que safe_epoch
+// (todas, com safe_epoch = ~0ull). Retorna quantas ainda esperam
+size_t alloc_reclaim(FsAllocator *a, unsigned long long safe_epoch);
+
+// Alocadores locais: cada worker de uma operação paralela (cp, rm -r) aloca
+// e libera no seu, sem travas, e no fim tudo é incorporado ao dono, com o
+// dono sob o controle de uma única thread. Os contadores de um local podem
+// ficar "negativos" (liberou mais do que alocou); a soma no dono acerta
+void alloc_init_local(FsAllocator *local, const FsAllocator *owner);
+void alloc_merge(FsAllocator *owner, FsAllocator *local);
+
+// Libera tudo de uma vez, em O(#slabs + #blocos + #grandes)
+void alloc_release_all(FsAllocator *a);
+
+void alloc_get_stats(const FsAllocator *a, AllocStats *out);
+
+#endif // ALLOC_H
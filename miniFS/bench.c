@@ -0,0 +1,1702 @@
+// miniFS/bench.c
+//
+// Benchmarks que exercitam a API do sistema de arquivos diretamente,
+// sem passar pelo shell. Compile junto com os módulos do FS (todos os .c
+// exceto main.c; o comando completo está no README) e execute,
+// por exemplo: ./bench bigdir 1000000
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "content.h"
+#include "fs.h"
+#include "journal.h"
+#include "metrics.h"
+#include "nameindex.h"
+#include "textscan.h"
+#include "shell.h"
+#include "utils.h"
+#include "workload.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Cria n arquivos em um único diretório e depois procura cada um deles.
+// Reporta o tempo por lote para evidenciar se o custo por operação é constante
+static void bench_bigdir(long n) {
+    char path[64];
+    long batch = n >= 10 ? n / 10 : 1;
+
+    fs_t *fs = fs_create();
+    fs_mkdir(fs, "/big");
+
+    printf("bigdir: creating %ld files in /big\n", n);
+    double start = now_seconds();
+    double batch_start = start;
+    for (long i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "/big/f%07ld", i);
+        fs_touch(fs, path);
+        if ((i + 1) % batch == 0) {
+            double t = now_seconds();
+            printf("  %8ld files: %.1f ns/create (batch)\n", i + 1, (t - batch_start) * 1e9 / batch);
+            batch_start = t;
+        }
+    }
+    double create_time = now_seconds() - start;
+
+    // fs_touch em um arquivo existente é apenas uma busca
+    start = now_seconds();
+    for (long i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "/big/f%07ld", i);
+        fs_touch(fs, path);
+    }
+    double lookup_time = now_seconds() - start;
+
+    AllocStats st;
+    fs_alloc_stats(fs, &st);
+
+    // Destruir a árvore libera os slabs e blocos de uma vez, sem percorrer a árvore
+    start = now_seconds();
+    fs_destroy(fs);
+    double destroy_time = now_seconds() - start;
+
+    printf("create: %.3f s total, %.0f ops/s\n", create_time, n / create_time);
+    printf("lookup: %.3f s total, %.0f ops/s\n", lookup_time, n / lookup_time);
+    printf("destroy: %.3f ms\n", destroy_time * 1e3);
+    fs_free(fs);
+    printf("memory: %zu nodes in %zu slabs (%.1f%% used), %zu bytes live\n",
+           st.live_nodes, st.slab_count, st.slab_utilization * 100.0, st.total_live_bytes);
+}
+
+// Popula um diretório com 'size' arquivos e mede o custo médio por
+// operação de criar, mover (ida e volta) e remover entradas nele.
+// Os movimentos tiram arquivos do meio da lista, o pior caso sem 'prev'
+static void churn_dir(fs_t *fs, long size, long ops) {
+    char dir[32], path[96], other[96];
+    snprintf(dir, sizeof(dir), "/churn%ld", size);
+    fs_mkdir(fs, dir);
+    for (long i = 0; i < size; i++) {
+        snprintf(path, sizeof(path), "%s/f%ld", dir, i);
+        fs_touch(fs, path);
+    }
+
+    unsigned long seed = 12345;
+    double start = now_seconds();
+    for (long i = 0; i < ops; i++) {
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        long victim = (long)((seed >> 33) % (unsigned long)size);
+
+        // Cria e remove uma entrada temporária
+        snprintf(path, sizeof(path), "%s/tmp%ld", dir, i);
+        fs_touch(fs, path);
+        fs_rm(fs, path);
+
+        // Move um arquivo existente para fora do diretório e de volta
+        snprintf(path, sizeof(path), "%s/f%ld", dir, victim);
+        snprintf(other, sizeof(other), "/churn_out/f%ld", victim);
+        fs_mv(fs, path, other);
+        fs_mv(fs, other, path);
+    }
+    double elapsed = now_seconds() - start;
+    printf("  %8ld entries: %.1f ns/op (%ld ops: touch+rm+mv+mv)\n",
+           size, elapsed * 1e9 / (ops * 4), ops);
+}
+
+static void bench_churn(long ops) {
+    fs_t *fs = fs_create();
+    fs_mkdir(fs, "/churn_out");
+    printf("churn: create/remove/move per directory size\n");
+    churn_dir(fs, 10, ops);
+    churn_dir(fs, 10000, ops);
+    churn_dir(fs, 1000000, ops);
+    fs_free(fs);
+}
+
+// Gera uma árvore sintética de quatro níveis de diretórios (fanout 10,
+// nomes d0..d9) com arquivos file0..fileK nas folhas, totalizando ~n nós.
+// Mede a memória da árvore e o custo de buscas de caminhos profundos
+static void bench_tree(long n) {
+    char path[128];
+    long leaf_dirs = 10000;
+    long files_per_dir = n / leaf_dirs > 0 ? n / leaf_dirs : 1;
+
+    fs_t *fs = fs_create();
+    double start = now_seconds();
+    for (long d = 0; d < leaf_dirs; d++) {
+        long a = d / 1000, b = (d / 100) % 10, c = (d / 10) % 10, e = d % 10;
+        if (d % 1000 == 0) { snprintf(path, sizeof(path), "/d%ld", a); fs_mkdir(fs, path); }
+        if (d % 100 == 0) { snprintf(path, sizeof(path), "/d%ld/d%ld", a, b); fs_mkdir(fs, path); }
+        if (d % 10 == 0) { snprintf(path, sizeof(path), "/d%ld/d%ld/d%ld", a, b, c); fs_mkdir(fs, path); }
+        snprintf(path, sizeof(path), "/d%ld/d%ld/d%ld/d%ld", a, b, c, e);
+        fs_mkdir(fs, path);
+        for (long f = 0; f < files_per_dir; f++) {
+            snprintf(path, sizeof(path), "/d%ld/d%ld/d%ld/d%ld/file%ld", a, b, c, e, f);
+            fs_touch(fs, path);
+        }
+    }
+    double build_time = now_seconds() - start;
+
+    AllocStats st;
+    fs_alloc_stats(fs, &st);
+    printf("tree: %zu nodes built in %.2f s\n", st.live_nodes, build_time);
+    printf("memory: sizeof(Node) = %zu, %zu bytes live (%.1f bytes/node), %zu bytes reserved\n",
+           sizeof(Node), st.total_live_bytes, (double)st.total_live_bytes / st.live_nodes,
+           st.slab_capacity * sizeof(Node) + st.arena_reserved_bytes + st.large_live_bytes);
+
+    // Buscas aleatórias de caminhos de profundidade 5 (fs_touch em um
+    // arquivo existente só resolve o caminho)
+    long lookups = 1000000;
+    unsigned long seed = 42;
+    start = now_seconds();
+    for (long i = 0; i < lookups; i++) {
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        long d = (long)((seed >> 33) % (unsigned long)leaf_dirs);
+        long f = (long)((seed >> 17) % (unsigned long)files_per_dir);
+        snprintf(path, sizeof(path), "/d%ld/d%ld/d%ld/d%ld/file%ld",
+                 d / 1000, (d / 100) % 10, (d / 10) % 10, d % 10, f);
+        fs_touch(fs, path);
+    }
+    double lookup_time = now_seconds() - start;
+    printf("lookup: %.0f ns/path (depth 5, %ld random paths)\n", lookup_time * 1e9 / lookups, lookups);
+    fs_free(fs);
+}
+
+// Buscas de caminhos profundos: um tronco de depth-1 diretórios com 'dirs'
+// diretórios de 10 arquivos na ponta, como em um script que trabalha sempre
+// na mesma região da árvore. Mostra o custo por caminho e a taxa de acerto
+// do cache de caminhos, separando uma passada fria (cada diretório resolvido
+// uma vez pela árvore) e uma quente
+static void bench_deeppath(long depth, long dirs) {
+    long files_per_dir = 10;
+    if (depth < 2 || dirs < 1) {
+        fprintf(stderr, "deeppath: depth must be at least 2 and dirs at least 1\n");
+        return;
+    }
+    // "/level" e até 20 dígitos por nível; a ponta ("/dir%ld/file%ld") cabe em 64
+    size_t trunk_cap = (size_t)depth * 26 + 1, path_cap = trunk_cap + 64;
+    char *trunk = (char*)malloc(trunk_cap);
+    char *path = (char*)malloc(path_cap);
+    if (!trunk || !path) { perror("Failed to allocate paths"); exit(1); }
+    size_t trunk_len = 0;
+
+    fs_t *fs = fs_create();
+    trunk[0] = '\0';
+    for (long l = 0; l < depth - 1; l++) {
+        trunk_len += (size_t)snprintf(trunk + trunk_len, trunk_cap - trunk_len, "/level%02ld", l);
+        fs_mkdir(fs, trunk);
+    }
+    for (long d = 0; d < dirs; d++) {
+        snprintf(path, path_cap, "%s/dir%ld", trunk, d);
+        fs_mkdir(fs, path);
+        for (long f = 0; f < files_per_dir; f++) {
+            snprintf(path, path_cap, "%s/dir%ld/file%ld", trunk, d, f);
+            fs_touch(fs, path);
+        }
+    }
+    printf("deeppath: depth %ld, %ld directories of %ld files, %zu-byte paths\n",
+           depth + 1, dirs, files_per_dir, trunk_len + strlen("/dir0/file0"));
+
+    long lookups = 1000000;
+    unsigned long seed = 42;
+    const char *pass_names[] = { "cold", "warm" };
+    for (int pass = 0; pass < 2; pass++) {
+        DcacheStats before, after;
+        fs_dcache_stats(fs, &before);
+        double start = now_seconds();
+        for (long i = 0; i < lookups; i++) {
+            seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+            long d = pass == 0 ? i % dirs : (long)((seed >> 33) % (unsigned long)dirs);
+            long f = (long)((seed >> 17) % (unsigned long)files_per_dir);
+            snprintf(path, path_cap, "%s/dir%ld/file%ld", trunk, d, f);
+            fs_touch(fs, path); // Arquivo existente: só resolve o caminho
+        }
+        double t = now_seconds() - start;
+        fs_dcache_stats(fs, &after);
+        size_t hits = after.hits - before.hits;
+        size_t misses = after.misses - before.misses;
+        printf("%s: %.0f ns/path, %zu hits, %zu misses (%.1f%% hit rate)\n", pass_names[pass],
+               t * 1e9 / lookups, hits, misses, hits + misses ? hits * 100.0 / (hits + misses) : 0.0);
+    }
+    fs_free(fs);
+    free(trunk);
+    free(path);
+}
+
+// Faz arquivos crescerem com muitas escritas pequenas no final
+// (fs_append). Com o buffer crescendo geometricamente, o custo por byte
+// deve ser constante, independente do tamanho final do arquivo
+static void bench_append(long total_mb) {
+    char buf[4096];
+    char path[64];
+    memset(buf, 'x', sizeof(buf));
+    long files = 16;
+    long writes_per_file = total_mb * 1024 * 1024 / files / (long)sizeof(buf);
+
+    fs_t *fs = fs_create();
+    fs_mkdir(fs, "/data");
+    double start = now_seconds();
+    for (long f = 0; f < files; f++) {
+        snprintf(path, sizeof(path), "/data/file%ld", f);
+        for (long w = 0; w < writes_per_file; w++) fs_append(fs, path, buf, sizeof(buf));
+    }
+    double elapsed = now_seconds() - start;
+    double mb = (double)files * writes_per_file * sizeof(buf) / (1024.0 * 1024.0);
+    printf("append: %.0f MB in %ld files with 4 KiB writes: %.3f s, %.0f MB/s\n",
+           mb, files, elapsed, mb / elapsed);
+    fs_free(fs);
+}
+
+// Copia uma subárvore com total_mb MB em arquivos de 1 MiB e altera 1% dos
+// dados da cópia com escritas de 4 KiB em posições aleatórias. Com os chunks
+// compartilhados, a cópia deve custar só metadados e a alteração deve
+// custar memória proporcional aos chunks tocados, não ao tamanho copiado
+static void bench_cow(long total_mb) {
+    const size_t file_size = 1024 * 1024;
+    char path[64];
+    char buf[4096];
+    char *data = (char*)malloc(file_size);
+    if (!data) { perror("malloc"); return; }
+    memset(data, 'x', file_size);
+    memset(buf, 'y', sizeof(buf));
+
+    fs_t *fs = fs_create();
+    fs_mkdir(fs, "/src");
+    for (long f = 0; f < total_mb; f++) {
+        snprintf(path, sizeof(path), "/src/file%ld", f);
+        fs_write(fs, path, 0, data, file_size);
+    }
+    free(data);
+
+    AllocStats before, after_cp, after_mod;
+    fs_alloc_stats(fs, &before);
+    printf("cow: /src has %ld MB in %ld files, %.1f MB live\n",
+           total_mb, total_mb, before.total_live_bytes / (1024.0 * 1024.0));
+
+    double start = now_seconds();
+    fs_cp(fs, "/src", "/dst");
+    double cp_time = now_seconds() - start;
+    fs_alloc_stats(fs, &after_cp);
+    printf("cp: %.3f ms, +%.2f MB\n", cp_time * 1e3,
+           (after_cp.total_live_bytes - before.total_live_bytes) / (1024.0 * 1024.0));
+
+    long writes = total_mb * 1024 * 1024 / 100 / (long)sizeof(buf);
+    srand(42);
+    start = now_seconds();
+    for (long w = 0; w < writes; w++) {
+        snprintf(path, sizeof(path), "/dst/file%ld", rand() % total_mb);
+        size_t offset = (size_t)(rand() % (file_size / sizeof(buf))) * sizeof(buf);
+        fs_write(fs, path, offset, buf, sizeof(buf));
+    }
+    double mod_time = now_seconds() - start;
+    fs_alloc_stats(fs, &after_mod);
+    printf("modify 1%%: %ld writes of 4 KiB, %.3f ms, +%.2f MB\n", writes, mod_time * 1e3,
+           (after_mod.total_live_bytes - after_cp.total_live_bytes) / (1024.0 * 1024.0));
+    fs_free(fs);
+}
+
+// Grava uma imagem com total_mb MB em arquivos de 1 MiB e 1M de arquivos
+// vazios em 1000 diretórios, e mede a abertura da imagem e os primeiros
+// acessos. Com o mapeamento preguiçoso, fs_load não deve depender do
+// tamanho da imagem; o custo aparece só nos diretórios acessados
+static void bench_load(long total_mb) {
+    const char *image = "bench_image.dat";
+    const size_t file_size = 1024 * 1024;
+    char path[64];
+    char *data = (char*)malloc(file_size);
+    if (!data) { perror("malloc"); return; }
+    memset(data, 'x', file_size);
+
+    fs_t *fs = fs_create();
+    fs_mkdir(fs, "/data");
+    for (long f = 0; f < total_mb; f++) {
+        snprintf(path, sizeof(path), "/data/file%ld", f);
+        fs_write(fs, path, 0, data, file_size);
+    }
+    free(data);
+    fs_mkdir(fs, "/meta");
+    for (long d = 0; d < 1000; d++) {
+        snprintf(path, sizeof(path), "/meta/d%ld", d);
+        fs_mkdir(fs, path);
+        for (long f = 0; f < 1000; f++) {
+            snprintf(path, sizeof(path), "/meta/d%ld/file%ld", d, f);
+            fs_touch(fs, path);
+        }
+    }
+
+    double start = now_seconds();
+    fs_save(fs, image);
+    printf("save: %.3f s\n", now_seconds() - start);
+    fs_destroy(fs);
+
+    AllocStats st;
+    start = now_seconds();
+    fs_load(fs, image);
+    double load_time = now_seconds() - start;
+    fs_alloc_stats(fs, &st);
+    printf("load: %.3f ms, %zu nodes in memory\n", load_time * 1e3, st.live_nodes);
+
+    start = now_seconds();
+    fs_touch(fs, "/meta/d500/file999");
+    double first_time = now_seconds() - start;
+    start = now_seconds();
+    fs_touch(fs, "/meta/d500/file998");
+    double second_time = now_seconds() - start;
+    fs_alloc_stats(fs, &st);
+    printf("first lookup: %.3f ms, second: %.1f us, %zu nodes in memory\n",
+           first_time * 1e3, second_time * 1e6, st.live_nodes);
+
+    char buf[4096];
+    memset(buf, 'y', sizeof(buf));
+    start = now_seconds();
+    fs_write(fs, "/data/file0", 0, buf, sizeof(buf));
+    printf("first write to a mapped file: %.1f us\n", (now_seconds() - start) * 1e6);
+
+    fs_free(fs);
+    remove(image);
+}
+
+static double file_mb(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0.0;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size / (1024.0 * 1024.0);
+}
+
+// Vazão de fs_save e fs_load: n arquivos de 1 KiB em 1000 diretórios mais
+// total_mb MB em arquivos de 1 MiB. A carga é medida até todos os nós
+// terem sido criados em memória, primeiro por acessos a cada arquivo e
+// depois com fs_preload; a gravação e o fs_preload, com 1 a 16 workers
+static void bench_save(long n, long total_mb) {
+    static const int worker_counts[] = { 1, 2, 4, 8, 16 };
+    const int counts = (int)(sizeof(worker_counts) / sizeof(worker_counts[0]));
+    const char *image = "bench_image.dat";
+    const size_t big_size = 1024 * 1024;
+    char path[64];
+    char small[1024];
+    char *data = (char*)malloc(big_size);
+    if (!data) { perror("malloc"); return; }
+    memset(data, 'x', big_size);
+    memset(small, 's', sizeof(small));
+    long dirs = 1000;
+    long per_dir = n / dirs > 0 ? n / dirs : 1;
+
+    fs_t *fs = fs_create();
+    for (long d = 0; d < dirs; d++) {
+        snprintf(path, sizeof(path), "/d%ld", d);
+        fs_mkdir(fs, path);
+        for (long f = 0; f < per_dir; f++) {
+            snprintf(path, sizeof(path), "/d%ld/f%ld", d, f);
+            fs_write(fs, path, 0, small, sizeof(small));
+        }
+    }
+    fs_mkdir(fs, "/big");
+    for (long f = 0; f < total_mb; f++) {
+        snprintf(path, sizeof(path), "/big/file%ld", f);
+        fs_write(fs, path, 0, data, big_size);
+    }
+    free(data);
+    AllocStats st;
+    fs_alloc_stats(fs, &st);
+    size_t nodes = st.live_nodes;
+
+    int rounds = 3;
+    double mb = 0;
+    for (int k = 0; k < counts; k++) {
+        fs_set_workers(fs, worker_counts[k]);
+        double best = 1e30;
+        for (int r = 0; r < rounds; r++) {
+            double start = now_seconds();
+            fs_save(fs, image);
+            double t = now_seconds() - start;
+            if (t < best) best = t;
+        }
+        mb = file_mb(image);
+        printf("save: %2d workers, %zu nodes, %.1f MB image, best of %d: %.3f s, %.0f MB/s, %.2f M nodes/s\n",
+               worker_counts[k], nodes, mb, rounds, best, mb / best, nodes / best / 1e6);
+    }
+    fs_destroy(fs);
+
+    double start = now_seconds();
+    fs_load(fs, image);
+    double open_time = now_seconds() - start;
+    for (long d = 0; d < dirs; d++) {
+        for (long f = 0; f < per_dir; f++) {
+            snprintf(path, sizeof(path), "/d%ld/f%ld", d, f);
+            fs_touch(fs, path);
+        }
+    }
+    fs_touch(fs, "/big/file0");
+    double load_time = now_seconds() - start;
+    fs_alloc_stats(fs, &st);
+    printf("load: open %.3f ms; all %zu nodes in memory after %.3f s, %.0f MB/s, %.2f M nodes/s\n",
+           open_time * 1e3, st.live_nodes, load_time, mb / load_time, st.live_nodes / load_time / 1e6);
+
+    for (int k = 0; k < counts; k++) {
+        fs_set_workers(fs, worker_counts[k]);
+        fs_load(fs, image);
+        start = now_seconds();
+        fs_preload(fs);
+        load_time = now_seconds() - start;
+        fs_alloc_stats(fs, &st);
+        printf("preload: %2d workers, %zu nodes in %.3f s, %.2f M nodes/s\n",
+               worker_counts[k], st.live_nodes, load_time, st.live_nodes / load_time / 1e6);
+    }
+    fs_set_workers(fs, 0);
+
+    fs_free(fs);
+    remove(image);
+}
+
+// Deduplicação: total_mb MB em arquivos de 256 KiB escritos um a um (sem
+// cp), dos quais uma fração repete o conteúdo de um conjunto de 16
+// modelos; o resto é único. Para cada fração, com e sem dedup, mede a
+// escrita, a memória viva, a gravação e o tamanho da imagem
+static void bench_dedup(long total_mb) {
+    static const int dup_percents[] = { 0, 50, 90 };
+    const char *image = "bench_image.dat";
+    const size_t file_size = 256 * 1024;
+    const long templates = 16;
+    long files = total_mb * 4;
+    char path[64];
+    char *data = (char*)malloc(file_size);
+    if (!data) { perror("malloc"); return; }
+
+    for (int k = 0; k < (int)(sizeof(dup_percents) / sizeof(dup_percents[0])); k++) {
+        for (int on = 0; on <= 1; on++) {
+            fs_t *fs = fs_create();
+            fs_set_dedup(fs, on);
+            fs_mkdir(fs, "/data");
+            srand(42);
+            double start = now_seconds();
+            for (long f = 0; f < files; f++) {
+                // O mesmo gerador nas duas rodadas: os mesmos bytes em cada arquivo
+                long id = rand() % 100 < dup_percents[k] ? rand() % templates : templates + f;
+                for (size_t i = 0; i < file_size; i += sizeof(long)) {
+                    long word = id * 2654435761L + (long)i;
+                    memcpy(data + i, &word, sizeof(long));
+                }
+                snprintf(path, sizeof(path), "/data/file%ld", f);
+                fs_write(fs, path, 0, data, file_size);
+            }
+            double write_time = now_seconds() - start;
+            AllocStats st;
+            fs_alloc_stats(fs, &st);
+            start = now_seconds();
+            fs_save(fs, image);
+            double save_time = now_seconds() - start;
+            printf("dedup %-3s %2d%% duplicates: write %.0f MB/s, %.1f MB live, save %.3f s, %.1f MB image\n",
+                   on ? "on" : "off", dup_percents[k], total_mb / write_time,
+                   st.total_live_bytes / (1024.0 * 1024.0), save_time, file_mb(image));
+            fs_free(fs);
+        }
+    }
+    free(data);
+    remove(image);
+}
+
+// Texto com palavras sorteadas (rand) de um vocabulário pequeno, como logs
+// e código: o conteúdo dos arquivos do compress e do grep
+static void fill_words(char *data, size_t size) {
+    static const char *const words[] = {
+        "the ", "file ", "node ", "chunk ", "error ", "write ", "read ", "0x", "ok\n", "=", "{ ", "} ",
+        "return ", "if ", "size ", "len ", "path ", "/usr/", "lib", ".c:", "42", "1337", "\t", "\n",
+    };
+    const size_t nwords = sizeof(words) / sizeof(words[0]);
+    size_t n = 0;
+    while (n < size) {
+        const char *w = words[(size_t)rand() % nwords];
+        size_t len = strlen(w);
+        if (len > size - n) len = size - n;
+        memcpy(data + n, w, len);
+        n += len;
+    }
+}
+
+// Compressão: total_mb MB de texto (fill_words) em arquivos de 256 KiB,
+// sem e com o lz4.
+// Mede a escrita, a taxa (bytes dos arquivos / bytes guardados), a leitura
+// de cada arquivo inteiro com fs_read (o caminho do cat, descomprimindo os
+// chunks), a gravação, o tamanho da imagem e a carga seguida da leitura de
+// tudo a partir dos bytes mapeados
+static void bench_compress(long total_mb) {
+    const char *image = "bench_image.dat";
+    const size_t file_size = 256 * 1024;
+    long files = total_mb * 4;
+    char path[64];
+    char *data = (char*)malloc(file_size);
+    char *buf = (char*)malloc(file_size);
+    if (!data || !buf) { perror("malloc"); return; }
+
+    for (int on = 0; on <= 1; on++) {
+        fs_t *fs = fs_create();
+        if (on) fs_set_compression(fs, "lz4", FS_COMPRESS_THRESHOLD);
+        fs_mkdir(fs, "/data");
+        srand(42);
+        double start = now_seconds();
+        for (long f = 0; f < files; f++) {
+            fill_words(data, file_size);
+            snprintf(path, sizeof(path), "/data/file%ld", f);
+            fs_write(fs, path, 0, data, file_size);
+        }
+        double write_time = now_seconds() - start;
+        CompressionStats cs;
+        fs_compression_stats(fs, &cs);
+
+        size_t got;
+        start = now_seconds();
+        for (long f = 0; f < files; f++) {
+            snprintf(path, sizeof(path), "/data/file%ld", f);
+            fs_read(fs, path, 0, buf, file_size, &got);
+        }
+        double read_time = now_seconds() - start;
+
+        start = now_seconds();
+        fs_save(fs, image);
+        double save_time = now_seconds() - start;
+        fs_destroy(fs);
+        start = now_seconds();
+        fs_load(fs, image);
+        for (long f = 0; f < files; f++) {
+            snprintf(path, sizeof(path), "/data/file%ld", f);
+            fs_read(fs, path, 0, buf, file_size, &got);
+        }
+        double load_time = now_seconds() - start;
+
+        printf("compress %-3s: write %.0f MB/s, ratio %.2f (%.1f MB stored), read %.1f us/file (%.0f MB/s), "
+               "save %.3f s, %.1f MB image, load+read %.3f s\n",
+               on ? "lz4" : "off", total_mb / write_time, cs.stored ? (double)cs.bytes / cs.stored : 1.0,
+               cs.stored / (1024.0 * 1024.0), read_time * 1e6 / files, total_mb / read_time, save_time,
+               file_mb(image), load_time);
+        fs_free(fs);
+    }
+    free(data);
+    free(buf);
+    remove(image);
+}
+
+// --- find ---
+
+static void count_found(const char *path, size_t len, void *arg) {
+    (void)path;
+    (void)len;
+    (*(long*)arg)++;
+}
+
+// O que o find faria sem o índice: a subárvore inteira, nó a nó
+static long find_walk(Node *root, Node *top, const char *pattern) {
+    long found = 0;
+    Node *n = top;
+    for (;;) {
+        if (n != root && nameindex_match(pattern, n->name, n->name_len)) found++;
+        if (n->child) {
+            n = n->child;
+            continue;
+        }
+        while (n != top && !n->next) n = n->parent;
+        if (n == top) break;
+        n = n->next;
+    }
+    return found;
+}
+
+// Tipos de consulta do bench_find, montados a partir do nome de um arquivo
+// sorteado ("src_1234.c"): o nome exato, um prefixo ("src_1234*"), um
+// sufixo ("*_1234.c"), um '?' ("src_123?.c"), um trecho do meio
+// ("*_1234*", sem prefixo nem sufixo: todos os nomes distintos) e o nome
+// exato dentro do diretório de primeiro nível que contém o arquivo
+enum { FIND_EXACT, FIND_PREFIX, FIND_SUFFIX, FIND_ONE, FIND_INFIX, FIND_SUBTREE, FIND_KINDS };
+static const char *const find_kinds[FIND_KINDS] = { "exact", "prefix", "suffix", "?", "infix", "subtree" };
+
+static void find_query(int kind, const char *base, char *pattern, size_t cap) {
+    const char *under = strchr(base, '_');
+    const char *dot = strchr(base, '.');
+    int stem = dot ? (int)(dot - base) : (int)strlen(base);
+    switch (kind) {
+    case FIND_PREFIX: snprintf(pattern, cap, "%.*s*", stem, base); break;
+    case FIND_SUFFIX: snprintf(pattern, cap, "*%s", under ? under : base); break;
+    case FIND_ONE:    snprintf(pattern, cap, "%.*s?%s", stem - 1, base, base + stem); break;
+    case FIND_INFIX:  snprintf(pattern, cap, "*%.*s*", (int)(stem - (under ? under - base : 0)), under ? under : base); break;
+    default:          snprintf(pattern, cap, "%s", base); break;
+    }
+}
+
+// Busca por nome numa árvore realista de n nós (nomes únicos, como
+// "src_1234.c"): o tempo da primeira busca, que monta o índice, e a latência
+// média de cada tipo de consulta com o índice e percorrendo a árvore
+static void bench_find(long nodes) {
+    char path[WORKLOAD_PATH_MAX], dir[WORKLOAD_PATH_MAX], pattern[256];
+    WorkloadOptions opts = { WORKLOAD_REALISTIC, nodes, SIZES_EMPTY, 0, 1 };
+    Workload w;
+    workload_plan(&w, &opts, "/gen");
+    fs_t *fs = fs_create();
+    double start = now_seconds();
+    workload_build(fs, &w, NULL);
+    double build_time = now_seconds() - start;
+
+    long found = 0;
+    start = now_seconds();
+    fs_find_each(fs, "/", "*.none", count_found, &found);
+    double index_time = now_seconds() - start;
+    printf("find: %ld nodes built in %.2f s, index built by the first find in %.3f s\n",
+           w.dir_count + w.file_count, build_time, index_time);
+
+    unsigned long long rng = 7;
+    for (int kind = 0; kind < FIND_KINDS; kind++) {
+        // O trecho do meio passa por todos os nomes: menos repetições
+        long queries = kind == FIND_INFIX ? 20 : 1000;
+        long walks = 3;
+        long indexed = 0, walked = 0;
+        double index_total = 0, walk_total = 0;
+        for (long q = 0; q < queries; q++) {
+            long f = (long)(workload_random(&rng) % (unsigned long long)w.file_count);
+            workload_file_path(&w, f, path, sizeof(path));
+            char *slash = strrchr(path, '/');
+            find_query(kind, slash + 1, pattern, sizeof(pattern));
+            // "/gen/<diretório>", o primeiro nível abaixo da base
+            size_t top_len = strcspn(path + 5, "/") + 5;
+            memcpy(dir, path, top_len);
+            dir[top_len] = '\0';
+            const char *top = kind == FIND_SUBTREE ? dir : "/";
+
+            found = 0;
+            start = now_seconds();
+            fs_find_each(fs, top, pattern, count_found, &found);
+            index_total += now_seconds() - start;
+            indexed += found;
+
+            if (q < walks) {
+                Node *root = fs_root(fs), *n = root;
+                if (kind == FIND_SUBTREE) {
+                    // O diretório é resolvido fora do tempo, como no find
+                    for (char *c = strtok(dir + 1, "/"); c && n; c = strtok(NULL, "/")) {
+                        for (n = n->child; n && strcmp(n->name, c) != 0; n = n->next) {}
+                    }
+                }
+                start = now_seconds();
+                walked += find_walk(root, n, pattern);
+                walk_total += now_seconds() - start;
+            }
+        }
+        printf("  %-8s index %10.1f us/query (%5.1f results)   walk %10.1f us/query (%5.1f results)\n",
+               find_kinds[kind], index_total * 1e6 / queries, (double)indexed / queries,
+               walk_total * 1e6 / walks, (double)walked / walks);
+    }
+    fs_free(fs);
+    workload_free(&w);
+}
+
+// --- du ---
+
+// O que o du faria sem os totais: a subárvore inteira, somando os arquivos
+static uint64_t du_walk(Node *top, long *files) {
+    uint64_t bytes = 0;
+    for (Node *n = top; n;) {
+        if (n->type == FILE_NODE) {
+            bytes += content_size(n->content);
+            (*files)++;
+        }
+        if (n->child) {
+            n = n->child;
+            continue;
+        }
+        while (n != top && !n->next) n = n->parent;
+        n = n == top ? NULL : n->next;
+    }
+    return bytes;
+}
+
+// Custo dos totais por diretório: append, echo, mkdir + rm e mv (entre
+// dois irmãos) na ponta de cadeias de 1 a 128 diretórios, com caminhos
+// relativos a partir dela, então só a subida pelos ancestrais cresce com a
+// profundidade. Depois, numa árvore realista de n nós com arquivos de
+// tamanhos variados, o du da raiz (fs_stat) contra a soma percorrendo a
+// árvore e contra fs_check_totals
+static void bench_du(long ops, long nodes) {
+    static const long depths[] = { 1, 8, 32, 128 };
+    char path[1024], data[16];
+    memset(data, 'x', sizeof(data));
+    printf("du: %ld operations of each kind at the end of a chain of directories\n", ops);
+    for (size_t k = 0; k < sizeof(depths) / sizeof(depths[0]); k++) {
+        fs_t *fs = fs_create();
+        size_t len = 0;
+        for (long l = 0; l < depths[k]; l++) {
+            len += (size_t)snprintf(path + len, sizeof(path) - len, "/d%ld", l);
+            fs_mkdir(fs, path);
+        }
+        fs_cd(fs, path);
+        fs_mkdir(fs, "x");
+        fs_mkdir(fs, "y");
+        fs_touch(fs, "x/m");
+
+        double start = now_seconds();
+        for (long i = 0; i < ops; i++) fs_append(fs, "f", data, sizeof(data));
+        double append_time = now_seconds() - start;
+        start = now_seconds();
+        for (long i = 0; i < ops; i++) fs_echo(fs, "g", i & 1 ? "short" : "a longer line");
+        double echo_time = now_seconds() - start;
+        start = now_seconds();
+        for (long i = 0; i < ops; i++) {
+            fs_mkdir(fs, "t");
+            fs_rm(fs, "t");
+        }
+        double dir_time = now_seconds() - start;
+        start = now_seconds();
+        for (long i = 0; i < ops; i++) fs_mv(fs, i & 1 ? "y/m" : "x/m", i & 1 ? "x" : "y");
+        double mv_time = now_seconds() - start;
+
+        FsStat st;
+        fs_stat(fs, "/", &st);
+        printf("  depth %3ld: append %5.0f ns, echo %5.0f ns, mkdir+rm %5.0f ns, mv %5.0f ns (root: %llu bytes)\n",
+               depths[k], append_time * 1e9 / ops, echo_time * 1e9 / ops, dir_time * 1e9 / ops,
+               mv_time * 1e9 / ops, (unsigned long long)st.totals.bytes);
+        fs_free(fs);
+    }
+
+    WorkloadOptions opts = { WORKLOAD_REALISTIC, nodes, SIZES_LOGNORMAL, 256, 1 };
+    Workload w;
+    workload_plan(&w, &opts, "/gen");
+    fs_t *fs = fs_create();
+    workload_build(fs, &w, NULL);
+    FsStat st;
+    double start = now_seconds();
+    fs_stat(fs, "/gen", &st);
+    double stat_time = now_seconds() - start;
+    long files = 0;
+    start = now_seconds();
+    uint64_t bytes = du_walk(fs_root(fs), &files);
+    double walk_time = now_seconds() - start;
+    start = now_seconds();
+    long bad = fs_check_totals(fs);
+    double check_time = now_seconds() - start;
+    printf("  %ld nodes: totals %.1f us (%llu bytes, %u files), walk %.1f ms (%llu bytes, %ld files), "
+           "check %.1f ms (%ld wrong)\n",
+           w.dir_count + w.file_count, stat_time * 1e6, (unsigned long long)st.totals.bytes,
+           st.totals.files, walk_time * 1e3, (unsigned long long)bytes, files, check_time * 1e3, bad);
+    fs_free(fs);
+    workload_free(&w);
+}
+
+// --- grep ---
+
+static void count_lines(const char *path, size_t path_len, size_t line, const char *text, size_t len,
+                        void *arg) {
+    (void)path;
+    (void)path_len;
+    (void)line;
+    (void)text;
+    (void)len;
+    (*(long*)arg)++;
+}
+
+// A busca de substring mais simples, byte a byte: a referência do núcleo
+static const char* naive_find(const char *hay, size_t n, const char *needle, size_t m) {
+    for (size_t i = 0; i + m <= n; i++) {
+        size_t j = 0;
+        while (j < m && hay[i + j] == needle[j]) j++;
+        if (j == m) return hay + i;
+    }
+    return NULL;
+}
+
+// Ocorrências de needle em todo o buffer, com a função de busca dada
+// (strstr só recebe o texto, que termina em '\0')
+static long count_hits(const char *(*find)(const char*, size_t, const char*, size_t), const char *data,
+                       size_t n, const char *needle) {
+    size_t m = strlen(needle);
+    long hits = 0;
+    for (const char *p = data; p < data + n; p++) {
+        p = find ? find(p, (size_t)(data + n - p), needle, m) : strstr(p, needle);
+        if (!p) break;
+        hits++;
+    }
+    return hits;
+}
+
+// grep: o núcleo de textscan.h contra a busca byte a byte e o strstr da
+// libc em total_mb MB de texto (fill_words), para um padrão raro e um
+// ausente, em GB/s numa thread; depois fs_grep_each -r no mesmo texto,
+// guardado em arquivos de 256 KiB, sem e com o lz4 e com 1, 2, 4... até
+// max_workers threads
+static void bench_grep(long total_mb, long max_workers) {
+    static const char *const needles[] = { "error 1337", "segfault" };
+    const size_t file_size = 256 * 1024;
+    size_t total = (size_t)total_mb * 1024 * 1024;
+    long files = total_mb * 4;
+    char path[64];
+    char *data = (char*)malloc(total + 1);
+    if (!data) { perror("malloc"); return; }
+    srand(42);
+    fill_words(data, total);
+    data[total] = '\0';
+
+    printf("grep: %ld MB of text\n", total_mb);
+    for (size_t k = 0; k < sizeof(needles) / sizeof(needles[0]); k++) {
+        double start = now_seconds();
+        long hits = count_hits(textscan_find, data, total, needles[k]);
+        double scan_time = now_seconds() - start;
+        start = now_seconds();
+        long naive_hits = count_hits(naive_find, data, total, needles[k]);
+        double naive_time = now_seconds() - start;
+        start = now_seconds();
+        long libc_hits = count_hits(NULL, data, total, needles[k]);
+        double libc_time = now_seconds() - start;
+        if (naive_hits != hits || libc_hits != hits) fprintf(stderr, "grep: hit counts differ\n");
+        printf("  %-12s %6ld hits: textscan %.2f GB/s, byte loop %.2f GB/s, strstr %.2f GB/s\n",
+               needles[k], hits, total_mb / 1024.0 / scan_time, total_mb / 1024.0 / naive_time,
+               total_mb / 1024.0 / libc_time);
+    }
+
+    for (int on = 0; on <= 1; on++) {
+        fs_t *fs = fs_create();
+        if (on) fs_set_compression(fs, "lz4", FS_COMPRESS_THRESHOLD);
+        fs_mkdir(fs, "/data");
+        for (long d = 0; d < 16; d++) {
+            snprintf(path, sizeof(path), "/data/d%ld", d);
+            fs_mkdir(fs, path);
+        }
+        for (long f = 0; f < files; f++) {
+            snprintf(path, sizeof(path), "/data/d%ld/file%ld", f % 16, f);
+            fs_write(fs, path, 0, data + (size_t)f * file_size, file_size);
+        }
+        double base = 0;
+        for (long w = 1; w <= max_workers; w = w < max_workers && w * 2 > max_workers ? max_workers : w * 2) {
+            fs_set_workers(fs, (int)w);
+            long lines = 0;
+            double start = now_seconds();
+            fs_grep_each(fs, "/data", needles[0], 1, count_lines, &lines);
+            double elapsed = now_seconds() - start;
+            if (w == 1) base = elapsed;
+            printf("  grep -r %-3s %2ld workers: %.3f s, %.2f GB/s (%.1fx), %ld lines\n",
+                   on ? "lz4" : "off", w, elapsed, total_mb / 1024.0 / elapsed, base / elapsed, lines);
+            if (w == max_workers) break;
+        }
+        fs_free(fs);
+    }
+    free(data);
+}
+
+// Vazão das operações com o journal ligado, para cada política de fsync
+// (1 = toda operação durável ao retornar; 32 = commit em grupo; 0 = só a
+// thread de fundo sincroniza), e o tempo para reaplicar o log ao reabrir
+static void bench_journal(long ops) {
+    const char *image = "bench_journal.dat";
+    const char *log = "bench_journal.dat.wal";
+    const unsigned int policies[] = { 1, 32, 0 };
+    char path[64];
+    char data[100];
+    memset(data, 'j', sizeof(data));
+
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+        remove(image);
+        remove(log);
+        JournalConfig config = { policies[p], JOURNAL_DEFAULT_SYNC_INTERVAL_MS, 0, 0 };
+        fs_t *fs = fs_create();
+        fs_recover(fs, image, &config);
+        fs_mkdir(fs, "/j");
+        double start = now_seconds();
+        for (long i = 0; i < ops; i++) {
+            snprintf(path, sizeof(path), "/j/f%ld", i % 1000);
+            fs_write(fs, path, 0, data, sizeof(data));
+        }
+        fs_shutdown(fs);
+        double run_time = now_seconds() - start;
+        fs_destroy(fs);
+
+        start = now_seconds();
+        fs_recover(fs, image, &config);
+        double replay_time = now_seconds() - start;
+        fs_shutdown(fs);
+        fs_free(fs);
+        printf("journal sync_records=%u: %ld writes of %zu bytes, %.0f ops/s, %.1f MB log, replay %.3f s\n",
+               policies[p], ops, sizeof(data), ops / run_time, file_mb(log), replay_time);
+    }
+    remove(image);
+    remove(log);
+}
+
+// Tráfego misto de várias threads clientes no modo concorrente, cada uma
+// com sua sessão (diretório de trabalho em /s): 90% buscas (fs_stat),
+// 5% criações/remoções e 5% renomeações entre diretórios, sobre arquivos
+// próprios de cada thread. Roda com 1, 2, 4... threads até max_threads
+#define STRESS_DIRS 64
+#define STRESS_FILES 100
+#define STRESS_SLOTS 64
+
+typedef struct {
+    fs_t *fs;
+    int id;
+    int loc[STRESS_SLOTS];     // Diretório de cada arquivo próprio (-1 = nenhum)
+    unsigned long long ops, lookups, found;
+} StressThread;
+
+static int stress_stop;
+
+static void* stress_worker(void *arg) {
+    StressThread *t = (StressThread*)arg;
+    fs_t *fs = t->fs;
+    FsSession *session = fs_session_open(fs);
+    fs_session_bind(session);
+    fs_cd(fs, "/s");
+    unsigned long long x = 0x9e3779b97f4a7c15ull * (unsigned long long)(t->id + 1);
+    char path[64], dest[64];
+    FsStat st;
+    while (!__atomic_load_n(&stress_stop, __ATOMIC_RELAXED)) {
+        for (int n = 0; n < 64; n++) {
+            x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+            unsigned int r = (unsigned int)(x >> 32);
+            unsigned int kind = r % 100;
+            int dir = (int)((r >> 8) % STRESS_DIRS);
+            int slot = (int)((r >> 16) % STRESS_SLOTS);
+            if (kind < 90) {
+                snprintf(path, sizeof(path), "d%02d/f%03u", dir, (r >> 20) % STRESS_FILES);
+                if (fs_stat(fs, path, &st) == 0) t->found++;
+                t->lookups++;
+            } else if (kind < 95 || t->loc[slot] < 0) {
+                if (t->loc[slot] < 0) {
+                    snprintf(path, sizeof(path), "/s/d%02d/t%d_%d", dir, t->id, slot);
+                    fs_touch(fs, path);
+                    t->loc[slot] = dir;
+                } else {
+                    snprintf(path, sizeof(path), "d%02d/t%d_%d", t->loc[slot], t->id, slot);
+                    fs_rm(fs, path);
+                    t->loc[slot] = -1;
+                }
+            } else if (dir != t->loc[slot]) {
+                snprintf(path, sizeof(path), "/s/d%02d/t%d_%d", t->loc[slot], t->id, slot);
+                snprintf(dest, sizeof(dest), "/s/d%02d", dir);
+                fs_mv(fs, path, dest);
+                t->loc[slot] = dir;
+            }
+            t->ops++;
+        }
+    }
+    fs_session_bind(NULL);
+    fs_session_close(session);
+    return NULL;
+}
+
+static void bench_stress(long max_threads, double seconds) {
+    char path[64];
+    fs_t *fs = fs_create();
+    fs_mkdir(fs, "/s");
+    for (int d = 0; d < STRESS_DIRS; d++) {
+        snprintf(path, sizeof(path), "/s/d%02d", d);
+        fs_mkdir(fs, path);
+        for (int f = 0; f < STRESS_FILES; f++) {
+            snprintf(path, sizeof(path), "/s/d%02d/f%03d", d, f);
+            fs_touch(fs, path);
+        }
+    }
+    fs_set_concurrent(fs, FS_CONCURRENT);
+
+    printf("stress: %d dirs x %d files, %.1f s per run (90%% lookup, 5%% create/rm, 5%% rename)\n",
+           STRESS_DIRS, STRESS_FILES, seconds);
+    double base_rate = 0;
+    for (long n = 1; n <= max_threads; n = n < max_threads && n * 2 > max_threads ? max_threads : n * 2) {
+        StressThread *threads = (StressThread*)calloc((size_t)n, sizeof(StressThread));
+        pthread_t *ids = (pthread_t*)malloc((size_t)n * sizeof(pthread_t));
+        if (!threads || !ids) { perror("bench"); exit(1); }
+        stress_stop = 0;
+        double start = now_seconds();
+        for (long i = 0; i < n; i++) {
+            threads[i].fs = fs;
+            threads[i].id = (int)i;
+            memset(threads[i].loc, -1, sizeof(threads[i].loc));
+            pthread_create(&ids[i], NULL, stress_worker, &threads[i]);
+        }
+        struct timespec ts = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9) };
+        nanosleep(&ts, NULL);
+        __atomic_store_n(&stress_stop, 1, __ATOMIC_RELAXED);
+        unsigned long long ops = 0, lookups = 0, found = 0;
+        for (long i = 0; i < n; i++) {
+            pthread_join(ids[i], NULL);
+            ops += threads[i].ops;
+            lookups += threads[i].lookups;
+            found += threads[i].found;
+        }
+        double elapsed = now_seconds() - start;
+
+        // Cada arquivo próprio tem que estar onde a thread o deixou; depois
+        // eles são removidos para a próxima rodada começar da mesma árvore
+        long missing = 0;
+        FsStat st;
+        for (long i = 0; i < n; i++) {
+            for (int s = 0; s < STRESS_SLOTS; s++) {
+                if (threads[i].loc[s] < 0) continue;
+                snprintf(path, sizeof(path), "/s/d%02d/t%ld_%d", threads[i].loc[s], i, s);
+                if (fs_stat(fs, path, &st) != 0) missing++;
+                fs_rm(fs, path);
+            }
+        }
+        double rate = ops / elapsed;
+        if (n == 1) base_rate = rate;
+        printf("  %2ld threads: %.0f ops/s (%.0f lookups/s, %.1fx), %llu/%llu lookups found, %ld missing\n",
+               n, rate, lookups / elapsed, base_rate > 0 ? rate / base_rate : 0.0, found, lookups, missing);
+        free(threads);
+        free(ids);
+        if (n == max_threads) break;
+    }
+    fs_set_concurrent(fs, FS_SEQUENTIAL);
+    fs_free(fs);
+}
+
+// Escalabilidade das leituras com escritores ativos: RCU_WRITERS threads
+// criam, reescrevem, removem e movem arquivos próprios o tempo todo,
+// enquanto 1, 2, 4... threads leitoras fazem fs_stat e fs_read nos
+// arquivos fixos. Cada rodada é feita com leituras com travas
+// (FS_CONCURRENT_LOCKED) e sem travas (FS_CONCURRENT)
+#define RCU_WRITERS 2
+
+typedef struct {
+    fs_t *fs;
+    int id;
+    int loc[STRESS_SLOTS];     // Escritores: diretório de cada arquivo próprio
+    unsigned long long ops;
+} RcuThread;
+
+static int rcu_stop;
+
+static void* rcu_reader(void *arg) {
+    RcuThread *t = (RcuThread*)arg;
+    fs_t *fs = t->fs;
+    FsSession *session = fs_session_open(fs);
+    fs_session_bind(session);
+    fs_cd(fs, "/r");
+    unsigned long long x = 0x9e3779b97f4a7c15ull * (unsigned long long)(t->id + 1);
+    char path[64], buf[64];
+    FsStat st;
+    size_t len;
+    while (!__atomic_load_n(&rcu_stop, __ATOMIC_RELAXED)) {
+        for (int n = 0; n < 64; n++) {
+            x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+            unsigned int r = (unsigned int)(x >> 32);
+            snprintf(path, sizeof(path), "d%02u/f%03u", r % STRESS_DIRS, (r >> 8) % STRESS_FILES);
+            if (r & (1u << 31)) fs_read(fs, path, 0, buf, sizeof(buf), &len);
+            else fs_stat(fs, path, &st);
+            t->ops++;
+        }
+    }
+    fs_session_bind(NULL);
+    fs_session_close(session);
+    return NULL;
+}
+
+static void* rcu_writer(void *arg) {
+    RcuThread *t = (RcuThread*)arg;
+    fs_t *fs = t->fs;
+    FsSession *session = fs_session_open(fs);
+    fs_session_bind(session);
+    unsigned long long x = 0xc4ceb9fe1a85ec53ull * (unsigned long long)(t->id + 1);
+    int *loc = t->loc;
+    char path[64], dest[64];
+    while (!__atomic_load_n(&rcu_stop, __ATOMIC_RELAXED)) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        unsigned int r = (unsigned int)(x >> 32);
+        int dir = (int)(r % STRESS_DIRS);
+        int slot = (int)((r >> 8) % STRESS_SLOTS);
+        unsigned int kind = (r >> 16) % 4;
+        if (loc[slot] < 0) {
+            snprintf(path, sizeof(path), "/r/d%02d/w%d_%d", dir, t->id, slot);
+            fs_touch(fs, path);
+            loc[slot] = dir;
+            continue;
+        }
+        snprintf(path, sizeof(path), "/r/d%02d/w%d_%d", loc[slot], t->id, slot);
+        if (kind == 0) {
+            fs_rm(fs, path);
+            loc[slot] = -1;
+        } else if (kind == 1 && dir != loc[slot]) {
+            snprintf(dest, sizeof(dest), "/r/d%02d", dir);
+            fs_mv(fs, path, dest);
+            loc[slot] = dir;
+        } else {
+            fs_write(fs, path, 0, path, strlen(path));
+        }
+        t->ops++;
+    }
+    fs_session_bind(NULL);
+    fs_session_close(session);
+    return NULL;
+}
+
+static void bench_rcu(long max_threads, double seconds) {
+    char path[64];
+    fs_t *fs = fs_create();
+    fs_mkdir(fs, "/r");
+    for (int d = 0; d < STRESS_DIRS; d++) {
+        snprintf(path, sizeof(path), "/r/d%02d", d);
+        fs_mkdir(fs, path);
+        for (int f = 0; f < STRESS_FILES; f++) {
+            snprintf(path, sizeof(path), "/r/d%02d/f%03d", d, f);
+            fs_echo(fs, path, "fixed content");
+        }
+    }
+
+    printf("rcu: %d dirs x %d files, %d writers, %.1f s per run\n",
+           STRESS_DIRS, STRESS_FILES, RCU_WRITERS, seconds);
+    static const int modes[] = { FS_CONCURRENT_LOCKED, FS_CONCURRENT };
+    for (int m = 0; m < 2; m++) {
+        fs_set_concurrent(fs, modes[m]);
+        double base_rate = 0;
+        for (long n = 1; n <= max_threads; n = n < max_threads && n * 2 > max_threads ? max_threads : n * 2) {
+            long total = n + RCU_WRITERS;
+            RcuThread *threads = (RcuThread*)calloc((size_t)total, sizeof(RcuThread));
+            pthread_t *ids = (pthread_t*)malloc((size_t)total * sizeof(pthread_t));
+            if (!threads || !ids) { perror("bench"); exit(1); }
+            rcu_stop = 0;
+            double start = now_seconds();
+            for (long i = 0; i < total; i++) {
+                threads[i].fs = fs;
+            threads[i].id = (int)i;
+                memset(threads[i].loc, -1, sizeof(threads[i].loc));
+                pthread_create(&ids[i], NULL, i < n ? rcu_reader : rcu_writer, &threads[i]);
+            }
+            struct timespec ts = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9) };
+            nanosleep(&ts, NULL);
+            __atomic_store_n(&rcu_stop, 1, __ATOMIC_RELAXED);
+            unsigned long long reads = 0, writes = 0;
+            for (long i = 0; i < total; i++) {
+                pthread_join(ids[i], NULL);
+                if (i < n) reads += threads[i].ops;
+                else writes += threads[i].ops;
+            }
+            double elapsed = now_seconds() - start;
+            for (long i = n; i < total; i++) {
+                for (int s = 0; s < STRESS_SLOTS; s++) {
+                    if (threads[i].loc[s] < 0) continue;
+                    snprintf(path, sizeof(path), "/r/d%02d/w%ld_%d", threads[i].loc[s], i, s);
+                    fs_rm(fs, path);
+                }
+            }
+            double rate = reads / elapsed;
+            if (n == 1) base_rate = rate;
+            printf("  %-6s %2ld readers: %.0f reads/s (%.1fx), %.0f writes/s\n",
+                   modes[m] == FS_CONCURRENT ? "rcu" : "locked", n, rate,
+                   base_rate > 0 ? rate / base_rate : 0.0, writes / elapsed);
+            free(threads);
+            free(ids);
+            if (n == max_threads) break;
+        }
+    }
+    fs_set_concurrent(fs, FS_SEQUENTIAL);
+    fs_free(fs);
+}
+
+// Copia e remove (rm -r) uma subárvore de ~n nós, com 1 worker e com
+// max_workers: 1000 diretórios de primeiro nível, cada um com 10
+// subdiretórios de arquivos pequenos (conteúdos compartilhados pela cópia)
+static void bench_subtree(long n, long max_workers) {
+    char path[96];
+    long dirs = 10000;
+    long files_per_dir = n / dirs > 1 ? n / dirs - 1 : 1;
+
+    fs_t *fs = fs_create();
+    fs_mkdir(fs, "/src");
+    double start = now_seconds();
+    for (long d = 0; d < dirs; d++) {
+        if (d % 10 == 0) { snprintf(path, sizeof(path), "/src/d%ld", d / 10); fs_mkdir(fs, path); }
+        snprintf(path, sizeof(path), "/src/d%ld/s%ld", d / 10, d % 10);
+        fs_mkdir(fs, path);
+        for (long f = 0; f < files_per_dir; f++) {
+            snprintf(path, sizeof(path), "/src/d%ld/s%ld/f%ld", d / 10, d % 10, f);
+            fs_echo(fs, path, "x");
+        }
+    }
+    AllocStats st;
+    fs_alloc_stats(fs, &st);
+    printf("subtree: %zu nodes built in %.2f s\n", st.live_nodes, now_seconds() - start);
+
+    double base_cp = 0, base_rm = 0;
+    for (long w = 1; w <= max_workers; w = w < max_workers && w * 2 > max_workers ? max_workers : w * 2) {
+        fs_set_workers(fs, (int)w);
+        start = now_seconds();
+        fs_cp(fs, "/src", "/copy");
+        double cp_time = now_seconds() - start;
+        start = now_seconds();
+        fs_rm_recursive(fs, "/copy");
+        double rm_time = now_seconds() - start;
+        if (w == 1) { base_cp = cp_time; base_rm = rm_time; }
+        printf("  %2ld workers: cp -r %.3f s (%.1fx), rm -r %.3f s (%.1fx)\n",
+               w, cp_time, base_cp / cp_time, rm_time, base_rm / rm_time);
+        if (w == max_workers) break;
+    }
+    fs_set_workers(fs, 0);
+    fs_free(fs);
+}
+
+// Divide e resolve o comando de n linhas típicas de um script, sem
+// executá-las: mede só o custo do shell por comando
+static void bench_parse(long n) {
+    static const char *const lines[] = {
+        "touch /home/user/docs/report.txt\n",
+        "mkdir /home/user/projects\n",
+        "echo some file content with a few words > /home/user/notes.txt\n",
+        "echo \"quoted content\" 'and more' >> /home/user/log.txt\n",
+        "cp -r /home/user/projects /backup/projects\n",
+        "ls /home/user\n",
+        "rm /tmp/scratch.tmp\n",
+        "checkpoint\n",
+    };
+    const long kinds = (long)(sizeof(lines) / sizeof(lines[0]));
+    size_t lens[sizeof(lines) / sizeof(lines[0])];
+    for (long k = 0; k < kinds; k++) lens[k] = strlen(lines[k]) + 1;
+
+    char buf[256];
+    Tokens tokens = {0};
+    long tokens_seen = 0, found = 0;
+
+    // Só a cópia da linha, que o fgets do shell também faz
+    double start = now_seconds();
+    for (long i = 0; i < n; i++) {
+        memcpy(buf, lines[i % kinds], lens[i % kinds]);
+        tokens_seen += buf[0];
+    }
+    double copy = now_seconds() - start;
+
+    start = now_seconds();
+    for (long i = 0; i < n; i++) {
+        memcpy(buf, lines[i % kinds], lens[i % kinds]);
+        tokens_seen += tokens_split(&tokens, buf);
+    }
+    double split = now_seconds() - start;
+
+    start = now_seconds();
+    for (long i = 0; i < n; i++) {
+        memcpy(buf, lines[i % kinds], lens[i % kinds]);
+        tokens_split(&tokens, buf);
+        found += shell_command_id(tokens.tok[0].text, tokens.tok[0].len) >= 0;
+    }
+    double total = now_seconds() - start;
+    tokens_free(&tokens);
+
+    printf("parse: %ld commands (%ld found, checksum %ld)\n", n, found, tokens_seen);
+    printf("  split:            %.1f ns/command\n", (split - copy) / n * 1e9);
+    printf("  split + dispatch: %.1f ns/command\n", (total - copy) / n * 1e9);
+}
+
+// Exporta uma árvore de ~n nós (1000 diretórios de arquivos) em JSON, em
+// NDJSON e com tamanhos, e reporta o tempo e a taxa de cada formato
+static void bench_export(long n) {
+    char path[64];
+    long dirs = 1000;
+    long files_per_dir = n / dirs > 1 ? n / dirs - 1 : 1;
+
+    fs_t *fs = fs_create();
+    for (long d = 0; d < dirs; d++) {
+        snprintf(path, sizeof(path), "/dir%ld", d);
+        fs_mkdir(fs, path);
+        for (long f = 0; f < files_per_dir; f++) {
+            snprintf(path, sizeof(path), "/dir%ld/file%ld", d, f);
+            fs_echo(fs, path, "x");
+        }
+    }
+    long nodes = dirs * (files_per_dir + 1) + 1;
+
+    static const struct { const char *label; const char *file; ExportOptions opts; } modes[] = {
+        { "json",          "bench_tree.json",   { -1, 0, 0 } },
+        { "json + sizes",  "bench_tree.json",   { -1, 1, 0 } },
+        { "ndjson",        "bench_tree.ndjson", { -1, 0, 1 } },
+        { "ndjson + sizes", "bench_tree.ndjson", { -1, 1, 1 } },
+    };
+    printf("export: %ld nodes\n", nodes);
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        double best = 0;
+        for (int run = 0; run < 3; run++) {
+            double start = now_seconds();
+            fs_export_tree_json(fs, modes[m].file, NULL, &modes[m].opts);
+            double t = now_seconds() - start;
+            if (run == 0 || t < best) best = t;
+        }
+        printf("  %-15s %.3f s, %.1f MB, %.1f M nodes/s\n", modes[m].label, best,
+               file_mb(modes[m].file), nodes / best / 1e6);
+        remove(modes[m].file);
+    }
+    fs_free(fs);
+}
+
+// --- Suíte reprodutível (./bench suite) ---
+//
+// Gera uma árvore sintética (workload.c) e roda sobre ela os cenários
+// abaixo, cada um com vazão, latências p50/p99 e pico de memória. A
+// semente fixa a árvore, os tamanhos e os nós sorteados, então duas
+// execuções com os mesmos parâmetros (em commits diferentes, por exemplo)
+// fazem exatamente as mesmas operações. Com -j arquivo, cada cenário
+// também vira uma linha JSON no arquivo, sempre com as mesmas chaves, fácil
+// de comparar entre commits (a saída padrão tem as mensagens do FS).
+
+#define SUITE_BASE "/gen"
+#define SUITE_COPY "/gen_copy"
+#define SUITE_IMAGE "bench_suite.dat"
+#define SUITE_EXPORT "bench_suite.json"
+#define SUITE_REPEATS 5            // Execuções das operações sobre a árvore inteira
+#define SUITE_MAX_RENAMES 100000
+
+typedef struct {
+    const Workload *w;
+    char sizes[32];
+    FILE *json;                // NULL = só a tabela
+} Suite;
+
+// O pico de memória residente (VmHWM) volta ao uso atual a cada cenário.
+// Sem /proc/self/clear_refs, o pico é o do processo inteiro
+static void peak_rss_reset(void) {
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (!f) return;
+    fputs("5", f);
+    fclose(f);
+}
+
+static long peak_rss_kb(void) {
+    char line[256];
+    long kb = -1;
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            if (strncmp(line, "VmHWM:", 6) == 0) { kb = atol(line + 6); break; }
+        }
+        fclose(f);
+    }
+    if (kb < 0) {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        kb = ru.ru_maxrss;
+    }
+    return kb;
+}
+
+static int compare_ticks(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long*)a, y = *(const unsigned long long*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Vazão pelo tempo somado das operações medidas (sem o custo de montar os
+// caminhos); percentis exatos, das latências ordenadas. items é o que cada
+// operação processa: 1 nas operações simples, a árvore inteira nas outras
+static void suite_report(const Suite *s, const char *scenario, unsigned long long *lat, long ops,
+                         long items, const char *unit) {
+    long rss = peak_rss_kb();
+    double scale = metrics_ns_per_tick();
+    unsigned long long total = 0;
+    for (long i = 0; i < ops; i++) total += lat[i];
+    qsort(lat, (size_t)ops, sizeof(unsigned long long), compare_ticks);
+    double seconds = total * scale / 1e9;
+    double rate = seconds > 0 ? ops * (double)items / seconds : 0;
+    double p50 = ops ? lat[(ops - 1) / 2] * scale : 0;
+    double p99 = ops ? lat[(long)((ops - 1) * 0.99)] * scale : 0;
+    double max = ops ? lat[ops - 1] * scale : 0;
+    const Workload *w = s->w;
+
+    if (s->json) {
+        fprintf(s->json, "{\"scenario\":\"%s\",\"shape\":\"%s\",\"nodes\":%ld,\"sizes\":\"%s\",\"seed\":%llu,"
+               "\"dirs\":%ld,\"files\":%ld,\"bytes\":%zu,\"ops\":%ld,\"seconds\":%.6f,"
+               "\"rate\":%.1f,\"unit\":\"%s/s\",\"p50_ns\":%.0f,\"p99_ns\":%.0f,\"max_ns\":%.0f,"
+               "\"peak_rss_kb\":%ld}\n",
+               scenario, workload_shape_name(w->opts.shape), w->opts.nodes, s->sizes, w->opts.seed,
+               w->dir_count, w->file_count, w->bytes, ops, seconds, rate, unit, p50, p99, max, rss);
+        fflush(s->json);
+    }
+    printf("  %-8s %9ld %9.3f %12.0f %-8s %10.2f %10.2f %10.1f\n", scenario, ops, seconds, rate,
+           unit, p50 / 1e3, p99 / 1e3, rss / 1024.0);
+    fflush(stdout);
+}
+
+static void suite_run(Suite *s, Workload *w) {
+    char path[WORKLOAD_PATH_MAX], other[WORKLOAD_PATH_MAX];
+    long nodes = w->dir_count + w->file_count;
+    long tree_nodes = nodes + 2; // Mais a raiz e a base
+    long renames = nodes / 10 < SUITE_MAX_RENAMES ? nodes / 10 : SUITE_MAX_RENAMES;
+    if (renames < 1) renames = 1;
+    size_t cap = (size_t)(nodes > 2 * renames ? nodes : 2 * renames);
+    unsigned long long *lat = (unsigned long long*)malloc(cap * sizeof(unsigned long long));
+    unsigned long long *lat2 = (unsigned long long*)malloc(SUITE_REPEATS * sizeof(unsigned long long));
+    if (!lat || !lat2) { perror("malloc"); exit(1); }
+    memset(lat, 0, cap * sizeof(unsigned long long));
+    unsigned long long rng = w->opts.seed ^ 0x243f6a8885a308d3ull; // Sorteios dos cenários
+    unsigned long long t0;
+
+    // Criação, na ordem do plano
+    fs_t *fs = fs_create();
+    peak_rss_reset();
+    long ops = workload_build(fs, w, lat);
+    printf("suite: %s, %ld nodes (%ld dirs, %ld files, %.1f MB), sizes %s, seed %llu\n",
+           workload_shape_name(w->opts.shape), nodes, w->dir_count, w->file_count,
+           w->bytes / (1024.0 * 1024.0), s->sizes, w->opts.seed);
+    printf("  %-8s %9s %9s %12s %-8s %10s %10s %10s\n", "scenario", "ops", "seconds", "rate", "unit",
+           "p50 us", "p99 us", "peak MB");
+    suite_report(s, "create", lat, ops, 1, "ops");
+
+    // Tempestade de buscas: nós sorteados entre todos os diretórios e arquivos
+    peak_rss_reset();
+    long missed = 0;
+    for (long i = 0; i < nodes; i++) {
+        long k = (long)(workload_random(&rng) % (unsigned long long)nodes);
+        if (k < w->dir_count) workload_dir_path(w, k, path, sizeof(path));
+        else workload_file_path(w, k - w->dir_count, path, sizeof(path));
+        FsStat st;
+        t0 = metrics_ticks();
+        int found = fs_stat(fs, path, &st) == 0;
+        lat[i] = metrics_ticks() - t0;
+        missed += !found;
+    }
+    if (missed) fprintf(stderr, "suite: %ld lookups missed\n", missed);
+    suite_report(s, "lookup", lat, nodes, 1, "ops");
+
+    // Renomeações: um arquivo sorteado vai para outro diretório sorteado e volta
+    peak_rss_reset();
+    for (long i = 0; i < renames; i++) {
+        long f = (long)(workload_random(&rng) % (unsigned long long)w->file_count);
+        long d = (long)(workload_random(&rng) % (unsigned long long)w->dir_count);
+        workload_file_path(w, f, path, sizeof(path));
+        size_t len = workload_dir_path(w, d, other, sizeof(other) - 24);
+        snprintf(other + len, sizeof(other) - len, "/moved%ld", i);
+        t0 = metrics_ticks();
+        fs_mv(fs, path, other);
+        lat[2 * i] = metrics_ticks() - t0;
+        t0 = metrics_ticks();
+        fs_mv(fs, other, path);
+        lat[2 * i + 1] = metrics_ticks() - t0;
+    }
+    suite_report(s, "rename", lat, 2 * renames, 1, "ops");
+
+    // Cópia e remoção recursivas da árvore inteira (mesmo pico de memória)
+    peak_rss_reset();
+    for (int r = 0; r < SUITE_REPEATS; r++) {
+        t0 = metrics_ticks();
+        fs_cp(fs, SUITE_BASE, SUITE_COPY);
+        lat[r] = metrics_ticks() - t0;
+        t0 = metrics_ticks();
+        fs_rm_recursive(fs, SUITE_COPY);
+        lat2[r] = metrics_ticks() - t0;
+    }
+    suite_report(s, "copy", lat, SUITE_REPEATS, nodes + 1, "nodes");
+    suite_report(s, "remove", lat2, SUITE_REPEATS, nodes + 1, "nodes");
+
+    peak_rss_reset();
+    for (int r = 0; r < SUITE_REPEATS; r++) {
+        t0 = metrics_ticks();
+        fs_save(fs, SUITE_IMAGE);
+        lat[r] = metrics_ticks() - t0;
+    }
+    suite_report(s, "save", lat, SUITE_REPEATS, tree_nodes, "nodes");
+
+    // Carga completa: abrir a imagem e criar todos os nós em memória
+    peak_rss_reset();
+    for (int r = 0; r < SUITE_REPEATS; r++) {
+        t0 = metrics_ticks();
+        fs_load(fs, SUITE_IMAGE);
+        fs_preload(fs);
+        lat[r] = metrics_ticks() - t0;
+    }
+    suite_report(s, "load", lat, SUITE_REPEATS, tree_nodes, "nodes");
+
+    ExportOptions opts = { -1, 0, 0 };
+    peak_rss_reset();
+    for (int r = 0; r < SUITE_REPEATS; r++) {
+        t0 = metrics_ticks();
+        fs_export_tree_json(fs, SUITE_EXPORT, NULL, &opts);
+        lat[r] = metrics_ticks() - t0;
+    }
+    suite_report(s, "export", lat, SUITE_REPEATS, tree_nodes, "nodes");
+
+    remove(SUITE_IMAGE);
+    remove(SUITE_EXPORT);
+    fs_free(fs);
+    free(lat);
+    free(lat2);
+}
+
+// ./bench suite [-j arquivo] [-s semente] [-f tamanhos] [formato|all] [nós]
+static int bench_suite(int argc, char **argv) {
+    WorkloadOptions opts = { WORKLOAD_REALISTIC, 100000, SIZES_LOGNORMAL, 256, 1 };
+    const char *json = NULL;
+    int all = 1, positional = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            json = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            opts.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            if (workload_parse_sizes(argv[++i], &opts.sizes, &opts.size_param) != 0) {
+                fprintf(stderr, "suite: invalid sizes '%s' (empty, fixed:N, uniform:N or lognormal:N)\n", argv[i]);
+                return 1;
+            }
+        } else if (positional == 0) {
+            positional++;
+            if (strcmp(argv[i], "all") == 0) continue;
+            if (workload_parse_shape(argv[i], &opts.shape) != 0) {
+                fprintf(stderr, "suite: unknown shape '%s' (wide, deep, skewed, realistic or all)\n", argv[i]);
+                return 1;
+            }
+            all = 0;
+        } else if (positional == 1) {
+            positional++;
+            opts.nodes = atol(argv[i]);
+        } else {
+            fprintf(stderr, "suite: unexpected argument '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (opts.nodes < 1) opts.nodes = 1;
+
+    Suite s;
+    s.json = NULL;
+    if (json && !(s.json = fopen(json, "w"))) {
+        perror("Error opening results file");
+        return 1;
+    }
+    workload_format_sizes(opts.sizes, opts.size_param, s.sizes, sizeof(s.sizes));
+    metrics_ns_per_tick(); // Começa a calibração do relógio
+    for (int shape = 0; shape < WORKLOAD_SHAPES; shape++) {
+        if (!all && shape != (int)opts.shape) continue;
+        WorkloadOptions run = opts;
+        run.shape = (WorkloadShape)shape;
+        Workload w;
+        workload_plan(&w, &run, SUITE_BASE);
+        s.w = &w;
+        suite_run(&s, &w);
+        workload_free(&w);
+    }
+    if (s.json) fclose(s.json);
+    return 0;
+}
+
+// Instâncias independentes: cada thread cria o seu contexto e faz nele a
+// criação da árvore sintética (formato realistic, arquivos vazios) e uma
+// busca em cada nó, sem nada compartilhado além das métricas. Roda com 1,
+// 2, 4... threads até max_threads; com a CPU livre, a vazão total deve
+// crescer com o número de threads
+typedef struct {
+    WorkloadOptions opts;
+    double seconds;
+} InstanceThread;
+
+static void* instance_worker(void *arg) {
+    InstanceThread *t = (InstanceThread*)arg;
+    char path[WORKLOAD_PATH_MAX];
+    Workload w;
+    workload_plan(&w, &t->opts, SUITE_BASE);
+    double start = now_seconds();
+    fs_t *fs = fs_create();
+    workload_build(fs, &w, NULL);
+    FsStat st;
+    for (long d = 0; d < w.dir_count; d++) {
+        workload_dir_path(&w, d, path, sizeof(path));
+        fs_stat(fs, path, &st);
+    }
+    for (long f = 0; f < w.file_count; f++) {
+        workload_file_path(&w, f, path, sizeof(path));
+        fs_stat(fs, path, &st);
+    }
+    fs_free(fs);
+    t->seconds = now_seconds() - start;
+    workload_free(&w);
+    return NULL;
+}
+
+static void bench_instances(long max_threads, long nodes) {
+    printf("instances: %ld nodes per instance (realistic, empty files), create + lookup each node\n", nodes);
+    double base_rate = 0;
+    for (long n = 1; n <= max_threads; n = n < max_threads && n * 2 > max_threads ? max_threads : n * 2) {
+        InstanceThread *threads = (InstanceThread*)calloc((size_t)n, sizeof(InstanceThread));
+        pthread_t *ids = (pthread_t*)malloc((size_t)n * sizeof(pthread_t));
+        if (!threads || !ids) { perror("bench"); exit(1); }
+        double start = now_seconds();
+        for (long i = 0; i < n; i++) {
+            WorkloadOptions opts = { WORKLOAD_REALISTIC, nodes, SIZES_EMPTY, 0, (unsigned long long)i + 1 };
+            threads[i].opts = opts;
+            pthread_create(&ids[i], NULL, instance_worker, &threads[i]);
+        }
+        double slowest = 0;
+        for (long i = 0; i < n; i++) {
+            pthread_join(ids[i], NULL);
+            if (threads[i].seconds > slowest) slowest = threads[i].seconds;
+        }
+        double elapsed = now_seconds() - start;
+        double rate = 2.0 * nodes * n / elapsed;
+        if (n == 1) base_rate = rate;
+        printf("  %2ld instances: %.3f s (slowest %.3f s), %.0f ops/s total, %.1fx\n",
+               n, elapsed, slowest, rate, base_rate > 0 ? rate / base_rate : 0.0);
+        free(threads);
+        free(ids);
+        if (n == max_threads) break;
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s bigdir [n] | churn [ops] | tree [nodes] | append [mb] | cow [mb] | load [mb]"
+                    " | save [nodes] [mb] | journal [ops]"
+                    " | deeppath [depth] [dirs] | stress [threads] [seconds]"
+                    " | rcu [threads] [seconds] | subtree [nodes] [workers] | parse [commands]"
+                    " | export [nodes] | instances [threads] [nodes] | dedup [mb] | compress [mb] | find [nodes]"
+                    " | grep [mb] [workers] | du [ops] [nodes]"
+                    " | suite [-j file] [-s seed] [-f sizes] [wide|deep|skewed|realistic|all] [nodes]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (strcmp(argv[1], "bigdir") == 0) {
+        bench_bigdir(argc > 2 ? atol(argv[2]) : 1000000);
+    } else if (strcmp(argv[1], "churn") == 0) {
+        bench_churn(argc > 2 ? atol(argv[2]) : 100000);
+    } else if (strcmp(argv[1], "tree") == 0) {
+        bench_tree(argc > 2 ? atol(argv[2]) : 10000000);
+    } else if (strcmp(argv[1], "append") == 0) {
+        bench_append(argc > 2 ? atol(argv[2]) : 512);
+    } else if (strcmp(argv[1], "cow") == 0) {
+        bench_cow(argc > 2 ? atol(argv[2]) : 1024);
+    } else if (strcmp(argv[1], "load") == 0) {
+        bench_load(argc > 2 ? atol(argv[2]) : 1024);
+    } else if (strcmp(argv[1], "save") == 0) {
+        bench_save(argc > 2 ? atol(argv[2]) : 1000000, argc > 3 ? atol(argv[3]) : 256);
+    } else if (strcmp(argv[1], "deeppath") == 0) {
+        bench_deeppath(argc > 2 ? atol(argv[2]) : 16, argc > 3 ? atol(argv[3]) : 1000);
+    } else if (strcmp(argv[1], "journal") == 0) {
+        bench_journal(argc > 2 ? atol(argv[2]) : 100000);
+    } else if (strcmp(argv[1], "stress") == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        bench_stress(argc > 2 ? atol(argv[2]) : (cpus > 0 ? cpus : 4), argc > 3 ? atof(argv[3]) : 2.0);
+    } else if (strcmp(argv[1], "rcu") == 0) {
+        bench_rcu(argc > 2 ? atol(argv[2]) : 64, argc > 3 ? atof(argv[3]) : 1.0);
+    } else if (strcmp(argv[1], "subtree") == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        bench_subtree(argc > 2 ? atol(argv[2]) : 10000000, argc > 3 ? atol(argv[3]) : (cpus > 0 ? cpus : 4));
+    } else if (strcmp(argv[1], "parse") == 0) {
+        bench_parse(argc > 2 ? atol(argv[2]) : 10000000);
+    } else if (strcmp(argv[1], "export") == 0) {
+        bench_export(argc > 2 ? atol(argv[2]) : 1000000);
+    } else if (strcmp(argv[1], "instances") == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        bench_instances(argc > 2 ? atol(argv[2]) : (cpus > 0 ? cpus : 4), argc > 3 ? atol(argv[3]) : 200000);
+    } else if (strcmp(argv[1], "dedup") == 0) {
+        bench_dedup(argc > 2 ? atol(argv[2]) : 512);
+    } else if (strcmp(argv[1], "compress") == 0) {
+        bench_compress(argc > 2 ? atol(argv[2]) : 256);
+    } else if (strcmp(argv[1], "find") == 0) {
+        bench_find(argc > 2 ? atol(argv[2]) : 1000000);
+    } else if (strcmp(argv[1], "du") == 0) {
+        bench_du(argc > 2 ? atol(argv[2]) : 200000, argc > 3 ? atol(argv[3]) : 1000000);
+    } else if (strcmp(argv[1], "grep") == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        bench_grep(argc > 2 ? atol(argv[2]) : 256, argc > 3 ? atol(argv[3]) : (cpus > 0 ? cpus : 4));
+    } else if (strcmp(argv[1], "suite") == 0) {
+        return bench_suite(argc - 2, argv + 2);
+    } else {
+        usage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
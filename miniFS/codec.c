@@ -0,0 +1,196 @@
+// miniFS/codec.c
+
+#include <stdint.h>
+#include <string.h>
+#include "codec.h"
+
+// --- lz4 (formato de bloco) ---
+//
+// Cada sequência é um token (4 bits para o número de literais, 4 para o
+// tamanho da referência menos 4), os literais e a referência: offset de 2
+// bytes e o tamanho. Valores a partir de 15 continuam em bytes extras de
+// até 255. A última sequência só tem literais, e os 5 últimos bytes do
+// bloco são sempre literais
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12     // Uma referência começa até 12 bytes antes do fim
+#define LZ4_HASH_BITS 12
+#define LZ4_MAX_INPUT 65536    // Posições da tabela em 16 bits
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned int lz4_hash(uint32_t seq) {
+    return (seq * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+// Bytes iguais a partir de a e b, sem passar de limit
+static size_t common_length(const unsigned char *a, const unsigned char *b, const unsigned char *limit) {
+    const unsigned char *start = a;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (a + 8 <= limit) {
+        uint64_t x, y;
+        memcpy(&x, a, 8);
+        memcpy(&y, b, 8);
+        if (x != y) return (size_t)(a - start) + (size_t)__builtin_ctzll(x ^ y) / 8;
+        a += 8;
+        b += 8;
+    }
+#endif
+    while (a < limit && *a == *b) { a++; b++; }
+    return (size_t)(a - start);
+}
+
+// Tamanho de 15 em diante: o resto em bytes de 255, terminando num menor
+static unsigned char* put_length(unsigned char *op, size_t n) {
+    for (n -= 15; n >= 255; n -= 255) *op++ = 255;
+    *op++ = (unsigned char)n;
+    return op;
+}
+
+// Espaço de uma sequência com lit literais (e uma referência de match bytes)
+static size_t sequence_size(size_t lit, size_t match) {
+    return 1 + (lit >= 15 ? (lit - 15) / 255 + 1 : 0) + lit +
+           (match ? 2 + (match >= 15 ? (match - 15) / 255 + 1 : 0) : 0);
+}
+
+static size_t lz4_bound(size_t len) {
+    return len + len / 255 + 16;
+}
+
+static size_t lz4_compress(const char *source, size_t len, char *dest, size_t cap) {
+    const unsigned char *src = (const unsigned char*)source;
+    const unsigned char *ip = src, *anchor = src, *end = src + len;
+    unsigned char *op = (unsigned char*)dest, *oend = op + cap;
+    if (len > LZ4_MAX_INPUT) return 0;
+
+    if (len > LZ4_MATCH_LIMIT) {
+        const unsigned char *last_match = end - LZ4_MATCH_LIMIT;
+        const unsigned char *match_limit = end - LZ4_LAST_LITERALS;
+        uint16_t table[1 << LZ4_HASH_BITS];
+        memset(table, 0, sizeof(table));
+        ip++;
+        while (ip <= last_match) {
+            uint32_t seq = read32(ip);
+            unsigned int h = lz4_hash(seq);
+            const unsigned char *ref = src + table[h];
+            table[h] = (uint16_t)(ip - src);
+            if (read32(ref) != seq || ref >= ip) {
+                // Sem referência: o passo cresce com a distância desde a
+                // última, para atravessar rápido trechos incompressíveis
+                ip += 1 + ((size_t)(ip - anchor) >> 6);
+                continue;
+            }
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) { ip--; ref--; }
+            size_t match = LZ4_MIN_MATCH + common_length(ip + LZ4_MIN_MATCH, ref + LZ4_MIN_MATCH, match_limit);
+            size_t lit = (size_t)(ip - anchor);
+            size_t extra = match - LZ4_MIN_MATCH;
+            if (sequence_size(lit, extra + 1) > (size_t)(oend - op)) return 0;
+
+            unsigned char *token = op++;
+            *token = (unsigned char)((lit >= 15 ? 15 : lit) << 4 | (extra >= 15 ? 15 : extra));
+            if (lit >= 15) op = put_length(op, lit);
+            memcpy(op, anchor, lit);
+            op += lit;
+            size_t offset = (size_t)(ip - ref);
+            *op++ = (unsigned char)offset;
+            *op++ = (unsigned char)(offset >> 8);
+            if (extra >= 15) op = put_length(op, extra);
+
+            ip += match;
+            anchor = ip;
+            if (ip <= last_match) table[lz4_hash(read32(ip - 2))] = (uint16_t)(ip - 2 - src);
+        }
+    }
+
+    size_t lit = (size_t)(end - anchor);
+    if (sequence_size(lit, 0) > (size_t)(oend - op)) return 0;
+    *op++ = (unsigned char)((lit >= 15 ? 15 : lit) << 4);
+    if (lit >= 15) op = put_length(op, lit);
+    memcpy(op, anchor, lit);
+    op += lit;
+    return (size_t)(op - (unsigned char*)dest);
+}
+
+// Lê a continuação de um tamanho; retorna -1 se os dados acabarem antes
+static int get_length(const unsigned char **ip, const unsigned char *iend, size_t *n) {
+    unsigned char b;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return 0;
+}
+
+static int lz4_decompress(const char *source, size_t len, char *dest, size_t out_len) {
+    const unsigned char *ip = (const unsigned char*)source, *iend = ip + len;
+    unsigned char *op = (unsigned char*)dest, *oend = op + out_len;
+    for (;;) {
+        if (ip >= iend) return -1;
+        unsigned int token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && get_length(&ip, iend, &lit) != 0) return -1;
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) return -1;
+        // Com folga nos dois buffers, poucos literais saem numa cópia fixa
+        // de 16 bytes; o excesso é sobrescrito pelo que vem depois
+        if (lit <= 16 && iend - ip >= 16 && oend - op >= 16) memcpy(op, ip, 16);
+        else memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) break; // Última sequência: só literais
+
+        if (iend - ip < 2) return -1;
+        size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t match = token & 15;
+        if (match == 15 && get_length(&ip, iend, &match) != 0) return -1;
+        match += LZ4_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - (unsigned char*)dest) || match > (size_t)(oend - op)) {
+            return -1;
+        }
+        const unsigned char *from = op - offset;
+        if (offset >= 16 && (size_t)(oend - op) >= match + 16) {
+            // Cópias de 16 bytes nunca se sobrepõem com offset >= 16
+            for (size_t i = 0; i < match; i += 16) memcpy(op + i, from + i, 16);
+            op += match;
+            continue;
+        }
+        // Uma referência que se sobrepõe ao destino repete um padrão de
+        // 'offset' bytes; cada cópia dobra o trecho já repetido
+        size_t ready = offset;
+        while (match > 0) {
+            size_t n = match < ready ? match : ready;
+            memcpy(op, from, n);
+            op += n;
+            match -= n;
+            ready += n;
+        }
+    }
+    return op == oend ? 0 : -1;
+}
+
+const Codec codec_lz4 = { "lz4", 1, lz4_bound, lz4_compress, lz4_decompress };
+
+// --- Tabela de codecs ---
+
+static const Codec *const codecs[] = { &codec_lz4 };
+#define CODEC_COUNT (sizeof(codecs) / sizeof(codecs[0]))
+
+const Codec* codec_find(const char *name) {
+    for (size_t i = 0; i < CODEC_COUNT; i++) {
+        if (strcmp(codecs[i]->name, name) == 0) return codecs[i];
+    }
+    return NULL;
+}
+
+const Codec* codec_get(unsigned int id) {
+    for (size_t i = 0; i < CODEC_COUNT; i++) {
+        if (codecs[i]->id == id) return codecs[i];
+    }
+    return NULL;
+}
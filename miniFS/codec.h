@@ -0,0 +1,39 @@
+// miniFS/codec.h
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h> // Para size_t
+
+// Codecs de compressão dos chunks (ver content_compress). Cada codec tem
+// um id de 1 a 255, guardado em cada chunk comprimido e na imagem, então
+// um chunk gravado com um codec continua legível mesmo depois que a
+// compressão é desligada ou trocada. Para acrescentar um codec, basta
+// definir a struct e incluí-la na tabela de codec.c, com um id novo.
+//
+// O codec incluído é o lz4: o formato de bloco do LZ4 (literais e
+// referências de até 64 KiB para trás), com uma busca gulosa por
+// sequências de 4 bytes numa tabela hash de 4096 posições. Comprime e
+// descomprime a várias centenas de MB/s por núcleo, o que mantém a leitura
+// (cat) barata mesmo descomprimindo cada chunk a cada acesso
+typedef struct Codec {
+    const char *name;
+    unsigned int id;
+    // Maior saída possível de compress para len bytes
+    size_t (*bound)(size_t len);
+    // Comprime len bytes (até CHUNK_SIZE) em dst; retorna o tamanho
+    // comprimido, ou 0 se não couber em cap
+    size_t (*compress)(const char *src, size_t len, char *dst, size_t cap);
+    // Descomprime exatamente out_len bytes em dst; retorna -1 se os dados
+    // forem inválidos (nunca lê nem escreve fora dos limites)
+    int (*decompress)(const char *src, size_t len, char *dst, size_t out_len);
+} Codec;
+
+extern const Codec codec_lz4;
+
+// Busca por nome (comando compress) ou por id (chunks e imagem); NULL se
+// não houver
+const Codec* codec_find(const char *name);
+const Codec* codec_get(unsigned int id);
+
+#endif // CODEC_H
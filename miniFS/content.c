@@ -0,0 +1,320 @@
+// miniFS/content.c
+
+#include <stdio.h>
+#include <string.h>
+#include "content.h"
+#include "alloc.h"
+#include "codec.h"
+
+#define MIN_CHUNK_CAP 16
+
+// --- Chunks ---
+
+static Chunk* chunk_alloc(FsAllocator *a, size_t cap) {
+    Chunk *ch = (Chunk*)alloc_bytes(a, sizeof(Chunk) + cap);
+    ch->refs = 1;
+    ch->len = 0;
+    ch->cap = (unsigned int)cap;
+    ch->flags = 0;
+    return ch;
+}
+
+// Chunk mapeado: cap = 0 (ou os bytes comprimidos), então qualquer
+// escrita passa por uma cópia
+static Chunk* chunk_map(FsAllocator *a, const char *bytes, size_t len, size_t stored,
+                        unsigned int codec) {
+    Chunk *ch = (Chunk*)alloc_bytes(a, sizeof(Chunk) + sizeof(const char*));
+    ch->refs = 1;
+    ch->len = (unsigned int)len;
+    ch->cap = codec ? (unsigned int)stored : 0;
+    ch->flags = CHUNK_MAPPED | codec << CHUNK_CODEC_SHIFT;
+    memcpy(ch->data, &bytes, sizeof(bytes));
+    return ch;
+}
+
+static char* chunk_bytes(const Chunk *ch) {
+    if (!(ch->flags & CHUNK_MAPPED)) return (char*)ch->data;
+    char *bytes;
+    memcpy(&bytes, ch->data, sizeof(bytes));
+    return bytes;
+}
+
+// Copia os ch->len bytes do chunk para dst, descomprimindo se preciso
+static void chunk_read(const Chunk *ch, char *dst) {
+    unsigned int id = CHUNK_CODEC(ch->flags);
+    if (!id) {
+        memcpy(dst, chunk_bytes(ch), ch->len);
+        return;
+    }
+    const Codec *codec = codec_get(id);
+    if (!codec || codec->decompress(chunk_bytes(ch), ch->cap, dst, ch->len) != 0) {
+        // Só com uma imagem corrompida: o chunk é lido como zeros
+        fprintf(stderr, "Corrupt compressed data (%u bytes)\n", ch->len);
+        memset(dst, 0, ch->len);
+    }
+}
+
+static void chunk_free(FsAllocator *a, Chunk *ch) {
+    size_t extra = (ch->flags & CHUNK_MAPPED) ? sizeof(const char*) : ch->cap;
+    alloc_free_bytes(a, ch, sizeof(Chunk) + extra);
+}
+
+static void chunk_release(FsAllocator *a, Chunk *ch) {
+    if (--ch->refs == 0) chunk_free(a, ch);
+}
+
+void content_chunk_release(FsAllocator *a, Chunk *ch) {
+    chunk_release(a, ch);
+}
+
+// --- Cabeçalho (vetor de chunks) ---
+
+static FileContent* header_alloc(FsAllocator *a, size_t slots) {
+    FileContent *c = (FileContent*)alloc_bytes(a, sizeof(FileContent) + slots * sizeof(Chunk*));
+    c->size = 0;
+    c->nchunks = 0;
+    c->slots = slots;
+    return c;
+}
+
+static void header_free(FsAllocator *a, FileContent *c) {
+    alloc_free_bytes(a, c, sizeof(FileContent) + c->slots * sizeof(Chunk*));
+}
+
+// Garante espaço para n chunks no vetor, dobrando sua capacidade
+static FileContent* reserve_slots(FsAllocator *a, FileContent *c, size_t n) {
+    if (c && n <= c->slots) return c;
+    size_t slots = c ? c->slots * 2 : 1;
+    if (slots < n) slots = n;
+    FileContent *grown = header_alloc(a, slots);
+    if (c) {
+        grown->size = c->size;
+        grown->nchunks = c->nchunks;
+        memcpy(grown->chunks, c->chunks, c->nchunks * sizeof(Chunk*));
+        header_free(a, c);
+    }
+    return grown;
+}
+
+// Torna o chunk i exclusivo deste arquivo (copy-on-write) e com capacidade
+// para pelo menos min_cap bytes, crescendo geometricamente até CHUNK_SIZE
+static Chunk* writable_chunk(FsAllocator *a, FileContent *c, size_t i, size_t min_cap) {
+    Chunk *ch = c->chunks[i];
+    int packed = CHUNK_CODEC(ch->flags) != 0;
+    if (ch->refs == 1 && ch->cap >= min_cap && !packed) return ch;
+
+    size_t cap = ch->cap < ch->len || packed ? ch->len : ch->cap;
+    if (cap < min_cap) {
+        cap = cap * 2 > min_cap ? cap * 2 : min_cap;
+        if (cap > CHUNK_SIZE) cap = CHUNK_SIZE;
+    }
+    Chunk *copy = chunk_alloc(a, cap);
+    chunk_read(ch, copy->data);
+    copy->len = ch->len;
+    chunk_release(a, ch);
+    c->chunks[i] = copy;
+    return copy;
+}
+
+// --- API ---
+
+size_t content_size(const FileContent *c) {
+    return c ? c->size : 0;
+}
+
+FileContent* content_create(FsAllocator *a, size_t size) {
+    size_t n = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    FileContent *c = header_alloc(a, n ? n : 1);
+    for (size_t i = 0; i < n; i++) {
+        size_t len = size - i * CHUNK_SIZE;
+        if (len > CHUNK_SIZE) len = CHUNK_SIZE;
+        Chunk *ch = chunk_alloc(a, len);
+        ch->len = (unsigned int)len;
+        c->chunks[i] = ch;
+    }
+    c->nchunks = n;
+    c->size = size;
+    return c;
+}
+
+FileContent* content_map(FsAllocator *a, const char *data, size_t size) {
+    size_t n = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    FileContent *c = header_alloc(a, n ? n : 1);
+    for (size_t i = 0; i < n; i++) {
+        size_t len = size - i * CHUNK_SIZE;
+        if (len > CHUNK_SIZE) len = CHUNK_SIZE;
+        c->chunks[i] = chunk_map(a, data + i * CHUNK_SIZE, len, len, 0);
+    }
+    c->nchunks = n;
+    c->size = size;
+    return c;
+}
+
+FileContent* content_map_chunks(FsAllocator *a, size_t size) {
+    size_t n = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    FileContent *c = header_alloc(a, n ? n : 1);
+    c->nchunks = n;
+    c->size = size;
+    return c;
+}
+
+void content_map_chunk(FsAllocator *a, FileContent *c, size_t i, const char *stored,
+                       size_t stored_len, unsigned int codec) {
+    size_t len = c->size - i * CHUNK_SIZE;
+    if (len > CHUNK_SIZE) len = CHUNK_SIZE;
+    c->chunks[i] = chunk_map(a, stored, len, stored_len, codec);
+}
+
+size_t content_chunk_count(const FileContent *c) {
+    return c ? c->nchunks : 0;
+}
+
+char* content_chunk(const FileContent *c, size_t i, size_t *len, char *scratch) {
+    const Chunk *ch = c->chunks[i];
+    *len = ch->len;
+    if (!CHUNK_CODEC(ch->flags)) return chunk_bytes(ch);
+    chunk_read(ch, scratch);
+    return scratch;
+}
+
+const char* content_chunk_stored(const FileContent *c, size_t i, size_t *stored,
+                                 unsigned int *codec) {
+    const Chunk *ch = c->chunks[i];
+    *codec = CHUNK_CODEC(ch->flags);
+    *stored = *codec ? ch->cap : ch->len;
+    return chunk_bytes(ch);
+}
+
+int content_compressed(const FileContent *c) {
+    for (size_t i = 0; c && i < c->nchunks; i++) {
+        if (CHUNK_CODEC(c->chunks[i]->flags)) return 1;
+    }
+    return 0;
+}
+
+void content_compress(FsAllocator *a, FileContent *c, size_t offset, size_t len, int whole,
+                      ChunkCompression *z) {
+    if (!z->codec || !c || c->nchunks == 0) return;
+    size_t first = whole ? 0 : offset / CHUNK_SIZE;
+    size_t end = whole ? c->nchunks : (offset + len + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    if (end > c->nchunks) end = c->nchunks;
+    size_t cap = z->codec->bound(CHUNK_SIZE);
+    for (size_t i = first; i < end; i++) {
+        Chunk *ch = c->chunks[i];
+        if (ch->refs != 1 || CHUNK_CODEC(ch->flags) || ch->len < z->threshold || ch->len == 0) continue;
+        if (ch->len < CHUNK_SIZE && !(whole && i == c->nchunks - 1)) continue;
+        z->tried++;
+        size_t out = z->codec->compress(chunk_bytes(ch), ch->len, z->scratch, cap);
+        if (out == 0 || out > ch->len - ch->len / 8) continue;
+        Chunk *packed = chunk_alloc(a, out);
+        memcpy(packed->data, z->scratch, out);
+        packed->len = ch->len;
+        packed->flags = z->codec->id << CHUNK_CODEC_SHIFT;
+        chunk_release(a, ch);
+        c->chunks[i] = packed;
+        z->kept++;
+    }
+}
+
+// Estende o conteúdo com zeros até 'size'
+static FileContent* zero_fill(FsAllocator *a, FileContent *c, size_t size) {
+    static const char zeros[4096];
+    while (content_size(c) < size) {
+        size_t n = size - content_size(c);
+        if (n > sizeof(zeros)) n = sizeof(zeros);
+        c = content_write(a, c, content_size(c), zeros, n);
+    }
+    return c;
+}
+
+FileContent* content_write(FsAllocator *a, FileContent *c, size_t offset,
+                           const void *buf, size_t len) {
+    if (offset > content_size(c)) c = zero_fill(a, c, offset);
+
+    size_t end = offset + len;
+    c = reserve_slots(a, c, (end + CHUNK_SIZE - 1) / CHUNK_SIZE);
+
+    const char *src = (const char*)buf;
+    size_t pos = offset;
+    while (pos < end) {
+        size_t i = pos / CHUNK_SIZE;
+        size_t coff = pos % CHUNK_SIZE;
+        size_t n = CHUNK_SIZE - coff;
+        if (n > end - pos) n = end - pos;
+
+        // As escritas avançam em ordem, então um chunk novo sempre começa
+        // no deslocamento 0 e o anterior já está cheio
+        if (i == c->nchunks) {
+            c->chunks[c->nchunks++] = chunk_alloc(a, n > MIN_CHUNK_CAP ? n : MIN_CHUNK_CAP);
+        }
+        Chunk *ch = writable_chunk(a, c, i, coff + n);
+        memcpy(ch->data + coff, src, n);
+        if (coff + n > ch->len) ch->len = (unsigned int)(coff + n);
+
+        pos += n;
+        src += n;
+    }
+    if (end > c->size) c->size = end;
+    return c;
+}
+
+FileContent* content_assign(FsAllocator *a, FileContent *c, const void *buf, size_t len) {
+    // Sobrescreve no lugar: chunks exclusivos são reaproveitados
+    if (content_size(c) > len) c = content_truncate(a, c, len);
+    return content_write(a, c, 0, buf, len);
+}
+
+FileContent* content_truncate(FsAllocator *a, FileContent *c, size_t size) {
+    if (!c) c = header_alloc(a, 1);
+    if (size >= c->size) return zero_fill(a, c, size);
+
+    size_t keep = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    for (size_t i = keep; i < c->nchunks; i++) chunk_release(a, c->chunks[i]);
+    c->nchunks = keep;
+    if (keep > 0) {
+        size_t last_len = size - (keep - 1) * CHUNK_SIZE;
+        if (c->chunks[keep - 1]->len != last_len) {
+            writable_chunk(a, c, keep - 1, 0)->len = (unsigned int)last_len;
+        }
+    }
+    c->size = size;
+    return c;
+}
+
+FileContent* content_copy(FsAllocator *a, const FileContent *c) {
+    if (!c) return NULL;
+    FileContent *copy = header_alloc(a, c->nchunks ? c->nchunks : 1);
+    for (size_t i = 0; i < c->nchunks; i++) {
+        c->chunks[i]->refs++;
+        copy->chunks[i] = c->chunks[i];
+    }
+    copy->nchunks = c->nchunks;
+    copy->size = c->size;
+    return copy;
+}
+
+void content_free(FsAllocator *a, FileContent *c) {
+    if (!c) return;
+    for (size_t i = 0; i < c->nchunks; i++) chunk_release(a, c->chunks[i]);
+    header_free(a, c);
+}
+
+FileContent* content_copy_shared(FsAllocator *a, const FileContent *c) {
+    if (!c) return NULL;
+    FileContent *copy = header_alloc(a, c->nchunks ? c->nchunks : 1);
+    for (size_t i = 0; i < c->nchunks; i++) {
+        __atomic_fetch_add(&c->chunks[i]->refs, 1, __ATOMIC_RELAXED);
+        copy->chunks[i] = c->chunks[i];
+    }
+    copy->nchunks = c->nchunks;
+    copy->size = c->size;
+    return copy;
+}
+
+void content_free_shared(FsAllocator *a, FileContent *c) {
+    if (!c) return;
+    for (size_t i = 0; i < c->nchunks; i++) {
+        if (__atomic_sub_fetch(&c->chunks[i]->refs, 1, __ATOMIC_ACQ_REL) == 0) chunk_free(a, c->chunks[i]);
+    }
+    header_free(a, c);
+}
@@ -0,0 +1,123 @@
+// miniFS/content.h
+
+#ifndef CONTENT_H
+#define CONTENT_H
+
+#include <stddef.h> // Para size_t
+
+struct FsAllocator;
+
+// Os dados de um arquivo são divididos em chunks (extents) de até
+// CHUNK_SIZE bytes. Todos os chunks, exceto o último, estão cheios, então
+// o chunk de um deslocamento é simplesmente offset / CHUNK_SIZE
+#define CHUNK_SIZE (64 * 1024)
+
+// Chunk com contagem de referências: cópias de arquivos compartilham os
+// mesmos chunks, e um chunk compartilhado só é copiado quando alguém
+// escreve nele (copy-on-write)
+typedef struct Chunk {
+    unsigned int refs;
+    unsigned int len;      // Bytes válidos
+    unsigned int cap;      // Bytes reservados (o último chunk cresce até CHUNK_SIZE);
+                           // num chunk comprimido, os bytes comprimidos
+    unsigned int flags;    // CHUNK_MAPPED, CHUNK_DEDUP e o codec
+    char data[];
+} Chunk;
+
+// Os bytes do chunk estão em uma imagem mapeada (somente leitura) e 'data'
+// guarda só o ponteiro para eles; a primeira escrita faz uma cópia própria
+#define CHUNK_MAPPED 0x1
+// O chunk está na tabela de deduplicação (ver dedup.h), que segura uma
+// das suas referências
+#define CHUNK_DEDUP 0x2
+// Bits 8 a 15: id do codec com que os bytes guardados foram comprimidos
+// (ver codec.h; 0 = sem compressão). Um chunk comprimido nunca é escrito
+// no lugar: a escrita descomprime uma cópia
+#define CHUNK_CODEC_SHIFT 8
+#define CHUNK_CODEC(flags) (((flags) >> CHUNK_CODEC_SHIFT) & 0xff)
+
+// Compressão dos chunks escritos (ver content_compress)
+typedef struct {
+    const struct Codec *codec; // NULL = desligada
+    size_t threshold;          // Chunks menores ficam sem compressão
+    char *scratch;             // Saída do codec (codec->bound(CHUNK_SIZE) bytes)
+    size_t tried;              // Chunks passados ao codec
+    size_t kept;               // Os que ficaram comprimidos
+} ChunkCompression;
+
+// Conteúdo de um arquivo: tamanho explícito e a lista de chunks.
+// Aceita dados binários (com '\0' no meio)
+typedef struct FileContent {
+    size_t size;
+    size_t nchunks;
+    size_t slots;          // Capacidade do vetor de chunks
+    Chunk *chunks[];
+} FileContent;
+
+// Tamanho do conteúdo em O(1); um arquivo sem conteúdo tem tamanho 0
+size_t content_size(const FileContent *c);
+
+// Cria um conteúdo com 'size' bytes não inicializados, com chunks próprios
+// (usado pela carga, que preenche cada chunk direto do arquivo)
+FileContent* content_create(struct FsAllocator *a, size_t size);
+
+// Cria um conteúdo que aponta para 'size' bytes de uma imagem mapeada, sem
+// copiá-los; a imagem precisa continuar mapeada enquanto o conteúdo existir
+FileContent* content_map(struct FsAllocator *a, const char *data, size_t size);
+
+// Como content_map, mas cada chunk vem de content_map_chunk com os bytes
+// guardados (comprimidos ou não) de um quadro da imagem
+FileContent* content_map_chunks(struct FsAllocator *a, size_t size);
+void content_map_chunk(struct FsAllocator *a, FileContent *c, size_t i, const char *stored,
+                       size_t stored_len, unsigned int codec);
+
+// Acesso aos chunks para leitura sequencial (cat, save, export). Um chunk
+// comprimido é descomprimido em scratch (CHUNK_SIZE bytes), que só é usado
+// nesse caso e pode ser NULL se content_compressed for falso
+size_t content_chunk_count(const FileContent *c);
+char* content_chunk(const FileContent *c, size_t i, size_t *len, char *scratch);
+
+// Bytes do chunk como estão guardados, com o codec (0 = sem compressão):
+// a gravação da imagem os copia sem descomprimir nem recomprimir
+const char* content_chunk_stored(const FileContent *c, size_t i, size_t *stored,
+                                 unsigned int *codec);
+
+// Algum chunk do conteúdo está comprimido
+int content_compressed(const FileContent *c);
+
+// Comprime os chunks de c que cobrem [offset, offset + len): os cheios e,
+// com whole, também o último (como dedup_content). Só chunks exclusivos
+// deste conteúdo, de pelo menos z->threshold bytes, e só ficam comprimidos
+// os que encolhem pelo menos 1/8. Os chunks de c podem ser trocados, então
+// c não pode estar visível a leitores sem travas
+void content_compress(struct FsAllocator *a, FileContent *c, size_t offset, size_t len,
+                      int whole, ChunkCompression *z);
+
+// Escreve len bytes a partir de offset (como pwrite). Só os chunks tocados
+// são alterados (e copiados, se compartilhados); o último chunk cresce
+// geometricamente e um buraco entre o fim atual e offset vira zeros.
+// Retorna o conteúdo (que pode ter mudado de endereço)
+FileContent* content_write(struct FsAllocator *a, FileContent *c, size_t offset,
+                           const void *buf, size_t len);
+
+// Substitui todo o conteúdo
+FileContent* content_assign(struct FsAllocator *a, FileContent *c, const void *buf, size_t len);
+
+// Ajusta o tamanho (cortando ou preenchendo com zeros)
+FileContent* content_truncate(struct FsAllocator *a, FileContent *c, size_t size);
+
+// Cópia em O(#chunks): os chunks são compartilhados, não duplicados
+FileContent* content_copy(struct FsAllocator *a, const FileContent *c);
+
+void content_free(struct FsAllocator *a, FileContent *c);
+
+// Solta uma referência de um chunk, liberando-o na última (deduplicação)
+void content_chunk_release(struct FsAllocator *a, Chunk *ch);
+
+// Variantes para as tarefas paralelas de cp e rm -r: arquivos de workers
+// diferentes podem compartilhar chunks, então as contagens mudam com
+// operações atômicas
+FileContent* content_copy_shared(struct FsAllocator *a, const FileContent *c);
+void content_free_shared(struct FsAllocator *a, FileContent *c);
+
+#endif // CONTENT_H
@@ -0,0 +1,124 @@
+// miniFS/dcache.c
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "dcache.h"
+
+// Hash do caminho combinado com o nó de partida: o mesmo caminho relativo
+// leva a lugares diferentes conforme o diretório atual. Caminhos profundos
+// são longos, então o caminho é consumido 8 bytes por vez (e não byte a
+// byte, como os nomes no índice dos diretórios)
+static unsigned int key_hash(const struct Node *start, const char *path, size_t len) {
+    uint64_t h = (uint64_t)(uintptr_t)start ^ (len * 0x9e3779b97f4a7c15ull);
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, path + i, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    if (i < len) {
+        uint64_t w = 0;
+        memcpy(&w, path + i, len - i);
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+    }
+    h ^= h >> 29;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 32;
+    return (unsigned int)h;
+}
+
+// Primeira posição do conjunto do hash
+static DcacheEntry* set_for(Dcache *c, unsigned int hash) {
+    return &c->table[(hash & (DCACHE_SIZE / DCACHE_WAYS - 1)) * DCACHE_WAYS];
+}
+
+static int entry_valid(const Dcache *c, const DcacheEntry *e) {
+    return e->gen == c->gen && (e->node || e->neg_gen == c->neg_gen);
+}
+
+static void count_hit(Dcache *c, const DcacheEntry *e) {
+    if (e->node) c->stats.hits++;
+    else c->stats.negative_hits++;
+}
+
+int dcache_lookup(Dcache *c, const struct Node *start, const char *path, size_t len,
+                  struct Node **out) {
+    DcacheEntry *last = c->last;
+    if (last && last->start == start && last->len == len && entry_valid(c, last) &&
+        memcmp(last->key, path, len) == 0) {
+        c->stats.repeats++;
+        count_hit(c, last);
+        *out = last->node;
+        return 1;
+    }
+    if (c->table && len <= DCACHE_KEY_MAX) {
+        unsigned int hash = key_hash(start, path, len);
+        DcacheEntry *set = set_for(c, hash);
+        for (int way = 0; way < DCACHE_WAYS; way++) {
+            DcacheEntry *e = &set[way];
+            if (e->hash == hash && e->start == start && e->len == len && entry_valid(c, e) &&
+                memcmp(e->key, path, len) == 0) {
+                count_hit(c, e);
+                c->last = e;
+                *out = e->node;
+                return 1;
+            }
+        }
+    }
+    c->stats.misses++;
+    return 0;
+}
+
+// A nova entrada ocupa uma posição livre (ou inválida) do conjunto; com
+// todas ocupadas, substitui uma delas escolhida pelo próprio hash
+void dcache_insert(Dcache *c, const struct Node *start, const char *path, size_t len,
+                   struct Node *node) {
+    if (len > DCACHE_KEY_MAX) return;
+    if (!c->table) {
+        c->table = (DcacheEntry*)calloc(DCACHE_SIZE, sizeof(DcacheEntry));
+        if (!c->table) return; // Sem cache, a resolução continua funcionando
+        if (c->gen == 0) c->gen = 1;
+    }
+    unsigned int hash = key_hash(start, path, len);
+    DcacheEntry *set = set_for(c, hash);
+    DcacheEntry *e = &set[(hash >> 24) % DCACHE_WAYS];
+    for (int way = 0; way < DCACHE_WAYS; way++) {
+        if (!entry_valid(c, &set[way])) {
+            e = &set[way];
+            break;
+        }
+    }
+    e->start = start;
+    e->node = node;
+    e->hash = hash;
+    e->gen = c->gen;
+    e->neg_gen = c->neg_gen;
+    e->len = (unsigned short)len;
+    memcpy(e->key, path, len);
+    c->last = e;
+}
+
+void dcache_invalidate(Dcache *c) {
+    c->stats.invalidations++;
+    if (++c->gen == 0) {
+        // Depois de dar a volta, gerações antigas voltariam a valer
+        if (c->table) memset(c->table, 0, DCACHE_SIZE * sizeof(DcacheEntry));
+        c->gen = 1;
+    }
+}
+
+void dcache_invalidate_negative(Dcache *c) {
+    if (++c->neg_gen == 0) dcache_invalidate(c);
+}
+
+void dcache_note_uncached(Dcache *c) {
+    c->stats.uncached++;
+}
+
+void dcache_destroy(Dcache *c) {
+    free(c->table);
+    c->table = NULL;
+    c->last = NULL;
+}
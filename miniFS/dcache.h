@@ -0,0 +1,73 @@
+// miniFS/dcache.h
+
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include <stddef.h> // Para size_t
+
+struct Node;
+
+// Cache de resolução de caminhos (dentry cache). Guarda, para um nó de
+// partida (raiz ou diretório atual) e o trecho de diretórios de um caminho
+// ("/a/b/c" em "/a/b/c/arquivo"), o diretório a que ele leva ou a certeza
+// de que ele não existe (entrada negativa). O último componente continua
+// sendo buscado no índice do diretório, então o cache só precisa conhecer
+// diretórios.
+//
+// A tabela tem tamanho fixo (conjuntos de DCACHE_WAYS posições) e é
+// invalidada por gerações, em O(1):
+//   gen: muda quando um diretório sai da árvore ou muda de lugar (rm e mv
+//        de diretórios, destruição da árvore), o que invalida tudo;
+//   neg_gen: muda quando um nó é anexado (mkdir, touch, cp, mv), o que só
+//        invalida as entradas negativas.
+// Criar e remover arquivos, o caso mais comum, não toca nas entradas
+// positivas. Comandos seguidos em geral trabalham no mesmo diretório (um
+// script que cria mil arquivos em /a/b), então a última entrada usada é
+// conferida antes de tudo, sem calcular o hash do caminho. Caminhos com
+// ".." não entram no cache (podem atravessar um arquivo, e remover arquivos
+// não invalida nada). Os maiores que DCACHE_KEY_MAX são guardados em
+// pedaços cortados em barras, cada um com o diretório a que o anterior
+// leva como ponto de partida (fs.c, resolve_dir).
+#define DCACHE_SIZE 4096       // Potência de 2
+#define DCACHE_WAYS 4          // Posições por conjunto
+#define DCACHE_KEY_MAX 224     // Entradas de 256 bytes: 1 MiB no total
+
+typedef struct {
+    const struct Node *start;
+    struct Node *node;     // NULL = entrada negativa
+    unsigned int hash;
+    unsigned int gen;      // 0 = posição vazia
+    unsigned int neg_gen;
+    unsigned short len;
+    char key[DCACHE_KEY_MAX];
+} DcacheEntry;
+
+typedef struct DcacheStats {
+    size_t hits;
+    size_t negative_hits;
+    size_t misses;
+    size_t repeats;        // Acertos na última entrada usada (incluídos nos acertos)
+    size_t uncached;       // Caminhos que não podem entrar no cache
+    size_t invalidations;
+} DcacheStats;
+
+typedef struct {
+    DcacheEntry *table;    // Alocada na primeira inserção
+    DcacheEntry *last;     // Última entrada encontrada ou inserida
+    unsigned int gen;
+    unsigned int neg_gen;
+    DcacheStats stats;
+} Dcache;
+
+// Retorna 1 e o nó (ou NULL, se negativa) quando há uma entrada válida
+int dcache_lookup(Dcache *c, const struct Node *start, const char *path, size_t len,
+                  struct Node **out);
+void dcache_insert(Dcache *c, const struct Node *start, const char *path, size_t len,
+                   struct Node *node);
+
+void dcache_invalidate(Dcache *c);           // Todas as entradas
+void dcache_invalidate_negative(Dcache *c);  // Só as negativas
+void dcache_note_uncached(Dcache *c);
+void dcache_destroy(Dcache *c);
+
+#endif // DCACHE_H
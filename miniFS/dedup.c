@@ -0,0 +1,237 @@
+// miniFS/dedup.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dedup.h"
+#include "content.h"
+#include "alloc.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// --- Hash ---
+
+#define HASH_PRIME32 0x9e3779b1u
+#define HASH_PRIME64 0x9e3779b185ebca87ull
+#define HASH_SCRAMBLE_STRIPES 16   // Embaralha os acumuladores a cada 1 KiB
+
+// Uma chave por acumulador, para que blocos iguais em posições diferentes
+// do bloco de 64 bytes não se cancelem
+static const uint64_t hash_keys[8] = {
+    0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+    0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+};
+
+#if !defined(__SSE2__)
+static uint64_t read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+#endif
+
+// Os 8 acumuladores não dependem uns dos outros dentro de um bloco: cada
+// um soma a multiplicação das metades de 32 bits da sua palavra e a
+// palavra do vizinho, para nenhum bit se perder. Com SSE2, são 2
+// acumuladores por registrador (pmuludq); o resultado é o mesmo
+static void hash_stripe(uint64_t *acc, const unsigned char *p) {
+#if defined(__SSE2__)
+    for (int i = 0; i < 8; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(const void*)(p + 8 * i));
+        __m128i k = _mm_xor_si128(v, _mm_loadu_si128((const __m128i*)(const void*)&hash_keys[i]));
+        __m128i product = _mm_mul_epu32(k, _mm_srli_epi64(k, 32));
+        __m128i swapped = _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+        __m128i *slot = (__m128i*)(void*)&acc[i];
+        _mm_storeu_si128(slot, _mm_add_epi64(_mm_loadu_si128(slot), _mm_add_epi64(swapped, product)));
+    }
+#else
+    for (int i = 0; i < 8; i++) {
+        uint64_t k = read64(p + 8 * i) ^ hash_keys[i];
+        acc[i] += read64(p + 8 * (i ^ 1)) + (k & 0xffffffffull) * (k >> 32);
+    }
+#endif
+}
+
+static void hash_scramble(uint64_t *acc) {
+    for (int i = 0; i < 8; i++) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= hash_keys[i];
+        acc[i] = a * HASH_PRIME32;
+    }
+}
+
+static uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t dedup_hash(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = (const unsigned char*)data;
+    uint64_t acc[8];
+    for (int i = 0; i < 8; i++) acc[i] = hash_keys[i] ^ seed;
+
+    size_t stripes = len / 64;
+    for (size_t s = 0; s < stripes; s++) {
+        hash_stripe(acc, p + s * 64);
+        if (s % HASH_SCRAMBLE_STRIPES == HASH_SCRAMBLE_STRIPES - 1) hash_scramble(acc);
+    }
+    // O resto vai completado com zeros; o tamanho entra no final, então
+    // "abc" e "abc\0" continuam diferentes
+    size_t rest = len % 64;
+    if (rest) {
+        unsigned char last[64] = {0};
+        memcpy(last, p + stripes * 64, rest);
+        hash_stripe(acc, last);
+    }
+
+    uint64_t h = seed ^ ((uint64_t)len * HASH_PRIME64);
+    for (int i = 0; i < 8; i++) h = hash_mix(h ^ acc[i]) + hash_keys[i];
+    return hash_mix(h);
+}
+
+// --- Tabela de chunks ---
+
+#define DEDUP_MIN_CAP 64
+#define DEDUP_SWEEP_SLACK 256      // Operações extras antes de uma varredura
+
+static void* chunk_data(const Chunk *ch) {
+    return (void*)ch->data;    // Nunca mapeado (ver dedup_content)
+}
+
+// Bytes guardados: um chunk comprimido é comparado sem descomprimir (o
+// codec é determinístico, então conteúdos iguais comprimem igual)
+static size_t stored_len(const Chunk *ch) {
+    return CHUNK_CODEC(ch->flags) ? ch->cap : ch->len;
+}
+
+// Tabela com pelo menos o dobro de posições que entradas
+static void rebuild(Dedup *d, size_t live) {
+    size_t cap = DEDUP_MIN_CAP;
+    while (cap < (live + 1) * 2) cap *= 2;
+    DedupSlot *slots = (DedupSlot*)calloc(cap, sizeof(DedupSlot));
+    if (!slots) { perror("Failed to allocate dedup table"); exit(1); }
+    for (size_t i = 0; i < d->cap; i++) {
+        if (!d->slots[i].chunk) continue;
+        size_t j = (size_t)d->slots[i].hash & (cap - 1);
+        while (slots[j].chunk) j = (j + 1) & (cap - 1);
+        slots[j] = d->slots[i];
+    }
+    free(d->slots);
+    d->slots = slots;
+    d->cap = cap;
+    d->live = live;
+}
+
+// Um chunk só da tabela não é usado por nenhum arquivo
+static int entry_dead(const Chunk *ch) {
+    return __atomic_load_n(&ch->refs, __ATOMIC_RELAXED) == 1;
+}
+
+static void drop_entry(FsAllocator *a, DedupSlot *slot) {
+    slot->chunk->flags &= ~CHUNK_DEDUP;
+    content_chunk_release(a, slot->chunk);
+    slot->chunk = NULL;
+}
+
+void dedup_sweep(Dedup *d, FsAllocator *a) {
+    d->ticks = 0;
+    if (d->cap == 0) return;
+    size_t live = 0;
+    for (size_t i = 0; i < d->cap; i++) {
+        if (!d->slots[i].chunk) continue;
+        if (entry_dead(d->slots[i].chunk)) drop_entry(a, &d->slots[i]);
+        else live++;
+    }
+    rebuild(d, live);
+}
+
+void dedup_tick(Dedup *d, FsAllocator *a) {
+    if (d->cap && ++d->ticks > d->live + DEDUP_SWEEP_SLACK) dedup_sweep(d, a);
+}
+
+// Chunk da tabela igual a ch ou, se não houver, ch (que entra na tabela).
+// O que for retornado ganha a referência que ch tinha no arquivo
+static Chunk* intern(Dedup *d, FsAllocator *a, Chunk *ch) {
+    size_t stored = stored_len(ch);
+    uint64_t hash = dedup_hash(chunk_data(ch), stored, ch->len);
+    d->lookups++;
+    if (d->cap) {
+        size_t mask = d->cap - 1;
+        for (size_t i = (size_t)hash & mask; d->slots[i].chunk; i = (i + 1) & mask) {
+            Chunk *other = d->slots[i].chunk;
+            if (d->slots[i].hash == hash && other->len == ch->len && CHUNK_CODEC(other->flags) == CHUNK_CODEC(ch->flags) &&
+                stored_len(other) == stored && memcmp(chunk_data(other), chunk_data(ch), stored) == 0) {
+                other->refs++;
+                content_chunk_release(a, ch);
+                d->hits++;
+                return other;
+            }
+        }
+    }
+
+    if ((d->live + 1) * 4 > d->cap * 3) {
+        dedup_sweep(d, a); // Reconstrói com folga
+        if (d->cap == 0) rebuild(d, 0);
+    }
+    size_t mask = d->cap - 1;
+    size_t i = (size_t)hash & mask;
+    while (d->slots[i].chunk) i = (i + 1) & mask;
+    d->slots[i].hash = hash;
+    d->slots[i].chunk = ch;
+    d->live++;
+    ch->flags |= CHUNK_DEDUP;
+    ch->refs++;
+    return ch;
+}
+
+void dedup_content(Dedup *d, FsAllocator *a, FileContent *c, size_t offset, size_t len,
+                   int whole) {
+    if (!d->enabled || !c || c->nchunks == 0) return;
+    size_t first = whole ? 0 : offset / CHUNK_SIZE;
+    size_t end = whole ? c->nchunks : (offset + len + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    if (end > c->nchunks) end = c->nchunks;
+    for (size_t i = first; i < end; i++) {
+        Chunk *ch = c->chunks[i];
+        if ((ch->flags & (CHUNK_MAPPED | CHUNK_DEDUP)) || ch->len == 0) continue;
+        if (ch->len < CHUNK_SIZE && !(whole && i == c->nchunks - 1)) continue;
+        c->chunks[i] = intern(d, a, ch);
+    }
+    dedup_tick(d, a);
+}
+
+void dedup_get_stats(const Dedup *d, DedupStats *out) {
+    memset(out, 0, sizeof(DedupStats));
+    for (size_t i = 0; i < d->cap; i++) {
+        const Chunk *ch = d->slots[i].chunk;
+        if (!ch || entry_dead(ch)) continue;
+        size_t refs = __atomic_load_n(&ch->refs, __ATOMIC_RELAXED) - 1;
+        out->chunks++;
+        out->chunk_bytes += stored_len(ch);
+        out->refs += refs;
+        out->ref_bytes += refs * stored_len(ch);
+    }
+    out->lookups = d->lookups;
+    out->hits = d->hits;
+}
+
+void dedup_clear(Dedup *d, FsAllocator *a) {
+    for (size_t i = 0; i < d->cap; i++) {
+        if (d->slots[i].chunk) drop_entry(a, &d->slots[i]);
+    }
+    dedup_reset(d);
+}
+
+void dedup_reset(Dedup *d) {
+    free(d->slots);
+    d->slots = NULL;
+    d->cap = 0;
+    d->live = 0;
+    d->ticks = 0;
+}
@@ -0,0 +1,86 @@
+// miniFS/dedup.h
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stddef.h> // Para size_t
+#include <stdint.h>
+
+struct FsAllocator;
+struct FileContent;
+struct Chunk;
+
+// Deduplicação de conteúdo (opcional, comando dedup). Com ela ligada, cada
+// chunk escrito por echo, write e append é identificado pelo hash dos seus
+// bytes numa tabela de chunks únicos: um chunk igual a outro já guardado é
+// trocado pelo da tabela, que passa a ser compartilhado (com contagem de
+// referências, como numa cópia com cp) e o novo é liberado.
+//
+// A tabela segura uma referência de cada chunk, então um chunk da tabela
+// nunca tem refs == 1 enquanto algum arquivo o usa e qualquer escrita nele
+// passa pelo copy-on-write. Um chunk que só a tabela segura está morto: as
+// entradas mortas são descartadas em varreduras espaçadas (a cada tantas
+// operações quanto há entradas), com custo O(1) amortizado.
+//
+// Só chunks cheios entram na tabela, mais o último chunk nos arquivos
+// escritos inteiros (echo): um arquivo que cresce por append não paga uma
+// cópia do chunk final a cada escrita. Chunks mapeados de uma imagem não
+// entram (fs_save já grava cada blob uma única vez, e os arquivos carregados
+// apontam para os mesmos bytes mapeados).
+//
+// Quem chama garante que só uma thread usa a tabela por vez (no fs, com o
+// mutex da árvore)
+
+// Hash dos bytes, 64 bits. Consome blocos de 64 bytes em 8 acumuladores
+// independentes (multiplicações 32x32->64), com SSE2 quando disponível;
+// seed encadeia pedaços de um mesmo blob
+uint64_t dedup_hash(const void *data, size_t len, uint64_t seed);
+
+typedef struct {
+    uint64_t hash;
+    struct Chunk *chunk;   // NULL = posição vazia
+} DedupSlot;
+
+typedef struct DedupStats {
+    size_t chunks;         // Chunks únicos vivos na tabela
+    size_t chunk_bytes;    // Bytes guardados por eles (comprimidos, se for o caso)
+    size_t refs;           // Referências de arquivos a esses chunks
+    size_t ref_bytes;      // Bytes vistos pelos arquivos (com repetições)
+    size_t lookups;        // Chunks consultados desde a criação
+    size_t hits;           // Chunks trocados por um igual já guardado
+} DedupStats;
+
+typedef struct {
+    int enabled;
+    DedupSlot *slots;
+    size_t cap;            // Potência de 2 (0 enquanto vazia)
+    size_t live;
+    size_t ticks;          // Operações desde a última varredura
+    size_t lookups;
+    size_t hits;
+} Dedup;
+
+// Passa pela tabela os chunks de c que cobrem [offset, offset + len):
+// os cheios e, com whole, também o último. Os chunks de c podem ser
+// trocados (c é o mesmo), então c não pode estar visível a leitores sem
+// travas
+void dedup_content(Dedup *d, struct FsAllocator *a, struct FileContent *c, size_t offset,
+                   size_t len, int whole);
+
+// Conta uma operação que pode ter soltado referências (rm, escrita) e
+// varre a tabela quando as operações passam do número de entradas
+void dedup_tick(Dedup *d, struct FsAllocator *a);
+
+// Descarta as entradas mortas agora
+void dedup_sweep(Dedup *d, struct FsAllocator *a);
+
+void dedup_get_stats(const Dedup *d, DedupStats *out);
+
+// Solta todas as referências da tabela e a libera (dedup off)
+void dedup_clear(Dedup *d, struct FsAllocator *a);
+
+// Esquece a tabela sem tocar nos chunks, que o alocador já liberou
+// (destruição da árvore)
+void dedup_reset(Dedup *d);
+
+#endif // DEDUP_H
@@ -0,0 +1,199 @@
+// miniFS/dirindex.c
+
+#include <string.h>
+#include "dirindex.h"
+#include "alloc.h"
+#include "names.h"
+#include "fs.h"
+
+// Marcador de posição removida: mantém as cadeias de sondagem intactas
+#define TOMBSTONE ((Node*)1)
+#define MIN_CAP 16
+// Quantas posições da tabela antiga são migradas por inserção/remoção
+#define MIGRATE_STEP 64
+
+unsigned int dirindex_hash(const char *name, size_t len) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static size_t round_pow2(size_t n) {
+    size_t cap = MIN_CAP;
+    while (cap < n) cap <<= 1;
+    return cap;
+}
+
+static IndexSlot* alloc_slots(FsAllocator *a, size_t cap) {
+    IndexSlot *slots = (IndexSlot*)alloc_bytes(a, cap * sizeof(IndexSlot));
+    memset(slots, 0, cap * sizeof(IndexSlot));
+    return slots;
+}
+
+// Cria um índice dimensionado para 'expected' entradas com folga
+DirIndex* dirindex_create(FsAllocator *alloc, size_t expected) {
+    DirIndex *idx = (DirIndex*)alloc_bytes(alloc, sizeof(DirIndex));
+    memset(idx, 0, sizeof(DirIndex));
+    idx->alloc = alloc;
+    idx->cap = round_pow2(expected * 2);
+    idx->slots = alloc_slots(alloc, idx->cap);
+    return idx;
+}
+
+void dirindex_destroy(DirIndex *idx) {
+    if (!idx) return;
+    alloc_free_bytes(idx->alloc, idx->slots, idx->cap * sizeof(IndexSlot));
+    if (idx->old_slots) {
+        alloc_free_bytes(idx->alloc, idx->old_slots, idx->old_cap * sizeof(IndexSlot));
+    }
+    alloc_free_bytes(idx->alloc, idx, sizeof(DirIndex));
+}
+
+void dirindex_adopt(DirIndex *idx, FsAllocator *alloc) {
+    if (idx) idx->alloc = alloc;
+}
+
+// Insere na primeira posição livre (vazia ou removida) da cadeia.
+// Retorna 1 se reaproveitou um marcador de remoção.
+static int raw_insert(IndexSlot *slots, size_t cap, unsigned int hash, Node *node) {
+    size_t mask = cap - 1;
+    size_t i = hash & mask;
+    while (slots[i].node != NULL && slots[i].node != TOMBSTONE) {
+        i = (i + 1) & mask;
+    }
+    int reused = slots[i].node == TOMBSTONE;
+    // O hash vai antes: quem encontra o nó já encontra o hash dele
+    __atomic_store_n(&slots[i].hash, hash, __ATOMIC_RELAXED);
+    __atomic_store_n(&slots[i].node, node, __ATOMIC_RELEASE);
+    return reused;
+}
+
+// Troca de tabelas visível para as buscas (como um seqlock)
+static void seq_begin(DirIndex *idx) {
+    __atomic_store_n(&idx->seq, idx->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void seq_end(DirIndex *idx) {
+    __atomic_store_n(&idx->seq, idx->seq + 1, __ATOMIC_RELEASE);
+}
+
+// Migra até 'steps' posições da tabela antiga para a nova
+static void migrate(DirIndex *idx, size_t steps) {
+    if (!idx->old_slots) return;
+    while (steps-- > 0 && idx->migrate_pos < idx->old_cap) {
+        IndexSlot *s = &idx->old_slots[idx->migrate_pos++];
+        if (s->node != NULL && s->node != TOMBSTONE) {
+            if (raw_insert(idx->slots, idx->cap, s->hash, s->node)) idx->tombs--;
+            idx->live++;
+            idx->old_live--;
+            // A cópia antiga vira marcador para que buscas na tabela antiga
+            // não a encontrem depois de o nó ser removido da tabela nova.
+            // Com release (como a publicação em raw_insert), quem lê o
+            // marcador com acquire já enxerga o nó na tabela nova
+            __atomic_store_n(&s->node, TOMBSTONE, __ATOMIC_RELEASE);
+        }
+    }
+    if (idx->migrate_pos == idx->old_cap) {
+        seq_begin(idx);
+        alloc_free_bytes(idx->alloc, idx->old_slots, idx->old_cap * sizeof(IndexSlot));
+        __atomic_store_n(&idx->old_slots, NULL, __ATOMIC_RELAXED);
+        __atomic_store_n(&idx->old_cap, 0, __ATOMIC_RELAXED);
+        idx->old_live = 0;
+        seq_end(idx);
+    }
+}
+
+// Inicia um redimensionamento: a tabela atual vira a "antiga" e uma nova
+// é alocada. Se a carga vem majoritariamente de remoções, mantém o tamanho.
+static void start_resize(DirIndex *idx) {
+    if (idx->old_slots) migrate(idx, idx->old_cap); // Termina a migração pendente
+
+    size_t new_cap = (idx->live * 4 > idx->cap) ? idx->cap * 2 : idx->cap;
+    IndexSlot *new_slots = alloc_slots(idx->alloc, new_cap);
+
+    seq_begin(idx);
+    __atomic_store_n(&idx->old_slots, idx->slots, __ATOMIC_RELAXED);
+    __atomic_store_n(&idx->old_cap, idx->cap, __ATOMIC_RELAXED);
+    idx->old_live = idx->live;
+    idx->migrate_pos = 0;
+
+    __atomic_store_n(&idx->slots, new_slots, __ATOMIC_RELAXED);
+    __atomic_store_n(&idx->cap, new_cap, __ATOMIC_RELAXED);
+    idx->live = 0;
+    idx->tombs = 0;
+    seq_end(idx);
+}
+
+// O nome é lido pelo cabeçalho do nome internado (names_equal), que
+// continua coerente mesmo se o nó for renomeado durante a busca
+static Node* probe(IndexSlot *slots, size_t cap, const char *name, size_t len, unsigned int hash) {
+    size_t mask = cap - 1;
+    size_t i = hash & mask;
+    Node *n;
+    while ((n = __atomic_load_n(&slots[i].node, __ATOMIC_ACQUIRE)) != NULL) {
+        if (n != TOMBSTONE && __atomic_load_n(&slots[i].hash, __ATOMIC_RELAXED) == hash &&
+            names_equal(__atomic_load_n(&n->name, __ATOMIC_ACQUIRE), name, len, hash)) {
+            return n;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+// Busca sem modificar o índice: durante uma migração, consulta a tabela
+// antiga antes da nova. Um nó migrado no meio da busca já estava na nova
+// quando sua cópia antiga virou marcador, então não escapa das duas
+Node* dirindex_find(DirIndex *idx, const char *name, size_t len, unsigned int hash) {
+    for (;;) {
+        unsigned int seq = __atomic_load_n(&idx->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        IndexSlot *old_slots = __atomic_load_n(&idx->old_slots, __ATOMIC_RELAXED);
+        size_t old_cap = __atomic_load_n(&idx->old_cap, __ATOMIC_RELAXED);
+        IndexSlot *slots = __atomic_load_n(&idx->slots, __ATOMIC_RELAXED);
+        size_t cap = __atomic_load_n(&idx->cap, __ATOMIC_RELAXED);
+
+        Node *found = old_slots ? probe(old_slots, old_cap, name, len, hash) : NULL;
+        if (!found) found = probe(slots, cap, name, len, hash);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&idx->seq, __ATOMIC_RELAXED) == seq) return found;
+    }
+}
+
+void dirindex_insert(DirIndex *idx, Node *node) {
+    migrate(idx, MIGRATE_STEP);
+    // Mantém a carga (incluindo marcadores de remoção) abaixo de 75%
+    if ((idx->live + idx->tombs + 1) * 4 > idx->cap * 3) {
+        start_resize(idx);
+        migrate(idx, MIGRATE_STEP);
+    }
+    if (raw_insert(idx->slots, idx->cap, node->name_hash, node)) idx->tombs--;
+    idx->live++;
+}
+
+// Procura a posição exata do nó e a marca como removida
+static int remove_from(IndexSlot *slots, size_t cap, Node *node) {
+    size_t mask = cap - 1;
+    size_t i = node->name_hash & mask;
+    while (slots[i].node != NULL) {
+        if (slots[i].node == node) {
+            __atomic_store_n(&slots[i].node, TOMBSTONE, __ATOMIC_RELAXED);
+            return 1;
+        }
+        i = (i + 1) & mask;
+    }
+    return 0;
+}
+
+void dirindex_remove(DirIndex *idx, Node *node) {
+    if (remove_from(idx->slots, idx->cap, node)) {
+        idx->live--;
+        idx->tombs++;
+    } else if (idx->old_slots && remove_from(idx->old_slots, idx->old_cap, node)) {
+        idx->old_live--;
+    }
+    migrate(idx, MIGRATE_STEP);
+}
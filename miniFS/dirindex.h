@@ -0,0 +1,66 @@
+// miniFS/dirindex.h
+
+#ifndef DIRINDEX_H
+#define DIRINDEX_H
+
+#include <stddef.h> // Para size_t
+
+struct Node;
+struct FsAllocator;
+
+// Diretórios com mais filhos do que este limite ganham um índice hash;
+// abaixo dele a varredura linear da lista de irmãos é mais barata.
+#define DIRINDEX_THRESHOLD 8
+
+// Uma posição da tabela: o hash do nome fica em cache ao lado do ponteiro,
+// então sondagens e redimensionamentos não precisam reler o nome do nó.
+typedef struct {
+    unsigned int hash;
+    struct Node *node;     // NULL = vazio; um marcador especial indica remoção
+} IndexSlot;
+
+// Índice hash por diretório (endereçamento aberto com sondagem linear).
+// O redimensionamento é incremental: ao crescer, a tabela antiga é mantida
+// em old_slots e migrada aos poucos a cada operação, sem pausas longas.
+//
+// As buscas podem correr junto com uma alteração (leitores sem travas no
+// modo concorrente): as posições são publicadas com stores atômicos, e seq
+// fica ímpar enquanto as tabelas são trocadas, para a busca repetir.
+// Tabelas descartadas só são reaproveitadas depois de um período de graça
+// (liberações adiadas do alocador).
+typedef struct DirIndex {
+    struct FsAllocator *alloc; // As tabelas pertencem ao alocador da árvore
+    IndexSlot *slots;
+    size_t cap;            // Sempre uma potência de 2
+    size_t live;           // Entradas válidas na tabela nova
+    size_t tombs;          // Marcadores de remoção na tabela nova
+
+    IndexSlot *old_slots;  // Tabela em migração (NULL se não houver)
+    size_t old_cap;
+    size_t old_live;
+    size_t migrate_pos;    // Próxima posição da tabela antiga a migrar
+    unsigned int seq;      // Ímpar durante a troca de tabelas
+} DirIndex;
+
+// Hash FNV-1a de 32 bits de um nome com tamanho explícito.
+unsigned int dirindex_hash(const char *name, size_t len);
+
+DirIndex* dirindex_create(struct FsAllocator *alloc, size_t expected);
+void dirindex_destroy(DirIndex *idx);
+
+// Troca o alocador usado daqui em diante (crescimento e destruição), para
+// índices criados ou destruídos por uma tarefa paralela com o alocador
+// local do worker (ver alloc_merge)
+void dirindex_adopt(DirIndex *idx, struct FsAllocator *alloc);
+
+// Busca um filho pelo nome (com o hash já calculado). Pode ser chamada sem
+// travas, ao mesmo tempo que inserções e remoções.
+struct Node* dirindex_find(DirIndex *idx, const char *name, size_t len, unsigned int hash);
+
+// Insere um nó; o chamador garante que o nome ainda não existe no índice.
+void dirindex_insert(DirIndex *idx, struct Node *node);
+
+// Remove um nó específico (comparando ponteiros, não nomes).
+void dirindex_remove(DirIndex *idx, struct Node *node);
+
+#endif // DIRINDEX_H
@@ -0,0 +1,73 @@
+// miniFS/dirlock.c
+
+#include "dirlock.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#define yield_cpu() SwitchToThread()
+#else
+#include <sched.h>
+#define yield_cpu() sched_yield()
+#endif
+
+#define SPINS_BEFORE_YIELD 64
+
+static void backoff(unsigned int *spins) {
+    if (++*spins >= SPINS_BEFORE_YIELD) {
+        *spins = 0;
+        yield_cpu();
+    }
+}
+
+int dirlock_try_read(unsigned short *lock) {
+    unsigned short v = __atomic_load_n(lock, __ATOMIC_RELAXED);
+    while (!(v & (DIRLOCK_WRITER | DIRLOCK_WAITING))) {
+        if (__atomic_compare_exchange_n(lock, &v, (unsigned short)(v + 1), 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void dirlock_read(unsigned short *lock) {
+    unsigned int spins = 0;
+    while (!dirlock_try_read(lock)) backoff(&spins);
+}
+
+int dirlock_try_write(unsigned short *lock) {
+    unsigned short v = __atomic_load_n(lock, __ATOMIC_RELAXED);
+    while ((v & ~DIRLOCK_WAITING) == 0) {
+        if (__atomic_compare_exchange_n(lock, &v, (unsigned short)DIRLOCK_WRITER, 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Enquanto houver alguém dentro, marca a espera para barrar novos leitores.
+// Ao entrar, o escritor limpa a marca; outros que ainda esperam a refazem
+void dirlock_write(unsigned short *lock) {
+    unsigned int spins = 0;
+    while (!dirlock_try_write(lock)) {
+        unsigned short v = __atomic_load_n(lock, __ATOMIC_RELAXED);
+        if (!(v & DIRLOCK_WAITING)) {
+            __atomic_compare_exchange_n(lock, &v, (unsigned short)(v | DIRLOCK_WAITING), 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        }
+        backoff(&spins);
+    }
+}
+
+void dirlock_unlock_read(unsigned short *lock) {
+    __atomic_fetch_sub(lock, 1, __ATOMIC_RELEASE);
+}
+
+void dirlock_unlock_write(unsigned short *lock) {
+    __atomic_fetch_and(lock, (unsigned short)~DIRLOCK_WRITER, __ATOMIC_RELEASE);
+}
+
+void dirlock_pause(void) {
+    yield_cpu();
+}
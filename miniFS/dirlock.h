@@ -0,0 +1,30 @@
+// miniFS/dirlock.h
+
+#ifndef DIRLOCK_H
+#define DIRLOCK_H
+
+// Trava de leitura/escrita de um diretório, guardada em 16 bits dentro do
+// próprio Node (no espaço que sobrava depois de type e flags), então a
+// árvore não cresce por ter uma trava em cada diretório.
+//
+//   bit 15: escritor dentro
+//   bit 14: escritor esperando (novos leitores esperam, para o escritor
+//           não ficar para sempre atrás de leitores)
+//   bits 0-13: número de leitores
+//
+// As seções críticas são curtas (uma busca ou uma alteração em um
+// diretório), então quem espera gira um pouco e depois cede o processador.
+#define DIRLOCK_WRITER 0x8000u
+#define DIRLOCK_WAITING 0x4000u
+
+void dirlock_read(unsigned short *lock);
+void dirlock_write(unsigned short *lock);
+int dirlock_try_read(unsigned short *lock);   // 1 se conseguiu
+int dirlock_try_write(unsigned short *lock);
+void dirlock_unlock_read(unsigned short *lock);
+void dirlock_unlock_write(unsigned short *lock);
+
+// Cede o processador, para quem repete um dirlock_try_* em volta de outra trava
+void dirlock_pause(void);
+
+#endif // DIRLOCK_H
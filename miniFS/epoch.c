@@ -0,0 +1,91 @@
+// miniFS/epoch.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "epoch.h"
+
+// Estado de uma thread leitora: (época << 1) | 1 enquanto está em uma
+// seção de leitura, 0 fora dela. Os registros nunca são liberados; o de
+// uma thread que terminou é reaproveitado pela próxima
+typedef struct EpochRecord {
+    unsigned long long state;
+    unsigned int depth;        // Aninhamento (só a própria thread mexe)
+    int in_use;
+    struct EpochRecord *next;
+} EpochRecord;
+
+static unsigned long long global_epoch = 2;
+static EpochRecord *records;   // Lista só cresce (inserção sob records_mutex)
+static pthread_mutex_t records_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t record_key;
+
+static void release_record(void *ptr) {
+    EpochRecord *r = (EpochRecord*)ptr;
+    __atomic_store_n(&r->state, 0, __ATOMIC_RELEASE);
+    r->depth = 0;
+    pthread_mutex_lock(&records_mutex);
+    r->in_use = 0;
+    pthread_mutex_unlock(&records_mutex);
+}
+
+static void create_key(void) {
+    pthread_key_create(&record_key, release_record);
+}
+
+static EpochRecord* my_record(void) {
+    pthread_once(&key_once, create_key);
+    EpochRecord *r = (EpochRecord*)pthread_getspecific(record_key);
+    if (r) return r;
+
+    pthread_mutex_lock(&records_mutex);
+    for (r = records; r && r->in_use; r = r->next) {}
+    if (!r) {
+        r = (EpochRecord*)calloc(1, sizeof(EpochRecord));
+        if (!r) { perror("Failed to allocate epoch record"); exit(1); }
+        r->next = records;
+        __atomic_store_n(&records, r, __ATOMIC_RELEASE);
+    }
+    r->in_use = 1;
+    pthread_mutex_unlock(&records_mutex);
+    pthread_setspecific(record_key, r);
+    return r;
+}
+
+// A barreira depois de publicar a época casa com a de epoch_advance: ou o
+// escritor vê este leitor ativo, ou o leitor vê tudo o que o escritor
+// desligou da árvore antes de avançar a época
+void epoch_enter(void) {
+    EpochRecord *r = my_record();
+    if (r->depth++ > 0) return;
+    unsigned long long e = __atomic_load_n(&global_epoch, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->state, (e << 1) | 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void epoch_leave(void) {
+    EpochRecord *r = (EpochRecord*)pthread_getspecific(record_key);
+    if (--r->depth > 0) return;
+    __atomic_store_n(&r->state, 0, __ATOMIC_RELEASE);
+}
+
+unsigned long long epoch_current(void) {
+    return __atomic_load_n(&global_epoch, __ATOMIC_RELAXED);
+}
+
+// As leituras com acquire dos estados ordenam a liberação depois de tudo o
+// que os leitores fizeram antes de sair
+unsigned long long epoch_advance(void) {
+    unsigned long long e = __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (EpochRecord *r = __atomic_load_n(&records, __ATOMIC_ACQUIRE); r; r = r->next) {
+        unsigned long long s = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE);
+        if ((s & 1) && (s >> 1) != e) return e - 1; // Alguém ainda está na anterior
+    }
+    if (__atomic_compare_exchange_n(&global_epoch, &e, e + 1, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return e;
+    }
+    return e - 1; // Outro escritor avançou junto; e já é a nova época
+}
@@ -0,0 +1,28 @@
+// miniFS/epoch.h
+
+#ifndef EPOCH_H
+#define EPOCH_H
+
+// Recuperação de memória por épocas (epoch-based reclamation), para
+// leitores que percorrem a árvore sem travas. Um leitor marca a época
+// global ao entrar (epoch_enter) e desmarca ao sair; o que um escritor
+// desliga da árvore e libera na época e só é reaproveitado quando a época
+// global chega a e + 2. Nesse ponto, todo leitor que ainda podia enxergar
+// o objeto já saiu.
+//
+// A época só avança quando todos os leitores ativos já viram a atual, e
+// as seções de leitura são curtas (uma busca, um ls, um cat), então os
+// objetos liberados esperam pouco.
+
+// Entra/sai de uma seção de leitura (pode ser aninhada na mesma thread)
+void epoch_enter(void);
+void epoch_leave(void);
+
+// Época global atual, com que as liberações são marcadas
+unsigned long long epoch_current(void);
+
+// Tenta avançar a época global e retorna o limite seguro: objetos
+// liberados em uma época menor que ele não são vistos por mais ninguém
+unsigned long long epoch_advance(void);
+
+#endif // EPOCH_H
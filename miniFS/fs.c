@@ -1,498 +1,2523 @@
 // miniFS/fs.c
 
+#define _POSIX_C_SOURCE 200809L // strnlen, fork, clock_gettime
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <libgen.h> // Essencial para basename() e dirname()
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
 #include "fs.h"
+#include "dirindex.h"
+#include "dirlock.h"
+#include "epoch.h"
+#include "taskpool.h"
+#include "dcache.h"
+#include "names.h"
+#include "content.h"
+#include "codec.h"
+#include "dedup.h"
+#include "nameindex.h"
+#include "textscan.h"
+#include "image.h"
+#include "journal.h"
+#include "metrics.h"
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Um sistema de arquivos inteiro: a árvore, o alocador, os nomes, a imagem,
+// o cache, o journal e as travas. Nada disso é compartilhado entre
+// contextos, então cada um pode ficar em uma thread sem nenhuma
+// sincronização com os outros
+struct FsContext {
+    Node *root;
+    Node *current_dir;         // Diretório de trabalho sem sessão (o do shell)
+
+    // Todos os nós, conteúdos e índices da árvore saem deste alocador
+    FsAllocator alloc;
+    // Nomes distintos da árvore, compartilhados pelos nós (ver names.h)
+    NameTable names;
+    // Imagem mapeada de onde vêm os diretórios ainda não carregados
+    Image *image;
+    // Cache de resolução de caminhos (ver dcache.h)
+    Dcache dcache;
+    // Chunks únicos, com a deduplicação ligada (ver dedup.h), e o
+    // resultado do último fs_save ou checkpoint
+    Dedup dedup;
+    ImageSaveStats saved;
+    // Nós por nome, para o find (ver nameindex.h); montado no primeiro uso
+    NameIndex name_index;
+    // Codec e limite da compressão dos chunks escritos (ver content.h)
+    ChunkCompression compression;
+
+    // Journal (NULL sem journal, como nos benchmarks e durante a
+    // recuperação) e o LSN da última operação refletida na árvore
+    Journal *journal;
+    uint64_t lsn;
+    char *image_path;          // Imagem onde os checkpoints são gravados
+    size_t checkpoint_bytes;
+    unsigned int checkpoint_interval; // Segundos entre checkpoints (0 = sem limite)
+    long long checkpoint_time;  // Início do último checkpoint (monotonic_ms)
+#ifndef _WIN32
+    pid_t checkpoint_pid;      // Processo gravando um checkpoint (0 = nenhum)
+    int checkpoint_stats_fd;   // Pipe por onde ele manda o ImageSaveStats (-1 = sem)
+#endif
+    uint64_t checkpoint_offset; // Parte do log coberta por esse checkpoint
+
+    // Modo concorrente (ver fs.h). A ordem das travas é sempre: mutex de
+    // renomeação, travas dos diretórios (de cima para baixo), mutex da
+    // árvore e, por último, o mutex das sessões
+    int threads;
+    pthread_mutex_t tree_mutex;     // Alocador, nomes, imagem e journal
+    pthread_mutex_t rename_mutex;   // rm, mv, cp e caminhos com ".."
+    pthread_mutex_t sessions_mutex;
+    pthread_mutex_t names_mutex;    // Nomes na carga paralela
+    FsSession *sessions;            // Sessões abertas (sob sessions_mutex)
 
-// Definição das variáveis globais declaradas em fs.h
-Node *root;
-Node *current_dir;
+    // Leituras sem travas (FS_CONCURRENT): ls, cat, fs_stat e fs_read
+    // percorrem a árvore dentro de uma seção de leitura (epoch.h) e
+    // conferem no fim se um mv ou rm de diretório mudou a árvore no meio
+    // do caminho (rename_seq fica ímpar durante essas operações e muda a
+    // cada uma, como um seqlock)
+    int rcu_reads;
+    unsigned int rename_seq;
+    unsigned int tree_depth;        // Aninhamento do mutex da árvore
+
+    // Threads usadas por cp e rm -r em subárvores grandes (0 = uma por
+    // processador; ver taskpool.h)
+    int workers;
+};
+
+#define RCU_ATTEMPTS 4                 // Tentativas antes de usar as travas
+#define RECLAIM_BATCH 1024             // Liberações adiadas por coleta
+
+// Sessão associada à thread (fs_session_bind). Vale só no contexto dela:
+// nos outros, a thread usa o current_dir de cada um
+static pthread_once_t session_once = PTHREAD_ONCE_INIT;
+static pthread_key_t session_key;
+
+struct FsSession {
+    fs_t *fs;
+    Node *cwd;                         // NULL = raiz
+    FsSession *prev, *next;
+};
 
 // --- Protótipos de Funções Estáticas (Auxiliares Internas) ---
-static Node* find_node_in_dir(Node* dir, const char* name);
-static Node* find_node_by_path(const char *path);
-static Node* get_parent_dir_and_basename(const char* path, char* out_basename);
-static void detach_node(Node* node);
-static void attach_node(Node* parent, Node* child);
-static Node* copy_node_recursive(Node* source, Node* new_parent);
-void save_node_recursive(FILE *file, Node *node);
-Node* load_node_recursive(FILE *file, Node *parent);
-void export_recursive(FILE *file, Node *node, int is_last);
+static Node* find_node_in_dir(fs_t *fs, Node* dir, const char* name, size_t len);
+static Node* find_node_by_path(fs_t *fs, const char *path);
+static Node* get_parent_dir_and_basename(fs_t *fs, const char* path, const char** out_name, size_t* out_len);
+static void detach_node(fs_t *fs, Node* node);
+static void attach_node(fs_t *fs, Node* parent, Node* child);
+static Node* copy_subtree(fs_t *fs, Node* source, Node* new_parent);
+static void set_node_name(fs_t *fs, Node* node, const char* name, size_t len);
+static void index_children(fs_t *fs, Node* dir);
+static void load_children(fs_t *fs, Node* dir);
+static void journal_node(fs_t *fs, JournalOp op, Node* node, const void* data, size_t len, uint64_t offset);
+static void journal_paths(fs_t *fs, JournalOp op, const char* a, size_t a_len, Node* node);
+static void maybe_checkpoint(fs_t *fs);
+static void finish_checkpoint(fs_t *fs, int wait);
+Node* load_node_recursive(fs_t *fs, FILE *file, Node *parent);
+
+
+// --- Travas do Modo Concorrente ---
+
+// O mutex da árvore e o de renomeação são recursivos: save e checkpoint,
+// por exemplo, entram no mutex da árvore e chamam funções que também
+// entram nele
+static void init_locks(fs_t *fs) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&fs->tree_mutex, &attr);
+    pthread_mutex_init(&fs->rename_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_mutex_init(&fs->sessions_mutex, NULL);
+    pthread_mutex_init(&fs->names_mutex, NULL);
+}
+
+static void create_session_key(void) {
+    pthread_key_create(&session_key, NULL);
+}
+
+static void tree_enter(fs_t *fs) {
+    if (!fs->threads) return;
+    pthread_mutex_lock(&fs->tree_mutex);
+    fs->tree_depth++;
+}
+
+// Ao sair do nível mais externo, conclui as liberações adiadas cujo
+// período de graça já passou
+static void tree_leave(fs_t *fs) {
+    if (!fs->threads) return;
+    if (--fs->tree_depth == 0 && fs->alloc.deferred_count >= RECLAIM_BATCH) {
+        alloc_reclaim(&fs->alloc, epoch_advance());
+    }
+    pthread_mutex_unlock(&fs->tree_mutex);
+}
+static void rename_enter(fs_t *fs) { if (fs->threads) pthread_mutex_lock(&fs->rename_mutex); }
+static void rename_leave(fs_t *fs) { if (fs->threads) pthread_mutex_unlock(&fs->rename_mutex); }
+
+// Um mv ou rm de diretório, visto pelas leituras sem travas. Só quem
+// segura o mutex de renomeação escreve em rename_seq
+static void rename_seq_begin(fs_t *fs) {
+    if (!fs->threads) return;
+    __atomic_store_n(&fs->rename_seq, fs->rename_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void rename_seq_end(fs_t *fs) {
+    if (fs->threads) __atomic_store_n(&fs->rename_seq, fs->rename_seq + 1, __ATOMIC_RELEASE);
+}
+
+static unsigned int read_begin(fs_t *fs) {
+    unsigned int seq;
+    while ((seq = __atomic_load_n(&fs->rename_seq, __ATOMIC_ACQUIRE)) & 1) dirlock_pause();
+    return seq;
+}
+
+// A leitura iniciada em seq não cruzou nenhum mv/rm de diretório
+static int read_valid(fs_t *fs, unsigned int seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&fs->rename_seq, __ATOMIC_RELAXED) == seq;
+}
+
+enum { LOCK_READ, LOCK_WRITE };
+
+// Diretório que uma operação mantém travado (node NULL = nenhum)
+typedef struct {
+    Node *node;
+    int mode;
+} Held;
+
+static void node_lock(fs_t *fs, Node* node, int mode) {
+    if (!fs->threads || !node) return;
+    if (mode == LOCK_WRITE) dirlock_write(&node->lock);
+    else dirlock_read(&node->lock);
+}
+
+static void node_unlock(fs_t *fs, Node* node, int mode) {
+    if (!fs->threads || !node) return;
+    if (mode == LOCK_WRITE) dirlock_unlock_write(&node->lock);
+    else dirlock_unlock_read(&node->lock);
+}
+
+static void release(fs_t *fs, Held* held) {
+    node_unlock(fs, held->node, held->mode);
+    held->node = NULL;
+}
+
+// Diretório de trabalho da thread: o da sessão associada a ela ou, sem
+// sessão (e sempre fora do modo concorrente), current_dir
+static Node** cwd_slot(fs_t *fs) {
+    if (fs->threads) {
+        FsSession *s = (FsSession*)pthread_getspecific(session_key);
+        if (s && s->fs == fs) return &s->cwd;
+    }
+    return &fs->current_dir;
+}
+
+static Node* get_cwd(fs_t *fs) {
+    if (!fs->threads) return fs->current_dir;
+    pthread_mutex_lock(&fs->sessions_mutex);
+    Node *dir = *cwd_slot(fs);
+    pthread_mutex_unlock(&fs->sessions_mutex);
+    return dir ? dir : fs->root;
+}
+
+// O valor é publicado com store atômico para as buscas sem travas, que o
+// leem sem o mutex das sessões
+static void set_cwd(fs_t *fs, Node* dir) {
+    if (fs->threads) pthread_mutex_lock(&fs->sessions_mutex);
+    __atomic_store_n(cwd_slot(fs), dir, __ATOMIC_RELEASE);
+    if (fs->threads) pthread_mutex_unlock(&fs->sessions_mutex);
+}
+
+// Um diretório que vai ser removido deixa de ser o diretório de trabalho de
+// qualquer sessão; quem estava nele passa para dest (chamado com o
+// diretório travado para escrita, então ninguém está partindo dele)
+static void move_sessions(fs_t *fs, Node* dir, Node* dest) {
+    if (fs->threads) pthread_mutex_lock(&fs->sessions_mutex);
+    if (fs->current_dir == dir) __atomic_store_n(&fs->current_dir, dest, __ATOMIC_RELEASE);
+    for (FsSession *s = fs->sessions; s; s = s->next) {
+        if (s->cwd == dir) __atomic_store_n(&s->cwd, dest, __ATOMIC_RELEASE);
+    }
+    if (fs->threads) pthread_mutex_unlock(&fs->sessions_mutex);
+}
+
+static void move_sessions_out(fs_t *fs, Node* dir) {
+    move_sessions(fs, dir, dir->parent);
+}
+
+// Trava o diretório de trabalho da thread. Um rm pode estar trocando esse
+// diretório pelo pai (move_sessions_out) enquanto o segura para escrita,
+// então aqui só se tenta travar com o mutex das sessões seguro e, se não
+// der, tenta-se de novo com o valor atualizado
+static Node* lock_cwd(fs_t *fs, int mode) {
+    for (;;) {
+        pthread_mutex_lock(&fs->sessions_mutex);
+        Node *dir = *cwd_slot(fs);
+        if (!dir) dir = fs->root;
+        int locked = mode == LOCK_WRITE ? dirlock_try_write(&dir->lock)
+                                        : dirlock_try_read(&dir->lock);
+        pthread_mutex_unlock(&fs->sessions_mutex);
+        if (locked) return dir;
+        dirlock_pause();
+    }
+}
 
 
 // --- Funções Auxiliares de Manipulação da Árvore ---
 
-// Encontra um nó em um diretório específico pelo nome
+// Encontra um nó em um diretório específico pelo nome (com tamanho explícito)
 // Começa verificando se o diretório é válido e, caso for,
-// começa a processar os filhos do diretório
-static Node* find_node_in_dir(Node* dir, const char* name) {
+// consulta o índice hash do diretório (se existir) ou percorre os filhos
+// comparando primeiro o hash em cache e só depois o nome
+// Os ponteiros são lidos como os escritores os publicam (com loads
+// atômicos), então a busca também serve às leituras sem travas
+static Node* find_node_in_dir(fs_t *fs, Node* dir, const char* name, size_t len) {
     if (!dir || dir->type != DIR_NODE) return NULL;
-    Node* current = dir->child;
+    load_children(fs, dir);
+    unsigned int hash = dirindex_hash(name, len);
+    DirIndex *index = __atomic_load_n(&dir->index, __ATOMIC_ACQUIRE);
+    if (index) return dirindex_find(index, name, len, hash);
+
+    Node* current = __atomic_load_n(&dir->child, __ATOMIC_ACQUIRE);
+    unsigned int scanned = 0;
     while (current != NULL) {
-        if (strcmp(current->name, name) == 0) {
-            return current;
+        scanned++;
+        if (__atomic_load_n(&current->name_hash, __ATOMIC_RELAXED) == hash &&
+            names_equal(__atomic_load_n(&current->name, __ATOMIC_ACQUIRE), name, len, hash)) {
+            break;
         }
-        current = current->next;
+        current = __atomic_load_n(&current->next, __ATOMIC_ACQUIRE);
     }
-    return NULL;
+    METRICS_SAMPLE(METRIC_SIBLING_SCAN, scanned);
+    return current;
 }
 
-// Encontra um nó pelo caminho completo
-static Node* find_node_by_path(const char *path) {
-    if (path == NULL || strlen(path) == 0) return current_dir;
-    if (strcmp(path, "/") == 0) return root;
+// Define o nome de um nó a partir da tabela de nomes internados,
+// soltando a referência ao nome anterior, e atualiza hash e tamanho
+static void set_node_name(fs_t *fs, Node* node, const char* name, size_t len) {
+    unsigned int hash = dirindex_hash(name, len);
+    const char *interned = names_intern(&fs->names, name, len, hash);
+    nameindex_unlink(&fs->name_index, node);
+    names_release(&fs->names, node->name);
+    __atomic_store_n(&node->name_hash, hash, __ATOMIC_RELAXED);
+    __atomic_store_n(&node->name_len, (unsigned int)len, __ATOMIC_RELAXED);
+    __atomic_store_n(&node->name, interned, __ATOMIC_RELEASE);
+    nameindex_link(&fs->name_index, node);
+}
 
-    char *path_copy = strdup(path);
-    if (!path_copy) return NULL;
-    
-    Node *start_node = (path[0] == '/') ? root : current_dir;
-    Node *current_node = start_node;
+// Cria o índice hash de um diretório cujos filhos foram ligados
+// diretamente na lista (cópia e carga), se ele passou do limite
+// O índice pode ser montado com o alocador local de um worker (cp
+// paralelo); depois de pronto, ele passa a usar o da árvore
+static void index_children_in(fs_t *fs, Node* dir, FsAllocator* alloc) {
+    if (dir->index || dir->child_count <= DIRINDEX_THRESHOLD) return;
+    DirIndex *index = dirindex_create(alloc, dir->child_count);
+    for (Node* c = dir->child; c; c = c->next) dirindex_insert(index, c);
+    dirindex_adopt(index, &fs->alloc);
+    // Publicado já completo: quem acha o índice não volta para a lista
+    __atomic_store_n(&dir->index, index, __ATOMIC_RELEASE);
+}
+
+static void index_children(fs_t *fs, Node* dir) {
+    index_children_in(fs, dir, &fs->alloc);
+}
+
+// Conteúdo de um arquivo da imagem, apontando para os bytes mapeados.
+// Num quadro (image.h), cada chunk aponta para os seus bytes guardados,
+// que só são descomprimidos na leitura
+static FileContent* map_file(FsAllocator *a, const Image *img, const ImageNode *rec) {
+    const char *data = image_data(img, rec);
+    if (!(rec->flags & IMAGE_NODE_FRAMED)) return content_map(a, data, rec->size);
+    FileContent *c = content_map_chunks(a, rec->size);
+    size_t n = content_chunk_count(c);
+    const char *stored = data + IMAGE_FRAME_HEAD(n);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t entry;
+        memcpy(&entry, data + IMAGE_FRAME_HEAD(i), sizeof(entry));
+        content_map_chunk(a, c, i, stored, IMAGE_FRAME_STORED(entry), IMAGE_FRAME_CODEC(entry));
+        stored += IMAGE_FRAME_STORED(entry);
+    }
+    return c;
+}
 
-    char *token = strtok(path_copy, "/");
-    while (token != NULL && current_node != NULL) {
-        if (strcmp(token, "..") == 0) {
-            current_node = current_node->parent ? current_node->parent : root;
-        } else if (strcmp(token, ".") != 0) {
-            current_node = find_node_in_dir(current_node, token);
+// Totais de um diretório da imagem, que ainda pode nem ter os filhos em memória
+static void map_totals(const Image *img, uint64_t id, Node *dir) {
+    ImageTotals t;
+    image_totals(img, id, &t);
+    dir->totals.bytes = t.bytes;
+    dir->totals.files = (unsigned int)t.files;
+    dir->totals.dirs = (unsigned int)t.dirs;
+}
+
+// Cria em memória os filhos de um diretório vindo da imagem mapeada.
+// Os arquivos apontam para os bytes da imagem (content_map) e os
+// subdiretórios com filhos ficam, por sua vez, para o primeiro acesso
+static void read_image_children(fs_t *fs, Node* dir) {
+    uint64_t id;
+    if (!fs->image || !image_take(fs->image, dir, &id)) return;
+
+    const ImageNode *rec = image_node(fs->image, id);
+    if (!rec) {
+        fprintf(stderr, "load: corrupt image record %llu\n", (unsigned long long)id);
+        return;
+    }
+    Node *prev_child = NULL;
+    unsigned int count = 0;
+    for (uint64_t i = 0; i < rec->size; i++) {
+        const ImageNode *c = image_node(fs->image, rec->first + i);
+        if (!c) {
+            fprintf(stderr, "load: corrupt image record %llu\n", (unsigned long long)(rec->first + i));
+            break;
+        }
+        Node *child = alloc_node(&fs->alloc);
+        set_node_name(fs, child, image_name(fs->image, c), c->name_len);
+        child->type = (unsigned char)c->type;
+        child->parent = dir;
+        if (c->type == FILE_NODE) {
+            if (c->size > 0) child->content = map_file(&fs->alloc, fs->image, c);
+        } else if (c->size > 0) {
+            child->flags |= NODE_LAZY;
+            child->child_count = (unsigned int)c->size;
+            map_totals(fs->image, rec->first + i, child);
+            image_bind(fs->image, child, rec->first + i);
         }
-        token = strtok(NULL, "/");
+        if (prev_child) prev_child->next = child;
+        else dir->child = child;
+        child->prev = prev_child;
+        prev_child = child;
+        count++;
+    }
+    dir->child_count = count;
+    dir->last_child = prev_child;
+    index_children(fs, dir);
+}
+
+// No modo concorrente, vários leitores do mesmo diretório podem chegar
+// aqui juntos: a carga é feita sob o mutex da árvore e a marca só sai
+// (com release) depois que a lista de filhos está completa
+static void load_children(fs_t *fs, Node* dir) {
+    if (!(__atomic_load_n(&dir->flags, __ATOMIC_ACQUIRE) & NODE_LAZY)) return;
+    tree_enter(fs);
+    if (dir->flags & NODE_LAZY) {
+        read_image_children(fs, dir);
+        __atomic_store_n(&dir->flags, (unsigned char)(dir->flags & ~NODE_LAZY), __ATOMIC_RELEASE);
     }
+    tree_leave(fs);
+}
 
-    free(path_copy);
+// Percorre os componentes de path[0..len) a partir de start, direto sobre
+// a string (sem cópia e sem strtok). Barras repetidas são ignoradas, "."
+// fica no lugar e ".." sobe para o pai (a raiz é pai de si mesma)
+static Node* walk_path(fs_t *fs, Node* start, const char* path, size_t len) {
+    Node *current_node = start;
+    size_t i = 0;
+    unsigned int walked = 0;
+    while (current_node != NULL) {
+        while (i < len && path[i] == '/') i++;
+        if (i == len) break;
+        size_t begin = i;
+        while (i < len && path[i] != '/') i++;
+        size_t n = i - begin;
+        if (n == 2 && path[begin] == '.' && path[begin + 1] == '.') {
+            Node *parent = __atomic_load_n(&current_node->parent, __ATOMIC_ACQUIRE);
+            current_node = parent ? parent : fs->root;
+            walked++;
+        } else if (n != 1 || path[begin] != '.') {
+            current_node = find_node_in_dir(fs, current_node, path + begin, n);
+            walked++;
+        }
+    }
+    METRICS_SAMPLE(METRIC_PATH_WALK, walked);
     return current_node;
 }
 
-// Obtém o diretório pai e o nome base de um caminho
-// Converte o caminho de char* para wchar_t* para manipulação
-// e retorna o diretório pai
-// O nome base é retornado no buffer out_basename   
+// Indica se algum componente do trecho é ".." (memchr salta direto para
+// cada '.', que é raro em caminhos de diretórios)
+static int has_dotdot(const char* path, size_t len) {
+    const char *end = path + len;
+    for (const char *p = (const char*)memchr(path, '.', len); p && p + 1 < end;
+         p = (const char*)memchr(p + 1, '.', (size_t)(end - p - 1))) {
+        if (p[1] == '.' && (p == path || p[-1] == '/') && (p + 2 == end || p[2] == '/')) return 1;
+    }
+    return 0;
+}
+
+// Um trecho de até DCACHE_KEY_MAX bytes: do cache ou, numa falta, da
+// árvore. Só diretórios e resultados inexistentes entram no cache; um
+// trecho que termina em arquivo é resolvido sem cache
+static Node* resolve_cached(fs_t *fs, Node* start, const char* path, size_t len) {
+    Node *node;
+    if (dcache_lookup(&fs->dcache, start, path, len, &node)) return node;
+    node = walk_path(fs, start, path, len);
+    if (!node || node->type == DIR_NODE) dcache_insert(&fs->dcache, start, path, len, node);
+    return node;
+}
+
+// Resolve o trecho de diretórios de um caminho, consultando o cache antes
+// de percorrer a árvore. Um trecho maior que DCACHE_KEY_MAX (os caminhos
+// profundos) é cortado em barras em pedaços que cabem numa entrada: cada
+// pedaço parte do diretório a que o anterior levou, então um caminho longo
+// custa algumas consultas ao cache, e não uma busca por nível
+static Node* resolve_dir(fs_t *fs, Node* start, const char* path, size_t len) {
+    size_t i = 0;
+    while (i < len && path[i] == '/') i++;
+    if (i == len) return start; // "" ou "/"
+    if (has_dotdot(path, len)) {
+        dcache_note_uncached(&fs->dcache);
+        return walk_path(fs, start, path, len);
+    }
+
+    Node *node = start;
+    while (len > DCACHE_KEY_MAX) {
+        size_t cut = DCACHE_KEY_MAX;
+        while (cut > 0 && path[cut] != '/') cut--;
+        if (cut == 0) {
+            // Um nome maior que uma entrada inteira
+            dcache_note_uncached(&fs->dcache);
+            return walk_path(fs, node, path, len);
+        }
+        node = resolve_cached(fs, node, path, cut);
+        if (!node || node->type != DIR_NODE) return NULL; // Não há nada abaixo de um arquivo
+        while (cut < len && path[cut] == '/') cut++;
+        path += cut;
+        len -= cut;
+    }
+    return len ? resolve_cached(fs, node, path, len) : node;
+}
+
+// Encontra um nó pelo caminho completo: os diretórios do caminho vêm do
+// cache e o último componente é buscado no diretório resultante
+static Node* find_node_by_path(fs_t *fs, const char *path) {
+    if (path == NULL || path[0] == '\0') return fs->current_dir;
+
+    size_t end = strlen(path);
+    while (end > 1 && path[end - 1] == '/') end--;
+    size_t start = end;
+    while (start > 0 && path[start - 1] != '/') start--;
+
+    size_t dir_len = start;
+    while (dir_len > 1 && path[dir_len - 1] == '/') dir_len--;
+    Node *dir = resolve_dir(fs, path[0] == '/' ? fs->root : fs->current_dir, path, dir_len);
+    return walk_path(fs, dir, path + start, end - start);
+}
+
+// Obtém o diretório pai e o nome base de um caminho, com a mesma
+// semântica de dirname()/basename(): barras finais são ignoradas
+// O nome base é retornado como um trecho do próprio caminho
+// (out_name/out_len), sem cópia e sem limite de tamanho
 // Se o caminho não contiver barras, assume que é um nome no diretório atual
 // Se o caminho começar com uma barra, assume que é relativo à raiz 
-// Se o caminho contiver barras, divide o caminho e busca o diretório pai
-// e o nome base
-static Node* get_parent_dir_and_basename(const char* path, char* out_basename) {
-    char* path_copy1 = strdup(path);
-    char* path_copy2 = strdup(path);
-    if (!path_copy1 || !path_copy2) {
-        if(path_copy1) free(path_copy1);
-        if(path_copy2) free(path_copy2);
-        return NULL;
+// Se o caminho contiver barras, o diretório pai é resolvido pelo cache
+static Node* get_parent_dir_and_basename(fs_t *fs, const char* path, const char** out_name, size_t* out_len) {
+    size_t end = strlen(path);
+    while (end > 1 && path[end - 1] == '/') end--;
+    if (end == 0) {
+        *out_name = ".";
+        *out_len = 1;
+        return fs->current_dir;
+    }
+    if (end == 1 && path[0] == '/') {
+        *out_name = "/";
+        *out_len = 1;
+        return fs->root;
     }
 
-    char* bname = basename(path_copy1);
-    char* dname = dirname(path_copy2);
-    
-    strcpy(out_basename, bname);
-    Node* parent_dir = find_node_by_path(dname);
+    size_t start = end;
+    while (start > 0 && path[start - 1] != '/') start--;
+    *out_name = path + start;
+    *out_len = end - start;
+    if (start == 0) return fs->current_dir;
+
+    size_t dir_len = start;
+    while (dir_len > 1 && path[dir_len - 1] == '/') dir_len--;
+    return resolve_dir(fs, path[0] == '/' ? fs->root : fs->current_dir, path, dir_len);
+}
+
+// Caminho absoluto de um nó, montado subindo pelos pais (como no pwd).
+// Caminhos curtos ficam no próprio PathBuf; os longos vão para o heap
+typedef struct {
+    char *str;
+    size_t len;
+    char stack[256];
+} PathBuf;
+
+static void path_of(fs_t *fs, Node* node, PathBuf* p) {
+    p->len = 0;
+    for (Node *n = node; n && n != fs->root; n = n->parent) p->len += n->name_len + 1;
+    if (p->len == 0) p->len = 1; // A própria raiz
+    p->str = p->len < sizeof(p->stack) ? p->stack : (char*)malloc(p->len + 1);
+    if (!p->str) { perror("Failed to allocate path"); exit(1); }
+    p->str[0] = '/';
+    p->str[p->len] = '\0';
+    size_t pos = p->len;
+    for (Node *n = node; n && n != fs->root; n = n->parent) {
+        pos -= n->name_len;
+        memcpy(p->str + pos, n->name, n->name_len);
+        p->str[--pos] = '/';
+    }
+}
+
+static void path_free(PathBuf* p) {
+    if (p->str != p->stack) free(p->str);
+}
+
+// Início do último componente de path[0..len) que não é ".", ou len se
+// não houver nenhum (o caminho leva ao próprio ponto de partida)
+static size_t last_component(const char* path, size_t len) {
+    size_t end = len;
+    for (;;) {
+        while (end > 0 && path[end - 1] == '/') end--;
+        if (end == 0) return len;
+        size_t begin = end;
+        while (begin > 0 && path[begin - 1] != '/') begin--;
+        if (end - begin != 1 || path[begin] != '.') return begin;
+        end = begin;
+    }
+}
+
+// walk_path do modo concorrente, com lock coupling: o próximo diretório é
+// travado (para leitura) antes de soltar o atual, e o último componente é
+// travado em mode. Um arquivo não tem trava própria: enquanto a posição é
+// um arquivo, quem fica travado é o diretório dele (no modo em que já
+// estava, o suficiente para examiná-lo).
+// ".." sobe na árvore, o que não dá para fazer segurando o filho sem
+// inverter a ordem das travas: o filho é solto antes de travar o pai, sob o
+// mutex de renomeação, com o qual nenhum diretório some ou muda de lugar
+static Node* walk_locked(fs_t *fs, int absolute, const char* path, size_t len, int mode, Held* held) {
+    size_t last = last_component(path, len);
+    int dotdot = has_dotdot(path, len);
+    if (dotdot) rename_enter(fs);
+
+    int locked_mode = last == len ? mode : LOCK_READ;
+    Node *locked;
+    if (absolute) {
+        locked = fs->root;
+        node_lock(fs, locked, locked_mode);
+    } else {
+        locked = lock_cwd(fs, locked_mode);
+    }
+
+    Node *cur = locked;
+    size_t i = 0;
+    unsigned int walked = 0;
+    for (;;) {
+        while (i < len && path[i] == '/') i++;
+        if (i == len) break;
+        size_t begin = i;
+        while (i < len && path[i] != '/') i++;
+        size_t n = i - begin;
+        if (n == 1 && path[begin] == '.') continue;
+        walked++;
+
+        int up = n == 2 && path[begin] == '.' && path[begin + 1] == '.';
+        Node *next = up ? (cur->parent ? cur->parent : fs->root)
+                        : find_node_in_dir(fs, cur, path + begin, n);
+        if (!next) {
+            node_unlock(fs, locked, locked_mode);
+            cur = NULL;
+            break;
+        }
+        cur = next;
+        if (next->type != DIR_NODE) continue;
+
+        int next_mode = begin == last ? mode : LOCK_READ;
+        if (next == locked) {
+            // ".." da raiz ou de um arquivo: o mesmo diretório, talvez em outro modo
+            if (next_mode == locked_mode) continue;
+            node_unlock(fs, locked, locked_mode);
+            node_lock(fs, next, next_mode);
+        } else if (up) {
+            node_unlock(fs, locked, locked_mode);
+            node_lock(fs, next, next_mode);
+        } else {
+            node_lock(fs, next, next_mode);
+            node_unlock(fs, locked, locked_mode);
+        }
+        locked = next;
+        locked_mode = next_mode;
+    }
+    if (cur) {
+        held->node = locked;
+        held->mode = locked_mode;
+    }
+    if (dotdot) rename_leave(fs);
+    METRICS_SAMPLE(METRIC_PATH_WALK, walked);
+    return cur;
+}
+
+// find_node_by_path com o resultado travado (ver walk_locked); fora do
+// modo concorrente é a própria find_node_by_path, com o cache de caminhos
+static Node* lock_path(fs_t *fs, const char* path, int mode, Held* held) {
+    held->node = NULL;
+    if (!fs->threads) return find_node_by_path(fs, path);
+    if (path == NULL || path[0] == '\0') {
+        held->node = lock_cwd(fs, mode);
+        held->mode = mode;
+        return held->node;
+    }
+    size_t end = strlen(path);
+    while (end > 1 && path[end - 1] == '/') end--;
+    return walk_locked(fs, path[0] == '/', path, end, mode, held);
+}
+
+// get_parent_dir_and_basename com o pai travado em mode
+static Node* lock_parent(fs_t *fs, const char* path, const char** out_name, size_t* out_len,
+                         int mode, Held* held) {
+    held->node = NULL;
+    if (!fs->threads) return get_parent_dir_and_basename(fs, path, out_name, out_len);
+    size_t end = strlen(path);
+    while (end > 1 && path[end - 1] == '/') end--;
+    if (end == 0 || (end == 1 && path[0] == '/')) {
+        *out_name = end == 0 ? "." : "/";
+        *out_len = 1;
+        held->node = end == 0 ? lock_cwd(fs, mode) : fs->root;
+        if (end != 0) node_lock(fs, fs->root, mode);
+        held->mode = mode;
+        return held->node;
+    }
+
+    size_t start = end;
+    while (start > 0 && path[start - 1] != '/') start--;
+    *out_name = path + start;
+    *out_len = end - start;
+    if (start == 0) {
+        held->node = lock_cwd(fs, mode);
+        held->mode = mode;
+        return held->node;
+    }
+    size_t dir_len = start;
+    while (dir_len > 1 && path[dir_len - 1] == '/') dir_len--;
+    return walk_locked(fs, path[0] == '/', path, dir_len, mode, held);
+}
+
+// Busca sem travas (leituras do modo concorrente, dentro de uma seção de
+// leitura): o mesmo percurso de walk_path, sem o cache de caminhos, a
+// partir da raiz ou do diretório de trabalho da sessão
+static Node* rcu_find(fs_t *fs, const char* path) {
+    Node *start = fs->root;
+    if (path == NULL || path[0] != '/') {
+        Node *cwd = __atomic_load_n(cwd_slot(fs), __ATOMIC_ACQUIRE);
+        if (cwd) start = cwd;
+    }
+    if (path == NULL || path[0] == '\0') return start;
+    size_t end = strlen(path);
+    while (end > 1 && path[end - 1] == '/') end--;
+    return walk_path(fs, start, path, end);
+}
+
+// Saída montada em memória: uma listagem sem travas que cruzou um mv pode
+// estar incompleta, e só é impressa depois de conferida. Com file, a saída
+// vai direto para ele (leituras com travas, que não precisam ser refeitas)
+typedef struct {
+    FILE *file;
+    char *str;
+    size_t len;
+    size_t cap;
+} OutBuf;
+
+static void out_printf(OutBuf* out, const char* fmt, ...) {
+    va_list ap;
+    if (out->file) {
+        va_start(ap, fmt);
+        vfprintf(out->file, fmt, ap);
+        va_end(ap);
+        return;
+    }
+    for (;;) {
+        va_start(ap, fmt);
+        int n = vsnprintf(out->str ? out->str + out->len : NULL, out->cap - out->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if (out->len + (size_t)n < out->cap) {
+            out->len += (size_t)n;
+            return;
+        }
+        size_t cap = out->cap ? out->cap * 2 : 4096;
+        while (cap <= out->len + (size_t)n) cap *= 2;
+        char *grown = (char*)realloc(out->str, cap);
+        if (!grown) { perror("Failed to allocate output"); exit(1); }
+        out->str = grown;
+        out->cap = cap;
+    }
+}
+
+// Copia até len bytes do conteúdo a partir de offset; retorna quantos.
+// Só os chunks tocados são descomprimidos: direto em buf quando o trecho
+// cobre o chunk inteiro, ou num buffer temporário
+static size_t read_content(const FileContent* content, size_t offset, void* buf, size_t len) {
+    size_t size = content_size(content);
+    if (offset >= size) return 0;
+    if (len > size - offset) len = size - offset;
+    size_t done = 0;
+    char *scratch = NULL;
+    for (size_t i = offset / CHUNK_SIZE; done < len; i++) {
+        size_t chunk_len = size - i * CHUNK_SIZE < CHUNK_SIZE ? size - i * CHUNK_SIZE : CHUNK_SIZE;
+        size_t skip = (offset + done) - i * CHUNK_SIZE;
+        size_t n = chunk_len - skip < len - done ? chunk_len - skip : len - done;
+        char *dst = (char*)buf + done;
+        size_t stored;
+        unsigned int codec;
+        char *into = NULL;
+        content_chunk_stored(content, i, &stored, &codec);
+        if (codec && n == chunk_len) {
+            into = dst;
+        } else if (codec) {
+            if (!scratch) scratch = (char*)malloc(CHUNK_SIZE);
+            if (!scratch) { perror("Failed to allocate buffer"); exit(1); }
+            into = scratch;
+        }
+        const char *data = content_chunk(content, i, &chunk_len, into);
+        if (data != dst) memcpy(dst, data + skip, n);
+        done += n;
+    }
+    free(scratch);
+    return done;
+}
+
+// Parte de um nó nos totais do pai: um arquivo com o seu tamanho, ou um
+// diretório com os seus totais e ele mesmo
+static NodeTotals node_share(const Node* node) {
+    NodeTotals share = { 0, 0, 0 };
+    if (node->type == FILE_NODE) {
+        share.bytes = content_size(node->content);
+        share.files = 1;
+    } else {
+        share = node->totals;
+        share.dirs++;
+    }
+    return share;
+}
 
-    free(path_copy1);
-    free(path_copy2);
-    return parent_dir;
+// Soma bytes, files e dirs nos totais de dir e de todos os ancestrais
+// (com o mutex da árvore seguro). Para subtrair, os valores vêm negados:
+// a conta sem sinal dá a volta e chega ao mesmo resultado. As leituras sem
+// travas (ls -l) podem ver um diretório no meio da subida, nunca um valor
+// pela metade
+static void add_totals(Node* dir, uint64_t bytes, unsigned int files, unsigned int dirs) {
+    for (; dir; dir = dir->parent) {
+        __atomic_store_n(&dir->totals.bytes, dir->totals.bytes + bytes, __ATOMIC_RELAXED);
+        __atomic_store_n(&dir->totals.files, dir->totals.files + files, __ATOMIC_RELAXED);
+        __atomic_store_n(&dir->totals.dirs, dir->totals.dirs + dirs, __ATOMIC_RELAXED);
+    }
+}
+
+// Cria um nó vazio e o anexa a parent (travado para escrita, com o mutex
+// da árvore seguro)
+static Node* new_child(fs_t *fs, Node* parent, const char* name, size_t len, NodeType type) {
+    Node* node = alloc_node(&fs->alloc);
+    set_node_name(fs, node, name, len);
+    node->type = type;
+    attach_node(fs, parent, node);
+    return node;
 }
 
 
 // --- Inicialização e Destruição ---
 
 // Função de inicialização do sistema de arquivos (cria o nó raiz, como um diretório)
-void fs_init() {
-    root = (Node*)malloc(sizeof(Node));
-    if (!root) { perror("Failed to allocate root"); exit(1); }
-    strcpy(root->name, "/");
-    root->type = DIR_NODE;
-    root->parent = NULL;
-    root->child = NULL;
-    root->next = NULL;
-    root->content = NULL;
-    current_dir = root;
+void fs_init(fs_t *fs) {
+    fs->root = alloc_node(&fs->alloc);
+    set_node_name(fs, fs->root, "/", 1);
+    fs->root->type = DIR_NODE;
+    fs->root->parent = NULL;
+    fs->root->child = NULL;
+    fs->root->last_child = NULL;
+    fs->root->next = NULL;
+    fs->root->prev = NULL;
+    fs->root->content = NULL;
+    fs->root->child_count = 0;
+    fs->root->index = NULL;
+    fs->current_dir = fs->root;
+    fs->lsn = 0; // Árvore nova: nenhum registro do journal aplicado
+    dcache_invalidate(&fs->dcache);
 }
 
-// Função de destruição do sistema de arquivos (libera memória alocada)
-// Libera recursivamente todos os nós, incluindo conteúdo de arquivos
-void fs_destroy(Node *node) {
-    if (node == NULL) return;
-    fs_destroy(node->child);
-    fs_destroy(node->next);
-    if (node->type == FILE_NODE && node->content != NULL) {
-        free(node->content);
+fs_t* fs_create(void) {
+    fs_t *fs = (fs_t*)calloc(1, sizeof(fs_t));
+    if (!fs) { perror("Failed to allocate file system"); exit(1); }
+    fs->names.alloc = &fs->alloc;
+    pthread_once(&session_once, create_session_key); // cwd_slot consulta a chave
+    init_locks(fs);
+    fs_init(fs);
+    return fs;
+}
+
+// As sessões que ainda estiverem abertas são fechadas junto
+void fs_free(fs_t *fs) {
+    if (!fs) return;
+    fs_shutdown(fs);
+    fs_destroy(fs);
+    while (fs->sessions) {
+        FsSession *next = fs->sessions->next;
+        free(fs->sessions);
+        fs->sessions = next;
+    }
+    pthread_mutex_destroy(&fs->tree_mutex);
+    pthread_mutex_destroy(&fs->rename_mutex);
+    pthread_mutex_destroy(&fs->sessions_mutex);
+    pthread_mutex_destroy(&fs->names_mutex);
+    free(fs->compression.scratch);
+    free(fs);
+}
+
+Node* fs_root(fs_t *fs) {
+    return fs->root;
+}
+
+Node* fs_cwd(fs_t *fs) {
+    return get_cwd(fs);
+}
+
+// Libera um único nó (sem filhos e irmãos), com seu conteúdo e índice
+static void free_node(fs_t *fs, Node* node) {
+    if (node->flags & NODE_LAZY) image_take(fs->image, node, NULL);
+    if (node->type == FILE_NODE) content_free(&fs->alloc, node->content);
+    dirindex_destroy(node->index);
+    nameindex_unlink(&fs->name_index, node);
+    names_release(&fs->names, node->name);
+    alloc_free_node(&fs->alloc, node);
+}
+
+// --- Cópia e Remoção de Subárvores (em paralelo) ---
+
+// Estado de um worker em cp, rm -r e fs_preload. O worker 0 é a thread
+// que chamou, com o mutex da árvore seguro, e usa o alocador da árvore
+// direto; os outros usam um alocador local, incorporado ao da árvore no
+// fim. Os nomes que perdem a última referência também só saem da tabela no
+// fim, por uma thread só. Diretórios ainda não carregados da imagem mexem
+// na imagem e na tabela de nomes, então viram tarefas fixas do worker 0
+typedef struct {
+    const char *image_name; // Nome no pool da imagem
+    const char *interned;
+} NameCacheEntry;
+
+#define NAME_CACHE_SIZE 4096   // Potência de 2
+
+typedef struct {
+    FsAllocator *alloc;
+    FsAllocator local;
+    const char **dead_names;
+    size_t dead_count;
+    size_t dead_cap;
+    NameCacheEntry *name_cache; // Só em fs_preload, criado no primeiro uso
+} TreeWorker;
+
+typedef struct {
+    fs_t *fs;
+    TreeWorker workers[TASKPOOL_MAX_WORKERS];
+} SubtreeOp;
+
+static int subtree_workers(fs_t *fs) {
+    return fs->workers > 0 ? fs->workers : taskpool_default_workers();
+}
+
+static SubtreeOp* subtree_begin(fs_t *fs) {
+    SubtreeOp *op = (SubtreeOp*)calloc(1, sizeof(SubtreeOp));
+    if (!op) { perror("Failed to allocate subtree operation"); exit(1); }
+    op->fs = fs;
+    op->workers[0].alloc = &fs->alloc;
+    for (int i = 1; i < TASKPOOL_MAX_WORKERS; i++) {
+        alloc_init_local(&op->workers[i].local, &fs->alloc);
+        op->workers[i].alloc = &op->workers[i].local;
+    }
+    return op;
+}
+
+// Incorpora os alocadores locais e tira da tabela os nomes sem referências
+// (com o mutex da árvore seguro)
+static void subtree_end(SubtreeOp* op) {
+    fs_t *fs = op->fs;
+    for (int i = 0; i < TASKPOOL_MAX_WORKERS; i++) {
+        TreeWorker *w = &op->workers[i];
+        if (i > 0) alloc_merge(&fs->alloc, &w->local);
+        for (size_t j = 0; j < w->dead_count; j++) names_remove(&fs->names, w->dead_names[j]);
+        free(w->dead_names);
+        free(w->name_cache);
+    }
+    free(op);
+}
+
+static void push_subtree(TaskPool* pool, int worker, Node* node, Node* copy) {
+    Task task = { node, copy };
+    if (node->flags & NODE_LAZY) taskpool_push_pinned(pool, task);
+    else taskpool_push(pool, worker, task);
+}
+
+// Diretório com filhos (em memória ou ainda na imagem)
+static int has_children(Node* node) {
+    return node->type == DIR_NODE && (node->child || (node->flags & NODE_LAZY));
+}
+
+// Próximo nó em pré-ordem dentro da subárvore de top (NULL no fim)
+static Node* next_in_subtree(Node *top, Node *n) {
+    if (n->child) return n->child;
+    while (n != top && !n->next) n = n->parent;
+    return n == top ? NULL : n->next;
+}
+
+// Cópia de um único nó (sem filhos), no alocador do worker
+static Node* clone_node(TreeWorker* w, Node* source, Node* parent) {
+    Node *copy = alloc_node(w->alloc);
+    copy->name = names_retain_shared(source->name);
+    copy->name_hash = source->name_hash;
+    copy->name_len = source->name_len;
+    copy->type = source->type;
+    copy->parent = parent;
+    copy->content = content_copy_shared(w->alloc, source->content);
+    copy->totals = source->totals; // A cópia vai ter a mesma subárvore
+    return copy;
+}
+
+// Copia os filhos de task.a para task.b e agenda os subdiretórios. A lista
+// de filhos é percorrida em laço e cada nível é uma tarefa, então nem a
+// profundidade nem a largura da árvore usam a pilha
+static size_t copy_task(TaskPool* pool, int worker, Task task, void* ctx) {
+    fs_t *fs = ((SubtreeOp*)ctx)->fs;
+    TreeWorker *w = &((SubtreeOp*)ctx)->workers[worker];
+    Node *source = (Node*)task.a, *copy = (Node*)task.b;
+    load_children(fs, source); // Só em tarefas fixas (worker 0)
+    Node *last = NULL;
+    unsigned int count = 0;
+    for (Node *c = source->child; c; c = c->next) {
+        Node *child = clone_node(w, c, copy);
+        child->prev = last;
+        if (last) last->next = child;
+        else copy->child = child;
+        last = child;
+        count++;
+        if (has_children(c)) push_subtree(pool, worker, c, child);
+    }
+    copy->last_child = last;
+    copy->child_count = count;
+    index_children_in(fs, copy, w->alloc);
+    return count + 1;
+}
+
+// Copia source e toda a subárvore abaixo dele, ainda fora da árvore (o
+// chamador dá o nome e anexa). O mutex da árvore fica seguro o tempo todo
+static Node* copy_subtree(fs_t *fs, Node* source, Node* new_parent) {
+    SubtreeOp *op = subtree_begin(fs);
+    Node *copy = clone_node(&op->workers[0], source, new_parent);
+    if (has_children(source)) {
+        Task first = { source, copy };
+        taskpool_run(subtree_workers(fs), copy_task, op, first);
+    }
+    subtree_end(op);
+    // Os workers não mexem no índice de nomes: a cópia entra nele depois
+    if (fs->name_index.active) {
+        for (Node *n = copy; n; n = next_in_subtree(copy, n)) nameindex_link(&fs->name_index, n);
+    }
+    return copy;
+}
+
+static void release_node(fs_t *fs, TreeWorker* w, Node* node) {
+    if (node->flags & NODE_LAZY) image_take(fs->image, node, NULL); // Só no worker 0
+    if (node->type == FILE_NODE) content_free_shared(w->alloc, node->content);
+    if (node->index) {
+        dirindex_adopt(node->index, w->alloc);
+        dirindex_destroy(node->index);
+    }
+    if (names_unref_shared(node->name)) {
+        if (w->dead_count == w->dead_cap) {
+            size_t cap = w->dead_cap ? w->dead_cap * 2 : 64;
+            const char **grown = (const char**)realloc((void*)w->dead_names, cap * sizeof(char*));
+            if (!grown) { perror("Failed to allocate name list"); exit(1); }
+            w->dead_names = grown;
+            w->dead_cap = cap;
+        }
+        w->dead_names[w->dead_count++] = node->name;
+    }
+    alloc_free_node(w->alloc, node);
+}
+
+// Libera os filhos de task.a (arquivos e diretórios vazios na hora, os
+// outros como novas tarefas) e depois o próprio task.a. O próximo irmão é
+// lido antes de liberar cada nó
+static size_t free_task(TaskPool* pool, int worker, Task task, void* ctx) {
+    fs_t *fs = ((SubtreeOp*)ctx)->fs;
+    TreeWorker *w = &((SubtreeOp*)ctx)->workers[worker];
+    Node *dir = (Node*)task.a;
+    size_t count = 1;
+    if (!(dir->flags & NODE_LAZY)) {
+        Node *c = dir->child;
+        while (c) {
+            Node *next = c->next;
+            if (has_children(c)) push_subtree(pool, worker, c, NULL);
+            else release_node(fs, w, c);
+            c = next;
+            count++;
+        }
+    }
+    release_node(fs, w, dir);
+    return count;
+}
+
+// Modo concorrente, antes de liberar: trava para escrita cada diretório da
+// subárvore (de cima para baixo, como as buscas), esperando quem ainda está
+// dentro dele, e tira dali as sessões. Nada aqui usa o mutex da árvore, que
+// quem está dentro pode precisar para terminar
+typedef struct {
+    fs_t *fs;
+    Node *dest;                // Para onde vão as sessões
+} LockSubtree;
+
+static size_t lock_task(TaskPool* pool, int worker, Task task, void* ctx) {
+    LockSubtree *op = (LockSubtree*)ctx;
+    Node *dir = (Node*)task.a;
+    dirlock_write(&dir->lock);
+    move_sessions(op->fs, dir, op->dest);
+    size_t count = 1;
+    for (Node *c = dir->child; c; c = c->next) {
+        if (c->type == DIR_NODE) {
+            Task t = { c, NULL };
+            taskpool_push(pool, worker, t);
+        }
+        count++;
+    }
+    return count;
+}
+
+// node é dir ou está abaixo dele
+static int is_inside(Node* node, Node* dir) {
+    for (; node; node = node->parent) {
+        if (node == dir) return 1;
+    }
+    return 0;
+}
+
+// Prepara a remoção da subárvore de dir: as sessões que estão dentro dela
+// passam para o pai de dir e, no modo concorrente, ninguém mais está lá
+// dentro quando ela retorna (com todos os diretórios travados)
+static void lock_subtree(fs_t *fs, Node* dir) {
+    if (fs->threads) {
+        LockSubtree op = { fs, dir->parent };
+        Task first = { dir, NULL };
+        taskpool_run(subtree_workers(fs), lock_task, &op, first);
+        return;
     }
-    free(node);
+    if (is_inside(fs->current_dir, dir)) fs->current_dir = dir->parent;
+    for (FsSession *s = fs->sessions; s; s = s->next) {
+        if (is_inside(s->cwd, dir)) s->cwd = dir->parent;
+    }
+}
+
+// Libera node e toda a subárvore abaixo dele, já desligados da árvore
+static void free_subtree(fs_t *fs, Node* node) {
+    if (fs->name_index.active) {
+        for (Node *n = node; n; n = next_in_subtree(node, n)) nameindex_unlink(&fs->name_index, n);
+    }
+    SubtreeOp *op = subtree_begin(fs);
+    Task first = { node, NULL };
+    taskpool_run(subtree_workers(fs), free_task, op, first);
+    subtree_end(op);
+}
+
+void fs_set_workers(fs_t *fs, int workers) {
+    fs->workers = workers;
+}
+
+// Função de destruição do sistema de arquivos (libera memória alocada)
+// A árvore inteira é liberada de uma vez pelo alocador (slabs e blocos)
+void fs_destroy(fs_t *fs) {
+    if (fs->root == NULL) return;
+    alloc_release_all(&fs->alloc);
+    names_reset(&fs->names, &fs->alloc);
+    // Os conteúdos mapeados foram liberados junto, então a imagem já
+    // pode ser desmapeada
+    image_close(fs->image);
+    fs->image = NULL;
+    fs->root = NULL;
+    fs->current_dir = NULL;
+    pthread_mutex_lock(&fs->sessions_mutex);
+    for (FsSession *s = fs->sessions; s; s = s->next) s->cwd = NULL;
+    pthread_mutex_unlock(&fs->sessions_mutex);
+    dcache_invalidate(&fs->dcache);
+    dcache_destroy(&fs->dcache);
+    dedup_reset(&fs->dedup);
+    nameindex_reset(&fs->name_index);
 }
 
 // --- Comandos do Sistema de Arquivos (API Pública) ---
 
+// Nomes que nenhum caminho alcança e que não podem ser dados a um nó novo:
+// "." e ".." são resolvidos antes de qualquer busca, "" vem de um caminho
+// vazio (get_parent_dir_and_basename o troca por ".") e "/" é a raiz
+static int reserved_name(const char *name, size_t len) {
+    return len == 0 || (len == 1 && (name[0] == '.' || name[0] == '/')) ||
+           (len == 2 && name[0] == '.' && name[1] == '.');
+}
+
 // Cria um novo diretório no caminho especificado
 // Verifica se o diretório pai existe e se é um diretório 
-void fs_mkdir(const char *path) {
-    char name[100];
-    Node *parent = get_parent_dir_and_basename(path, name);
+void fs_mkdir(fs_t *fs, const char *path) {
+    METRICS_START(t0);
+    const char *name;
+    size_t name_len;
+    Held held;
+    Node *parent = lock_parent(fs, path, &name, &name_len, LOCK_WRITE, &held);
 
     if (!parent) {
         fprintf(stderr, "mkdir: cannot create directory '%s': No such file or directory\n", path);
+        METRICS_END(METRIC_MKDIR, t0);
         return;
     }
-    if (find_node_in_dir(parent, name) != NULL) {
-        fprintf(stderr, "mkdir: cannot create directory '%s': File or directory exists\n", name);
-        return;
+    if (reserved_name(name, name_len)) {
+        fprintf(stderr, "mkdir: cannot create directory '%s': Invalid name\n", path);
+    } else if (find_node_in_dir(fs, parent, name, name_len) != NULL) {
+        fprintf(stderr, "mkdir: cannot create directory '%.*s': File or directory exists\n", (int)name_len, name);
+    } else if (parent->type == DIR_NODE) {
+        // attach_node recusa pais que são arquivos; não cria um nó solto
+        tree_enter(fs);
+        Node* new_dir = new_child(fs, parent, name, name_len, DIR_NODE);
+        journal_node(fs, J_MKDIR, new_dir, NULL, 0, 0);
+        tree_leave(fs);
     }
-
-    Node* new_dir = (Node*)malloc(sizeof(Node));
-    strcpy(new_dir->name, name);
-    new_dir->type = DIR_NODE;
-    new_dir->content = NULL;
-    new_dir->child = NULL;
-    attach_node(parent, new_dir);
+    release(fs, &held);
+    METRICS_END(METRIC_MKDIR, t0);
 }
 
 // Cria um novo arquivo no caminho especificado
 // Verifica se o diretório pai existe e se é um diretório
 // Também verifica se o arquivo já existe
-void fs_touch(const char *path) {
-    char name[100];
-    Node *parent = get_parent_dir_and_basename(path, name);
+void fs_touch(fs_t *fs, const char *path) {
+    METRICS_START(t0);
+    const char *name;
+    size_t name_len;
+    Held held;
+    Node *parent = lock_parent(fs, path, &name, &name_len, LOCK_WRITE, &held);
     if (!parent) {
         fprintf(stderr, "touch: cannot create file '%s': No such file or directory\n", path);
+        METRICS_END(METRIC_TOUCH, t0);
         return;
     }
-    if (find_node_in_dir(parent, name)) {
+    if (reserved_name(name, name_len)) {
+        fprintf(stderr, "touch: cannot create file '%s': Invalid name\n", path);
+    } else if (!find_node_in_dir(fs, parent, name, name_len) && parent->type == DIR_NODE) {
+        tree_enter(fs);
+        Node* new_file = new_child(fs, parent, name, name_len, FILE_NODE);
+        journal_node(fs, J_TOUCH, new_file, NULL, 0, 0);
+        tree_leave(fs);
+    }
+    release(fs, &held);
+    METRICS_END(METRIC_TOUCH, t0);
+}
+
+// Totais de um diretório, que podem estar sendo somados por uma escrita
+static NodeTotals load_totals(Node* dir) {
+    NodeTotals t;
+    t.bytes = __atomic_load_n(&dir->totals.bytes, __ATOMIC_RELAXED);
+    t.files = __atomic_load_n(&dir->totals.files, __ATOMIC_RELAXED);
+    t.dirs = __atomic_load_n(&dir->totals.dirs, __ATOMIC_RELAXED);
+    return t;
+}
+
+// Uma linha do ls -l: tipo, bytes (os totais, num diretório) e nome
+static void list_long(Node* node, const char* name, OutBuf* out) {
+    if (node->type == DIR_NODE) {
+        NodeTotals t = load_totals(node);
+        out_printf(out, "d %12llu  %s/  (%u files, %u dirs)\n", (unsigned long long)t.bytes, name,
+                   t.files, t.dirs);
+    } else {
+        size_t size = content_size(__atomic_load_n(&node->content, __ATOMIC_ACQUIRE));
+        out_printf(out, "- %12zu  %s\n", size, name);
+    }
+}
+
+// Escreve em out a listagem de um nó (o nome, se for um arquivo)
+static void list_node(fs_t *fs, Node* node, int long_format, OutBuf* out) {
+    if (node->type != DIR_NODE) {
+        const char *name = __atomic_load_n(&node->name, __ATOMIC_ACQUIRE);
+        if (long_format) list_long(node, name, out);
+        else out_printf(out, "%s\n", name);
         return;
     }
-    
-    Node* new_file = (Node*)malloc(sizeof(Node));
-    strcpy(new_file->name, name);
-    new_file->type = FILE_NODE;
-    new_file->content = NULL;
-    new_file->child = NULL;
-    attach_node(parent, new_file);
+    load_children(fs, node);
+    for (Node *c = __atomic_load_n(&node->child, __ATOMIC_ACQUIRE); c != NULL;
+         c = __atomic_load_n(&c->next, __ATOMIC_ACQUIRE)) {
+        const char *name = __atomic_load_n(&c->name, __ATOMIC_ACQUIRE);
+        if (long_format) {
+            list_long(c, name, out);
+        } else if (c->type == DIR_NODE) {
+            out_printf(out, "d %s/\n", name);
+        } else {
+            size_t size = content_size(__atomic_load_n(&c->content, __ATOMIC_ACQUIRE));
+            out_printf(out, "- %s (%zu bytes)\n", name, size);
+        }
+    }
 }
 
 // Lista todos os arquivos e diretórios no caminho especificado
 // Se o caminho não existir, exibe uma mensagem de erro
-void fs_ls(const char *path) {
-    Node* dir_to_list = find_node_by_path(path);
+// No modo concorrente, a listagem é feita sem travas e refeita se cruzar
+// um mv; depois de algumas tentativas, usa as travas dos diretórios
+static void list_path(fs_t *fs, const char *path, int long_format) {
+    METRICS_START(t0);
+    OutBuf out = { NULL, NULL, 0, 0 };
+    int found = -1; // -1 = ainda não resolvido
+    if (fs->rcu_reads) {
+        epoch_enter();
+        for (int attempt = 0; attempt < RCU_ATTEMPTS && found < 0; attempt++) {
+            unsigned int seq = read_begin(fs);
+            out.len = 0;
+            Node *node = rcu_find(fs, path);
+            if (node) list_node(fs, node, long_format, &out);
+            if (read_valid(fs, seq)) found = node != NULL;
+        }
+        epoch_leave();
+    }
+    if (found < 0) {
+        Held held;
+        Node *node = lock_path(fs, path, LOCK_READ, &held);
+        OutBuf direct = { stdout, NULL, 0, 0 };
+        if (node) list_node(fs, node, long_format, &direct);
+        release(fs, &held);
+        found = node != NULL;
+    } else if (found && out.len > 0) {
+        fwrite(out.str, 1, out.len, stdout);
+    }
+    if (!found) fprintf(stderr, "ls: cannot access '%s': No such file or directory\n", path);
+    free(out.str);
+    METRICS_END(METRIC_LS, t0);
+}
 
-    if (dir_to_list == NULL) {
-        fprintf(stderr, "ls: cannot access '%s': No such file or directory\n", path);
+void fs_ls(fs_t *fs, const char *path) {
+    list_path(fs, path, 0);
+}
+
+void fs_ls_long(fs_t *fs, const char *path) {
+    list_path(fs, path, 1);
+}
+
+// Muda para o diretório especificado
+// No modo concorrente, o diretório ainda está travado quando passa a ser o
+// da sessão, então um rm dele espera e depois move a sessão para o pai
+void fs_cd(fs_t *fs, const char *path) {
+    METRICS_START(t0);
+    Held held;
+    Node *target = lock_path(fs, path, LOCK_READ, &held);
+    if (target == NULL) {
+        fprintf(stderr, "cd: %s: No such file or directory\n", path);
+        METRICS_END(METRIC_CD, t0);
         return;
     }
-    if (dir_to_list->type != DIR_NODE) {
-        printf("%s\n", dir_to_list->name);
+    if (target->type != DIR_NODE) {
+        fprintf(stderr, "cd: %s: Not a directory\n", path);
+    } else {
+        set_cwd(fs, target);
+    }
+    release(fs, &held);
+    METRICS_END(METRIC_CD, t0);
+}
+
+// O caminho é montado subindo pelos pais, sob o mutex de renomeação
+void fs_pwd(fs_t *fs) {
+    rename_enter(fs);
+    Node *dir = get_cwd(fs);
+    if (dir == fs->root) {
+        printf("/\n");
+        rename_leave(fs);
         return;
     }
 
-    Node *current = dir_to_list->child;
-    while (current != NULL) {
-        if (current->type == DIR_NODE) {
-            printf("d %s/\n", current->name);
+    char path_buffer[1024];
+    char *p = &path_buffer[sizeof(path_buffer) - 1];
+    *p = '\0'; // Null-terminate at the very end
+
+    for (Node *temp = dir; temp != fs->root; temp = temp->parent) {
+        size_t name_len = temp->name_len;
+        size_t needed = name_len + 1; // for name + '/'
+
+        // Check if there is enough space to prepend this part
+        if ((p - path_buffer) < needed) {
+            // Not enough space, path will be truncated. Break and show what we have.
+            break; 
+        }
+
+        p -= name_len;
+        memcpy(p, temp->name, name_len);
+        p--;
+        *p = '/';
+    }
+    printf("%s\n", p);
+    rename_leave(fs);
+}
+
+// Tipo e tamanho de um nó, para clientes que não usam o terminal
+static void stat_node(Node* node, FsStat* out) {
+    out->type = (NodeType)node->type;
+    out->size = node->type == FILE_NODE
+        ? content_size(__atomic_load_n(&node->content, __ATOMIC_ACQUIRE))
+        : __atomic_load_n(&node->child_count, __ATOMIC_RELAXED);
+    if (node->type == DIR_NODE) {
+        out->totals = load_totals(node);
+    } else {
+        out->totals.bytes = 0;
+        out->totals.files = 0;
+        out->totals.dirs = 0;
+    }
+}
+
+int fs_stat(fs_t *fs, const char *path, FsStat *out) {
+    if (fs->rcu_reads) {
+        int found = -1;
+        epoch_enter();
+        for (int attempt = 0; attempt < RCU_ATTEMPTS && found < 0; attempt++) {
+            unsigned int seq = read_begin(fs);
+            Node *node = rcu_find(fs, path);
+            if (node) stat_node(node, out);
+            if (read_valid(fs, seq)) found = node != NULL;
+        }
+        epoch_leave();
+        if (found >= 0) return found ? 0 : -1;
+    }
+    Held held;
+    Node *node = lock_path(fs, path, LOCK_READ, &held);
+    if (!node) return -1;
+    stat_node(node, out);
+    release(fs, &held);
+    return 0;
+}
+
+int fs_read(fs_t *fs, const char *path, size_t offset, void *buf, size_t len, size_t *out_len) {
+    if (fs->rcu_reads) {
+        int found = -1;
+        epoch_enter();
+        for (int attempt = 0; attempt < RCU_ATTEMPTS && found < 0; attempt++) {
+            unsigned int seq = read_begin(fs);
+            Node *node = rcu_find(fs, path);
+            int is_file = node && node->type == FILE_NODE;
+            if (is_file) {
+                *out_len = read_content(__atomic_load_n(&node->content, __ATOMIC_ACQUIRE),
+                                        offset, buf, len);
+            }
+            if (read_valid(fs, seq)) found = is_file;
+        }
+        epoch_leave();
+        if (found >= 0) return found ? 0 : -1;
+    }
+    Held held;
+    Node *node = lock_path(fs, path, LOCK_READ, &held);
+    int ok = node && node->type == FILE_NODE;
+    if (ok) *out_len = read_content(node->content, offset, buf, len);
+    release(fs, &held);
+    return ok ? 0 : -1;
+}
+
+// --- Totais (du) ---
+
+// Os totais de vários diretórios só fecham entre si com o mutex da árvore,
+// que toda alteração segura enquanto sobe somando
+int fs_du(fs_t *fs, const char *path) {
+    METRICS_START(t0);
+    Held held;
+    Node *node = lock_path(fs, path, LOCK_READ, &held);
+    if (!node) {
+        release(fs, &held);
+        fprintf(stderr, "du: cannot access '%s': No such file or directory\n", path);
+        METRICS_END(METRIC_DU, t0);
+        return -1;
+    }
+    tree_enter(fs);
+    if (node->type == FILE_NODE) {
+        printf("%zu\t%s\n", content_size(node->content), path);
+    } else {
+        size_t len = strlen(path);
+        const char *sep = len > 0 && path[len - 1] != '/' ? "/" : "";
+        load_children(fs, node);
+        for (Node *c = node->child; c; c = c->next) {
+            if (c->type == FILE_NODE) {
+                printf("%zu\t%s%s%s\n", content_size(c->content), path, sep, c->name);
+            } else {
+                printf("%llu\t%s%s%s  (%u files, %u dirs)\n", (unsigned long long)c->totals.bytes, path,
+                       sep, c->name, c->totals.files, c->totals.dirs);
+            }
+        }
+        printf("%llu\t%s  (%u files, %u dirs)\n", (unsigned long long)node->totals.bytes,
+               len > 0 ? path : ".", node->totals.files, node->totals.dirs);
+    }
+    tree_leave(fs);
+    release(fs, &held);
+    METRICS_END(METRIC_DU, t0);
+    return 0;
+}
+
+// Compara os totais guardados de dir com os recalculados
+static long check_dir(fs_t *fs, Node* dir, const NodeTotals* expected) {
+    if (dir->totals.bytes == expected->bytes && dir->totals.files == expected->files &&
+        dir->totals.dirs == expected->dirs) {
+        return 0;
+    }
+    PathBuf p;
+    path_of(fs, dir, &p);
+    fprintf(stderr, "check: %s: totals %llu bytes, %u files, %u dirs; expected %llu bytes, %u files, %u dirs\n",
+            p.str, (unsigned long long)dir->totals.bytes, dir->totals.files, dir->totals.dirs,
+            (unsigned long long)expected->bytes, expected->files, expected->dirs);
+    path_free(&p);
+    return 1;
+}
+
+// Pós-ordem sem recursão: cada diretório aberto tem uma entrada na pilha
+// (no heap, com a profundidade da árvore), que recebe os arquivos e os
+// diretórios já fechados abaixo dele
+long fs_check_totals(fs_t *fs) {
+    tree_enter(fs);
+    NodeTotals *stack = NULL;
+    size_t depth = 0, cap = 0;
+    long bad = 0;
+    Node *top = fs->root, *n = top;
+    for (;;) {
+        if (n->type == DIR_NODE) {
+            load_children(fs, n);
+            if (depth == cap) {
+                cap = cap ? cap * 2 : 64;
+                NodeTotals *grown = (NodeTotals*)realloc(stack, cap * sizeof(NodeTotals));
+                if (!grown) { perror("Failed to allocate check stack"); exit(1); }
+                stack = grown;
+            }
+            memset(&stack[depth++], 0, sizeof(NodeTotals));
+            if (n->child) {
+                n = n->child;
+                continue;
+            }
         } else {
-            size_t size = current->content ? strlen(current->content) : 0;
-            printf("- %s (%zu bytes)\n", current->name, size);
+            stack[depth - 1].bytes += content_size(n->content);
+            stack[depth - 1].files++;
+        }
+        // n terminou: sobe fechando os diretórios sem mais irmãos pela frente
+        for (;;) {
+            if (n->type == DIR_NODE) {
+                NodeTotals sum = stack[--depth];
+                bad += check_dir(fs, n, &sum);
+                if (depth > 0) {
+                    stack[depth - 1].bytes += sum.bytes;
+                    stack[depth - 1].files += sum.files;
+                    stack[depth - 1].dirs += sum.dirs + 1;
+                }
+            }
+            if (n == top || n->next) break;
+            n = n->parent;
+        }
+        if (n == top) break;
+        n = n->next;
+    }
+    free(stack);
+    tree_leave(fs);
+    return bad;
+}
+
+// --- Busca por Nome ---
+
+// Liga o índice de nomes com todos os nós da árvore, menos a raiz (cujo
+// nome "/" não é um nome de verdade). Com a imagem toda carregada, nenhum
+// nó entra na árvore sem passar por set_node_name ou copy_subtree
+static void build_name_index(fs_t *fs) {
+    fs_preload(fs);
+    nameindex_start(&fs->name_index);
+    for (Node *n = fs->root->child; n; n = next_in_subtree(fs->root, n)) {
+        nameindex_link(&fs->name_index, n);
+    }
+}
+
+typedef struct {
+    fs_t *fs;
+    FsFindFn fn;
+    void *arg;
+} FindVisit;
+
+static void find_visit(Node* node, void* arg) {
+    FindVisit *v = (FindVisit*)arg;
+    PathBuf p;
+    path_of(v->fs, node, &p);
+    v->fn(p.str, p.len, v->arg);
+    path_free(&p);
+}
+
+long fs_find_each(fs_t *fs, const char *dir, const char *pattern, FsFindFn fn, void *arg) {
+    METRICS_START(t0);
+    Held held;
+    Node *top = lock_path(fs, dir, LOCK_READ, &held);
+    long found = -1;
+    if (top && top->type == DIR_NODE) {
+        tree_enter(fs);
+        if (!fs->name_index.active) build_name_index(fs);
+        FindVisit v = { fs, fn, arg };
+        found = (long)nameindex_find(&fs->name_index, &fs->names, pattern, top, find_visit, &v);
+        tree_leave(fs);
+    }
+    release(fs, &held);
+    METRICS_END(METRIC_FIND, t0);
+    return found;
+}
+
+// Caminhos achados por fs_find, um após o outro (com '\0') em str
+typedef struct {
+    char *str;
+    size_t len;
+    size_t cap;
+    size_t *offsets;
+    size_t count;
+    size_t offsets_cap;
+} FoundPaths;
+
+static void collect_path(const char *path, size_t len, void *arg) {
+    FoundPaths *out = (FoundPaths*)arg;
+    if (out->len + len + 1 > out->cap) {
+        size_t cap = out->cap ? out->cap : 4096;
+        while (out->len + len + 1 > cap) cap *= 2;
+        char *grown = (char*)realloc(out->str, cap);
+        if (!grown) { perror("Failed to allocate find output"); exit(1); }
+        out->str = grown;
+        out->cap = cap;
+    }
+    if (out->count == out->offsets_cap) {
+        size_t cap = out->offsets_cap ? out->offsets_cap * 2 : 64;
+        size_t *grown = (size_t*)realloc(out->offsets, cap * sizeof(size_t));
+        if (!grown) { perror("Failed to allocate find output"); exit(1); }
+        out->offsets = grown;
+        out->offsets_cap = cap;
+    }
+    out->offsets[out->count++] = out->len;
+    memcpy(out->str + out->len, path, len + 1);
+    out->len += len + 1;
+}
+
+static int path_order(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+long fs_find(fs_t *fs, const char *dir, const char *pattern) {
+    if (strchr(pattern, '/')) {
+        fprintf(stderr, "find: '%s': pattern must be a name, not a path\n", pattern);
+        return -1;
+    }
+    FoundPaths out = { NULL, 0, 0, NULL, 0, 0 };
+    long found = fs_find_each(fs, dir, pattern, collect_path, &out);
+    if (found < 0) {
+        fprintf(stderr, "find: '%s': No such directory\n", dir);
+    } else if (out.count > 0) {
+        const char **paths = (const char**)malloc(out.count * sizeof(char*));
+        if (!paths) { perror("Failed to allocate find output"); exit(1); }
+        for (size_t i = 0; i < out.count; i++) paths[i] = out.str + out.offsets[i];
+        qsort((void*)paths, out.count, sizeof(char*), path_order);
+        for (size_t i = 0; i < out.count; i++) printf("%s\n", paths[i]);
+        free((void*)paths);
+    }
+    free(out.str);
+    free(out.offsets);
+    return found;
+}
+
+// --- Busca no Conteúdo (grep) ---
+
+// Os arquivos são lidos em lotes de até GREP_BATCH_BYTES, um arquivo por
+// tarefa no pool; lotes menores que GREP_PARALLEL_BYTES ficam na thread que
+// chamou. As linhas achadas ficam com cada arquivo e saem, na ordem da
+// árvore, no fim do lote
+#define GREP_BATCH_BYTES (64 * 1024 * 1024)
+#define GREP_PARALLEL_BYTES (1024 * 1024)
+
+typedef struct {
+    Node *node;
+    char *out;                 // Registros: linha, tamanho e texto
+    size_t len;
+    size_t cap;
+} GrepFile;
+
+typedef struct {
+    TextScan scan;
+    char *scratch;             // Chunks comprimidos (CHUNK_SIZE bytes)
+} GrepWorker;
+
+typedef struct {
+    const char *pattern;
+    size_t len;
+    GrepWorker workers[TASKPOOL_MAX_WORKERS];
+} GrepOp;
+
+static void grep_record(size_t line, const char* text, size_t len, void* arg) {
+    GrepFile *f = (GrepFile*)arg;
+    size_t need = f->len + 2 * sizeof(size_t) + len;
+    if (need > f->cap) {
+        size_t cap = f->cap ? f->cap : 256;
+        while (cap < need) cap *= 2;
+        char *grown = (char*)realloc(f->out, cap);
+        if (!grown) { perror("Failed to allocate grep output"); exit(1); }
+        f->out = grown;
+        f->cap = cap;
+    }
+    memcpy(f->out + f->len, &line, sizeof(size_t));
+    memcpy(f->out + f->len + sizeof(size_t), &len, sizeof(size_t));
+    memcpy(f->out + f->len + 2 * sizeof(size_t), text, len);
+    f->len = need;
+}
+
+// Procura no conteúdo do arquivo, chunk a chunk (os comprimidos são
+// descomprimidos no scratch do worker)
+static size_t grep_file(GrepOp* op, GrepWorker* w, GrepFile* f) {
+    const FileContent *content = f->node->content;
+    size_t chunks = content_chunk_count(content);
+    if (content_compressed(content) && !w->scratch && !(w->scratch = (char*)malloc(CHUNK_SIZE))) {
+        perror("Failed to allocate buffer");
+        exit(1);
+    }
+    textscan_begin(&w->scan, op->pattern, op->len, grep_record, f);
+    for (size_t i = 0; i < chunks; i++) {
+        size_t len;
+        const char *data = content_chunk(content, i, &len, w->scratch);
+        textscan_feed(&w->scan, data, len);
+    }
+    textscan_end(&w->scan);
+    return chunks + 1;
+}
+
+static size_t grep_task(TaskPool* pool, int worker, Task task, void* ctx) {
+    (void)pool;
+    GrepOp *op = (GrepOp*)ctx;
+    return grep_file(op, &op->workers[worker], (GrepFile*)task.a);
+}
+
+// Procura nos arquivos [0, n) e passa as linhas achadas a fn, arquivo por
+// arquivo. Retorna quantas linhas casaram
+static long grep_batch(fs_t *fs, GrepOp* op, GrepFile* files, size_t n, size_t bytes, FsGrepFn fn,
+                       void *arg) {
+    int workers = subtree_workers(fs);
+    if (n > 1 && workers > 1 && bytes >= GREP_PARALLEL_BYTES) {
+        Task *tasks = (Task*)malloc(n * sizeof(Task));
+        if (!tasks) { perror("Failed to allocate grep tasks"); exit(1); }
+        for (size_t i = 0; i < n; i++) {
+            tasks[i].a = &files[i];
+            tasks[i].b = NULL;
+        }
+        taskpool_run_all(workers, grep_task, op, tasks, n);
+        free(tasks);
+    } else {
+        for (size_t i = 0; i < n; i++) grep_file(op, &op->workers[0], &files[i]);
+    }
+
+    long matches = 0;
+    for (size_t i = 0; i < n; i++) {
+        GrepFile *f = &files[i];
+        if (f->len == 0) continue;
+        PathBuf p;
+        path_of(fs, f->node, &p);
+        for (size_t at = 0; at < f->len;) {
+            size_t line, len;
+            memcpy(&line, f->out + at, sizeof(size_t));
+            memcpy(&len, f->out + at + sizeof(size_t), sizeof(size_t));
+            at += 2 * sizeof(size_t);
+            fn(p.str, p.len, line, f->out + at, len, arg);
+            at += len;
+            matches++;
+        }
+        path_free(&p);
+        free(f->out);
+        f->out = NULL;
+    }
+    return matches;
+}
+
+long fs_grep_each(fs_t *fs, const char *path, const char *pattern, int recursive, FsGrepFn fn,
+                  void *arg) {
+    METRICS_START(t0);
+    Held held;
+    Node *top = lock_path(fs, path, LOCK_READ, &held);
+    if (!top || (top->type == DIR_NODE && !recursive)) {
+        release(fs, &held);
+        METRICS_END(METRIC_GREP, t0);
+        return top ? -2 : -1;
+    }
+    // Uma linha nunca contém '\n', então esse padrão não casa com nada
+    if (strchr(pattern, '\n')) {
+        release(fs, &held);
+        METRICS_END(METRIC_GREP, t0);
+        return 0;
+    }
+    tree_enter(fs);
+    GrepFile *files = NULL;
+    size_t count = 0, cap = 0;
+    for (Node *n = top; n; n = next_in_subtree(top, n)) {
+        load_children(fs, n);
+        if (n->type != FILE_NODE || content_size(n->content) == 0) continue;
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            GrepFile *grown = (GrepFile*)realloc(files, cap * sizeof(GrepFile));
+            if (!grown) { perror("Failed to allocate grep files"); exit(1); }
+            files = grown;
+        }
+        files[count].node = n;
+        files[count].out = NULL;
+        files[count].len = 0;
+        files[count].cap = 0;
+        count++;
+    }
+
+    GrepOp *op = (GrepOp*)calloc(1, sizeof(GrepOp));
+    if (!op) { perror("Failed to allocate grep"); exit(1); }
+    op->pattern = pattern;
+    op->len = strlen(pattern);
+    long matches = 0;
+    for (size_t start = 0; start < count;) {
+        size_t end = start, bytes = 0;
+        while (end < count && (end == start || bytes < GREP_BATCH_BYTES)) {
+            bytes += content_size(files[end++].node->content);
         }
-        current = current->next;
+        matches += grep_batch(fs, op, files + start, end - start, bytes, fn, arg);
+        start = end;
+    }
+    for (int i = 0; i < TASKPOOL_MAX_WORKERS; i++) {
+        textscan_free(&op->workers[i].scan);
+        free(op->workers[i].scratch);
     }
+    free(op);
+    free(files);
+    tree_leave(fs);
+    release(fs, &held);
+    METRICS_END(METRIC_GREP, t0);
+    return matches;
+}
+
+static void print_match(const char *path, size_t path_len, size_t line, const char *text, size_t len,
+                        void *arg) {
+    (void)arg;
+    fwrite(path, 1, path_len, stdout);
+    printf(":%zu:", line);
+    fwrite(text, 1, len, stdout);
+    putchar('\n');
+}
+
+long fs_grep(fs_t *fs, const char *path, const char *pattern, int recursive) {
+    long matches = fs_grep_each(fs, path, pattern, recursive, print_match, NULL);
+    if (matches == -1) fprintf(stderr, "grep: %s: No such file or directory\n", path);
+    if (matches == -2) fprintf(stderr, "grep: %s: Is a directory\n", path);
+    return matches;
+}
+
+// Preenche as estatísticas do alocador da árvore
+void fs_alloc_stats(fs_t *fs, AllocStats *out) {
+    tree_enter(fs);
+    alloc_get_stats(&fs->alloc, out);
+    tree_leave(fs);
 }
 
-// Muda para o diretório especificado
-void fs_cd(const char *path) {
-    Node *target = find_node_by_path(path);
-    if (target == NULL) {
-        fprintf(stderr, "cd: %s: No such file or directory\n", path);
-    } else if (target->type != DIR_NODE) {
-        fprintf(stderr, "cd: %s: Not a directory\n", path);
-    } else {
-        current_dir = target;
-    }
+// Preenche os contadores do cache de caminhos
+void fs_dcache_stats(fs_t *fs, DcacheStats *out) {
+    *out = fs->dcache.stats;
 }
 
-void fs_pwd() {
-    if (current_dir == root) {
-        printf("/\n");
-        return;
+void fs_set_dedup(fs_t *fs, int on) {
+    tree_enter(fs);
+    if (on && !fs->dedup.enabled) {
+        // Diretórios ainda não carregados ficam de fora: seus arquivos
+        // apontam para a imagem mapeada
+        fs->dedup.enabled = 1;
+        for (Node *n = fs->root; n; n = next_in_subtree(fs->root, n)) {
+            if (n->type == FILE_NODE) dedup_content(&fs->dedup, &fs->alloc, n->content, 0, 0, 1);
+        }
+    } else if (!on && fs->dedup.enabled) {
+        dedup_clear(&fs->dedup, &fs->alloc);
+        fs->dedup.enabled = 0;
     }
+    tree_leave(fs);
+}
 
-    char path_buffer[1024];
-    char *p = &path_buffer[sizeof(path_buffer) - 1];
-    *p = '\0'; // Null-terminate at the very end
+void fs_dedup_stats(fs_t *fs, DedupStats *mem, ImageSaveStats *saved) {
+    tree_enter(fs);
+    dedup_sweep(&fs->dedup, &fs->alloc); // Só as entradas ainda em uso
+    if (mem) dedup_get_stats(&fs->dedup, mem);
+    if (saved) *saved = fs->saved;
+    tree_leave(fs);
+}
 
-    for (Node *temp = current_dir; temp != root; temp = temp->parent) {
-        size_t name_len = strlen(temp->name);
-        size_t needed = name_len + 1; // for name + '/'
+// Mostra quanto a deduplicação economizou, em memória e na última gravação
+void fs_dedup_report(fs_t *fs) {
+    DedupStats st;
+    ImageSaveStats saved;
+    fs_dedup_stats(fs, &st, &saved);
+    printf("dedup: %s\n", fs->dedup.enabled ? "on" : "off");
+    printf("memory: %zu unique chunks (%zu bytes) referenced %zu times (%zu bytes), "
+           "%zu bytes saved\n",
+           st.chunks, st.chunk_bytes, st.refs, st.ref_bytes,
+           st.ref_bytes > st.chunk_bytes ? st.ref_bytes - st.chunk_bytes : 0);
+    printf("lookups: %zu chunks, %zu matched a stored chunk (%.1f%%)\n",
+           st.lookups, st.hits, st.lookups ? st.hits * 100.0 / st.lookups : 0.0);
+    if (saved.files == 0) return; // Nada gravado ainda por fs_save ou checkpoint
+    printf("last save: %llu files (%llu bytes), %llu sharing data (%llu bytes saved), "
+           "%llu bytes of data written\n",
+           (unsigned long long)saved.files, (unsigned long long)saved.file_bytes,
+           (unsigned long long)saved.shared_files, (unsigned long long)saved.shared_bytes,
+           (unsigned long long)saved.data_bytes);
+}
 
-        // Check if there is enough space to prepend this part
-        if ((p - path_buffer) < needed) {
-            // Not enough space, path will be truncated. Break and show what we have.
-            break; 
+int fs_set_compression(fs_t *fs, const char *codec, size_t threshold) {
+    const Codec *found = NULL;
+    if (codec && strcmp(codec, "off") != 0 && !(found = codec_find(codec))) {
+        fprintf(stderr, "compress: unknown codec '%s'\n", codec);
+        return -1;
+    }
+    tree_enter(fs);
+    ChunkCompression *z = &fs->compression;
+    if (found && !z->scratch) {
+        z->scratch = (char*)malloc(found->bound(CHUNK_SIZE));
+        if (!z->scratch) { perror("Failed to allocate compression buffer"); exit(1); }
+    } else if (found && found != z->codec) {
+        char *grown = (char*)realloc(z->scratch, found->bound(CHUNK_SIZE));
+        if (!grown) { perror("Failed to allocate compression buffer"); exit(1); }
+        z->scratch = grown;
+    }
+    z->codec = found;
+    z->threshold = threshold;
+    // Os conteúdos publicados no modo concorrente não mudam no lugar:
+    // lá, só as escritas seguintes são comprimidas
+    if (found && !fs->threads) {
+        for (Node *n = fs->root; n; n = next_in_subtree(fs->root, n)) {
+            if (n->type == FILE_NODE) content_compress(&fs->alloc, n->content, 0, 0, 1, z);
         }
+    }
+    tree_leave(fs);
+    return 0;
+}
 
-        p -= name_len;
-        memcpy(p, temp->name, name_len);
-        p--;
-        *p = '/';
+void fs_compression_stats(fs_t *fs, CompressionStats *out) {
+    memset(out, 0, sizeof(CompressionStats));
+    tree_enter(fs);
+    for (Node *n = fs->root; n; n = next_in_subtree(fs->root, n)) {
+        if (n->type != FILE_NODE || !n->content) continue;
+        out->files++;
+        out->bytes += content_size(n->content);
+        for (size_t i = 0; i < content_chunk_count(n->content); i++) {
+            size_t stored;
+            unsigned int codec;
+            content_chunk_stored(n->content, i, &stored, &codec);
+            out->chunks++;
+            out->stored += stored;
+            if (codec) out->compressed++;
+        }
     }
-    printf("%s\n", p);
+    out->tried = fs->compression.tried;
+    out->kept = fs->compression.kept;
+    tree_leave(fs);
+}
+
+// Mostra o codec em uso e quanto os arquivos carregados ocupam
+void fs_compression_report(fs_t *fs) {
+    CompressionStats st;
+    fs_compression_stats(fs, &st);
+    const ChunkCompression *z = &fs->compression;
+    if (z->codec) printf("compress: %s (chunks from %zu bytes)\n", z->codec->name, z->threshold);
+    else printf("compress: off\n");
+    printf("files: %zu (%zu bytes) in %zu chunks, %zu compressed\n",
+           st.files, st.bytes, st.chunks, st.compressed);
+    printf("stored: %zu bytes (ratio %.2f)\n", st.stored, st.stored ? (double)st.bytes / st.stored : 1.0);
+    printf("writes: %zu chunks tried, %zu kept compressed\n", st.tried, st.kept);
+}
+
+// Mostra as estatísticas do alocador no terminal
+void fs_memstats(fs_t *fs) {
+    AllocStats st;
+    tree_enter(fs);
+    alloc_get_stats(&fs->alloc, &st);
+    tree_leave(fs);
+    printf("nodes: %zu live, %zu slabs (%.1f%% used)\n",
+           st.live_nodes, st.slab_count, st.slab_utilization * 100.0);
+    printf("arena: %zu blocks, %zu bytes reserved, %zu bytes live, %zu bytes free-listed\n",
+           st.arena_blocks, st.arena_reserved_bytes, st.small_live_bytes, st.small_free_bytes);
+    printf("large: %zu blocks, %zu bytes\n", st.large_count, st.large_live_bytes);
+    printf("total: %zu bytes live\n", st.total_live_bytes);
+    const DcacheStats *dc = &fs->dcache.stats;
+    size_t lookups = dc->hits + dc->negative_hits + dc->misses;
+    printf("dcache: %zu hits (%zu repeated), %zu negative hits, %zu misses (%.1f%% hit rate), "
+           "%zu uncached, %zu invalidations\n",
+           dc->hits, dc->repeats, dc->negative_hits, dc->misses,
+           lookups ? (dc->hits + dc->negative_hits) * 100.0 / lookups : 0.0,
+           dc->uncached, dc->invalidations);
 }
 
 // Apaga um arquivo ou diretório especificado
 // Verifica se o nó existe, se é o nó raiz ou se é um diretório não vazio
-void fs_rm(const char *path) {
-    Node *target = find_node_by_path(path);
+// (a não ser com recursive, que apaga a subárvore inteira)
+// No modo concorrente, o alvo é encontrado sob o mutex de renomeação (ele
+// não muda de lugar até o fim) e só então o pai e o próprio alvo, se for um
+// diretório, são travados para escrita (com recursive, todos os
+// diretórios da subárvore; ver lock_subtree)
+static void remove_path(fs_t *fs, const char *path, int recursive) {
+    Held held;
+    rename_enter(fs);
+    Node *target = lock_path(fs, path, LOCK_READ, &held);
+    release(fs, &held);
     if (target == NULL) {
         fprintf(stderr, "rm: cannot remove '%s': No such file or directory\n", path);
+        rename_leave(fs);
         return;
     }
-    if (target == root) {
+    if (target == fs->root) {
         fprintf(stderr, "rm: cannot remove root directory '/'\n");
+        rename_leave(fs);
         return;
     }
-    if (target->type == DIR_NODE && target->child != NULL) {
+
+    Node *parent = target->parent;
+    int is_dir = target->type == DIR_NODE;
+    int subtree = recursive && is_dir;
+    node_lock(fs, parent, LOCK_WRITE);
+    if (subtree) lock_subtree(fs, target);
+    else if (is_dir) node_lock(fs, target, LOCK_WRITE);
+    if (!subtree && is_dir && target->child_count > 0) {
         fprintf(stderr, "rm: cannot remove '%s': Directory not empty\n", path);
-        return;
+        node_unlock(fs, target, LOCK_WRITE);
+    } else {
+        // Sem recursive, só diretórios vazios são removidos, então um
+        // diretório de trabalho só pode ser o próprio alvo; nesse caso ele
+        // passa a ser o pai. Uma busca sem travas que partiu dele refaz o
+        // caminho (rename_seq)
+        if (is_dir) {
+            rename_seq_begin(fs);
+            move_sessions_out(fs, target);
+        }
+
+        tree_enter(fs);
+        PathBuf p;
+        if (fs->journal) path_of(fs, target, &p);
+        detach_node(fs, target);
+        if (is_dir) {
+            rename_seq_end(fs);
+            // As travas da subárvore ficam com os nós, que vão ser liberados
+            if (!subtree) node_unlock(fs, target, LOCK_WRITE);
+        }
+        // Os irmãos continuam na árvore: só o nó e o que está abaixo dele
+        if (subtree) free_subtree(fs, target);
+        else free_node(fs, target);
+        if (fs->journal) {
+            journal_paths(fs, recursive ? J_RMR : J_RM, p.str, p.len, NULL);
+            path_free(&p);
+        }
+        dedup_tick(&fs->dedup, &fs->alloc);
+        tree_leave(fs);
     }
-    
-    detach_node(target);
-    target->next = NULL;
-    fs_destroy(target);
+    node_unlock(fs, parent, LOCK_WRITE);
+    rename_leave(fs);
+}
+
+void fs_rm(fs_t *fs, const char *path) {
+    METRICS_START(t0);
+    remove_path(fs, path, 0);
+    METRICS_END(METRIC_RM, t0);
+}
+
+void fs_rm_recursive(fs_t *fs, const char *path) {
+    METRICS_START(t0);
+    remove_path(fs, path, 1);
+    METRICS_END(METRIC_RM, t0);
 }
 
 // Printa o conteúdo de um arquivo especificado
 // Verifica se o nó existe e se é um arquivo
-void fs_cat(const char *path) {
-    Node *target = find_node_by_path(path);
-    if (target == NULL) {
+// O tamanho é explícito, então conteúdos binários saem inteiros
+static void print_content(const FileContent* content) {
+    if (!content) return;
+    char *scratch = NULL;
+    if (content_compressed(content) && !(scratch = (char*)malloc(CHUNK_SIZE))) {
+        perror("Failed to allocate buffer");
+        exit(1);
+    }
+    for (size_t i = 0; i < content_chunk_count(content); i++) {
+        size_t len;
+        const char *data = content_chunk(content, i, &len, scratch);
+        fwrite(data, 1, len, stdout);
+    }
+    free(scratch);
+    printf("\n");
+}
+
+// No modo concorrente, o conteúdo publicado no arquivo nunca muda (uma
+// escrita publica outro), então basta mantê-lo vivo durante a impressão
+void fs_cat(fs_t *fs, const char *path) {
+    METRICS_START(t0);
+    Node *target = NULL;
+    int found = -1, is_file = 0;
+    if (fs->rcu_reads) {
+        epoch_enter();
+        for (int attempt = 0; attempt < RCU_ATTEMPTS && found < 0; attempt++) {
+            unsigned int seq = read_begin(fs);
+            target = rcu_find(fs, path);
+            if (read_valid(fs, seq)) found = target != NULL;
+        }
+        is_file = found > 0 && target->type == FILE_NODE;
+        if (is_file) print_content(__atomic_load_n(&target->content, __ATOMIC_ACQUIRE));
+        epoch_leave();
+    }
+    Held held = { NULL, LOCK_READ };
+    if (found < 0) {
+        target = lock_path(fs, path, LOCK_READ, &held);
+        found = target != NULL;
+        is_file = found && target->type == FILE_NODE;
+        if (is_file) print_content(target->content);
+    }
+    if (!found) {
         fprintf(stderr, "cat: %s: No such file or directory\n", path);
-    } else if (target->type != FILE_NODE) {
+    } else if (!is_file) {
         fprintf(stderr, "cat: %s: Is a directory\n", path);
-    } else if (target->content) {
-        printf("%s\n", target->content);
     }
+    release(fs, &held);
+    METRICS_END(METRIC_CAT, t0);
 }
 
-// Escreve conteúdo em um arquivo especificado
+// Resolve o arquivo que será escrito por echo/write/append, com o diretório
+// dele travado para escrita em held
 // Se o arquivo não existir, cria um novo arquivo
-// Se o arquivo já existir, substitui seu conteúdo
-void fs_echo(const char *path, const char *content) {
-    char name[100];
-    Node *parent = get_parent_dir_and_basename(path, name);
+// Retorna NULL (após exibir o erro) se o pai não existir ou se for um diretório
+static Node* open_file_for_write(fs_t *fs, const char *cmd, const char *path, Held *held) {
+    const char *name;
+    size_t name_len;
+    Node *parent = lock_parent(fs, path, &name, &name_len, LOCK_WRITE, held);
     if (!parent) {
-        fprintf(stderr, "echo: cannot write to '%s': No such file or directory\n", path);
-        return;
+        fprintf(stderr, "%s: cannot write to '%s': No such file or directory\n", cmd, path);
+        return NULL;
+    }
+    if (reserved_name(name, name_len)) {
+        fprintf(stderr, "%s: cannot write to '%s': Invalid name\n", cmd, path);
+        release(fs, held);
+        return NULL;
+    }
+
+    Node *target = find_node_in_dir(fs, parent, name, name_len);
+    if (target == NULL && parent->type == DIR_NODE) {
+        tree_enter(fs);
+        target = new_child(fs, parent, name, name_len, FILE_NODE);
+        journal_node(fs, J_TOUCH, target, NULL, 0, 0);
+        tree_leave(fs);
     }
-    
-    Node *target = find_node_in_dir(parent, name);
     if (target == NULL) {
-        fs_touch(path);
-        target = find_node_in_dir(parent, name);
-        if (!target) return;
+        release(fs, held);
+        return NULL;
     }
 
     if (target->type != FILE_NODE) {
-        fprintf(stderr, "echo: %s: Is a directory\n", name);
+        fprintf(stderr, "%s: %.*s: Is a directory\n", cmd, (int)name_len, name);
+        release(fs, held);
+        return NULL;
+    }
+    return target;
+}
+
+// Conteúdo que uma escrita pode alterar. No modo concorrente, o atual
+// pode estar sendo lido sem travas: a escrita vai para uma cópia, que
+// compartilha os chunks (só os tocados são duplicados, por copy-on-write),
+// e publish_content a coloca no lugar de uma vez. A compressão e a
+// deduplicação trocam os chunks escritos antes disso, enquanto ninguém
+// mais vê o conteúdo
+static FileContent* writable_content(fs_t *fs, Node* file) {
+    return fs->threads ? content_copy(&fs->alloc, file->content) : file->content;
+}
+
+// old_size é o tamanho antes da escrita (o conteúdo pode ser o mesmo,
+// alterado no lugar); a diferença vai para os totais dos diretórios acima
+static void publish_content(fs_t *fs, Node* file, FileContent* content, size_t old_size) {
+    FileContent *old = file->content;
+    __atomic_store_n(&file->content, content, __ATOMIC_RELEASE);
+    add_totals(file->parent, (uint64_t)content_size(content) - old_size, 0, 0);
+    if (fs->threads) content_free(&fs->alloc, old); // Liberação adiada
+}
+
+// Escreve conteúdo em um arquivo especificado
+// Se o arquivo já existir, substitui seu conteúdo (reaproveitando o buffer,
+// fora do modo concorrente)
+void fs_echo(fs_t *fs, const char *path, const char *content) {
+    METRICS_START(t0);
+    Held held;
+    Node *target = open_file_for_write(fs, "echo", path, &held);
+    if (!target) {
+        METRICS_END(METRIC_ECHO, t0);
+        return;
+    }
+    size_t len = strlen(content);
+    tree_enter(fs);
+    size_t old_size = content_size(target->content);
+    FileContent *reuse = fs->threads ? NULL : target->content;
+    FileContent *assigned = content_assign(&fs->alloc, reuse, content, len);
+    content_compress(&fs->alloc, assigned, 0, len, 1, &fs->compression);
+    dedup_content(&fs->dedup, &fs->alloc, assigned, 0, len, 1);
+    publish_content(fs, target, assigned, old_size);
+    journal_node(fs, J_ECHO, target, content, len, 0);
+    tree_leave(fs);
+    release(fs, &held);
+    METRICS_END(METRIC_ECHO, t0);
+}
+
+// Escreve len bytes a partir de offset, sem reescrever o resto do arquivo
+void fs_write(fs_t *fs, const char *path, size_t offset, const void *data, size_t len) {
+    METRICS_START(t0);
+    Held held;
+    Node *target = open_file_for_write(fs, "write", path, &held);
+    if (!target) {
+        METRICS_END(METRIC_WRITE, t0);
         return;
     }
+    tree_enter(fs);
+    size_t old_size = content_size(target->content);
+    FileContent *written = content_write(&fs->alloc, writable_content(fs, target), offset, data, len);
+    content_compress(&fs->alloc, written, offset, len, 0, &fs->compression);
+    dedup_content(&fs->dedup, &fs->alloc, written, offset, len, 0);
+    publish_content(fs, target, written, old_size);
+    journal_node(fs, J_WRITE, target, data, len, offset);
+    tree_leave(fs);
+    release(fs, &held);
+    METRICS_END(METRIC_WRITE, t0);
+}
 
-    if (target->content) free(target->content);
-    target->content = strdup(content);
+// Acrescenta len bytes ao final do arquivo (crescimento geométrico)
+void fs_append(fs_t *fs, const char *path, const void *data, size_t len) {
+    METRICS_START(t0);
+    Held held;
+    Node *target = open_file_for_write(fs, "append", path, &held);
+    if (!target) {
+        METRICS_END(METRIC_WRITE, t0);
+        return;
+    }
+    tree_enter(fs);
+    size_t size = content_size(target->content);
+    FileContent *written = content_write(&fs->alloc, writable_content(fs, target), size, data, len);
+    content_compress(&fs->alloc, written, size, len, 0, &fs->compression);
+    dedup_content(&fs->dedup, &fs->alloc, written, size, len, 0);
+    publish_content(fs, target, written, size);
+    journal_node(fs, J_APPEND, target, data, len, 0);
+    tree_leave(fs);
+    release(fs, &held);
+    METRICS_END(METRIC_WRITE, t0);
 }
 
 
 // --- Funções de Mover e Copiar (Lógica Principal) ---
 
 // Desanexa um nó de seu pai, removendo-o da lista de filhos
-// e limpando seus ponteiros pai e próximo
-static void detach_node(Node* node) {
+// (e do índice hash do pai).
+// Com os ponteiros prev e last_child, não é preciso percorrer a lista
+// next e parent continuam valendo: uma leitura sem travas parada neste nó
+// ainda segue para o irmão seguinte (attach_node os refaz no mv)
+static void detach_node(fs_t *fs, Node* node) {
     if (!node || !node->parent) return;
     Node* parent = node->parent;
-    if (parent->child == node) {
-        parent->child = node->next;
-    } else {
-        Node* sibling = parent->child;
-        while (sibling && sibling->next != node) {
-            sibling = sibling->next;
+    if (parent->index) dirindex_remove(parent->index, node);
+    __atomic_store_n(&parent->child_count, parent->child_count - 1, __ATOMIC_RELAXED);
+    if (node->prev) __atomic_store_n(&node->prev->next, node->next, __ATOMIC_RELEASE);
+    else __atomic_store_n(&parent->child, node->next, __ATOMIC_RELEASE);
+    if (node->next) node->next->prev = node->prev;
+    else parent->last_child = node->prev;
+    node->prev = NULL;
+    NodeTotals share = node_share(node);
+    add_totals(parent, 0 - share.bytes, 0 - share.files, 0 - share.dirs);
+    // Caminhos em cache podem passar por um diretório que saiu daqui
+    if (node->type == DIR_NODE) dcache_invalidate(&fs->dcache);
+}
+
+// Anexa um nó filho ao final da lista de filhos de um pai, garantindo
+// que o pai seja um diretório. O ponteiro last_child evita percorrer a lista.
+// O índice hash do pai é criado quando ele passa do limite de filhos
+static void attach_node(fs_t *fs, Node* parent, Node* child) {
+    if (!parent || parent->type != DIR_NODE || !child) return;
+    load_children(fs, parent);
+    __atomic_store_n(&child->parent, parent, __ATOMIC_RELAXED);
+    __atomic_store_n(&child->next, NULL, __ATOMIC_RELAXED);
+    child->prev = parent->last_child;
+    __atomic_store_n(&parent->child_count, parent->child_count + 1, __ATOMIC_RELAXED);
+    if (parent->index) dirindex_insert(parent->index, child);
+    // O filho já está completo quando aparece para as leituras sem travas
+    if (parent->last_child) __atomic_store_n(&parent->last_child->next, child, __ATOMIC_RELEASE);
+    else __atomic_store_n(&parent->child, child, __ATOMIC_RELEASE);
+    parent->last_child = child;
+    index_children(fs, parent);
+    NodeTotals share = node_share(child);
+    add_totals(parent, share.bytes, share.files, share.dirs);
+    // Um caminho dado como inexistente pode passar a existir
+    dcache_invalidate_negative(&fs->dcache);
+}
+
+// Profundidade de um nó (a raiz tem 0)
+static unsigned int node_depth(Node* node) {
+    unsigned int depth = 0;
+    for (Node *n = node->parent; n; n = n->parent) depth++;
+    return depth;
+}
+
+// Trava para escrita os diretórios distintos de dirs (até 3), dos
+// ancestrais para os descendentes e, na mesma profundidade, por endereço,
+// a mesma ordem das buscas de caminhos. Retorna quantos foram travados
+static int lock_dirs(fs_t *fs, Node** dirs, int count) {
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        int seen = !dirs[i];
+        for (int j = 0; j < n; j++) seen |= dirs[j] == dirs[i];
+        if (!seen) dirs[n++] = dirs[i];
+    }
+    for (int i = 1; i < n; i++) {
+        for (int j = i; j > 0; j--) {
+            unsigned int da = node_depth(dirs[j - 1]), db = node_depth(dirs[j]);
+            if (da < db || (da == db && dirs[j - 1] < dirs[j])) break;
+            Node *t = dirs[j - 1];
+            dirs[j - 1] = dirs[j];
+            dirs[j] = t;
         }
-        if (sibling) sibling->next = node->next;
     }
-    node->parent = NULL;
-    node->next = NULL;
+    for (int i = 0; i < n; i++) node_lock(fs, dirs[i], LOCK_WRITE);
+    return n;
 }
 
-// Anexa um nó filho a um pai, garantindo que o pai seja um diretório
-// e que o filho não tenha um próximo irmão por enquanto
-static void attach_node(Node* parent, Node* child) {
-    if (!parent || parent->type != DIR_NODE || !child) return;
-    child->parent = parent;
-    child->next = NULL;
-    if (parent->child == NULL) {
-        parent->child = child;
-    } else {
-        Node* sibling = parent->child;
-        while (sibling->next != NULL) sibling = sibling->next;
-        sibling->next = child;
+static void unlock_dirs(fs_t *fs, Node** dirs, int n) {
+    while (n > 0) node_unlock(fs, dirs[--n], LOCK_WRITE);
+}
+
+// Resolve o destino de mv/cp: um diretório existente recebe o nó com o
+// mesmo nome; senão, o último componente é o novo nome. Chamado sob o mutex
+// de renomeação, então o resultado continua valendo depois de destravado
+static Node* dest_dir(fs_t *fs, const char* dest_path, Node* source_node,
+                      const char** new_name, size_t* new_len) {
+    Held held;
+    Node *dest_target = lock_path(fs, dest_path, LOCK_READ, &held);
+    release(fs, &held);
+    if (dest_target && dest_target->type == DIR_NODE) {
+        *new_name = source_node->name;
+        *new_len = source_node->name_len;
+        return dest_target;
     }
+    Node *dest_parent = lock_parent(fs, dest_path, new_name, new_len, LOCK_READ, &held);
+    release(fs, &held);
+    return dest_parent;
 }
 
 // Move um nó de um caminho para outro
 // Verifica se o nó de origem existe, se o destino é válido e se não há
-// conflitos de nome
-void fs_mv(const char *source_path, const char *dest_path) {
-    Node *source_node = find_node_by_path(source_path);
-    if (!source_node || source_node == root) {
+// conflitos de nome. Um diretório não pode ir para dentro de si mesmo
+// No modo concorrente, o pai da origem, o destino e a própria origem (se
+// for um diretório) ficam travados para escrita durante a troca
+void fs_mv(fs_t *fs, const char *source_path, const char *dest_path) {
+    METRICS_START(t0);
+    Held held;
+    rename_enter(fs);
+    Node *source_node = lock_path(fs, source_path, LOCK_READ, &held);
+    release(fs, &held);
+    if (!source_node || source_node == fs->root) {
         fprintf(stderr, "mv: cannot move '%s': Invalid source or root\n", source_path);
+        rename_leave(fs);
+        METRICS_END(METRIC_MV, t0);
         return;
     }
     
-    Node *dest_target = find_node_by_path(dest_path);
-    Node *dest_parent;
-    char new_name[100];
-
-    if (dest_target && dest_target->type == DIR_NODE) {
-        dest_parent = dest_target;
-        strcpy(new_name, source_node->name);
-    } else {
-        dest_parent = get_parent_dir_and_basename(dest_path, new_name);
-    }
-    
+    const char *new_name;
+    size_t new_len;
+    Node *dest_parent = dest_dir(fs, dest_path, source_node, &new_name, &new_len);
     if (!dest_parent) {
         fprintf(stderr, "mv: cannot move to '%s': Destination path not found\n", dest_path);
+        rename_leave(fs);
+        METRICS_END(METRIC_MV, t0);
         return;
     }
-    if (find_node_in_dir(dest_parent, new_name)) {
-        fprintf(stderr, "mv: cannot move to '%s': Destination already exists\n", dest_path);
+    if (dest_parent->type != DIR_NODE) {
+        fprintf(stderr, "mv: cannot move to '%s': Not a directory\n", dest_path);
+        rename_leave(fs);
+        METRICS_END(METRIC_MV, t0);
+        return;
+    }
+    if (reserved_name(new_name, new_len)) {
+        fprintf(stderr, "mv: cannot move to '%s': Invalid name\n", dest_path);
+        rename_leave(fs);
+        METRICS_END(METRIC_MV, t0);
         return;
     }
-    
-    detach_node(source_node);
-    strcpy(source_node->name, new_name);
-    attach_node(dest_parent, source_node);
-}
 
-// Copia um nó recursivamente, incluindo seus filhos (se for diretório)
-// Cria um novo nó com o mesmo nome e tipo, e copia o conteúdo se for um arquivo
-static Node* copy_node_recursive(Node* source, Node* new_parent) {
-    if (!source) return NULL;
-    
-    Node* new_node = (Node*)malloc(sizeof(Node));
-    strcpy(new_node->name, source->name);
-    new_node->type = source->type;
-    new_node->parent = new_parent;
-    new_node->content = source->content ? strdup(source->content) : NULL;
-    new_node->next = NULL;
-    
-    Node *child_head = NULL;
-    Node *last_copied_child = NULL;
-    for (Node *source_child = source->child; source_child != NULL; source_child = source_child->next) {
-        Node* copied_child = copy_node_recursive(source_child, new_node);
-        if (child_head == NULL) {
-            child_head = copied_child;
-        } else {
-            last_copied_child->next = copied_child;
+    Node *dirs[3] = { source_node->parent, dest_parent,
+                      source_node->type == DIR_NODE ? source_node : NULL };
+    int locked = lock_dirs(fs, dirs, 3);
+    int into_itself = 0;
+    for (Node *n = dest_parent; n && !into_itself; n = n->parent) into_itself = n == source_node;
+    if (find_node_in_dir(fs, dest_parent, new_name, new_len)) {
+        fprintf(stderr, "mv: cannot move to '%s': Destination already exists\n", dest_path);
+    } else if (into_itself) {
+        fprintf(stderr, "mv: cannot move '%s' to a subdirectory of itself\n", source_path);
+    } else {
+        tree_enter(fs);
+        PathBuf p;
+        if (fs->journal) path_of(fs, source_node, &p);
+        rename_seq_begin(fs);
+        detach_node(fs, source_node);
+        set_node_name(fs, source_node, new_name, new_len);
+        attach_node(fs, dest_parent, source_node);
+        rename_seq_end(fs);
+        if (fs->journal) {
+            journal_paths(fs, J_MV, p.str, p.len, source_node);
+            path_free(&p);
         }
-        last_copied_child = copied_child;
+        tree_leave(fs);
     }
-    new_node->child = child_head;
-    return new_node;
+    unlock_dirs(fs, dirs, locked);
+    rename_leave(fs);
+    METRICS_END(METRIC_MV, t0);
 }
 
-void fs_cp(const char *source_path, const char *dest_path) {
-    Node *source_node = find_node_by_path(source_path);
+// Diretórios são copiados com toda a subárvore, em paralelo (copy_subtree)
+// No modo concorrente, só o destino é travado: a cópia lê a origem com o
+// mutex da árvore seguro, e toda alteração da árvore é feita sob ele
+void fs_cp(fs_t *fs, const char *source_path, const char *dest_path) {
+    METRICS_START(t0);
+    Held held;
+    rename_enter(fs);
+    Node *source_node = lock_path(fs, source_path, LOCK_READ, &held);
+    release(fs, &held);
     if (!source_node) {
         fprintf(stderr, "cp: cannot stat '%s': No such file or directory\n", source_path);
+        rename_leave(fs);
+        METRICS_END(METRIC_CP, t0);
         return;
     }
 
-    Node* dest_target = find_node_by_path(dest_path);
-    Node* dest_parent;
-    char new_name[100];
-
-    if(dest_target && dest_target->type == DIR_NODE){
-        dest_parent = dest_target;
-        strcpy(new_name, source_node->name);
-    } else {
-        dest_parent = get_parent_dir_and_basename(dest_path, new_name);
-    }
-
+    const char *new_name;
+    size_t new_len;
+    Node *dest_parent = dest_dir(fs, dest_path, source_node, &new_name, &new_len);
     if (!dest_parent) {
         fprintf(stderr, "cp: cannot copy to '%s': Destination path not found\n", dest_path);
+        rename_leave(fs);
+        METRICS_END(METRIC_CP, t0);
         return;
     }
-    if (find_node_in_dir(dest_parent, new_name)) {
-        fprintf(stderr, "cp: cannot copy to '%s': Destination already exists\n", dest_path);
+    if (dest_parent->type != DIR_NODE) {
+        fprintf(stderr, "cp: cannot copy to '%s': Not a directory\n", dest_path);
+        rename_leave(fs);
+        METRICS_END(METRIC_CP, t0);
         return;
     }
-    
-    Node* new_node = copy_node_recursive(source_node, dest_parent);
-    strcpy(new_node->name, new_name);
-    attach_node(dest_parent, new_node);
+    if (reserved_name(new_name, new_len)) {
+        fprintf(stderr, "cp: cannot copy to '%s': Invalid name\n", dest_path);
+        rename_leave(fs);
+        METRICS_END(METRIC_CP, t0);
+        return;
+    }
+
+    node_lock(fs, dest_parent, LOCK_WRITE);
+    if (find_node_in_dir(fs, dest_parent, new_name, new_len)) {
+        fprintf(stderr, "cp: cannot copy to '%s': Destination already exists\n", dest_path);
+    } else {
+        tree_enter(fs);
+        Node* new_node = copy_subtree(fs, source_node, dest_parent);
+        set_node_name(fs, new_node, new_name, new_len);
+        attach_node(fs, dest_parent, new_node);
+        if (fs->journal) {
+            PathBuf p;
+            path_of(fs, source_node, &p);
+            journal_paths(fs, J_CP, p.str, p.len, new_node);
+            path_free(&p);
+        }
+        tree_leave(fs);
+    }
+    node_unlock(fs, dest_parent, LOCK_WRITE);
+    rename_leave(fs);
+    METRICS_END(METRIC_CP, t0);
 }
 
-// --- Funções de Serialização (Save/Load) e Exportação ---
+// --- Modo Concorrente e Sessões ---
 
-// Salva um nó recursivamente em um arquivo binário
-// Inclui o tipo do nó, nome, conteúdo (se for arquivo) e filhos 
-void save_node_recursive(FILE *file, Node *node) {
-    if (node == NULL) return;
+// Ao sair do modo concorrente, não há mais leitores sem travas, então as
+// liberações adiadas podem ser concluídas todas
+void fs_set_concurrent(fs_t *fs, int mode) {
+    fs->threads = mode != FS_SEQUENTIAL;
+    fs->rcu_reads = mode == FS_CONCURRENT;
+    alloc_set_defer(&fs->alloc, fs->threads);
+    if (!fs->threads) alloc_reclaim(&fs->alloc, ~0ull);
+}
 
-    fwrite(&node->type, sizeof(NodeType), 1, file);
-    size_t name_len = strlen(node->name) + 1;
-    fwrite(&name_len, sizeof(size_t), 1, file);
-    fwrite(node->name, sizeof(char), name_len, file);
+FsSession* fs_session_open(fs_t *fs) {
+    FsSession *session = (FsSession*)calloc(1, sizeof(FsSession));
+    if (!session) { perror("Failed to allocate session"); exit(1); }
+    session->fs = fs;
+    pthread_mutex_lock(&fs->sessions_mutex);
+    session->next = fs->sessions;
+    if (fs->sessions) fs->sessions->prev = session;
+    fs->sessions = session;
+    pthread_mutex_unlock(&fs->sessions_mutex);
+    return session;
+}
 
-    if (node->type == FILE_NODE) {
-        size_t content_len = node->content ? strlen(node->content) + 1 : 0;
-        fwrite(&content_len, sizeof(size_t), 1, file);
-        if (content_len > 0) {
-            fwrite(node->content, sizeof(char), content_len, file);
-        }
-    }
+void fs_session_close(FsSession *session) {
+    if (!session) return;
+    fs_t *fs = session->fs;
+    pthread_mutex_lock(&fs->sessions_mutex);
+    if (session->prev) session->prev->next = session->next;
+    else fs->sessions = session->next;
+    if (session->next) session->next->prev = session->prev;
+    pthread_mutex_unlock(&fs->sessions_mutex);
+    free(session);
+}
 
-    int child_count = 0;
-    for (Node *child = node->child; child; child = child->next) child_count++;
-    fwrite(&child_count, sizeof(int), 1, file);
-    
-    for (Node *child = node->child; child; child = child->next) {
-        save_node_recursive(file, child);
-    }
+void fs_session_bind(FsSession *session) {
+    pthread_once(&session_once, create_session_key);
+    pthread_setspecific(session_key, session);
 }
 
-// Abre o arquivo minifs.dat, salvando toda a árvore de nós
-// Começa pela raiz e salva recursivamente todos os nós
-// através da função save_node_recursive
-// Fecha o arquivo após salvar
-void fs_save(const char* filepath) {
-    FILE *file = fopen(filepath, "wb");
-    if (!file) { perror("Error opening file for saving"); return; }
-    save_node_recursive(file, root);
-    fclose(file);
-    printf("File system saved to %s\n", filepath);
+// --- Funções de Serialização (Save/Load) e Exportação ---
+
+// Salva a árvore no formato de imagem atual (ver image.h)
+// Diretórios que ainda não foram carregados são copiados direto da
+// imagem mapeada, sem precisar criar seus nós em memória. A gravação vai
+// para um arquivo temporário que substitui o original só depois de
+// completa, então uma falha no meio preserva a imagem anterior
+void fs_save(fs_t *fs, const char* filepath) {
+    METRICS_START(t0);
+    tree_enter(fs); // Nenhuma alteração durante a gravação
+    finish_checkpoint(fs, 1); // Um checkpoint em andamento usa o mesmo arquivo temporário
+    int failed = image_save(filepath, fs->root, fs->image, fs->lsn, subtree_workers(fs),
+                            fs->dedup.enabled, &fs->saved) != 0;
+    if (failed) perror("Error saving file system");
+    tree_leave(fs);
+    if (!failed) printf("File system saved to %s\n", filepath);
+    METRICS_END(METRIC_SAVE, t0);
 }
 
-// Carrega um nó recursivamente de um arquivo binário
+// Carrega um nó recursivamente de um arquivo no formato antigo (sem
+// cabeçalho), mantido para migração: a próxima gravação já usa a imagem
 // Lê o tipo do nó, nome, conteúdo (se for arquivo) e filhos
-Node* load_node_recursive(FILE *file, Node *parent) {
+Node* load_node_recursive(fs_t *fs, FILE *file, Node *parent) {
     NodeType type;
     if (fread(&type, sizeof(NodeType), 1, file) != 1) return NULL;
 
     size_t name_len;
-    fread(&name_len, sizeof(size_t), 1, file);
-    char name[100];
+    if (fread(&name_len, sizeof(size_t), 1, file) != 1 || name_len == 0) return NULL;
+    char stack_buf[256];
+    char *name = name_len <= sizeof(stack_buf) ? stack_buf : (char*)malloc(name_len);
+    if (!name) return NULL;
     fread(name, sizeof(char), name_len, file);
 
-    Node* new_node = (Node*)malloc(sizeof(Node));
-    strcpy(new_node->name, name);
+    Node* new_node = alloc_node(&fs->alloc);
+    set_node_name(fs, new_node, name, strnlen(name, name_len));
+    if (name != stack_buf) free(name);
     new_node->type = type;
     new_node->parent = parent;
+    new_node->child_count = 0;
+    new_node->index = NULL;
     
     // CORREÇÃO: Atribuições separadas para evitar erro de tipo de ponteiro incompatível.
     new_node->child = NULL;
+    new_node->last_child = NULL;
     new_node->next = NULL;
+    new_node->prev = NULL;
     new_node->content = NULL;
 
     if (type == FILE_NODE) {
         size_t content_len;
         fread(&content_len, sizeof(size_t), 1, file);
         if (content_len > 0) {
-            new_node->content = (char*)malloc(content_len);
-            fread(new_node->content, sizeof(char), content_len, file);
+            FileContent *c = content_create(&fs->alloc, content_len - 1);
+            for (size_t i = 0; i < content_chunk_count(c); i++) {
+                size_t len;
+                char *data = content_chunk(c, i, &len, NULL);
+                fread(data, sizeof(char), len, file);
+            }
+            fgetc(file); // '\0' final
+            new_node->content = c;
         }
     }
 
@@ -501,60 +2526,633 @@ Node* load_node_recursive(FILE *file, Node *parent) {
     
     Node *prev_child = NULL;
     for (int i = 0; i < child_count; i++) {
-        Node *child_node = load_node_recursive(file, new_node);
+        Node *child_node = load_node_recursive(fs, file, new_node);
+        if (!child_node) break; // Arquivo truncado
         if (i == 0) new_node->child = child_node;
         else prev_child->next = child_node;
+        child_node->prev = prev_child;
         prev_child = child_node;
+        new_node->child_count++;
+        NodeTotals share = node_share(child_node);
+        new_node->totals.bytes += share.bytes;
+        new_node->totals.files += share.files;
+        new_node->totals.dirs += share.dirs;
     }
+    new_node->last_child = prev_child;
+    index_children(fs, new_node);
     return new_node;
 }
 
 // Carrega o sistema de arquivos a partir de um arquivo binário
-// Abre o arquivo minifs.dat, carregando toda a árvore de nós
-void fs_load(const char* filepath) {
+// Uma imagem no formato atual é só mapeada: apenas a raiz é criada, e os
+// demais diretórios são carregados no primeiro acesso. Arquivos sem
+// cabeçalho são lidos inteiros pelo formato antigo
+void fs_load(fs_t *fs, const char* filepath) {
+    METRICS_START(t0);
+    ImageStatus status;
+    Image *img = image_open(filepath, &status);
+    if (status == IMAGE_OK) {
+        const ImageNode *rec = image_node(img, 0);
+        if (!rec || rec->type != DIR_NODE) {
+            fprintf(stderr, "load: %s: corrupt image\n", filepath);
+            image_close(img);
+            if (!fs->root) fs_init(fs);
+            METRICS_END(METRIC_LOAD, t0);
+            return;
+        }
+        fs_destroy(fs);
+        fs_init(fs);
+        fs->image = img;
+        fs->lsn = image_checkpoint_lsn(img);
+        if (rec->size > 0) {
+            fs->root->flags |= NODE_LAZY;
+            fs->root->child_count = (unsigned int)rec->size;
+            map_totals(img, 0, fs->root);
+            image_bind(img, fs->root, 0);
+        }
+        printf("File system loaded from %s\n", filepath);
+        METRICS_END(METRIC_LOAD, t0);
+        return;
+    }
+    if (status == IMAGE_BAD_VERSION || status == IMAGE_CORRUPT) {
+        fprintf(stderr, "load: %s: %s\n", filepath,
+                status == IMAGE_BAD_VERSION ? "unsupported image version" : "corrupt image");
+        if (!fs->root) fs_init(fs);
+        METRICS_END(METRIC_LOAD, t0);
+        return;
+    }
+
     FILE *file = fopen(filepath, "rb");
     if (!file) {
         printf("No save file found. Starting a new file system.\n");
-        fs_init();
+        fs_init(fs);
+        METRICS_END(METRIC_LOAD, t0);
         return;
     }
-    fs_destroy(root);
-    root = load_node_recursive(file, NULL);
-    current_dir = root;
+    // Buffer grande: os muitos campos pequenos são lidos da memória
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+    fs_destroy(fs);
+    fs->lsn = 0;
+    fs->root = load_node_recursive(fs, file, NULL);
+    fs->current_dir = fs->root;
     fclose(file);
     printf("File system loaded from %s\n", filepath);
+    METRICS_END(METRIC_LOAD, t0);
+}
+
+// --- Carga Completa da Imagem (em paralelo) ---
+
+// Nome de um registro da imagem para um nó criado por um worker. Dentro de
+// uma subárvore, um nome repetido tem sempre o mesmo offset no pool da
+// imagem, então o cache do worker resolve a maioria só com a contagem
+// atômica; a tabela de nomes só é alterada com names_mutex
+static void preload_name(fs_t *fs, TreeWorker* w, Node* node, const char* name, size_t len) {
+    if (!w->name_cache) {
+        w->name_cache = (NameCacheEntry*)calloc(NAME_CACHE_SIZE, sizeof(NameCacheEntry));
+        if (!w->name_cache) { perror("Failed to allocate name cache"); exit(1); }
+    }
+    uintptr_t key = (uintptr_t)name;
+    NameCacheEntry *e = &w->name_cache[(key ^ (key >> 12)) & (NAME_CACHE_SIZE - 1)];
+    const char *interned;
+    if (e->image_name == name) {
+        interned = names_retain_shared(e->interned);
+    } else {
+        pthread_mutex_lock(&fs->names_mutex);
+        interned = names_intern_in(&fs->names, w->alloc, name, len, dirindex_hash(name, len));
+        pthread_mutex_unlock(&fs->names_mutex);
+        e->image_name = name;
+        e->interned = interned;
+    }
+    node->name = interned;
+    node->name_hash = NAME_HEADER(interned)->hash;
+    node->name_len = (unsigned int)len;
+}
+
+// Cria os filhos de task.a a partir do registro task.b - 1 e agenda os
+// subdiretórios, que ficam com NODE_LAZY (quem chegar neles espera no
+// mutex da árvore) até a própria tarefa completar a lista. Sem registro,
+// task.a é um diretório já em memória, que só é percorrido, ou um
+// diretório associado à imagem por uma carga anterior (tarefa fixa)
+static size_t preload_task(TaskPool* pool, int worker, Task task, void* ctx) {
+    fs_t *fs = ((SubtreeOp*)ctx)->fs;
+    TreeWorker *w = &((SubtreeOp*)ctx)->workers[worker];
+    Node *dir = (Node*)task.a;
+    uint64_t id;
+    if (task.b) {
+        id = (uint64_t)(uintptr_t)task.b - 1;
+    } else if (!(dir->flags & NODE_LAZY)) {
+        size_t count = 1;
+        for (Node *c = dir->child; c; c = c->next, count++) {
+            Task sub = { c, NULL };
+            if (c->type != DIR_NODE || !has_children(c)) continue;
+            if (c->flags & NODE_LAZY) taskpool_push_pinned(pool, sub);
+            else taskpool_push(pool, worker, sub);
+        }
+        return count;
+    } else if (!image_take(fs->image, dir, &id)) { // Só no worker 0
+        __atomic_store_n(&dir->flags, (unsigned char)(dir->flags & ~NODE_LAZY), __ATOMIC_RELEASE);
+        return 1;
+    }
+
+    const ImageNode *rec = image_node(fs->image, id);
+    if (!rec) fprintf(stderr, "load: corrupt image record %llu\n", (unsigned long long)id);
+    Node *prev_child = NULL;
+    unsigned int count = 0;
+    for (uint64_t i = 0; rec && i < rec->size; i++) {
+        const ImageNode *c = image_node(fs->image, rec->first + i);
+        if (!c) {
+            fprintf(stderr, "load: corrupt image record %llu\n", (unsigned long long)(rec->first + i));
+            break;
+        }
+        Node *child = alloc_node(w->alloc);
+        preload_name(fs, w, child, image_name(fs->image, c), c->name_len);
+        child->type = (unsigned char)c->type;
+        child->parent = dir;
+        if (c->type == FILE_NODE) {
+            if (c->size > 0) child->content = map_file(w->alloc, fs->image, c);
+        } else if (c->size > 0) {
+            child->flags |= NODE_LAZY;
+            child->child_count = (unsigned int)c->size;
+            map_totals(fs->image, rec->first + i, child);
+            Task sub = { child, (void*)(uintptr_t)(rec->first + i + 1) };
+            taskpool_push(pool, worker, sub);
+        }
+        if (prev_child) prev_child->next = child;
+        else dir->child = child;
+        child->prev = prev_child;
+        prev_child = child;
+        count++;
+    }
+    dir->child_count = count;
+    dir->last_child = prev_child;
+    index_children_in(fs, dir, w->alloc);
+    __atomic_store_n(&dir->flags, (unsigned char)(dir->flags & ~NODE_LAZY), __ATOMIC_RELEASE);
+    return count + 1;
+}
+
+typedef struct {
+    Task task;
+    uint64_t size;         // Registros da subárvore, segundo a imagem
+} PreloadRoot;
+
+static int preload_root_cmp(const void* a, const void* b) {
+    uint64_t x = ((const PreloadRoot*)a)->size, y = ((const PreloadRoot*)b)->size;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Tamanho da subárvore do registro id, se ela está no diretório de
+// subárvores da imagem (que segue a ordem do bloco da raiz)
+static uint64_t image_subtree_size(fs_t *fs, uint64_t id) {
+    uint64_t n;
+    const ImageSubtree *s = image_subtrees(fs->image, &n);
+    uint64_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (s[mid].node == id) return s[mid].count;
+        if (s[mid].node < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return 0;
+}
+
+void fs_preload(fs_t *fs) {
+    tree_enter(fs);
+    if (!fs->image) {
+        tree_leave(fs);
+        return;
+    }
+    load_children(fs, fs->root);
+    size_t n = 0;
+    for (Node *c = fs->root->child; c; c = c->next) n += has_children(c);
+    PreloadRoot *roots = (PreloadRoot*)malloc((n ? n : 1) * sizeof(PreloadRoot));
+    Task *tasks = (Task*)malloc((n ? n : 1) * sizeof(Task));
+    if (!roots || !tasks) { perror("Failed to allocate preload tasks"); exit(1); }
+
+    // As subárvores da raiz entram da maior para a menor: os outros
+    // workers roubam do começo da fila, então começam pelas maiores
+    size_t k = 0;
+    for (Node *c = fs->root->child; c; c = c->next) {
+        if (!has_children(c)) continue;
+        uint64_t id;
+        roots[k].task.a = c;
+        roots[k].task.b = NULL;
+        roots[k].size = 0;
+        if (c->flags & NODE_LAZY) {
+            if (image_take(fs->image, c, &id)) {
+                roots[k].task.b = (void*)(uintptr_t)(id + 1);
+                roots[k].size = image_subtree_size(fs, id);
+            } else {
+                c->flags &= (unsigned char)~NODE_LAZY;
+            }
+        }
+        k++;
+    }
+    qsort(roots, n, sizeof(PreloadRoot), preload_root_cmp);
+    for (size_t i = 0; i < n; i++) tasks[i] = roots[i].task;
+
+    SubtreeOp *op = subtree_begin(fs);
+    if (n > 0) taskpool_run_all(subtree_workers(fs), preload_task, op, tasks, n);
+    subtree_end(op);
+    free(roots);
+    free(tasks);
+    tree_leave(fs);
+}
+
+// --- Journal e Checkpoints ---
+
+// Registra uma operação já aplicada com sucesso, identificando o nó pelo
+// caminho absoluto (o diretório atual não existe na recuperação)
+static void journal_node(fs_t *fs, JournalOp op, Node* node, const void* data, size_t len, uint64_t offset) {
+    if (!fs->journal) return;
+    PathBuf p;
+    path_of(fs, node, &p);
+    fs->lsn = journal_append(fs->journal, op, p.str, p.len, data, len, offset);
+    path_free(&p);
+    maybe_checkpoint(fs);
+}
+
+// Registra uma operação com um caminho de origem e, se houver, o caminho
+// final do nó afetado (destino de mv e cp)
+static void journal_paths(fs_t *fs, JournalOp op, const char* a, size_t a_len, Node* node) {
+    if (!fs->journal) return;
+    PathBuf p;
+    if (node) path_of(fs, node, &p);
+    fs->lsn = journal_append(fs->journal, op, a, a_len, node ? p.str : NULL, node ? p.len : 0, 0);
+    if (node) path_free(&p);
+    maybe_checkpoint(fs);
+}
+
+// Reaplica um registro do journal; os caminhos são absolutos e a operação
+// já deu certo uma vez sobre o mesmo estado, então dá certo de novo
+typedef struct {
+    fs_t *fs;
+    unsigned long long count;
+} Replay;
+
+static void replay_record(const JournalRecord *rec, void *ctx) {
+    fs_t *fs = ((Replay*)ctx)->fs;
+    switch (rec->op) {
+        case J_MKDIR:  fs_mkdir(fs, rec->a); break;
+        case J_TOUCH:  fs_touch(fs, rec->a); break;
+        case J_ECHO:   fs_echo(fs, rec->a, rec->b); break;
+        case J_WRITE:  fs_write(fs, rec->a, (size_t)rec->offset, rec->b, rec->b_len); break;
+        case J_APPEND: fs_append(fs, rec->a, rec->b, rec->b_len); break;
+        case J_MV:     fs_mv(fs, rec->a, rec->b); break;
+        case J_CP:     fs_cp(fs, rec->a, rec->b); break;
+        case J_RM:     fs_rm(fs, rec->a); break;
+        case J_RMR:    fs_rm_recursive(fs, rec->a); break;
+    }
+    fs->lsn = rec->lsn;
+    ((Replay*)ctx)->count++;
+}
+
+// Em milissegundos: em segundos inteiros, um intervalo de 1 s venceria
+// logo depois de uma virada de segundo
+static long long monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Grava a árvore na imagem com o LSN atual. Com fork, quem grava é um
+// processo filho, que enxerga uma cópia (copy-on-write) da memória no
+// instante do fork; o shell segue atendendo comandos enquanto isso.
+// O log é rotacionado só quando o filho termina com sucesso.
+//
+// No filho só existe a thread que chamou fork, e as travas das outras (a
+// do journal, as do pool de tarefas) podem ter ficado presas no meio:
+// ele grava com um worker só, sem criar threads
+static void start_checkpoint(fs_t *fs) {
+    if (!fs->journal) return;
+#ifndef _WIN32
+    if (fs->checkpoint_pid) return;
+#endif
+    journal_commit(fs->journal);
+    uint64_t offset = journal_bytes(fs->journal);
+    fs->checkpoint_time = monotonic_ms();
+#ifndef _WIN32
+    // O resultado da gravação volta pelo pipe para o relatório do dedup
+    int fds[2];
+    if (pipe(fds) != 0) fds[0] = fds[1] = -1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        ImageSaveStats saved;
+        if (image_save(fs->image_path, fs->root, fs->image, fs->lsn, 1, fs->dedup.enabled, &saved) != 0) _exit(1);
+        if (fds[1] >= 0 && write(fds[1], &saved, sizeof(saved)) != (ssize_t)sizeof(saved)) _exit(1);
+        _exit(0);
+    }
+    if (fds[1] >= 0) close(fds[1]);
+    if (pid > 0) {
+        fs->checkpoint_pid = pid;
+        fs->checkpoint_stats_fd = fds[0];
+        fs->checkpoint_offset = offset;
+        return;
+    }
+    if (fds[0] >= 0) close(fds[0]);
+#endif
+    // Sem fork, o checkpoint é feito no próprio processo
+    if (image_save(fs->image_path, fs->root, fs->image, fs->lsn, subtree_workers(fs),
+                   fs->dedup.enabled, &fs->saved) == 0) {
+        journal_truncate_front(fs->journal, offset);
+    } else {
+        perror("checkpoint: error saving file system");
+    }
+}
+
+// Colhe o checkpoint em andamento (esperando por ele, se wait) e descarta
+// do log a parte que ele cobre
+static void finish_checkpoint(fs_t *fs, int wait) {
+#ifndef _WIN32
+    if (!fs->checkpoint_pid) return;
+    int status;
+    pid_t done = waitpid(fs->checkpoint_pid, &status, wait ? 0 : WNOHANG);
+    if (done == 0) return;
+    fs->checkpoint_pid = 0;
+    if (done > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        journal_truncate_front(fs->journal, fs->checkpoint_offset);
+        ImageSaveStats saved;
+        if (fs->checkpoint_stats_fd >= 0 &&
+            read(fs->checkpoint_stats_fd, &saved, sizeof(saved)) == (ssize_t)sizeof(saved)) {
+            fs->saved = saved;
+        }
+    } else {
+        fprintf(stderr, "checkpoint: error saving %s\n", fs->image_path);
+    }
+    if (fs->checkpoint_stats_fd >= 0) close(fs->checkpoint_stats_fd);
+#else
+    (void)wait;
+#endif
+}
+
+// Um checkpoint vem quando o log passa de checkpoint_bytes ou, com poucas
+// escritas, quando o último fica mais velho que checkpoint_interval. Sem
+// operações novas o log não cresce, então não há o que gravar
+static void maybe_checkpoint(fs_t *fs) {
+    finish_checkpoint(fs, 0);
+    if ((fs->checkpoint_bytes && journal_bytes(fs->journal) >= fs->checkpoint_bytes) ||
+        (fs->checkpoint_interval && monotonic_ms() - fs->checkpoint_time >= fs->checkpoint_interval * 1000LL)) {
+        start_checkpoint(fs);
+    }
+}
+
+void fs_recover(fs_t *fs, const char *filepath, const JournalConfig *config) {
+    fs_load(fs, filepath);
+
+    size_t len = strlen(filepath);
+    char *journal_path = (char*)malloc(len + 5);
+    if (!journal_path) { perror("Failed to allocate path"); exit(1); }
+    memcpy(journal_path, filepath, len);
+    memcpy(journal_path + len, ".wal", 5);
+
+    uint64_t base_lsn = fs->lsn, last_lsn, valid_bytes;
+    Replay replay = { fs, 0 };
+    if (journal_replay(journal_path, base_lsn, replay_record, &replay, &last_lsn, &valid_bytes) != 0) {
+        fprintf(stderr, "journal: %s: not a journal file, changes will not be logged\n", journal_path);
+        free(journal_path);
+        return;
+    }
+    if (replay.count > 0) printf("Replayed %llu operations from %s\n", replay.count, journal_path);
+
+    uint64_t next_lsn = (last_lsn > base_lsn ? last_lsn : base_lsn) + 1;
+    fs->journal = journal_open(journal_path, config, valid_bytes, next_lsn);
+    if (!fs->journal) {
+        perror("journal: cannot open log, changes will not be logged");
+    } else {
+        fs->image_path = (char*)malloc(len + 1);
+        if (!fs->image_path) { perror("Failed to allocate path"); exit(1); }
+        memcpy(fs->image_path, filepath, len + 1);
+        fs->checkpoint_bytes = config->checkpoint_bytes;
+        fs->checkpoint_interval = config->checkpoint_interval_s;
+        fs->checkpoint_time = monotonic_ms();
+    }
+    free(journal_path);
+}
+
+void fs_checkpoint(fs_t *fs) {
+    if (!fs->journal) {
+        fprintf(stderr, "checkpoint: no journal open\n");
+        return;
+    }
+    tree_enter(fs);
+    finish_checkpoint(fs, 1);
+    start_checkpoint(fs);
+    finish_checkpoint(fs, 1);
+    tree_leave(fs);
+    printf("Checkpoint written to %s\n", fs->image_path);
+}
+
+void fs_shutdown(fs_t *fs) {
+    if (!fs->journal) return;
+    finish_checkpoint(fs, 1);
+    journal_close(fs->journal);
+    fs->journal = NULL;
+    free(fs->image_path);
+    fs->image_path = NULL;
+}
+
+// --- Exportação da Árvore (JSON e NDJSON) ---
+
+#define EXPORT_BUFFER (1 << 16)
+
+// Saída da exportação: acumula em um buffer e só chama fwrite quando ele
+// enche, em vez de um fprintf por campo
+typedef struct {
+    FILE *file;
+    char *buf;
+    size_t len;
+    int failed;
+} JsonOut;
+
+static void jout_flush(JsonOut* out) {
+    if (out->len > 0 && fwrite(out->buf, 1, out->len, out->file) != out->len) out->failed = 1;
+    out->len = 0;
+}
+
+static void jout_write(JsonOut* out, const char* data, size_t len) {
+    if (out->len + len > EXPORT_BUFFER) {
+        jout_flush(out);
+        if (len > EXPORT_BUFFER) {
+            if (fwrite(data, 1, len, out->file) != len) out->failed = 1;
+            return;
+        }
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+}
+
+#define jout_literal(out, s) jout_write(out, s, sizeof(s) - 1)
+
+static void jout_size(JsonOut* out, size_t value) {
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    do { *--p = (char)('0' + value % 10); value /= 10; } while (value);
+    jout_write(out, p, (size_t)(digits + sizeof(digits) - p));
+}
+
+// String JSON entre aspas. Aspas, barras e caracteres de controle são
+// escapados; o resto (inclusive UTF-8) sai como está, em trechos inteiros
+static void jout_string(JsonOut* out, const char* s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    jout_literal(out, "\"");
+    size_t run = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        jout_write(out, s + run, i - run);
+        run = i + 1;
+        char esc[6] = { '\\', (char)c, 0, 0, 0, 0 };
+        size_t esc_len = 2;
+        if (c == '\n') esc[1] = 'n';
+        else if (c == '\t') esc[1] = 't';
+        else if (c == '\r') esc[1] = 'r';
+        else if (c < 0x20) {
+            esc[1] = 'u'; esc[2] = '0'; esc[3] = '0';
+            esc[4] = hex[c >> 4]; esc[5] = hex[c & 0xf];
+            esc_len = 6;
+        }
+        jout_write(out, esc, esc_len);
+    }
+    jout_write(out, s + run, len - run);
+    jout_literal(out, "\"");
+}
+
+// Caminho do nó atual no NDJSON, atualizado a cada passo da descida (sem
+// a barra final; vazio na raiz)
+typedef struct {
+    char *str;
+    size_t len;
+    size_t cap;
+} ExportPath;
+
+static void export_path_push(ExportPath* p, const Node* node) {
+    size_t need = p->len + 1 + node->name_len + 1;
+    if (need > p->cap) {
+        size_t cap = p->cap ? p->cap * 2 : 256;
+        while (cap < need) cap *= 2;
+        char *grown = (char*)realloc(p->str, cap);
+        if (!grown) { perror("Failed to allocate path"); exit(1); }
+        p->str = grown;
+        p->cap = cap;
+    }
+    p->str[p->len++] = '/';
+    memcpy(p->str + p->len, node->name, node->name_len);
+    p->len += node->name_len;
+}
+
+// Abre o objeto de um nó. Em JSON, um diretório em que se vai descer fica
+// aberto na lista "children"; os outros já são fechados aqui
+static void export_node(JsonOut* out, const ExportOptions* opts, Node* node, const ExportPath* path,
+                        int depth, int descend, int truncated) {
+    if (opts->ndjson) {
+        jout_literal(out, "{\"path\":");
+        if (path->len == 0) jout_string(out, "/", 1);
+        else jout_string(out, path->str, path->len);
+        jout_literal(out, ",\"depth\":");
+        jout_size(out, (size_t)depth);
+    } else {
+        jout_literal(out, "{\"name\":");
+        jout_string(out, node->name, node->name_len);
+    }
+    if (node->type == DIR_NODE) {
+        jout_literal(out, ",\"type\":\"directory\"");
+    } else {
+        jout_literal(out, ",\"type\":\"file\"");
+        if (opts->sizes) {
+            jout_literal(out, ",\"size\":");
+            jout_size(out, content_size(node->content));
+        }
+    }
+    if (truncated) jout_literal(out, ",\"truncated\":true");
+    if (opts->ndjson) jout_literal(out, "}\n");
+    else if (descend) jout_literal(out, ",\"children\":[");
+    else jout_literal(out, "}");
 }
 
-// Escreve no arquivo JSON a estrutura da árvore de nós
-// Converte os nomes de nós de wchar_t para char* para JSON
-void export_recursive(FILE *file, Node *node, int is_last) {
-    if (node == NULL) return;
-    fprintf(file, "{");
-    fprintf(file, "\"name\":\"%s\",", node->name);
-    fprintf(file, "\"type\":\"%s\"", (node->type == DIR_NODE) ? "directory" : "file");
+// Percorre a subárvore em pré-ordem sem recursão, com os ponteiros
+// parent e next, então a profundidade da árvore não pesa na pilha
+static void export_subtree(fs_t *fs, JsonOut* out, const ExportOptions* opts, Node* start) {
+    ExportPath path = { NULL, 0, 0 };
+    if (start != fs->root) {
+        PathBuf p;
+        path_of(fs, start, &p);
+        path.cap = p.len + 256;
+        path.str = (char*)malloc(path.cap);
+        if (!path.str) { perror("Failed to allocate path"); exit(1); }
+        memcpy(path.str, p.str, p.len);
+        path.len = p.len;
+        path_free(&p);
+    }
 
-    if (node->type == DIR_NODE && node->child) {
-        fprintf(file, ",\"children\":[");
-        Node *child = node->child;
-        while (child) {
-            export_recursive(file, child, child->next == NULL);
-            child = child->next;
+    Node *node = start;
+    int depth = 0;
+    for (;;) {
+        int descend = 0, truncated = 0;
+        if (has_children(node)) {
+            if (opts->max_depth < 0 || depth < opts->max_depth) {
+                load_children(fs, node);
+                descend = node->child != NULL;
+            } else {
+                truncated = 1;
+            }
         }
-        fprintf(file, "]");
+        export_node(out, opts, node, &path, depth, descend, truncated);
+        if (descend) {
+            node = node->child;
+            depth++;
+            export_path_push(&path, node);
+            continue;
+        }
+        while (node != start && !node->next) {
+            path.len -= node->name_len + 1;
+            node = node->parent;
+            depth--;
+            if (!opts->ndjson) jout_literal(out, "]}");
+        }
+        if (node == start) break;
+        if (!opts->ndjson) jout_literal(out, ",");
+        path.len -= node->name_len + 1;
+        node = node->next;
+        export_path_push(&path, node);
     }
-    fprintf(file, "}");
-    if (!is_last) fprintf(file, ",");
+    if (!opts->ndjson) jout_literal(out, "\n");
+    free(path.str);
 }
 
-// Exporta a árvore de nós para um arquivo JSON
-// Abre o arquivo em modo de escrita e chama a função recursiva para exportar
-void fs_export_tree_json(const char *filepath) {
-    FILE *file = fopen(filepath, "w");
+// Exporta a subárvore de path (ou a árvore inteira) para filepath
+void fs_export_tree_json(fs_t *fs, const char *filepath, const char *path, const ExportOptions *opts) {
+    static const ExportOptions defaults = { -1, 0, 0 };
+    if (!opts) opts = &defaults;
+
+    Held held;
+    rename_enter(fs);
+    Node *start = path ? lock_path(fs, path, LOCK_READ, &held) : fs->root;
+    if (path) release(fs, &held);
+    if (!start) {
+        fprintf(stderr, "tree: cannot access '%s': No such file or directory\n", path);
+        rename_leave(fs);
+        return;
+    }
+
+    FILE *file = fopen(filepath, "wb");
     if (!file) {
         perror("Error opening file for JSON export");
+        rename_leave(fs);
+        return;
+    }
+    JsonOut out = { file, (char*)malloc(EXPORT_BUFFER), 0, 0 };
+    if (!out.buf) { perror("Failed to allocate export buffer"); exit(1); }
+
+    tree_enter(fs);
+    export_subtree(fs, &out, opts, start);
+    tree_leave(fs);
+    rename_leave(fs);
+
+    jout_flush(&out);
+    free(out.buf);
+    if (fclose(file) != 0) out.failed = 1;
+    if (out.failed) {
+        fprintf(stderr, "tree: error writing '%s'\n", filepath);
         return;
     }
-    export_recursive(file, root, 1);
-    fclose(file);
     printf("File system tree exported to %s\n", filepath);
 }
@@ -4,46 +4,251 @@
 #define FS_H
 
 #include <stddef.h> // Para size_t
+#include <stdint.h>
+#include "alloc.h"
+#include "dcache.h"
+#include "dedup.h"
+#include "image.h"
 
 // 1. Estruturas de Dados
 typedef enum { FILE_NODE, DIR_NODE } NodeType;
 
+struct DirIndex;
+struct FileContent;
+
+// Totais da subárvore abaixo de um diretório (sem contar ele mesmo). Cada
+// alteração soma a diferença nos totais do pai e de todos os ancestrais,
+// então du e ls -l não percorrem nada; a imagem guarda os totais e um
+// diretório ainda não carregado já os tem
+typedef struct {
+    uint64_t bytes;        // Soma dos tamanhos dos arquivos
+    unsigned int files;
+    unsigned int dirs;
+} NodeTotals;
+
+// Layout compacto: o nome é um ponteiro para a tabela de nomes internados
+// (names.h), com hash e tamanho ao lado, e o tipo ocupa um único byte
 typedef struct Node {
-    char name[100];
-    NodeType type;
+    const char *name;      // Nome internado, terminado em '\0'
+    unsigned int name_hash; // Hash do nome, em cache para o índice do pai
+    unsigned int name_len;
+    unsigned int child_count; // Número de filhos, se for um diretório
+    unsigned char type;    // NodeType
+    unsigned char flags;   // NODE_LAZY
+    unsigned short lock;   // Trava de leitura/escrita do diretório (dirlock.h)
     struct Node *parent;
     struct Node *child;    // Ponteiro para o primeiro filho
+    struct Node *last_child; // Ponteiro para o último filho (anexação em O(1))
     struct Node *next;     // Ponteiro para o próximo irmão
-    char *content;         // Conteúdo, se for um arquivo
+    struct Node *prev;     // Ponteiro para o irmão anterior (remoção em O(1))
+    struct FileContent *content; // Conteúdo (com tamanho), se for um arquivo
+    struct DirIndex *index; // Índice hash dos filhos (só em diretórios grandes)
+    struct Node *name_next; // Outros nós com o mesmo nome (nameindex.h)
+    struct Node *name_prev;
+    NodeTotals totals;     // Só em diretórios
 } Node;
 
-// 2. Variáveis Globais (Estado do Sistema)
-extern Node *root;
-extern Node *current_dir;
+// Diretório vindo de uma imagem mapeada cujos filhos ainda não foram
+// criados em memória; eles são carregados no primeiro acesso
+#define NODE_LAZY 0x1
+
+// 2. Contexto (Estado do Sistema)
+// Cada contexto é um sistema de arquivos independente, com sua própria
+// árvore, alocador, tabela de nomes, cache de caminhos, journal, travas e
+// diretório de trabalho. Todas as funções recebem o contexto, então um
+// processo pode ter vários, inclusive um por thread, sem nada em comum
+// entre eles além das épocas de leitura (epoch.h) e das métricas
+typedef struct FsContext fs_t;
+
+fs_t* fs_create(void);         // Contexto novo, com uma árvore só com a raiz
+void fs_free(fs_t *fs);        // Sincroniza o journal e libera tudo
+
+Node* fs_root(fs_t *fs);
+Node* fs_cwd(fs_t *fs);        // Diretório de trabalho da thread (ver sessões)
 
 // 3. Funções da API do Sistema de Arquivos
-void fs_init();
-void fs_destroy(Node *node);
+void fs_init(fs_t *fs);        // Árvore nova, só com a raiz
+void fs_destroy(fs_t *fs);     // Libera a árvore inteira
 
 // Funções agora recebem caminhos (paths)
-void fs_mkdir(const char *path);
-void fs_touch(const char *path);
-void fs_ls(const char *path);
-void fs_cd(const char *path);
-void fs_rm(const char *path);
-void fs_cat(const char *path);
-void fs_echo(const char *path, const char *content);
+void fs_mkdir(fs_t *fs, const char *path);
+void fs_touch(fs_t *fs, const char *path);
+void fs_ls(fs_t *fs, const char *path);
+void fs_ls_long(fs_t *fs, const char *path); // ls -l: tamanhos, e totais dos diretórios
+void fs_cd(fs_t *fs, const char *path);
+void fs_rm(fs_t *fs, const char *path);
+void fs_rm_recursive(fs_t *fs, const char *path); // rm -r: o diretório e tudo abaixo dele
+void fs_cat(fs_t *fs, const char *path);
+void fs_echo(fs_t *fs, const char *path, const char *content);
+
+// Escrita parcial e binária: grava len bytes a partir de offset (como
+// pwrite) ou no final do arquivo, criando-o se não existir
+void fs_write(fs_t *fs, const char *path, size_t offset, const void *data, size_t len);
+void fs_append(fs_t *fs, const char *path, const void *data, size_t len);
 
 // Novas funções
-void fs_mv(const char *source_path, const char *dest_path);
-void fs_cp(const char *source_path, const char *dest_path);
+void fs_mv(fs_t *fs, const char *source_path, const char *dest_path);
+void fs_cp(fs_t *fs, const char *source_path, const char *dest_path);
 
 // Funções existentes
-void fs_pwd();
+void fs_pwd(fs_t *fs);
+
+// cp de diretórios, rm -r e grep -r percorrem a subárvore em paralelo (ver
+// taskpool.h), com até 'workers' threads; 0 = uma por processador e 1 =
+// sem threads auxiliares
+void fs_set_workers(fs_t *fs, int workers);
+
+// Estatísticas do alocador da árvore (nodes, bytes e uso dos slabs)
+void fs_alloc_stats(fs_t *fs, AllocStats *out);
+void fs_memstats(fs_t *fs);
+
+// Contadores do cache de resolução de caminhos (ver dcache.h)
+void fs_dcache_stats(fs_t *fs, DcacheStats *out);
+
+// Deduplicação de conteúdo (ver dedup.h), desligada por padrão. Ao ligar,
+// os arquivos já carregados passam pela tabela; ao desligar, os chunks
+// continuam compartilhados, mas os novos deixam de ser comparados. Com
+// ela ligada, fs_save também grava uma vez só os arquivos iguais. Trocar
+// sem outras threads ativas
+void fs_set_dedup(fs_t *fs, int on);
+// Tabela em memória e a última gravação, por fs_save ou checkpoint (zeros
+// antes da primeira)
+void fs_dedup_stats(fs_t *fs, DedupStats *mem, ImageSaveStats *saved);
+void fs_dedup_report(fs_t *fs);
+
+// Compressão dos chunks escritos (ver codec.h e content_compress),
+// desligada por padrão. codec é o nome de um codec ("lz4") ou "off"/NULL;
+// threshold é o menor chunk comprimido. Ao ligar, os arquivos já
+// carregados são comprimidos também (fora do modo concorrente); ao
+// desligar, os chunks comprimidos continuam comprimidos e legíveis. fs_save
+// grava os chunks como estão. Retorna -1 se o codec não existir
+#define FS_COMPRESS_THRESHOLD 4096
+int fs_set_compression(fs_t *fs, const char *codec, size_t threshold);
+
+// Arquivos carregados: bytes lógicos e bytes guardados nos chunks (um
+// chunk compartilhado conta em cada arquivo)
+typedef struct {
+    size_t files;
+    size_t bytes;
+    size_t chunks;
+    size_t compressed;     // Chunks comprimidos
+    size_t stored;
+    size_t tried;          // Chunks passados ao codec pelas escritas
+    size_t kept;           // Os que ficaram comprimidos
+} CompressionStats;
+void fs_compression_stats(fs_t *fs, CompressionStats *out);
+void fs_compression_report(fs_t *fs);
+
+// Tipo e tamanho de um nó, sem imprimir nada; retorna -1 se não existir
+typedef struct {
+    NodeType type;
+    size_t size;               // Arquivo: bytes; diretório: número de filhos
+    NodeTotals totals;         // Diretório: a subárvore abaixo dele (zeros num arquivo)
+} FsStat;
+int fs_stat(fs_t *fs, const char *path, FsStat *out);
+
+// du: bytes de cada entrada do diretório (os totais, nos subdiretórios) e
+// do próprio path, com quantos arquivos e diretórios há abaixo dele; num
+// arquivo, só o tamanho. O(1) por entrada. Retorna -1 se path não existir
+int fs_du(fs_t *fs, const char *path);
+
+// Confere os totais de todos os diretórios, recalculados a partir dos
+// arquivos (a árvore inteira é carregada da imagem). Cada diretório com
+// totais errados é mostrado em stderr; retorna quantos são
+long fs_check_totals(fs_t *fs);
+
+// Copia até len bytes do arquivo a partir de offset (como pread), sem
+// imprimir nada; retorna -1 se o caminho não existir ou não for arquivo
+int fs_read(fs_t *fs, const char *path, size_t offset, void *buf, size_t len, size_t *out_len);
+
+// Busca por nome na subárvore de dir, dir incluído (ver nameindex.h):
+// pattern é um nome exato ou um glob com '*' e '?'. fs_find imprime os
+// caminhos em ordem; fs_find_each os passa a fn, sem ordem definida, com o
+// mutex da árvore seguro (fn não pode chamar o fs). O primeiro uso carrega
+// a imagem inteira (fs_preload) e monta o índice. Retornam quantos nós
+// casaram, ou -1 se dir não for um diretório
+typedef void (*FsFindFn)(const char *path, size_t len, void *arg);
+long fs_find_each(fs_t *fs, const char *dir, const char *pattern, FsFindFn fn, void *arg);
+long fs_find(fs_t *fs, const char *dir, const char *pattern);
+
+// Linhas dos arquivos que contêm pattern (um texto, sem curingas): o
+// arquivo de path ou, com recursive, todos os arquivos da subárvore, lidos
+// em paralelo (ver fs_set_workers) com o núcleo de textscan.h, direto nos
+// chunks. fs_grep imprime "caminho:linha:texto"; fs_grep_each passa cada
+// linha (sem o '\n') a fn, na ordem da árvore, com o mutex da árvore
+// seguro (fn não pode chamar o fs). Retornam quantas linhas casaram, -1 se
+// path não existir ou -2 se for um diretório sem recursive
+typedef void (*FsGrepFn)(const char *path, size_t path_len, size_t line, const char *text, size_t len,
+                         void *arg);
+long fs_grep_each(fs_t *fs, const char *path, const char *pattern, int recursive, FsGrepFn fn,
+                  void *arg);
+long fs_grep(fs_t *fs, const char *path, const char *pattern, int recursive);
+
+// Modo concorrente: várias threads clientes usando a API ao mesmo tempo.
+// Cada diretório tem uma trava de leitura/escrita, tomada de cima para
+// baixo com lock coupling nas buscas de caminhos (trava o filho antes de
+// soltar o pai). rm, mv e cp passam antes por um mutex de renomeação, que
+// garante que nenhum diretório some ou muda de lugar enquanto eles travam
+// origem e destino (sempre dos ancestrais para os descendentes, e por
+// endereço entre diretórios sem parentesco). As alterações em si (alocador,
+// nomes, journal) são feitas sob um mutex da árvore, então leituras em
+// paralelo escalam e escritas em diretórios diferentes só disputam esse
+// trecho curto. Fora do modo concorrente nada disso é usado.
+//
+// Em FS_CONCURRENT, ls, cat, fs_stat e fs_read nem tocam nas travas: leem
+// a árvore dentro de uma seção de leitura (epoch.h), e os escritores só
+// publicam nós e conteúdos completos (o conteúdo de um arquivo é trocado
+// inteiro por uma cópia alterada). Nós, nomes e conteúdos soltos por rm e
+// mv só voltam ao alocador depois que todos os leitores que podiam vê-los
+// saíram. Um mv ou rm de diretório no meio de uma leitura faz a leitura ser
+// refeita; depois de algumas tentativas, ela usa as travas. Em
+// FS_CONCURRENT_LOCKED as leituras também usam as travas, como as escritas.
+//
+// Cada thread cliente abre uma sessão, com seu próprio diretório de
+// trabalho, e a associa a si com fs_session_bind. Sem sessão, os caminhos
+// relativos partem de current_dir (a sessão do shell). Uma sessão só vale
+// no contexto em que foi aberta.
+typedef struct FsSession FsSession;
+#define FS_SEQUENTIAL 0
+#define FS_CONCURRENT 1
+#define FS_CONCURRENT_LOCKED 2
+void fs_set_concurrent(fs_t *fs, int mode); // Trocar de modo sem outras threads ativas
+FsSession* fs_session_open(fs_t *fs);  // Começa na raiz
+void fs_session_close(FsSession *session);
+void fs_session_bind(FsSession *session); // Sessão da thread atual (NULL = nenhuma)
 
 // Funções de Serialização e Visualização
-void fs_save(const char* filepath);
-void fs_load(const char* filepath);
-void fs_export_tree_json(const char* filepath); // Exporta para o Python ler
+void fs_save(fs_t *fs, const char* filepath);
+void fs_load(fs_t *fs, const char* filepath);
+
+// fs_load só mapeia a imagem, e cada diretório é criado em memória no
+// primeiro acesso. fs_preload cria de uma vez todos os que faltam, com os
+// workers de fs_set_workers (uma tarefa por diretório, começando pelas
+// maiores subárvores da raiz). fs_save também grava as subárvores da raiz
+// em paralelo
+void fs_preload(fs_t *fs);
+
+// Durabilidade com journal (ver journal.h): fs_recover carrega a imagem,
+// reaplica o log gravado depois do último checkpoint e passa a registrar
+// cada operação em '<filepath>.wal'. fs_checkpoint grava a imagem na hora e
+// fs_shutdown espera um checkpoint em andamento e sincroniza o log
+struct JournalConfig;
+void fs_recover(fs_t *fs, const char* filepath, const struct JournalConfig* config);
+void fs_checkpoint(fs_t *fs);
+void fs_shutdown(fs_t *fs);
+
+// Exportação da árvore (comando tree), lida pelo visualize.py. Em JSON, um
+// documento só, com os filhos aninhados em "children"; em NDJSON, um nó por
+// linha, em pré-ordem, com o caminho completo e a profundidade, para quem
+// quer ler árvores enormes sem carregar tudo
+typedef struct {
+    int max_depth;         // Níveis exportados abaixo do nó inicial; -1 = todos
+    int sizes;             // Inclui o tamanho dos arquivos ("size")
+    int ndjson;
+} ExportOptions;
+
+// Exporta a subárvore de path (NULL = a árvore inteira); opts NULL = padrão.
+// Diretórios cortados por max_depth saem com "truncated": true
+void fs_export_tree_json(fs_t *fs, const char* filepath, const char* path, const ExportOptions* opts);
 
 #endif // FS_H
\ No newline at end of file
@@ -0,0 +1,1185 @@
+// miniFS/image.c
+
+#define _POSIX_C_SOURCE 200809L // fstat, mmap
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image.h"
+#include "fs.h"
+#include "content.h"
+#include "codec.h"
+#include "dedup.h"
+#include "taskpool.h"
+#include "utils.h"
+#include <pthread.h>
+
+#ifdef _WIN32
+// Sem mmap: a imagem é lida inteira para a memória
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// --- Mapa de ponteiros (Node* ou nome -> valor) ---
+
+// Endereçamento aberto com marcadores de remoção; usado para associar
+// diretórios não carregados aos seus registros e, na gravação, nomes aos
+// seus offsets no pool
+typedef struct {
+    const void *key;
+    uint64_t value;
+} PtrSlot;
+
+typedef struct {
+    PtrSlot *slots;
+    size_t cap;            // Potência de 2 (0 enquanto vazio)
+    size_t used;           // Ocupados, incluindo removidos
+    size_t live;
+} PtrMap;
+
+static const char ptrmap_tomb_marker;
+#define PTRMAP_TOMB ((const void*)&ptrmap_tomb_marker)
+
+static size_t ptrmap_hash(const void *key) {
+    uint64_t h = (uint64_t)(uintptr_t)key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t)h;
+}
+
+static PtrSlot* ptrmap_slot(const PtrMap *m, const void *key) {
+    if (m->cap == 0) return NULL;
+    size_t mask = m->cap - 1;
+    for (size_t i = ptrmap_hash(key) & mask;; i = (i + 1) & mask) {
+        if (m->slots[i].key == key) return &m->slots[i];
+        if (m->slots[i].key == NULL) return NULL;
+    }
+}
+
+static void ptrmap_put(PtrMap *m, const void *key, uint64_t value) {
+    if ((m->used + 1) * 4 > m->cap * 3) {
+        // Dobra se estiver cheio de verdade; senão só descarta os removidos
+        PtrMap grown = { NULL, m->cap ? m->cap : 64, 0, 0 };
+        if ((m->live + 1) * 2 > grown.cap) grown.cap *= 2;
+        grown.slots = (PtrSlot*)calloc(grown.cap, sizeof(PtrSlot));
+        if (!grown.slots) { perror("Failed to allocate image map"); exit(1); }
+        for (size_t i = 0; i < m->cap; i++) {
+            if (m->slots[i].key && m->slots[i].key != PTRMAP_TOMB) {
+                ptrmap_put(&grown, m->slots[i].key, m->slots[i].value);
+            }
+        }
+        free(m->slots);
+        *m = grown;
+    }
+    size_t mask = m->cap - 1;
+    size_t i = ptrmap_hash(key) & mask;
+    while (m->slots[i].key && m->slots[i].key != PTRMAP_TOMB) i = (i + 1) & mask;
+    if (!m->slots[i].key) m->used++;
+    m->live++;
+    m->slots[i].key = key;
+    m->slots[i].value = value;
+}
+
+// --- Leitura ---
+
+struct Image {
+    const char *base;
+    size_t size;
+    const ImageHeader *header;
+    const ImageNode *nodes;
+    const char *names;
+    const char *data;
+    uint64_t checkpoint_lsn;
+    const ImageSubtree *subtrees;
+    uint64_t subtree_count;
+    const ImageTotals *totals;
+    uint64_t totals_count;
+    ImageTotals *computed; // Totais calculados na abertura (antes da versão 6)
+    PtrMap lazy;           // Node* -> índice do registro
+};
+
+static int map_file(const char *path, const char **base, size_t *size) {
+#ifdef _WIN32
+    FILE *file = fopen(path, "rb");
+    if (!file) return -1;
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *buf = (char*)malloc(len > 0 ? (size_t)len : 1);
+    if (!buf || (len > 0 && fread(buf, 1, (size_t)len, file) != (size_t)len)) {
+        free(buf);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    *base = buf;
+    *size = (size_t)len;
+    return 0;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return -1; }
+    *size = (size_t)st.st_size;
+    *base = NULL;
+    if (*size > 0) {
+        void *p = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) { close(fd); return -1; }
+        *base = (const char*)p;
+    }
+    close(fd); // O mapeamento continua válido sem o descritor
+    return 0;
+#endif
+}
+
+static void unmap_file(const char *base, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    free((void*)base);
+#else
+    if (base) munmap((void*)base, size);
+#endif
+}
+
+// Verifica se [off, off+len) cabe em um arquivo de 'size' bytes
+static int in_bounds(uint64_t off, uint64_t len, uint64_t size) {
+    return off <= size && len <= size - off;
+}
+
+// O diretório de subárvores tem uma entrada por filho da raiz, no máximo,
+// então conferir todas não depende do tamanho da árvore
+static int subtrees_valid(const ImageHeader *h, const char *base, uint64_t size) {
+    if (h->subtrees_off % 8 != 0 || !in_bounds(h->subtrees_off, 0, size) ||
+        h->subtree_count > (size - h->subtrees_off) / sizeof(ImageSubtree)) {
+        return 0;
+    }
+    const ImageSubtree *s = (const ImageSubtree*)(base + h->subtrees_off);
+    for (uint64_t i = 0; i < h->subtree_count; i++) {
+        if (s[i].node == 0 || s[i].node >= h->node_count || s[i].first <= s[i].node ||
+            !in_bounds(s[i].first, s[i].count, h->node_count)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// A tabela de totais só é conferida por inteiro ao ser usada (um registro
+// fora de ordem faz a busca errar, mas nunca sair dos limites)
+static int totals_valid(const ImageHeader *h, uint64_t size) {
+    return h->totals_off % 8 == 0 && in_bounds(h->totals_off, 0, size) &&
+           h->totals_count <= (size - h->totals_off) / sizeof(ImageTotals);
+}
+
+// Imagens anteriores à versão 6: os totais de cada diretório, dos últimos
+// registros para os primeiros, somando os filhos (que já estão prontos).
+// Registros corrompidos contam como vazios
+static void compute_totals(Image *img) {
+    uint64_t n = img->header->node_count, dirs = 0;
+    ImageTotals *all = (ImageTotals*)calloc((size_t)n, sizeof(ImageTotals));
+    if (!all) { perror("Failed to allocate image totals"); exit(1); }
+    for (uint64_t i = n; i-- > 0;) {
+        if (img->nodes[i].type != DIR_NODE || img->nodes[i].size == 0) continue;
+        const ImageNode *rec = image_node(img, i); // Confere a faixa dos filhos
+        if (!rec) continue;
+        ImageTotals *t = &all[i];
+        for (uint64_t k = rec->first; k < rec->first + rec->size; k++) {
+            const ImageNode *c = &img->nodes[k];
+            if (c->type == FILE_NODE) {
+                t->bytes += c->size;
+                t->files++;
+            } else if (c->type == DIR_NODE) {
+                t->bytes += all[k].bytes;
+                t->files += all[k].files;
+                t->dirs += all[k].dirs + 1;
+            }
+        }
+        dirs++;
+    }
+    // Só os diretórios com filhos, como na tabela gravada
+    img->computed = (ImageTotals*)malloc((size_t)(dirs ? dirs : 1) * sizeof(ImageTotals));
+    if (!img->computed) { perror("Failed to allocate image totals"); exit(1); }
+    uint64_t k = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        if (all[i].files == 0 && all[i].dirs == 0) continue;
+        img->computed[k] = all[i];
+        img->computed[k++].node = i;
+    }
+    free(all);
+    img->totals = img->computed;
+    img->totals_count = k;
+}
+
+Image* image_open(const char *path, ImageStatus *status) {
+    const char *base;
+    size_t size;
+    if (map_file(path, &base, &size) != 0) {
+        *status = IMAGE_NOT_FOUND;
+        return NULL;
+    }
+    if (size < 8 || memcmp(base, IMAGE_MAGIC, 8) != 0) {
+        unmap_file(base, size);
+        *status = IMAGE_NOT_IMAGE;
+        return NULL;
+    }
+    if (size < sizeof(ImageHeader)) {
+        unmap_file(base, size);
+        *status = IMAGE_CORRUPT;
+        return NULL;
+    }
+
+    const ImageHeader *h = (const ImageHeader*)base;
+    if (h->version < IMAGE_MIN_VERSION || h->version > IMAGE_VERSION) {
+        unmap_file(base, size);
+        *status = IMAGE_BAD_VERSION;
+        return NULL;
+    }
+    uint32_t min_header = h->version >= 6 ? sizeof(ImageHeader) :
+                          h->version >= 4 ? offsetof(ImageHeader, totals_off) :
+                          h->version == 3 ? offsetof(ImageHeader, subtrees_off) :
+                          offsetof(ImageHeader, checkpoint_lsn);
+    if (h->header_size < min_header || h->header_size > size || h->node_count == 0 ||
+        h->nodes_off % 8 != 0 || !in_bounds(h->nodes_off, 0, size) ||
+        h->node_count > (size - h->nodes_off) / sizeof(ImageNode) ||
+        !in_bounds(h->names_off, h->names_size, size) ||
+        !in_bounds(h->data_off, h->data_size, size) ||
+        (h->version >= 4 && !subtrees_valid(h, base, size)) ||
+        (h->version >= 6 && !totals_valid(h, size))) {
+        unmap_file(base, size);
+        *status = IMAGE_CORRUPT;
+        return NULL;
+    }
+
+    Image *img = (Image*)calloc(1, sizeof(Image));
+    if (!img) { perror("Failed to allocate image"); exit(1); }
+    img->base = base;
+    img->size = size;
+    img->header = h;
+    img->nodes = (const ImageNode*)(base + h->nodes_off);
+    img->names = base + h->names_off;
+    img->data = base + h->data_off;
+    img->checkpoint_lsn = h->version >= 3 ? h->checkpoint_lsn : 0;
+    if (h->version >= 4) {
+        img->subtrees = (const ImageSubtree*)(base + h->subtrees_off);
+        img->subtree_count = h->subtree_count;
+    }
+    if (h->version >= 6) {
+        img->totals = (const ImageTotals*)(base + h->totals_off);
+        img->totals_count = h->totals_count;
+    } else {
+        compute_totals(img);
+    }
+    *status = IMAGE_OK;
+    return img;
+}
+
+void image_close(Image *img) {
+    if (!img) return;
+    unmap_file(img->base, img->size);
+    free(img->lazy.slots);
+    free(img->computed);
+    free(img);
+}
+
+uint64_t image_checkpoint_lsn(const Image *img) {
+    return img->checkpoint_lsn;
+}
+
+const ImageSubtree* image_subtrees(const Image *img, uint64_t *count) {
+    *count = img->subtree_count;
+    return img->subtrees;
+}
+
+// Quadro de um arquivo: a tabela precisa cobrir exatamente os bytes do
+// quadro, chunks sem compressão têm o tamanho lógico do chunk e os
+// comprimidos usam um codec conhecido. Custa O(chunks), como a carga
+static int frame_valid(const Image *img, const ImageNode *rec) {
+    uint64_t n = (rec->size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    uint64_t head = IMAGE_FRAME_HEAD(n), bytes;
+    if (!in_bounds(rec->first, head, img->header->data_size)) return 0;
+    const char *frame = img->data + rec->first;
+    memcpy(&bytes, frame, sizeof(bytes));
+    if (bytes < head || !in_bounds(rec->first, bytes, img->header->data_size)) return 0;
+    uint64_t total = head;
+    for (uint64_t k = 0; k < n; k++) {
+        uint32_t entry;
+        memcpy(&entry, frame + sizeof(uint64_t) + k * sizeof(uint32_t), sizeof(entry));
+        uint64_t len = rec->size - k * CHUNK_SIZE < CHUNK_SIZE ? rec->size - k * CHUNK_SIZE : CHUNK_SIZE;
+        uint32_t stored = IMAGE_FRAME_STORED(entry), codec = IMAGE_FRAME_CODEC(entry);
+        if (codec ? stored == 0 || !codec_get(codec) : stored != len) return 0;
+        total += stored;
+    }
+    return total == bytes;
+}
+
+const ImageNode* image_node(const Image *img, uint64_t i) {
+    const ImageHeader *h = img->header;
+    if (i >= h->node_count) return NULL;
+    const ImageNode *rec = &img->nodes[i];
+    // O nome precisa caber no pool junto com o '\0' final
+    if (!in_bounds(rec->name_off, (uint64_t)rec->name_len + 1, h->names_size) ||
+        img->names[rec->name_off + rec->name_len] != '\0') {
+        return NULL;
+    }
+    if (rec->type == DIR_NODE) {
+        if (rec->size > 0 && (rec->first <= i || !in_bounds(rec->first, rec->size, h->node_count))) {
+            return NULL;
+        }
+    } else if (rec->type == FILE_NODE) {
+        if (rec->flags & IMAGE_NODE_FRAMED) {
+            if (!frame_valid(img, rec)) return NULL;
+        } else if (!in_bounds(rec->first, rec->size, h->data_size)) {
+            return NULL;
+        }
+    } else {
+        return NULL;
+    }
+    return rec;
+}
+
+const char* image_name(const Image *img, const ImageNode *rec) {
+    return img->names + rec->name_off;
+}
+
+const char* image_data(const Image *img, const ImageNode *rec) {
+    return img->data + rec->first;
+}
+
+void image_totals(const Image *img, uint64_t i, ImageTotals *out) {
+    uint64_t lo = 0, hi = img->totals_count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (img->totals[mid].node == i) {
+            *out = img->totals[mid];
+            return;
+        }
+        if (img->totals[mid].node < i) lo = mid + 1;
+        else hi = mid;
+    }
+    memset(out, 0, sizeof(ImageTotals));
+    out->node = i;
+}
+
+void image_bind(Image *img, Node *node, uint64_t i) {
+    ptrmap_put(&img->lazy, node, i);
+}
+
+int image_lookup(const Image *img, const Node *node, uint64_t *i) {
+    PtrSlot *slot = ptrmap_slot(&img->lazy, node);
+    if (!slot) return 0;
+    *i = slot->value;
+    return 1;
+}
+
+int image_take(Image *img, Node *node, uint64_t *i) {
+    PtrSlot *slot = ptrmap_slot(&img->lazy, node);
+    if (!slot) return 0;
+    if (i) *i = slot->value;
+    slot->key = PTRMAP_TOMB;
+    img->lazy.live--;
+    return 1;
+}
+
+// --- Gravação ---
+
+#define SAVE_BUFFER_SIZE (1 << 20)
+#define DATA_OFF ((uint64_t)sizeof(ImageHeader)) // A região de dados vem logo depois do cabeçalho
+#define BLOB_STRIPES 64        // Partes do mapa de blobs, cada uma com seu mutex
+
+// --- Mapa de blobs (deduplicação na gravação) ---
+
+// Um blob são os bytes gravados de um arquivo: os dados, ou o quadro
+// inteiro se houver chunks comprimidos. É identificado pelo hash e pelo
+// tamanho gravado; a origem (conteúdo em memória ou bytes da imagem
+// antiga) continua intacta durante a gravação e serve para conferir os
+// bytes
+typedef struct {
+    uint64_t hash;
+    uint64_t stored;           // Bytes gravados (0 = posição vazia)
+    uint64_t where;            // Offset na região de dados (ou registro, ver Writer)
+    const FileContent *content;
+    const char *bytes;
+    uint64_t size;             // Tamanho do arquivo
+    int framed;
+} BlobSlot;
+
+typedef struct {
+    BlobSlot *slots;
+    size_t cap;                // Potência de 2 (0 enquanto vazio)
+    size_t live;
+} BlobMap;
+
+static BlobSlot* blobmap_find(const BlobMap *m, uint64_t hash, uint64_t stored) {
+    if (m->cap == 0) return NULL;
+    size_t mask = m->cap - 1;
+    for (size_t i = (size_t)hash & mask; m->slots[i].stored; i = (i + 1) & mask) {
+        if (m->slots[i].hash == hash && m->slots[i].stored == stored) return &m->slots[i];
+    }
+    return NULL;
+}
+
+static void blobmap_put(BlobMap *m, const BlobSlot *blob) {
+    if ((m->live + 1) * 4 > m->cap * 3) {
+        BlobMap grown = { NULL, m->cap ? m->cap * 2 : 256, 0 };
+        grown.slots = (BlobSlot*)calloc(grown.cap, sizeof(BlobSlot));
+        if (!grown.slots) { perror("Failed to allocate image map"); exit(1); }
+        for (size_t i = 0; i < m->cap; i++) {
+            if (m->slots[i].stored) blobmap_put(&grown, &m->slots[i]);
+        }
+        free(m->slots);
+        *m = grown;
+    }
+    size_t mask = m->cap - 1;
+    size_t i = (size_t)blob->hash & mask;
+    while (m->slots[i].stored) i = (i + 1) & mask;
+    m->slots[i] = *blob;
+    m->live++;
+}
+
+static void blobmap_clear(BlobMap *m) {
+    if (m->live == 0) return;
+    memset(m->slots, 0, m->cap * sizeof(BlobSlot));
+    m->live = 0;
+}
+
+static uint64_t chunk_count(uint64_t size) {
+    return (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+}
+
+// Tamanho do quadro de um conteúdo com chunks comprimidos
+static uint64_t frame_bytes(const FileContent *content) {
+    uint64_t total = IMAGE_FRAME_HEAD(content_chunk_count(content));
+    for (size_t i = 0; i < content_chunk_count(content); i++) {
+        size_t stored;
+        unsigned int codec;
+        content_chunk_stored(content, i, &stored, &codec);
+        total += stored;
+    }
+    return total;
+}
+
+// Pedaços dos bytes gravados de um blob, em ordem: sem quadro, os chunks
+// (ou trechos de CHUNK_SIZE dos bytes contínuos); com quadro, o cabeçalho
+// com a tabela e depois os bytes guardados de cada chunk. As duas origens
+// são percorridas nos mesmos limites, então o hash e a comparação não
+// dependem de onde o blob veio
+typedef struct {
+    const BlobSlot *b;
+    uint64_t k;                // Próximo pedaço
+    uint64_t pos;              // Offset do próximo pedaço (bytes contínuos)
+    char *head;                // Cabeçalho montado a partir de um conteúdo
+    char inline_head[256];
+} BlobIter;
+
+static void blob_begin(BlobIter *it, const BlobSlot *b) {
+    it->b = b;
+    it->k = 0;
+    it->pos = 0;
+    it->head = NULL;
+    if (!b->framed || !b->content) return;
+    uint64_t n = content_chunk_count(b->content);
+    size_t head_len = (size_t)IMAGE_FRAME_HEAD(n);
+    it->head = head_len <= sizeof(it->inline_head) ? it->inline_head : (char*)malloc(head_len);
+    if (!it->head) { perror("Failed to allocate image buffer"); exit(1); }
+    memcpy(it->head, &b->stored, sizeof(uint64_t));
+    for (uint64_t i = 0; i < n; i++) {
+        size_t stored;
+        unsigned int codec;
+        content_chunk_stored(b->content, (size_t)i, &stored, &codec);
+        uint32_t entry = IMAGE_FRAME_ENTRY(stored, codec);
+        memcpy(it->head + IMAGE_FRAME_HEAD(i), &entry, sizeof(entry));
+    }
+}
+
+static void blob_end(BlobIter *it) {
+    if (it->head != it->inline_head) free(it->head);
+}
+
+// Próximo pedaço (NULL no fim)
+static const char* blob_next(BlobIter *it, size_t *len) {
+    const BlobSlot *b = it->b;
+    uint64_t n = chunk_count(b->size);
+    unsigned int codec;
+    if (!b->framed) {
+        if (it->k >= n) return NULL;
+        if (b->content) return content_chunk_stored(b->content, (size_t)it->k++, len, &codec);
+        *len = b->size - it->pos < CHUNK_SIZE ? (size_t)(b->size - it->pos) : CHUNK_SIZE;
+    } else if (it->k == 0) {
+        *len = (size_t)IMAGE_FRAME_HEAD(n);
+        if (b->content) {
+            it->k++;
+            return it->head;
+        }
+    } else {
+        if (it->k > n) return NULL;
+        if (b->content) return content_chunk_stored(b->content, (size_t)(it->k++ - 1), len, &codec);
+        uint32_t entry;
+        memcpy(&entry, b->bytes + IMAGE_FRAME_HEAD(it->k - 1), sizeof(entry));
+        *len = IMAGE_FRAME_STORED(entry);
+    }
+    const char *piece = b->bytes + it->pos;
+    it->pos += *len;
+    it->k++;
+    return piece;
+}
+
+static uint64_t blob_hash(const BlobSlot *b) {
+    uint64_t h = b->stored;
+    BlobIter it;
+    blob_begin(&it, b);
+    size_t len;
+    for (const char *piece; (piece = blob_next(&it, &len)) != NULL;) h = dedup_hash(piece, len, h);
+    blob_end(&it);
+    return h;
+}
+
+// Chunks compartilhados (cp, dedup) e bytes mapeados repetidos são
+// reconhecidos pelo ponteiro, sem comparar os bytes
+static int blob_equal(const BlobSlot *a, const BlobSlot *b) {
+    if ((a->bytes && a->bytes == b->bytes) || (a->content && a->content == b->content)) return 1;
+    BlobIter ia, ib;
+    blob_begin(&ia, a);
+    blob_begin(&ib, b);
+    int equal = 1;
+    for (;;) {
+        size_t la, lb;
+        const char *pa = blob_next(&ia, &la);
+        const char *pb = blob_next(&ib, &lb);
+        if (!pa || !pb) {
+            equal = !pa && !pb;
+            break;
+        }
+        if (la != lb || (pa != pb && memcmp(pa, pb, la) != 0)) {
+            equal = 0;
+            break;
+        }
+    }
+    blob_end(&ia);
+    blob_end(&ib);
+    return equal;
+}
+
+// Estado comum às threads da gravação. Cada uma grava seus dados em
+// trechos reservados no fim da região de dados (data_end), com escritas
+// posicionais, então ninguém espera pelo arquivo. Com dedup, os blobs já
+// gravados ficam no mapa, dividido em partes pelo hash para que as
+// threads raramente disputem o mesmo mutex
+typedef struct {
+    int fd;
+    const Image *old;
+    uint64_t data_end;
+    int failed;
+    int dedup;
+    BlobMap blobs[BLOB_STRIPES];
+    pthread_mutex_t blob_locks[BLOB_STRIPES];
+} SaveShared;
+
+// Gravação de uma subárvore (ou do bloco de filhos da raiz). Os dados
+// passam por um buffer de 1 MiB do worker; a tabela de nós e o pool de
+// nomes são montados em memória, com índices e offsets locais, e só são
+// gravados no final, quando a posição de cada subárvore é conhecida
+typedef struct {
+    SaveShared *shared;
+    char *buf;
+    size_t used;
+    uint64_t *pending;     // Registros cujo offset de dados é relativo ao buffer
+    uint64_t pending_count;
+    uint64_t pending_cap;
+    ImageNode *nodes;
+    uint64_t count;
+    uint64_t nodes_cap;
+    char *names;
+    uint64_t names_size;
+    uint64_t names_cap;
+    PtrMap name_offsets;   // Nome (ponteiro) -> offset no pool
+    uint64_t data_size;
+    // Blobs que ainda estão no buffer: 'where' é o registro do primeiro
+    // arquivo com eles, cujo offset só vale depois de out_flush
+    BlobMap pending_blobs;
+    ImageTotals *totals;   // Diretórios com filhos, na ordem em que foram preenchidos
+    uint64_t totals_count;
+    uint64_t totals_cap;
+    uint64_t files;
+    uint64_t shared_files;
+    uint64_t shared_bytes;
+} Writer;
+
+#ifdef _WIN32
+static pthread_mutex_t write_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void write_at(SaveShared *s, const void *data, size_t len, uint64_t off) {
+#ifdef _WIN32
+    // Sem pwrite: posiciona e grava sem que outra thread mude a posição no meio
+    pthread_mutex_lock(&write_mutex);
+    int ok = _lseeki64(s->fd, (__int64)off, SEEK_SET) >= 0;
+    while (ok && len > 0) {
+        unsigned int part = len > (1u << 30) ? (1u << 30) : (unsigned int)len;
+        int n = _write(s->fd, data, part);
+        if (n <= 0) ok = 0;
+        else { data = (const char*)data + n; len -= (size_t)n; }
+    }
+    pthread_mutex_unlock(&write_mutex);
+#else
+    int ok = 1;
+    while (ok && len > 0) {
+        ssize_t n = pwrite(s->fd, data, len, (off_t)off);
+        if (n <= 0) ok = 0;
+        else { data = (const char*)data + n; len -= (size_t)n; off += (uint64_t)n; }
+    }
+#endif
+    if (!ok) __atomic_store_n(&s->failed, 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t reserve_data(SaveShared *s, uint64_t len) {
+    return __atomic_fetch_add(&s->data_end, len, __ATOMIC_RELAXED);
+}
+
+static void* grow(void *buf, uint64_t *cap, uint64_t need, size_t elem) {
+    if (need <= *cap) return buf;
+    uint64_t new_cap = *cap ? *cap : 64;
+    while (new_cap < need) new_cap *= 2;
+    void *p = realloc(buf, (size_t)new_cap * elem);
+    if (!p) { perror("Failed to allocate image buffer"); exit(1); }
+    *cap = new_cap;
+    return p;
+}
+
+// Grava o buffer em um trecho novo da região de dados e corrige os
+// offsets dos arquivos que estavam nele
+static void out_flush(Writer *w) {
+    if (w->used == 0) return;
+    uint64_t base = reserve_data(w->shared, w->used);
+    write_at(w->shared, w->buf, w->used, DATA_OFF + base);
+    for (uint64_t i = 0; i < w->pending_count; i++) w->nodes[w->pending[i]].first += base;
+    w->pending_count = 0;
+    w->used = 0;
+
+    // Com os offsets conhecidos, os blobs do buffer passam para o mapa comum
+    BlobMap *pending = &w->pending_blobs;
+    for (size_t i = 0; i < pending->cap && pending->live; i++) {
+        BlobSlot blob = pending->slots[i];
+        if (!blob.stored) continue;
+        blob.where = w->nodes[blob.where].first;
+        size_t stripe = (size_t)(blob.hash >> 58) % BLOB_STRIPES;
+        pthread_mutex_lock(&w->shared->blob_locks[stripe]);
+        blobmap_put(&w->shared->blobs[stripe], &blob);
+        pthread_mutex_unlock(&w->shared->blob_locks[stripe]);
+    }
+    blobmap_clear(pending);
+}
+
+// Reserva n registros consecutivos na tabela e retorna o primeiro índice
+static uint64_t reserve_records(Writer *w, uint64_t n) {
+    w->nodes = (ImageNode*)grow(w->nodes, &w->nodes_cap, w->count + n, sizeof(ImageNode));
+    memset(&w->nodes[w->count], 0, (size_t)n * sizeof(ImageNode));
+    uint64_t first = w->count;
+    w->count += n;
+    return first;
+}
+
+// Os nomes vêm internados (ou de outra imagem), então o próprio ponteiro
+// identifica o nome e cada nome distinto entra uma única vez no pool
+static uint64_t add_name(Writer *w, const char *name, size_t len) {
+    PtrSlot *slot = ptrmap_slot(&w->name_offsets, name);
+    if (slot) return slot->value;
+    w->names = (char*)grow(w->names, &w->names_cap, w->names_size + len + 1, 1);
+    uint64_t off = w->names_size;
+    memcpy(w->names + off, name, len);
+    w->names[off + len] = '\0';
+    w->names_size += len + 1;
+    ptrmap_put(&w->name_offsets, name, off);
+    return off;
+}
+
+static void add_pending(Writer *w, uint64_t slot) {
+    w->pending = (uint64_t*)grow(w->pending, &w->pending_cap, w->pending_count + 1, sizeof(uint64_t));
+    w->pending[w->pending_count++] = slot;
+}
+
+// Aponta o registro para um blob igual já gravado (ou ainda no buffer)
+static int reuse_blob(Writer *w, uint64_t slot, const BlobSlot *blob) {
+    BlobSlot *pending = blobmap_find(&w->pending_blobs, blob->hash, blob->stored);
+    if (pending && blob_equal(pending, blob)) {
+        w->nodes[slot].first = w->nodes[pending->where].first;
+        add_pending(w, slot);
+        return 1;
+    }
+    size_t stripe = (size_t)(blob->hash >> 58) % BLOB_STRIPES;
+    pthread_mutex_lock(&w->shared->blob_locks[stripe]);
+    BlobSlot *found = blobmap_find(&w->shared->blobs[stripe], blob->hash, blob->stored);
+    BlobSlot other;
+    if (found) other = *found;
+    pthread_mutex_unlock(&w->shared->blob_locks[stripe]);
+    if (!found || !blob_equal(&other, blob)) return 0;
+    w->nodes[slot].first = other.where;
+    return 1;
+}
+
+// Dados de um arquivo, vindos de um conteúdo em chunks ou de um bloco
+// contínuo (imagem antiga). Com chunks comprimidos (framed), o que se
+// grava é o quadro: os chunks saem como estão, sem descomprimir, e os
+// chunks crus do mesmo arquivo vão crus dentro do quadro (a gravação não
+// comprime nada). Os pequenos entram no buffer com offset relativo; os
+// maiores que o buffer ganham um trecho só deles, gravado direto ou
+// passando pelo buffer (chunks). Com dedup, um blob igual a um já gravado
+// não é gravado de novo: o registro só aponta para ele
+static void add_file(Writer *w, uint64_t slot, const FileContent *content, const char *bytes,
+                     uint64_t size, int framed) {
+    w->nodes[slot].size = size;
+    w->data_size += size;
+    if (size == 0) return;
+    w->files++;
+    BlobSlot blob = { 0, size, slot, content, bytes, size, framed };
+    if (framed) {
+        w->nodes[slot].flags |= IMAGE_NODE_FRAMED;
+        if (bytes) memcpy(&blob.stored, bytes, sizeof(uint64_t));
+        else blob.stored = frame_bytes(content);
+    }
+    uint64_t stored = blob.stored;
+    if (w->shared->dedup) {
+        blob.hash = blob_hash(&blob);
+        if (reuse_blob(w, slot, &blob)) {
+            w->shared_files++;
+            w->shared_bytes += stored;
+            return;
+        }
+    }
+    BlobIter it;
+    size_t len;
+    if (stored < SAVE_BUFFER_SIZE) {
+        if (stored > SAVE_BUFFER_SIZE - w->used) out_flush(w);
+        w->nodes[slot].first = w->used;
+        add_pending(w, slot);
+        if (w->shared->dedup) blobmap_put(&w->pending_blobs, &blob);
+        if (bytes) {
+            memcpy(w->buf + w->used, bytes, (size_t)stored);
+            w->used += (size_t)stored;
+            return;
+        }
+        blob_begin(&it, &blob);
+        for (const char *piece; (piece = blob_next(&it, &len)) != NULL;) {
+            memcpy(w->buf + w->used, piece, len);
+            w->used += len;
+        }
+        blob_end(&it);
+        return;
+    }
+
+    out_flush(w);
+    uint64_t off = reserve_data(w->shared, stored);
+    w->nodes[slot].first = off;
+    if (w->shared->dedup) {
+        size_t stripe = (size_t)(blob.hash >> 58) % BLOB_STRIPES;
+        blob.where = off;
+        pthread_mutex_lock(&w->shared->blob_locks[stripe]);
+        blobmap_put(&w->shared->blobs[stripe], &blob);
+        pthread_mutex_unlock(&w->shared->blob_locks[stripe]);
+    }
+    if (bytes) {
+        write_at(w->shared, bytes, (size_t)stored, DATA_OFF + off);
+        return;
+    }
+    uint64_t pos = DATA_OFF + off;
+    blob_begin(&it, &blob);
+    for (const char *piece; (piece = blob_next(&it, &len)) != NULL;) {
+        if (len > SAVE_BUFFER_SIZE - w->used) {
+            write_at(w->shared, w->buf, w->used, pos);
+            pos += w->used;
+            w->used = 0;
+        }
+        if (len > SAVE_BUFFER_SIZE) {
+            // Cabeçalho de um quadro enorme (milhares de chunks)
+            write_at(w->shared, piece, len, pos);
+            pos += len;
+            continue;
+        }
+        memcpy(w->buf + w->used, piece, len);
+        w->used += len;
+    }
+    blob_end(&it);
+    write_at(w->shared, w->buf, w->used, pos);
+    w->used = 0;
+}
+
+static void add_totals(Writer *w, uint64_t slot, uint64_t bytes, uint64_t files, uint64_t dirs) {
+    if (files == 0 && dirs == 0) return;
+    w->totals = (ImageTotals*)grow(w->totals, &w->totals_cap, w->totals_count + 1, sizeof(ImageTotals));
+    ImageTotals *t = &w->totals[w->totals_count++];
+    t->node = slot;
+    t->bytes = bytes;
+    t->files = files;
+    t->dirs = dirs;
+}
+
+static void add_node_totals(Writer *w, uint64_t slot, const Node *dir) {
+    add_totals(w, slot, dir->totals.bytes, dir->totals.files, dir->totals.dirs);
+}
+
+static void add_old_totals(Writer *w, uint64_t slot, uint64_t old_i) {
+    ImageTotals t;
+    image_totals(w->shared->old, old_i, &t);
+    add_totals(w, slot, t.bytes, t.files, t.dirs);
+}
+
+static int totals_cmp(const void *a, const void *b) {
+    uint64_t x = ((const ImageTotals*)a)->node, y = ((const ImageTotals*)b)->node;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// A tabela vai para o disco ordenada pelo registro (vazia, totals é NULL)
+static void sort_totals(Writer *w) {
+    if (w->totals_count == 0) return;
+    qsort(w->totals, (size_t)w->totals_count, sizeof(ImageTotals), totals_cmp);
+}
+
+static void fill_record(Writer *w, uint64_t slot, const char *name, size_t name_len, uint32_t type) {
+    uint64_t name_off = add_name(w, name, name_len);
+    ImageNode *rec = &w->nodes[slot];
+    rec->name_off = name_off;
+    rec->name_len = (uint32_t)name_len;
+    rec->type = type;
+}
+
+// Copia um diretório ainda não carregado da imagem antiga: o bloco de
+// filhos é reservado de uma vez e cada subdiretório é gravado logo depois
+// do seu registro, então a lista de filhos é percorrida uma única vez
+static void save_record_dir(Writer *w, uint64_t old_i, uint64_t slot) {
+    const Image *old = w->shared->old;
+    const ImageNode *src = image_node(old, old_i);
+    if (!src || src->size == 0) return;
+    uint64_t n = src->size, old_first = src->first;
+    uint64_t first = reserve_records(w, n);
+    w->nodes[slot].first = first;
+    w->nodes[slot].size = n;
+    for (uint64_t k = 0; k < n; k++) {
+        const ImageNode *c = image_node(old, old_first + k);
+        if (!c) {
+            // Registro corrompido: grava um arquivo vazio no lugar
+            fill_record(w, first + k, "", 0, FILE_NODE);
+            continue;
+        }
+        fill_record(w, first + k, image_name(old, c), c->name_len, c->type);
+        if (c->type == FILE_NODE) {
+            add_file(w, first + k, NULL, image_data(old, c), c->size, c->flags & IMAGE_NODE_FRAMED);
+        } else {
+            add_old_totals(w, first + k, old_first + k);
+            save_record_dir(w, old_first + k, first + k);
+        }
+    }
+}
+
+static void save_node(Writer *w, Node *node, uint64_t slot);
+
+// Grava o bloco de filhos de um diretório, descendo em cada subdiretório
+// assim que seu registro é preenchido. Diretórios ainda não carregados
+// vêm da imagem antiga
+static void save_node_dir(Writer *w, Node *dir, uint64_t slot) {
+    uint64_t old_i;
+    if ((dir->flags & NODE_LAZY) && w->shared->old && image_lookup(w->shared->old, dir, &old_i)) {
+        save_record_dir(w, old_i, slot);
+        return;
+    }
+    if (dir->child_count == 0) return;
+    uint64_t first = reserve_records(w, dir->child_count);
+    w->nodes[slot].first = first;
+    w->nodes[slot].size = dir->child_count;
+    uint64_t k = 0;
+    for (Node *child = dir->child; child; child = child->next) save_node(w, child, first + k++);
+}
+
+static void save_node(Writer *w, Node *node, uint64_t slot) {
+    fill_record(w, slot, node->name, node->name_len, node->type);
+    if (node->type == DIR_NODE) {
+        add_node_totals(w, slot, node);
+        save_node_dir(w, node, slot);
+    } else if (node->content) {
+        add_file(w, slot, node->content, NULL, content_size(node->content),
+                 content_compressed(node->content));
+    }
+}
+
+static void writer_free(Writer *w) {
+    free(w->pending_blobs.slots);
+    free(w->pending);
+    free(w->totals);
+    free(w->nodes);
+    free(w->names);
+    free(w->name_offsets.slots);
+}
+
+// --- Gravação em paralelo ---
+
+// Um diretório filho da raiz, gravado por uma tarefa. O registro 0 do
+// writer dela é uma cópia de trabalho do registro do diretório (que fica
+// no bloco da raiz); os outros vão para [base, base + count - 1) na tabela
+typedef struct {
+    Node *dir;             // NULL: diretório ainda na imagem antiga (old_i)
+    uint64_t old_i;
+    uint64_t slot;         // Registro no bloco de filhos da raiz
+    uint64_t base;
+    uint64_t names_base;
+    uint64_t totals_base;
+    Writer w;
+} SavePart;
+
+typedef struct {
+    SaveShared shared;
+    char *bufs[TASKPOOL_MAX_WORKERS]; // Buffer de cada worker, criado no primeiro uso
+    uint64_t nodes_off;
+    uint64_t names_off;
+    uint64_t totals_off;
+} SaveJob;
+
+static size_t save_part_task(TaskPool *pool, int worker, Task task, void *ctx) {
+    (void)pool;
+    SaveJob *job = (SaveJob*)ctx;
+    SavePart *p = (SavePart*)task.a;
+    if (!job->bufs[worker]) {
+        job->bufs[worker] = (char*)malloc(SAVE_BUFFER_SIZE);
+        if (!job->bufs[worker]) { perror("Failed to allocate image buffer"); exit(1); }
+    }
+    p->w.shared = &job->shared;
+    p->w.buf = job->bufs[worker];
+    reserve_records(&p->w, 1);
+    if (p->dir) save_node_dir(&p->w, p->dir, 0);
+    else save_record_dir(&p->w, p->old_i, 0);
+    out_flush(&p->w);
+    sort_totals(&p->w);
+    return (size_t)p->w.count;
+}
+
+// Com as posições conhecidas, passa os índices e offsets de nomes da
+// subárvore para a numeração global e grava seus registros e nomes
+static size_t write_part_task(TaskPool *pool, int worker, Task task, void *ctx) {
+    (void)pool;
+    (void)worker;
+    SaveJob *job = (SaveJob*)ctx;
+    SavePart *p = (SavePart*)task.a;
+    Writer *w = &p->w;
+    for (uint64_t i = 1; i < w->count; i++) {
+        ImageNode *rec = &w->nodes[i];
+        rec->name_off += p->names_base;
+        if (rec->type == DIR_NODE && rec->size > 0) rec->first += p->base - 1;
+    }
+    for (uint64_t i = 0; i < w->totals_count; i++) w->totals[i].node += p->base - 1;
+    write_at(&job->shared, w->nodes + 1, (size_t)(w->count - 1) * sizeof(ImageNode),
+             job->nodes_off + p->base * sizeof(ImageNode));
+    write_at(&job->shared, w->names, (size_t)w->names_size, job->names_off + p->names_base);
+    write_at(&job->shared, w->totals, (size_t)w->totals_count * sizeof(ImageTotals),
+             job->totals_off + p->totals_base * sizeof(ImageTotals));
+    return (size_t)w->count;
+}
+
+// Monta o bloco de filhos da raiz no writer principal; cada subdiretório
+// com filhos vira uma parte. Arquivos da raiz são gravados aqui mesmo
+static SavePart* split_root(Writer *m, Node *root, uint64_t *part_count) {
+    const Image *old = m->shared->old;
+    uint64_t old_root, n;
+    int from_old = (root->flags & NODE_LAZY) && old && image_lookup(old, root, &old_root);
+    const ImageNode *src = NULL;
+    if (from_old) {
+        src = image_node(old, old_root);
+        n = src ? src->size : 0;
+    } else {
+        n = root->child_count;
+    }
+    SavePart *parts = (SavePart*)calloc(n ? (size_t)n : 1, sizeof(SavePart));
+    if (!parts) { perror("Failed to allocate image parts"); exit(1); }
+    *part_count = 0;
+    if (n == 0) return parts;
+
+    uint64_t first = reserve_records(m, n);
+    m->nodes[0].first = first;
+    m->nodes[0].size = n;
+    Node *child = from_old ? NULL : root->child;
+    for (uint64_t k = 0; k < n; k++) {
+        uint64_t slot = first + k;
+        if (from_old) {
+            const ImageNode *c = image_node(old, src->first + k);
+            if (!c) {
+                fill_record(m, slot, "", 0, FILE_NODE);
+                continue;
+            }
+            fill_record(m, slot, image_name(old, c), c->name_len, c->type);
+            if (c->type == FILE_NODE) {
+                add_file(m, slot, NULL, image_data(old, c), c->size, c->flags & IMAGE_NODE_FRAMED);
+            } else if (c->size > 0) {
+                add_old_totals(m, slot, src->first + k);
+                parts[*part_count].old_i = src->first + k;
+                parts[(*part_count)++].slot = slot;
+            }
+        } else {
+            fill_record(m, slot, child->name, child->name_len, child->type);
+            if (child->type == FILE_NODE) {
+                if (child->content) {
+                    add_file(m, slot, child->content, NULL, content_size(child->content),
+                             content_compressed(child->content));
+                }
+            } else if (child->child_count > 0) {
+                add_node_totals(m, slot, child);
+                parts[*part_count].dir = child;
+                parts[(*part_count)++].slot = slot;
+            }
+            child = child->next;
+        }
+    }
+    return parts;
+}
+
+// Grava a imagem em '<path>.tmp', força os dados para o disco e só então
+// a renomeia por cima de 'path': uma queda no meio da gravação deixa a
+// imagem anterior intacta. Como o rename troca a entrada do diretório e não
+// o arquivo antigo, um mapeamento da imagem anterior continua válido.
+//
+// As subárvores da raiz são gravadas em paralelo (uma tarefa cada) e só
+// depois recebem sua posição na tabela de nós e no pool de nomes, na
+// ordem do bloco da raiz, o que também monta o diretório de subárvores
+int image_save(const char *path, Node *root, const Image *old, uint64_t checkpoint_lsn,
+               int workers, int dedup, ImageSaveStats *stats) {
+    size_t path_len = strlen(path);
+    char *tmp_path = (char*)malloc(path_len + 5);
+    if (!tmp_path) return -1;
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", 5);
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) { free(tmp_path); return -1; }
+
+    SaveJob job;
+    memset(&job, 0, sizeof(job));
+    job.shared.fd = fileno(file);
+    job.shared.old = old;
+    job.shared.dedup = dedup;
+    for (int i = 0; i < BLOB_STRIPES; i++) pthread_mutex_init(&job.shared.blob_locks[i], NULL);
+
+    Writer m;
+    memset(&m, 0, sizeof(m));
+    m.shared = &job.shared;
+    m.buf = (char*)malloc(SAVE_BUFFER_SIZE);
+    if (!m.buf) { perror("Failed to allocate image buffer"); exit(1); }
+    uint64_t root_slot = reserve_records(&m, 1);
+    fill_record(&m, root_slot, root->name, root->name_len, root->type);
+    add_node_totals(&m, root_slot, root);
+    uint64_t part_count;
+    SavePart *parts = split_root(&m, root, &part_count);
+    out_flush(&m);
+    sort_totals(&m);
+
+    Task *tasks = (Task*)malloc((part_count ? (size_t)part_count : 1) * sizeof(Task));
+    if (!tasks) { perror("Failed to allocate image parts"); exit(1); }
+    for (uint64_t i = 0; i < part_count; i++) {
+        tasks[i].a = &parts[i];
+        tasks[i].b = NULL;
+    }
+    if (part_count > 0) taskpool_run_all(workers, save_part_task, &job, tasks, (size_t)part_count);
+
+    // Posições: o bloco da raiz e depois as subárvores, na ordem do bloco
+    uint64_t count = m.count, names_size = m.names_size, data_size = job.shared.data_end;
+    uint64_t subtree_count = 0, totals_count = m.totals_count;
+    for (uint64_t i = 0; i < part_count; i++) {
+        SavePart *p = &parts[i];
+        p->base = count;
+        p->names_base = names_size;
+        p->totals_base = totals_count;
+        count += p->w.count - 1;
+        names_size += p->w.names_size;
+        totals_count += p->w.totals_count;
+        ImageNode *rec = &m.nodes[p->slot];
+        rec->size = p->w.nodes[0].size;
+        rec->first = rec->size > 0 ? p->w.nodes[0].first + p->base - 1 : 0;
+        if (p->w.count > 1) subtree_count++;
+    }
+
+    // Alinha a tabela de nós para que os registros possam ser lidos
+    // diretamente do mapeamento
+    uint64_t end = DATA_OFF + data_size;
+    job.nodes_off = end + (8 - end % 8) % 8;
+    job.names_off = job.nodes_off + count * sizeof(ImageNode);
+    uint64_t subtrees_off = job.names_off + names_size;
+    subtrees_off += (8 - subtrees_off % 8) % 8;
+    job.totals_off = subtrees_off + subtree_count * sizeof(ImageSubtree);
+
+    if (part_count > 0) taskpool_run_all(workers, write_part_task, &job, tasks, (size_t)part_count);
+    write_at(&job.shared, m.nodes, (size_t)m.count * sizeof(ImageNode), job.nodes_off);
+    write_at(&job.shared, m.names, (size_t)m.names_size, job.names_off);
+    write_at(&job.shared, m.totals, (size_t)m.totals_count * sizeof(ImageTotals), job.totals_off);
+
+    ImageSubtree *subtrees = (ImageSubtree*)calloc(subtree_count ? (size_t)subtree_count : 1,
+                                                   sizeof(ImageSubtree));
+    if (!subtrees) { perror("Failed to allocate image parts"); exit(1); }
+    uint64_t s = 0;
+    for (uint64_t i = 0; i < part_count; i++) {
+        SavePart *p = &parts[i];
+        if (p->w.count <= 1) continue;
+        subtrees[s].node = p->slot;
+        subtrees[s].first = p->base;
+        subtrees[s].count = p->w.count - 1;
+        subtrees[s++].data_size = p->w.data_size;
+    }
+    // O padding antes da tabela e do diretório é preenchido com zeros
+    static const char zeros[8];
+    write_at(&job.shared, zeros, (size_t)(job.nodes_off - end), end);
+    write_at(&job.shared, zeros, (size_t)(subtrees_off - job.names_off - names_size), job.names_off + names_size);
+    write_at(&job.shared, subtrees, (size_t)subtree_count * sizeof(ImageSubtree), subtrees_off);
+
+    ImageHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, IMAGE_MAGIC, 8);
+    h.version = IMAGE_VERSION;
+    h.header_size = sizeof(h);
+    h.node_count = count;
+    h.data_off = DATA_OFF;
+    h.data_size = data_size;
+    h.nodes_off = job.nodes_off;
+    h.names_off = job.names_off;
+    h.names_size = names_size;
+    h.checkpoint_lsn = checkpoint_lsn;
+    h.subtrees_off = subtrees_off;
+    h.subtree_count = subtree_count;
+    h.totals_off = job.totals_off;
+    h.totals_count = totals_count;
+    write_at(&job.shared, &h, sizeof(h), 0);
+
+    if (stats) {
+        memset(stats, 0, sizeof(ImageSaveStats));
+        stats->data_bytes = data_size;
+        for (uint64_t i = 0; i <= part_count; i++) {
+            const Writer *w = i < part_count ? &parts[i].w : &m;
+            stats->files += w->files;
+            stats->file_bytes += w->data_size;
+            stats->shared_files += w->shared_files;
+            stats->shared_bytes += w->shared_bytes;
+        }
+    }
+
+    int failed = job.shared.failed;
+    if (sync_file(file) != 0) failed = 1;
+    if (fclose(file) != 0) failed = 1;
+    for (int i = 0; i < BLOB_STRIPES; i++) {
+        free(job.shared.blobs[i].slots);
+        pthread_mutex_destroy(&job.shared.blob_locks[i]);
+    }
+    for (uint64_t i = 0; i < part_count; i++) writer_free(&parts[i].w);
+    for (int i = 0; i < TASKPOOL_MAX_WORKERS; i++) free(job.bufs[i]);
+    free(parts);
+    free(tasks);
+    free(subtrees);
+    free(m.buf);
+    writer_free(&m);
+
+    if (!failed) {
+#ifdef _WIN32
+        remove(path); // rename não substitui um arquivo existente no Windows
+#endif
+        if (rename(tmp_path, path) != 0) failed = 1;
+        else sync_parent_dir(path);
+    }
+    if (failed) remove(tmp_path);
+    free(tmp_path);
+    return failed ? -1 : 0;
+}
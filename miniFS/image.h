@@ -0,0 +1,162 @@
+// miniFS/image.h
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h> // Para size_t
+#include <stdint.h>
+
+struct Node;
+
+// Formato versionado da imagem em disco (minifs.dat):
+//
+//   [ImageHeader][conteúdos][tabela de nós][pool de nomes][subárvores]
+//
+// Os offsets de cada região ficam no cabeçalho. A tabela de nós é um vetor
+// de registros de tamanho fixo; a raiz é o registro 0 e os filhos de cada
+// diretório ocupam um bloco contíguo da tabela, sempre depois do registro
+// do pai. Os blocos são gravados em pré-ordem de diretórios, então cada
+// subárvore também ocupa uma faixa contígua. A imagem é aberta com mmap e
+// os nós só são criados em memória quando o diretório é acessado.
+//
+// A partir da versão 4, um diretório de subárvores no final lista, para
+// cada diretório filho da raiz, a faixa de registros abaixo dele e quantos
+// bytes de conteúdo ela tem. Cada uma dessas subárvores é gravada por uma
+// thread, com sua própria parte do pool de nomes, e a carga completa
+// (fs_preload) começa pelas maiores. Os conteúdos de uma subárvore não
+// ficam necessariamente juntos: cada thread reserva trechos da região de
+// dados conforme grava.
+//
+// Na versão 5, um arquivo com chunks comprimidos (IMAGE_NODE_FRAMED) é
+// gravado como um quadro: o tamanho do quadro (uint64_t), uma entrada de 32
+// bits por chunk de CHUNK_SIZE bytes (bytes guardados e o id do codec; 0 =
+// sem compressão) e os bytes guardados de cada chunk, na ordem. Os chunks
+// vão para o disco como estão em memória, sem recomprimir, e voltam
+// mapeados ainda comprimidos: cada um só é descomprimido quando lido.
+// Registros de versões anteriores têm flags = 0 (o campo fazia parte de
+// type, sempre menor que 2^16).
+//
+// A versão 6 acrescenta, depois do diretório de subárvores, a tabela de
+// totais: bytes, arquivos e subdiretórios abaixo de cada diretório com
+// filhos, ordenada pelo registro (diretórios vazios ficam de fora, com
+// totais zero). Nas versões anteriores, os totais são calculados ao abrir
+// a imagem, numa passada de trás para frente pela tabela de nós (os filhos
+// vêm sempre depois do pai).
+//
+// O formato antigo (registros recursivos gravados campo a campo) não tem
+// cabeçalho e continua sendo lido por fs_load, para migração.
+#define IMAGE_MAGIC "MINIFSIM"
+#define IMAGE_VERSION 6
+#define IMAGE_MIN_VERSION 2   // A versão 2 não tem checkpoint_lsn; a 3, subárvores; a 4, quadros; a 5, totais
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t node_count;
+    uint64_t nodes_off;    // Alinhado em 8 bytes
+    uint64_t names_off;
+    uint64_t names_size;
+    uint64_t data_off;
+    uint64_t data_size;
+    uint64_t checkpoint_lsn; // Último registro do journal já incluído (versão 3)
+    uint64_t subtrees_off; // Diretório de subárvores (versão 4), alinhado em 8 bytes
+    uint64_t subtree_count;
+    uint64_t totals_off;   // Tabela de totais (versão 6), alinhada em 8 bytes
+    uint64_t totals_count;
+} ImageHeader;
+
+typedef struct {
+    uint64_t name_off;     // Offset do nome no pool (terminado em '\0')
+    uint32_t name_len;
+    // NodeType e IMAGE_NODE_*: ocupam os 32 bits do antigo type, com type
+    // na metade menos significativa em qualquer ordem de bytes
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    uint16_t flags;
+    uint16_t type;
+#else
+    uint16_t type;
+    uint16_t flags;
+#endif
+    uint64_t first;        // Diretório: índice do primeiro filho; arquivo: offset dos dados
+    uint64_t size;         // Diretório: número de filhos; arquivo: tamanho em bytes
+} ImageNode;
+
+#define IMAGE_NODE_FRAMED 0x1  // Os dados do arquivo são um quadro (versão 5)
+
+// Quadro de n chunks: cabeçalho com a tabela, e cada entrada da tabela
+#define IMAGE_FRAME_HEAD(n) (sizeof(uint64_t) + (uint64_t)(n) * sizeof(uint32_t))
+#define IMAGE_FRAME_ENTRY(stored, codec) ((uint32_t)(stored) | (uint32_t)(codec) << 24)
+#define IMAGE_FRAME_STORED(entry) ((entry) & 0xffffffu)
+#define IMAGE_FRAME_CODEC(entry) ((entry) >> 24)
+
+typedef struct {
+    uint64_t node;         // Registro do diretório, no bloco de filhos da raiz
+    uint64_t first;        // Registros abaixo dele: [first, first + count)
+    uint64_t count;
+    uint64_t data_size;    // Bytes de conteúdo dos arquivos da subárvore
+} ImageSubtree;
+
+typedef struct {
+    uint64_t node;         // Registro do diretório
+    uint64_t bytes;
+    uint64_t files;
+    uint64_t dirs;
+} ImageTotals;
+
+typedef struct Image Image;
+
+typedef enum {
+    IMAGE_OK,
+    IMAGE_NOT_FOUND,       // Arquivo não existe
+    IMAGE_NOT_IMAGE,       // Sem cabeçalho: formato antigo
+    IMAGE_BAD_VERSION,
+    IMAGE_CORRUPT
+} ImageStatus;
+
+// Mapeia a imagem e valida o cabeçalho, em tempo independente do tamanho
+Image* image_open(const char *path, ImageStatus *status);
+void image_close(Image *img);
+
+// LSN do journal até o qual a imagem está atualizada (0 se não houver)
+uint64_t image_checkpoint_lsn(const Image *img);
+
+// Diretório de subárvores, validado na abertura (vazio antes da versão 4)
+const ImageSubtree* image_subtrees(const Image *img, uint64_t *count);
+
+// Registro i, validado (filhos depois do pai, nome e dados dentro das
+// regiões, e a tabela do quadro coerente com o tamanho do arquivo);
+// retorna NULL se o registro estiver corrompido
+const ImageNode* image_node(const Image *img, uint64_t i);
+const char* image_name(const Image *img, const ImageNode *rec);
+// Totais do diretório do registro i (busca binária na tabela; zeros se
+// ele não estiver nela)
+void image_totals(const Image *img, uint64_t i, ImageTotals *out);
+const char* image_data(const Image *img, const ImageNode *rec);
+
+// Associação entre diretórios ainda não carregados (NODE_LAZY) e seus
+// registros. image_take remove a associação ao carregar o diretório
+void image_bind(Image *img, struct Node *node, uint64_t i);
+int image_lookup(const Image *img, const struct Node *node, uint64_t *i);
+int image_take(Image *img, struct Node *node, uint64_t *i);
+
+// Resultado de uma gravação
+typedef struct {
+    uint64_t files;        // Arquivos não vazios
+    uint64_t file_bytes;   // Soma dos tamanhos desses arquivos
+    uint64_t shared_files; // Arquivos que apontam para os dados de outro (dedup)
+    uint64_t shared_bytes; // Bytes que eles deixaram de gravar
+    uint64_t data_bytes;   // Tamanho da região de dados
+} ImageSaveStats;
+
+// Grava a árvore no formato atual. Diretórios ainda não carregados são
+// copiados direto dos registros de 'old' (a imagem de onde vieram), e
+// checkpoint_lsn marca até onde o journal já está refletido na imagem. As
+// subárvores da raiz são gravadas em paralelo, com até 'workers' threads.
+// Com dedup, arquivos com o mesmo conteúdo (conferido byte a byte depois
+// do hash) são gravados uma vez só e os registros apontam para os mesmos
+// dados, o que o formato já permite. stats pode ser NULL
+int image_save(const char *path, struct Node *root, const Image *old, uint64_t checkpoint_lsn,
+               int workers, int dedup, ImageSaveStats *stats);
+
+#endif // IMAGE_H
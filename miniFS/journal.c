@@ -0,0 +1,345 @@
+// miniFS/journal.c
+
+#define _POSIX_C_SOURCE 200809L // fsync, ftruncate, clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "journal.h"
+#include "utils.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define JOURNAL_MAGIC_LEN 8
+#define JOURNAL_COPY_BUFFER (1 << 20)
+
+struct Journal {
+    char *path;
+    FILE *file;
+    JournalConfig config;
+
+    pthread_mutex_t lock;      // Protege o buffer, os contadores e o LSN
+    pthread_mutex_t io_lock;   // Um grupo de registros gravado por vez
+    pthread_cond_t wake;
+    pthread_t thread;
+    int has_thread;
+    int stop;
+
+    char *buf;                 // Registros pendentes
+    size_t used;
+    size_t cap;
+    char *spare;               // Buffer trocado com 'buf' durante o commit
+    size_t spare_cap;
+    unsigned int pending;
+
+    uint64_t next_lsn;
+    uint64_t file_bytes;       // Bytes já gravados no arquivo
+    int failed;
+};
+
+static void out_of_memory(void) {
+    perror("Failed to allocate journal memory");
+    exit(1);
+}
+
+// FNV-1a sobre o cabeçalho (a partir do LSN) e os dados do registro
+static uint32_t checksum_update(uint32_t h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char*)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t record_checksum(const JournalHeader *h, const char *a, const char *b) {
+    const size_t skip = offsetof(JournalHeader, lsn);
+    uint32_t sum = checksum_update(2166136261u, (const char*)h + skip, sizeof(JournalHeader) - skip);
+    sum = checksum_update(sum, a, h->a_len);
+    return checksum_update(sum, b, (size_t)h->b_len);
+}
+
+static int truncate_file(FILE *file, uint64_t size) {
+#ifdef _WIN32
+    return _chsize_s(_fileno(file), (long long)size);
+#else
+    return ftruncate(fileno(file), (off_t)size);
+#endif
+}
+
+// --- Recuperação ---
+
+int journal_replay(const char *path, uint64_t after_lsn, JournalApply apply, void *ctx,
+                   uint64_t *last_lsn, uint64_t *valid_bytes) {
+    *last_lsn = 0;
+    *valid_bytes = 0;
+    FILE *file = fopen(path, "rb");
+    if (!file) return 0;
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    char magic[JOURNAL_MAGIC_LEN];
+    size_t got = fread(magic, 1, sizeof(magic), file);
+    if (got == 0) { fclose(file); return 0; } // Arquivo vazio
+    if (got < sizeof(magic) || memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) != 0) {
+        fclose(file);
+        return -1;
+    }
+    uint64_t valid = sizeof(magic);
+
+    char *data = NULL;
+    size_t data_cap = 0;
+    JournalHeader h;
+    while (fread(&h, sizeof(h), 1, file) == 1) {
+        if (h.op < J_MKDIR || h.op > J_RMR || h.lsn <= *last_lsn ||
+            h.b_len > UINT32_MAX || h.size != sizeof(h) + h.a_len + h.b_len) {
+            break;
+        }
+        size_t payload = (size_t)(h.a_len + h.b_len);
+        if (payload + 2 > data_cap) {
+            data_cap = payload + 2;
+            char *p = (char*)realloc(data, data_cap);
+            if (!p) out_of_memory();
+            data = p;
+        }
+        if (fread(data, 1, payload, file) != payload) break;
+        // Cada campo ganha um '\0' para poder ser usado como string
+        memmove(data + h.a_len + 1, data + h.a_len, (size_t)h.b_len);
+        data[h.a_len] = '\0';
+        data[payload + 1] = '\0';
+        const char *a = data, *b = data + h.a_len + 1;
+        if (record_checksum(&h, a, b) != h.checksum) break;
+
+        if (h.lsn > after_lsn) {
+            JournalRecord rec = { h.lsn, (JournalOp)h.op, a, h.a_len, b, (size_t)h.b_len, h.offset };
+            apply(&rec, ctx);
+        }
+        *last_lsn = h.lsn;
+        valid += h.size;
+    }
+    free(data);
+    fclose(file);
+    *valid_bytes = valid;
+    return 0;
+}
+
+// --- Gravação ---
+
+// Grava e sincroniza os registros pendentes como um único grupo. Novos
+// registros continuam entrando no outro buffer enquanto o grupo é gravado
+int journal_commit(Journal *j) {
+    pthread_mutex_lock(&j->io_lock);
+    pthread_mutex_lock(&j->lock);
+    char *group = j->buf;
+    size_t group_cap = j->cap, len = j->used;
+    j->buf = j->spare;
+    j->cap = j->spare_cap;
+    j->used = 0;
+    j->pending = 0;
+    j->spare = group;
+    j->spare_cap = group_cap;
+    pthread_mutex_unlock(&j->lock);
+
+    int failed = 0;
+    if (len > 0) {
+        if (fwrite(group, 1, len, j->file) != len || sync_file(j->file) != 0) failed = 1;
+        pthread_mutex_lock(&j->lock);
+        j->file_bytes += len;
+        if (failed) j->failed = 1;
+        pthread_mutex_unlock(&j->lock);
+    }
+    pthread_mutex_unlock(&j->io_lock);
+    return failed ? -1 : 0;
+}
+
+// Thread de group commit: acorda a cada sync_interval_ms e grava o que
+// estiver pendente
+static void* flusher(void *arg) {
+    Journal *j = (Journal*)arg;
+    pthread_mutex_lock(&j->lock);
+    while (!j->stop) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += (long)(j->config.sync_interval_ms % 1000) * 1000000L;
+        until.tv_sec += j->config.sync_interval_ms / 1000 + until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&j->wake, &j->lock, &until);
+        if (j->used > 0) {
+            pthread_mutex_unlock(&j->lock);
+            journal_commit(j);
+            pthread_mutex_lock(&j->lock);
+        }
+    }
+    pthread_mutex_unlock(&j->lock);
+    return NULL;
+}
+
+Journal* journal_open(const char *path, const JournalConfig *config,
+                      uint64_t valid_bytes, uint64_t next_lsn) {
+    Journal *j = (Journal*)calloc(1, sizeof(Journal));
+    if (!j) out_of_memory();
+    j->path = (char*)malloc(strlen(path) + 1);
+    if (!j->path) out_of_memory();
+    strcpy(j->path, path);
+    j->config = *config;
+    j->next_lsn = next_lsn;
+
+    if (valid_bytes >= JOURNAL_MAGIC_LEN) {
+        j->file = fopen(path, "r+b");
+        if (j->file && (truncate_file(j->file, valid_bytes) != 0 || fseek(j->file, 0, SEEK_END) != 0)) {
+            fclose(j->file);
+            j->file = NULL;
+        }
+        j->file_bytes = valid_bytes;
+    } else {
+        // Leitura também: a rotação (journal_truncate_front) copia o log por
+        // este mesmo FILE
+        j->file = fopen(path, "w+b");
+        if (j->file && (fwrite(JOURNAL_MAGIC, 1, JOURNAL_MAGIC_LEN, j->file) != JOURNAL_MAGIC_LEN ||
+                        sync_file(j->file) != 0)) {
+            fclose(j->file);
+            j->file = NULL;
+        }
+        j->file_bytes = JOURNAL_MAGIC_LEN;
+    }
+    if (!j->file) {
+        free(j->path);
+        free(j);
+        return NULL;
+    }
+    setvbuf(j->file, NULL, _IONBF, 0); // Os grupos já chegam montados
+
+    pthread_mutex_init(&j->lock, NULL);
+    pthread_mutex_init(&j->io_lock, NULL);
+    pthread_cond_init(&j->wake, NULL);
+    if (config->sync_interval_ms > 0 && pthread_create(&j->thread, NULL, flusher, j) == 0) {
+        j->has_thread = 1;
+    }
+    return j;
+}
+
+uint64_t journal_append(Journal *j, JournalOp op, const char *a, size_t a_len,
+                        const void *b, size_t b_len, uint64_t offset) {
+    JournalHeader h;
+    h.size = (uint32_t)(sizeof(h) + a_len + b_len);
+    h.op = op;
+    h.a_len = (uint32_t)a_len;
+    h.b_len = b_len;
+    h.offset = offset;
+
+    pthread_mutex_lock(&j->lock);
+    h.lsn = j->next_lsn++;
+    h.checksum = record_checksum(&h, a, (const char*)b);
+    if (j->used + h.size > j->cap) {
+        size_t cap = j->cap ? j->cap * 2 : 64 * 1024;
+        while (cap < j->used + h.size) cap *= 2;
+        char *p = (char*)realloc(j->buf, cap);
+        if (!p) out_of_memory();
+        j->buf = p;
+        j->cap = cap;
+    }
+    char *dst = j->buf + j->used;
+    memcpy(dst, &h, sizeof(h));
+    memcpy(dst + sizeof(h), a, a_len);
+    if (b_len > 0) memcpy(dst + sizeof(h) + a_len, b, b_len);
+    j->used += h.size;
+    j->pending++;
+    int sync_now = j->config.sync_records > 0 && j->pending >= j->config.sync_records;
+    pthread_mutex_unlock(&j->lock);
+
+    if (sync_now) journal_commit(j);
+    return h.lsn;
+}
+
+uint64_t journal_last_lsn(const Journal *j) {
+    return j->next_lsn - 1;
+}
+
+uint64_t journal_bytes(Journal *j) {
+    pthread_mutex_lock(&j->lock);
+    uint64_t bytes = j->file_bytes + j->used;
+    pthread_mutex_unlock(&j->lock);
+    return bytes;
+}
+
+int journal_truncate_front(Journal *j, uint64_t offset) {
+    if (journal_commit(j) != 0) return -1;
+    pthread_mutex_lock(&j->io_lock);
+
+    size_t path_len = strlen(j->path);
+    char *tmp_path = (char*)malloc(path_len + 5);
+    char *copy = (char*)malloc(JOURNAL_COPY_BUFFER);
+    if (!tmp_path || !copy) out_of_memory();
+    memcpy(tmp_path, j->path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", 5);
+
+    int failed = 0;
+    uint64_t bytes = JOURNAL_MAGIC_LEN;
+    FILE *out = fopen(tmp_path, "wb");
+    if (!out || fwrite(JOURNAL_MAGIC, 1, JOURNAL_MAGIC_LEN, out) != JOURNAL_MAGIC_LEN ||
+        fseek(j->file, (long)offset, SEEK_SET) != 0) {
+        failed = 1;
+    }
+    while (!failed) {
+        size_t n = fread(copy, 1, JOURNAL_COPY_BUFFER, j->file);
+        if (n == 0) break;
+        if (fwrite(copy, 1, n, out) != n) failed = 1;
+        bytes += n;
+    }
+    // Uma leitura que falhou parece o fim do log: sem isto, a cópia curta
+    // substituiria o log inteiro
+    if (ferror(j->file)) failed = 1;
+    if (out && sync_file(out) != 0) failed = 1;
+    if (out && fclose(out) != 0) failed = 1;
+
+    if (!failed) {
+        fclose(j->file);
+#ifdef _WIN32
+        remove(j->path); // rename não substitui um arquivo existente no Windows
+#endif
+        if (rename(tmp_path, j->path) != 0) failed = 1;
+        else sync_parent_dir(j->path);
+        j->file = fopen(j->path, "r+b");
+        if (!j->file) {
+            perror("Failed to reopen journal");
+            exit(1);
+        }
+        setvbuf(j->file, NULL, _IONBF, 0);
+        if (!failed) j->file_bytes = bytes;
+    } else {
+        remove(tmp_path);
+        clearerr(j->file); // O log continua valendo e recebendo registros
+    }
+    fseek(j->file, 0, SEEK_END);
+
+    free(copy);
+    free(tmp_path);
+    pthread_mutex_unlock(&j->io_lock);
+    return failed ? -1 : 0;
+}
+
+void journal_close(Journal *j) {
+    if (!j) return;
+    if (j->has_thread) {
+        pthread_mutex_lock(&j->lock);
+        j->stop = 1;
+        pthread_cond_signal(&j->wake);
+        pthread_mutex_unlock(&j->lock);
+        pthread_join(j->thread, NULL);
+    }
+    journal_commit(j);
+    if (j->failed) fprintf(stderr, "journal: %s: write failed, recent changes may be lost\n", j->path);
+    fclose(j->file);
+    pthread_cond_destroy(&j->wake);
+    pthread_mutex_destroy(&j->io_lock);
+    pthread_mutex_destroy(&j->lock);
+    free(j->buf);
+    free(j->spare);
+    free(j->path);
+    free(j);
+}
@@ -0,0 +1,109 @@
+// miniFS/journal.h
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h> // Para size_t
+#include <stdint.h>
+
+// Log de operações (write-ahead journal) gravado ao lado da imagem.
+// Cada operação bem-sucedida que altera a árvore vira um registro com um
+// número de sequência (LSN) crescente e caminhos absolutos, então pode ser
+// reaplicada sobre a imagem do último checkpoint na ordem em que ocorreu.
+//
+//   [JOURNAL_MAGIC][registro][registro]...
+//
+// Um registro é um JournalHeader seguido dos bytes de 'a' e de 'b'. O
+// checksum cobre o restante do cabeçalho e os dados, de modo que um
+// registro cortado por uma queda é detectado e descartado na recuperação.
+#define JOURNAL_MAGIC "MINIFSWL"
+
+typedef enum {
+    J_MKDIR = 1,   // a = caminho
+    J_TOUCH,       // a = caminho
+    J_ECHO,        // a = caminho, b = conteúdo
+    J_WRITE,       // a = caminho, b = dados, offset
+    J_APPEND,      // a = caminho, b = dados
+    J_MV,          // a = origem, b = destino (caminho final do nó)
+    J_CP,          // a = origem, b = destino (caminho final da cópia)
+    J_RM,          // a = caminho
+    J_RMR          // a = caminho (rm -r)
+} JournalOp;
+
+typedef struct {
+    uint32_t size;         // Tamanho total do registro
+    uint32_t checksum;
+    uint64_t lsn;
+    uint32_t op;
+    uint32_t a_len;
+    uint64_t b_len;
+    uint64_t offset;
+} JournalHeader;
+
+// Registro lido na recuperação; a e b terminam em '\0'
+typedef struct {
+    uint64_t lsn;
+    JournalOp op;
+    const char *a;
+    size_t a_len;
+    const char *b;
+    size_t b_len;
+    uint64_t offset;
+} JournalRecord;
+
+// Política de durabilidade. Os registros ficam em um buffer e vão para o
+// disco em grupo (um write e um fsync para vários registros):
+//   sync_records: fsync síncrono a cada N registros (1 = toda operação é
+//                 durável ao retornar; 0 = só a thread de fundo sincroniza)
+//   sync_interval_ms: intervalo da thread de fundo que grava e sincroniza
+//                 o que estiver pendente (0 = sem thread)
+//   checkpoint_bytes: tamanho do log a partir do qual fs.c grava um novo
+//                 checkpoint da imagem (0 = nunca)
+//   checkpoint_interval_s: passado esse tempo desde o último checkpoint, a
+//                 próxima operação registrada dispara outro (0 = nunca)
+typedef struct JournalConfig {
+    unsigned int sync_records;
+    unsigned int sync_interval_ms;
+    size_t checkpoint_bytes;
+    unsigned int checkpoint_interval_s;
+} JournalConfig;
+
+#define JOURNAL_DEFAULT_SYNC_RECORDS 32
+#define JOURNAL_DEFAULT_SYNC_INTERVAL_MS 20
+#define JOURNAL_DEFAULT_CHECKPOINT_BYTES (64u * 1024 * 1024)
+#define JOURNAL_DEFAULT_CHECKPOINT_SECONDS 60
+
+typedef struct Journal Journal;
+
+// Lê o log e chama apply para cada registro com LSN > after_lsn, parando no
+// primeiro registro incompleto ou corrompido. Retorna o último LSN lido e,
+// em valid_bytes, o tamanho da parte válida do arquivo. Um log inexistente
+// é tratado como vazio
+typedef void (*JournalApply)(const JournalRecord *rec, void *ctx);
+int journal_replay(const char *path, uint64_t after_lsn, JournalApply apply, void *ctx,
+                   uint64_t *last_lsn, uint64_t *valid_bytes);
+
+// Abre o log para acréscimos, cortando-o em valid_bytes (o que vier depois
+// é o resto de um registro incompleto). O próximo registro recebe next_lsn
+Journal* journal_open(const char *path, const JournalConfig *config,
+                      uint64_t valid_bytes, uint64_t next_lsn);
+
+// Acrescenta um registro e retorna seu LSN. Faz o commit do grupo se o
+// número de registros pendentes chegou a sync_records
+uint64_t journal_append(Journal *j, JournalOp op, const char *a, size_t a_len,
+                        const void *b, size_t b_len, uint64_t offset);
+
+// Grava e sincroniza todos os registros pendentes
+int journal_commit(Journal *j);
+
+uint64_t journal_last_lsn(const Journal *j);
+uint64_t journal_bytes(Journal *j); // Tamanho do log, incluindo pendentes
+
+// Depois de um checkpoint que cobre os primeiros 'offset' bytes do log,
+// reescreve o log só com o que veio depois (gravação atômica via rename)
+int journal_truncate_front(Journal *j, uint64_t offset);
+
+// Sincroniza o que estiver pendente, para a thread de fundo e fecha
+void journal_close(Journal *j);
+
+#endif // JOURNAL_H
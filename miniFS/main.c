@@ -1,29 +1,81 @@
 // miniFS/main.c
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "fs.h"
 #include "shell.h"
+#include "journal.h"
 #include <locale.h>
 
 #define SAVE_FILE "minifs.dat"
 
-int main() {
+// Lê um número de uma variável de ambiente, se ela estiver definida
+static void env_number(const char *name, unsigned long *value) {
+    const char *s = getenv(name);
+    if (s && *s) *value = strtoul(s, NULL, 10);
+}
+
+// Uso: minifs            shell interativo
+//      minifs -b [script] executa os comandos do script (ou de stdin, se
+//                         omitido ou "-") sem prompt
+int main(int argc, char **argv) {
+    FILE *batch = NULL;
+    if (argc > 1) {
+        if (strcmp(argv[1], "-b") != 0 || argc > 3) {
+            fprintf(stderr, "Usage: %s [-b [script]]\n", argv[0]);
+            return 1;
+        }
+        batch = stdin;
+        if (argc > 2 && strcmp(argv[2], "-") != 0) {
+            batch = fopen(argv[2], "r");
+            if (!batch) { perror(argv[2]); return 1; }
+        }
+        // Sem prompt, a saída só precisa ser escrita quando o buffer enche
+        setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+    }
+
     // Configura o locale para suportar caracteres especiais em português
     // Isso é importante para garantir que nomes de arquivos e diretórios com acentos funcionem
     setlocale(LC_ALL, "pt_BR.UTF-8");
-    
-    // Tenta carregar o estado anterior do sistema de arquivos
-    fs_load(SAVE_FILE);
+
+    // Política do journal, ajustável por variáveis de ambiente
+    unsigned long sync_records = JOURNAL_DEFAULT_SYNC_RECORDS;
+    unsigned long sync_ms = JOURNAL_DEFAULT_SYNC_INTERVAL_MS;
+    unsigned long checkpoint_mb = JOURNAL_DEFAULT_CHECKPOINT_BYTES / (1024 * 1024);
+    env_number("MINIFS_SYNC_RECORDS", &sync_records);
+    env_number("MINIFS_SYNC_MS", &sync_ms);
+    unsigned long checkpoint_s = JOURNAL_DEFAULT_CHECKPOINT_SECONDS;
+    env_number("MINIFS_CHECKPOINT_MB", &checkpoint_mb);
+    env_number("MINIFS_CHECKPOINT_S", &checkpoint_s);
+    JournalConfig config = { (unsigned int)sync_records, (unsigned int)sync_ms,
+                             (size_t)checkpoint_mb * 1024 * 1024, (unsigned int)checkpoint_s };
+    unsigned long dedup = 0;   // MINIFS_DEDUP=1 liga a deduplicação desde a recuperação
+    env_number("MINIFS_DEDUP", &dedup);
+    // MINIFS_COMPRESS=lz4 comprime os chunks escritos, também na recuperação
+    const char *compress = getenv("MINIFS_COMPRESS");
+
+    // Carrega o último checkpoint e reaplica as operações registradas
+    // depois dele; a partir daqui, cada operação vai para o journal
+    fs_t *fs = fs_create();
+    if (dedup) fs_set_dedup(fs, 1);
+    if (compress && *compress) fs_set_compression(fs, compress, FS_COMPRESS_THRESHOLD);
+    fs_recover(fs, SAVE_FILE, &config);
 
     // Inicia o loop do shell
-    shell_loop();
+    if (batch) {
+        shell_batch(fs, batch);
+        if (batch != stdin) fclose(batch);
+    } else {
+        shell_loop(fs);
+    }
 
-    // Salva o estado atual do sistema de arquivos ao sair
-    fs_save(SAVE_FILE);
+    // Não é preciso gravar a árvore inteira: basta sincronizar o journal
+    fs_shutdown(fs);
 
     // Libera toda a memória alocada para a árvore
-    fs_destroy(root);
+    fs_free(fs);
 
-    printf("Exiting MiniFS. Goodbye!\n");
+    if (!batch) printf("Exiting MiniFS. Goodbye!\n");
     return 0;
-}
\ No newline at end of file
+}
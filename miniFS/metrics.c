@@ -0,0 +1,269 @@
+// miniFS/metrics.c
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "metrics.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+unsigned long long metrics_now(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (unsigned long long)(now.QuadPart / freq.QuadPart * 1000000000ull +
+                                now.QuadPart % freq.QuadPart * 1000000000ull / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+// Ponto de partida da conversão de ticks para ns: o contador e o relógio
+// lidos juntos na primeira amostra (ou na primeira conversão)
+static pthread_once_t calibrate_once = PTHREAD_ONCE_INIT;
+static unsigned long long base_ticks, base_ns;
+
+static void calibrate_start(void) {
+    base_ns = metrics_now();
+    base_ticks = metrics_ticks();
+}
+
+double metrics_ns_per_tick(void) {
+    if (!METRICS_TSC) return 1.0;
+    pthread_once(&calibrate_once, calibrate_start);
+    unsigned long long ns, ticks;
+    do {
+        ns = metrics_now();
+        ticks = metrics_ticks();
+    } while (ns - base_ns < 1000000);
+    return ticks > base_ticks ? (double)(ns - base_ns) / (double)(ticks - base_ticks) : 1.0;
+}
+
+#if MINIFS_METRICS
+
+static const char *const hist_names[METRIC_HIST_COUNT] = {
+    "mkdir", "touch", "ls", "cd", "rm", "cat", "echo", "write", "mv", "cp", "find", "grep", "du", "save", "load",
+    "path_walk", "sibling_scan"
+};
+
+// Valores menores que 8 têm uma posição cada; daí em diante, cada potência
+// de 2 é dividida em 8 faixas iguais
+#define METRICS_SUB_BITS 3
+#define METRICS_BUCKETS ((64 - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS)
+
+// Contadores de uma thread. Só a dona escreve (com load e store atômicos,
+// sem disputa); a leitura soma os blocos de todas. Os blocos nunca são
+// liberados: o de uma thread que terminou passa para a próxima, com os
+// valores que já tinha
+typedef struct MetricsShard {
+    unsigned long long buckets[METRIC_HIST_COUNT][METRICS_BUCKETS];
+    unsigned long long sum[METRIC_HIST_COUNT];
+    unsigned long long max[METRIC_HIST_COUNT];
+    unsigned long long counters[METRIC_COUNTER_COUNT];
+    int in_use;
+    struct MetricsShard *next;
+} MetricsShard;
+
+static MetricsShard *shards;   // Lista só cresce (inserção sob shards_mutex)
+static pthread_mutex_t shards_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t shard_key;      // Só para devolver o bloco quando a thread termina
+static __thread MetricsShard *local; // Acesso rápido ao bloco da thread
+
+static void release_shard(void *ptr) {
+    MetricsShard *s = (MetricsShard*)ptr;
+    pthread_mutex_lock(&shards_mutex);
+    s->in_use = 0;
+    pthread_mutex_unlock(&shards_mutex);
+}
+
+static void create_key(void) {
+    pthread_key_create(&shard_key, release_shard);
+}
+
+static MetricsShard* my_shard(void) {
+    if (local) return local;
+    pthread_once(&key_once, create_key);
+    pthread_once(&calibrate_once, calibrate_start);
+
+    MetricsShard *s;
+    pthread_mutex_lock(&shards_mutex);
+    for (s = shards; s && s->in_use; s = s->next) {}
+    if (!s) {
+        s = (MetricsShard*)calloc(1, sizeof(MetricsShard));
+        if (!s) { perror("Failed to allocate metrics"); exit(1); }
+        s->next = shards;
+        __atomic_store_n(&shards, s, __ATOMIC_RELEASE);
+    }
+    s->in_use = 1;
+    pthread_mutex_unlock(&shards_mutex);
+    pthread_setspecific(shard_key, s);
+    local = s;
+    return s;
+}
+
+static void bump(unsigned long long *slot, unsigned long long n) {
+    __atomic_store_n(slot, __atomic_load_n(slot, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static unsigned int bucket_of(unsigned long long v) {
+    if (v < (1u << METRICS_SUB_BITS)) return (unsigned int)v;
+    unsigned int e = 63u - (unsigned int)__builtin_clzll(v);
+    return ((e - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS) +
+           (unsigned int)((v >> (e - METRICS_SUB_BITS)) & ((1u << METRICS_SUB_BITS) - 1));
+}
+
+// Maior valor que cai na posição
+static unsigned long long bucket_top(unsigned int b) {
+    if (b < (1u << METRICS_SUB_BITS)) return b;
+    unsigned int e = (b >> METRICS_SUB_BITS) + METRICS_SUB_BITS - 1;
+    unsigned long long sub = b & ((1u << METRICS_SUB_BITS) - 1);
+    unsigned long long width = 1ull << (e - METRICS_SUB_BITS);
+    return (((1ull << METRICS_SUB_BITS) + sub) << (e - METRICS_SUB_BITS)) + width - 1;
+}
+
+void metrics_sample(MetricHist hist, unsigned long long value) {
+    MetricsShard *s = my_shard();
+    bump(&s->buckets[hist][bucket_of(value)], 1);
+    bump(&s->sum[hist], value);
+    if (value > __atomic_load_n(&s->max[hist], __ATOMIC_RELAXED)) {
+        __atomic_store_n(&s->max[hist], value, __ATOMIC_RELAXED);
+    }
+}
+
+void metrics_alloc(unsigned long long bytes) {
+    MetricsShard *s = my_shard();
+    bump(&s->counters[METRIC_ALLOCS], 1);
+    bump(&s->counters[METRIC_ALLOC_BYTES], bytes);
+}
+
+void metrics_summary(MetricHist hist, MetricSummary *out) {
+    unsigned long long merged[METRICS_BUCKETS] = {0};
+    memset(out, 0, sizeof(MetricSummary));
+    pthread_mutex_lock(&shards_mutex);
+    for (MetricsShard *s = shards; s; s = s->next) {
+        for (unsigned int b = 0; b < METRICS_BUCKETS; b++) {
+            unsigned long long n = __atomic_load_n(&s->buckets[hist][b], __ATOMIC_RELAXED);
+            merged[b] += n;
+            out->count += n;
+        }
+        out->sum += __atomic_load_n(&s->sum[hist], __ATOMIC_RELAXED);
+        unsigned long long max = __atomic_load_n(&s->max[hist], __ATOMIC_RELAXED);
+        if (max > out->max) out->max = max;
+    }
+
+    // Cada percentil é o topo da posição em que cai a amostra de ordem
+    // correspondente (limitado ao máximo visto)
+    const double quantiles[4] = { 0.5, 0.9, 0.99, 0.999 };
+    unsigned long long *targets[4] = { &out->p50, &out->p90, &out->p99, &out->p999 };
+    unsigned long long seen = 0;
+    int q = 0;
+    for (unsigned int b = 0; b < METRICS_BUCKETS && q < 4 && out->count > 0; b++) {
+        seen += merged[b];
+        while (q < 4 && seen > 0 && seen >= (unsigned long long)(quantiles[q] * out->count + 0.5)) {
+            unsigned long long top = bucket_top(b);
+            *targets[q++] = top < out->max ? top : out->max;
+        }
+    }
+    pthread_mutex_unlock(&shards_mutex);
+
+    if (hist < METRIC_OP_COUNT && METRICS_TSC) {
+        double scale = metrics_ns_per_tick();
+        unsigned long long *values[7] = { &out->sum, &out->max, &out->p50, &out->p90,
+                                          &out->p99, &out->p999, NULL };
+        for (int i = 0; values[i]; i++) *values[i] = (unsigned long long)(*values[i] * scale);
+    }
+}
+
+unsigned long long metrics_counter(MetricCounter counter) {
+    unsigned long long total = 0;
+    pthread_mutex_lock(&shards_mutex);
+    for (MetricsShard *s = shards; s; s = s->next) {
+        total += __atomic_load_n(&s->counters[counter], __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&shards_mutex);
+    return total;
+}
+
+void metrics_reset(void) {
+    pthread_mutex_lock(&shards_mutex);
+    for (MetricsShard *s = shards; s; s = s->next) {
+        unsigned long long *words = &s->buckets[0][0];
+        size_t n = offsetof(MetricsShard, in_use) / sizeof(unsigned long long);
+        for (size_t i = 0; i < n; i++) __atomic_store_n(&words[i], 0, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&shards_mutex);
+}
+
+void metrics_print(FILE *out) {
+    MetricSummary m;
+    fprintf(out, "%-10s %10s %10s %9s %9s %9s %9s %9s %9s\n", "operation", "count", "total ms",
+            "mean us", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+    for (int h = 0; h < METRIC_OP_COUNT; h++) {
+        metrics_summary((MetricHist)h, &m);
+        if (m.count == 0) continue;
+        fprintf(out, "%-10s %10llu %10.1f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n", hist_names[h],
+                m.count, m.sum / 1e6, m.sum / 1e3 / m.count, m.p50 / 1e3, m.p90 / 1e3,
+                m.p99 / 1e3, m.p999 / 1e3, m.max / 1e3);
+    }
+    const char *labels[2] = { "path walk: components per walk", "sibling scan: nodes per lookup" };
+    for (int h = METRIC_PATH_WALK; h < METRIC_HIST_COUNT; h++) {
+        metrics_summary((MetricHist)h, &m);
+        fprintf(out, "%s: %llu samples, mean %.2f, p50 %llu, p99 %llu, max %llu\n",
+                labels[h - METRIC_PATH_WALK], m.count, m.count ? (double)m.sum / m.count : 0.0,
+                m.p50, m.p99, m.max);
+    }
+    fprintf(out, "alloc: %llu allocations, %llu bytes\n", metrics_counter(METRIC_ALLOCS),
+            metrics_counter(METRIC_ALLOC_BYTES));
+}
+
+void metrics_print_json(FILE *out) {
+    MetricSummary m;
+    fprintf(out, "{\"enabled\":true,\"histograms\":{");
+    for (int h = 0; h < METRIC_HIST_COUNT; h++) {
+        metrics_summary((MetricHist)h, &m);
+        fprintf(out, "%s\"%s\":{\"unit\":\"%s\",\"count\":%llu,\"sum\":%llu,\"max\":%llu,"
+                     "\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu}",
+                h ? "," : "", hist_names[h], h < METRIC_OP_COUNT ? "ns" : "nodes",
+                m.count, m.sum, m.max, m.p50, m.p90, m.p99, m.p999);
+    }
+    fprintf(out, "},\"alloc\":{\"allocations\":%llu,\"bytes\":%llu}}\n",
+            metrics_counter(METRIC_ALLOCS), metrics_counter(METRIC_ALLOC_BYTES));
+}
+
+#else // !MINIFS_METRICS
+
+void metrics_sample(MetricHist hist, unsigned long long value) { (void)hist; (void)value; }
+void metrics_alloc(unsigned long long bytes) { (void)bytes; }
+
+void metrics_summary(MetricHist hist, MetricSummary *out) {
+    (void)hist;
+    memset(out, 0, sizeof(MetricSummary));
+}
+
+unsigned long long metrics_counter(MetricCounter counter) {
+    (void)counter;
+    return 0;
+}
+
+void metrics_reset(void) {}
+
+void metrics_print(FILE *out) {
+    fprintf(out, "stats: metrics disabled at compile time (MINIFS_METRICS=0)\n");
+}
+
+void metrics_print_json(FILE *out) {
+    fprintf(out, "{\"enabled\":false}\n");
+}
+
+#endif // MINIFS_METRICS
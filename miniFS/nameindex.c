@@ -0,0 +1,354 @@
+// miniFS/nameindex.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nameindex.h"
+#include "names.h"
+#include "dirindex.h"
+#include "fs.h"
+
+#define MIN_CAP 1024
+#define EMPTY_SLACK 4096       // Nomes sem nós tolerados além de um quarto do total
+
+static void* checked_malloc(size_t size, const char *what) {
+    void *p = malloc(size ? size : 1);
+    if (!p) { perror(what); exit(1); }
+    return p;
+}
+
+// --- Nome -> lista de nós ---
+
+static NameEntry* lookup(const NameIndex *x, const char *name) {
+    if (x->cap == 0) return NULL;
+    size_t mask = x->cap - 1;
+    for (size_t i = NAME_HEADER(name)->hash & mask; x->slots[i].name; i = (i + 1) & mask) {
+        if (x->slots[i].name == name) return &x->slots[i];
+    }
+    return NULL;
+}
+
+// Tabela com cap posições, com as entradas (não vazias, com drop) da atual
+static void rehash(NameIndex *x, NameTable *t, size_t cap, int drop) {
+    NameEntry *slots = (NameEntry*)calloc(cap, sizeof(NameEntry));
+    if (!slots) { perror("Failed to allocate name index"); exit(1); }
+    size_t live = 0;
+    for (size_t i = 0; i < x->cap; i++) {
+        const char *name = x->slots[i].name;
+        if (!name) continue;
+        if (drop && !x->slots[i].nodes) {
+            names_release(t, name);
+            continue;
+        }
+        size_t j = NAME_HEADER(name)->hash & (cap - 1);
+        while (slots[j].name) j = (j + 1) & (cap - 1);
+        slots[j] = x->slots[i];
+        live++;
+    }
+    free(x->slots);
+    x->slots = slots;
+    x->cap = cap;
+    x->live = live;
+    if (drop) x->empty = 0;
+}
+
+static size_t capacity_for(size_t live) {
+    size_t cap = MIN_CAP;
+    while (cap < (live + 1) * 2) cap *= 2;
+    return cap;
+}
+
+// Entrada do nome, criada (com uma referência ao nome) se necessário
+static NameEntry* entry_for(NameIndex *x, const char *name) {
+    NameEntry *e = lookup(x, name);
+    if (e) return e;
+    if ((x->live + 1) * 4 > x->cap * 3) rehash(x, NULL, capacity_for(x->live + 1), 0);
+    size_t mask = x->cap - 1;
+    size_t i = NAME_HEADER(name)->hash & mask;
+    while (x->slots[i].name) i = (i + 1) & mask;
+    x->slots[i].name = names_retain(name);
+    x->slots[i].nodes = NULL;
+    x->live++;
+    x->empty++;
+    if (x->added_count == x->added_cap) {
+        size_t cap = x->added_cap ? x->added_cap * 2 : 64;
+        const char **grown = (const char**)realloc((void*)x->added, cap * sizeof(char*));
+        if (!grown) { perror("Failed to allocate name index"); exit(1); }
+        x->added = grown;
+        x->added_cap = cap;
+    }
+    x->added[x->added_count++] = name;
+    return &x->slots[i];
+}
+
+void nameindex_link(NameIndex *x, Node *node) {
+    if (!x->active || !node->name) return;
+    NameEntry *e = entry_for(x, node->name);
+    if (!e->nodes) x->empty--;
+    node->name_prev = NULL;
+    node->name_next = e->nodes;
+    if (e->nodes) e->nodes->name_prev = node;
+    e->nodes = node;
+}
+
+void nameindex_unlink(NameIndex *x, Node *node) {
+    if (!x->active || !node->name) return;
+    if (node->name_prev) {
+        node->name_prev->name_next = node->name_next;
+    } else {
+        NameEntry *e = lookup(x, node->name);
+        if (!e || e->nodes != node) return; // Nó fora do índice
+        e->nodes = node->name_next;
+        if (!e->nodes) x->empty++;
+    }
+    if (node->name_next) node->name_next->name_prev = node->name_prev;
+    node->name_next = NULL;
+    node->name_prev = NULL;
+}
+
+void nameindex_start(NameIndex *x) {
+    x->active = 1;
+}
+
+// --- Vetores ordenados ---
+
+// Os 8 primeiros bytes do nome (ou os 8 últimos, do fim para o começo)
+// como um número, completados com zeros: comparar chaves é comparar esses
+// bytes como em strcmp
+static uint64_t front_key(const char *s, size_t len) {
+    uint64_t k = 0;
+    for (size_t i = 0; i < 8; i++) k = k << 8 | (i < len ? (unsigned char)s[i] : 0);
+    return k;
+}
+
+static uint64_t back_key(const char *s, size_t len) {
+    uint64_t k = 0;
+    for (size_t i = 0; i < 8; i++) k = k << 8 | (i < len ? (unsigned char)s[len - 1 - i] : 0);
+    return k;
+}
+
+// Com as chaves iguais, nomes diferentes têm pelo menos 8 bytes (um nome
+// não contém '\0'), e a comparação segue do nono byte
+static int front_cmp(const NameKey *a, const NameKey *b) {
+    if (a->key != b->key) return a->key < b->key ? -1 : 1;
+    if (NAME_HEADER(a->name)->len < 8 || NAME_HEADER(b->name)->len < 8) return 0;
+    return strcmp(a->name + 8, b->name + 8);
+}
+
+static int back_cmp(const NameKey *a, const NameKey *b) {
+    if (a->key != b->key) return a->key < b->key ? -1 : 1;
+    size_t la = NAME_HEADER(a->name)->len, lb = NAME_HEADER(b->name)->len;
+    for (size_t i = 8; i < la && i < lb; i++) {
+        unsigned char ca = (unsigned char)a->name[la - 1 - i], cb = (unsigned char)b->name[lb - 1 - i];
+        if (ca != cb) return ca < cb ? -1 : 1;
+    }
+    return la < lb ? -1 : la > lb;
+}
+
+static int front_sort(const void *a, const void *b) { return front_cmp((const NameKey*)a, (const NameKey*)b); }
+static int back_sort(const void *a, const void *b) { return back_cmp((const NameKey*)a, (const NameKey*)b); }
+
+// Intercala os n nomes de add (já ordenados) com os count de *keys
+static void merge_keys(NameKey **keys, size_t count, const NameKey *add, size_t n,
+                       int (*cmp)(const NameKey*, const NameKey*)) {
+    NameKey *out = (NameKey*)checked_malloc((count + n) * sizeof(NameKey), "Failed to allocate name index");
+    const NameKey *old = *keys;
+    size_t i = 0, j = 0, k = 0;
+    while (i < count && j < n) out[k++] = cmp(&old[i], &add[j]) <= 0 ? old[i++] : add[j++];
+    while (i < count) out[k++] = old[i++];
+    while (j < n) out[k++] = add[j++];
+    free(*keys);
+    *keys = out;
+}
+
+// Copia os nomes de sorted para o pool, cada um com seu '\0'
+static void fill_pool(NameIndex *x) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < x->sorted_count; i++) bytes += NAME_HEADER(x->sorted[i].name)->len + 1;
+    free(x->pool);
+    x->pool = (char*)checked_malloc(bytes, "Failed to allocate name index");
+    char *p = x->pool;
+    for (size_t i = 0; i < x->sorted_count; i++) {
+        size_t len = NAME_HEADER(x->sorted[i].name)->len + 1;
+        memcpy(p, x->sorted[i].name, len);
+        p += len;
+    }
+}
+
+// Passa os nomes novos para os vetores ordenados
+static void merge_added(NameIndex *x) {
+    size_t n = x->added_count;
+    NameKey *add = (NameKey*)checked_malloc(n * sizeof(NameKey), "Failed to allocate name index");
+    for (size_t i = 0; i < n; i++) {
+        add[i].name = x->added[i];
+        add[i].key = front_key(add[i].name, NAME_HEADER(add[i].name)->len);
+    }
+    qsort(add, n, sizeof(NameKey), front_sort);
+    merge_keys(&x->sorted, x->sorted_count, add, n, front_cmp);
+    for (size_t i = 0; i < n; i++) {
+        add[i].name = x->added[i];
+        add[i].key = back_key(add[i].name, NAME_HEADER(add[i].name)->len);
+    }
+    qsort(add, n, sizeof(NameKey), back_sort);
+    merge_keys(&x->reversed, x->sorted_count, add, n, back_cmp);
+    free(add);
+    x->sorted_count += n;
+    x->added_count = 0;
+    fill_pool(x);
+}
+
+static int has_nodes(const NameIndex *x, const char *name) {
+    return lookup(x, name)->nodes != NULL;
+}
+
+// Tira do índice os nomes sem nós: primeiro dos vetores (enquanto os
+// nomes ainda existem), depois da tabela, soltando as referências
+static void compact(NameIndex *x, NameTable *t) {
+    size_t kept = 0;
+    for (size_t i = 0; i < x->sorted_count; i++) {
+        if (has_nodes(x, x->sorted[i].name)) x->sorted[kept++] = x->sorted[i];
+    }
+    kept = 0;
+    for (size_t i = 0; i < x->sorted_count; i++) {
+        if (has_nodes(x, x->reversed[i].name)) x->reversed[kept++] = x->reversed[i];
+    }
+    x->sorted_count = kept;
+    kept = 0;
+    for (size_t i = 0; i < x->added_count; i++) {
+        if (has_nodes(x, x->added[i])) x->added[kept++] = x->added[i];
+    }
+    x->added_count = kept;
+    fill_pool(x);
+    rehash(x, t, capacity_for(x->live - x->empty), 1);
+}
+
+// --- Busca ---
+
+int nameindex_match(const char *pattern, const char *name, size_t len) {
+    // Com '*', guarda onde ele está e até onde do nome ele já cobriu: numa
+    // falha, ele passa a cobrir um caractere a mais. Só o último '*' importa
+    size_t p = 0, n = 0, star = (size_t)-1, mark = 0;
+    while (n < len) {
+        if (pattern[p] == '*') {
+            star = p++;
+            mark = n;
+        } else if (pattern[p] && (pattern[p] == '?' || pattern[p] == name[n])) {
+            p++;
+            n++;
+        } else if (star != (size_t)-1) {
+            p = star + 1;
+            n = ++mark;
+        } else {
+            return 0;
+        }
+    }
+    while (pattern[p] == '*') p++;
+    return pattern[p] == '\0';
+}
+
+// Compara o nome com o prefixo (ou o sufixo) de lp bytes do padrão, como
+// strncmp: a ordem dos vetores, então os nomes que o têm são uma faixa
+static int prefix_cmp(const char *name, const char *prefix, size_t lp) {
+    return strncmp(name, prefix, lp);
+}
+
+static int suffix_cmp(const char *name, const char *suffix, size_t ls) {
+    size_t len = NAME_HEADER(name)->len;
+    for (size_t i = 0; i < ls; i++) {
+        if (i == len) return -1;
+        unsigned char a = (unsigned char)name[len - 1 - i], b = (unsigned char)suffix[ls - 1 - i];
+        if (a != b) return a < b ? -1 : 1;
+    }
+    return 0;
+}
+
+// Faixa [*lo, *hi) dos nomes de keys com cmp(nome) == 0
+static void key_range(const NameKey *keys, size_t count, const char *lit, size_t n,
+                      int (*cmp)(const char*, const char*, size_t), size_t *lo, size_t *hi) {
+    size_t a = 0, b = count;
+    while (a < b) {
+        size_t mid = a + (b - a) / 2;
+        if (cmp(keys[mid].name, lit, n) < 0) a = mid + 1;
+        else b = mid;
+    }
+    *lo = a;
+    b = count;
+    while (a < b) {
+        size_t mid = a + (b - a) / 2;
+        if (cmp(keys[mid].name, lit, n) <= 0) a = mid + 1;
+        else b = mid;
+    }
+    *hi = a;
+}
+
+// top é a raiz da árvore ou um nó acima de node
+static int inside(Node *node, Node *top) {
+    if (!top->parent) return 1;
+    for (; node; node = node->parent) {
+        if (node == top) return 1;
+    }
+    return 0;
+}
+
+static size_t report(Node *nodes, Node *top, NameIndexFn fn, void *arg) {
+    size_t found = 0;
+    for (Node *n = nodes; n; n = n->name_next) {
+        if (!inside(n, top)) continue;
+        fn(n, arg);
+        found++;
+    }
+    return found;
+}
+
+static size_t report_name(const NameIndex *x, const char *name, const char *pattern, Node *top,
+                          NameIndexFn fn, void *arg) {
+    if (!nameindex_match(pattern, name, NAME_HEADER(name)->len)) return 0;
+    return report(lookup(x, name)->nodes, top, fn, arg);
+}
+
+size_t nameindex_find(NameIndex *x, NameTable *t, const char *pattern, Node *top,
+                      NameIndexFn fn, void *arg) {
+    if (x->empty > x->live / 4 + EMPTY_SLACK) compact(x, t);
+    if (x->added_count > NAMEINDEX_ADDED_MAX) merge_added(x);
+
+    size_t len = strlen(pattern);
+    size_t lp = strcspn(pattern, "*?");
+    if (lp == len) {
+        const char *name = names_lookup(t, pattern, len, dirindex_hash(pattern, len));
+        NameEntry *e = name ? lookup(x, name) : NULL;
+        return e ? report(e->nodes, top, fn, arg) : 0;
+    }
+    size_t ls = 0;
+    while (ls < len && pattern[len - 1 - ls] != '*' && pattern[len - 1 - ls] != '?') ls++;
+
+    size_t found = 0;
+    size_t lo = 0, hi = 0, rlo = 0, rhi = (size_t)-1;
+    if (lp) key_range(x->sorted, x->sorted_count, pattern, lp, prefix_cmp, &lo, &hi);
+    if (ls) key_range(x->reversed, x->sorted_count, pattern + len - ls, ls, suffix_cmp, &rlo, &rhi);
+    if (lp == 0 && ls == 0) {
+        // Sem nada fixo: todos os nomes, lidos em sequência no pool
+        const char *p = x->pool;
+        for (size_t i = 0; i < x->sorted_count; i++) {
+            size_t n = strlen(p);
+            if (nameindex_match(pattern, p, n)) found += report(lookup(x, x->sorted[i].name)->nodes, top, fn, arg);
+            p += n + 1;
+        }
+    } else if (lp && (!ls || hi - lo <= rhi - rlo)) {
+        for (size_t i = lo; i < hi; i++) found += report_name(x, x->sorted[i].name, pattern, top, fn, arg);
+    } else {
+        for (size_t i = rlo; i < rhi; i++) found += report_name(x, x->reversed[i].name, pattern, top, fn, arg);
+    }
+    for (size_t i = 0; i < x->added_count; i++) {
+        found += report_name(x, x->added[i], pattern, top, fn, arg);
+    }
+    return found;
+}
+
+void nameindex_reset(NameIndex *x) {
+    free(x->slots);
+    free(x->sorted);
+    free(x->reversed);
+    free(x->pool);
+    free((void*)x->added);
+    memset(x, 0, sizeof(NameIndex));
+}
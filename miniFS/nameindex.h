@@ -0,0 +1,89 @@
+// miniFS/nameindex.h
+
+#ifndef NAMEINDEX_H
+#define NAMEINDEX_H
+
+#include <stddef.h> // Para size_t
+#include <stdint.h>
+
+struct Node;
+struct NameTable;
+
+// Índice global de nomes, usado pelo find. Para cada nome internado da
+// árvore (names.h), a lista dos nós com esse nome, encadeada pelos
+// próprios nós (name_next/name_prev, inserção e remoção em O(1)). Os nomes
+// ficam também em dois vetores ordenados: pelo nome e pelo nome lido de
+// trás para frente. Um padrão com prefixo fixo ("src*", "a?.c") vira uma
+// faixa do primeiro, e um com sufixo fixo ("*.c") uma faixa do segundo,
+// achadas por busca binária; só um padrão sem nenhum dos dois ("*x*")
+// percorre todos os nomes distintos, numa cópia deles em sequência (pool),
+// e não espalhados pela arena. Nome exato é uma consulta à tabela de
+// nomes. Em nenhum caso a árvore é percorrida: o caminho de cada resultado
+// sai dos ponteiros parent.
+//
+// O índice é montado no primeiro find (nameindex_start) e, daí em diante,
+// acompanha cada nó que ganha, troca ou perde o nome. Um mv só muda os
+// ponteiros parent, então não mexe no índice. Nomes novos entram num vetor
+// à parte, procurado por varredura e intercalado nos vetores ordenados
+// quando passa de NAMEINDEX_ADDED_MAX nomes; nomes sem nenhum nó continuam
+// no índice até uma limpeza, feita quando eles passam de um quarto do
+// total. O índice segura uma referência de cada nome que guarda, então os
+// ponteiros dos vetores nunca ficam soltos.
+//
+// Quem chama garante que só uma thread usa o índice por vez (no fs, com o
+// mutex da árvore)
+#define NAMEINDEX_ADDED_MAX 4096
+
+typedef struct {
+    const char *name;      // Nome internado (NULL = posição vazia)
+    struct Node *nodes;    // Primeiro nó com esse nome (NULL = nenhum)
+} NameEntry;
+
+// Nome num vetor ordenado, com os 8 primeiros (ou últimos) bytes em cache
+// na ordem de comparação: a ordenação quase nunca precisa ler o nome
+typedef struct {
+    uint64_t key;
+    const char *name;
+} NameKey;
+
+typedef struct NameIndex {
+    int active;
+    NameEntry *slots;      // Nome -> lista de nós (endereçamento aberto)
+    size_t cap;            // Potência de 2 (0 enquanto vazio)
+    size_t live;           // Nomes no índice, com ou sem nós
+    size_t empty;          // Deles, os que estão sem nós
+    NameKey *sorted;       // Pela ordem de strcmp
+    NameKey *reversed;     // Pela ordem dos nomes invertidos
+    size_t sorted_count;
+    char *pool;            // Os nomes de sorted, na mesma ordem e seguidos
+    const char **added;    // Nomes que ainda não estão nos vetores ordenados
+    size_t added_count;
+    size_t added_cap;
+} NameIndex;
+
+// Liga o nó à lista do seu nome, ou o tira dela (nada com o índice
+// desligado). O nó guarda o nome em node->name
+void nameindex_link(NameIndex *x, struct Node *node);
+void nameindex_unlink(NameIndex *x, struct Node *node);
+
+// Liga o índice, que passa a valer para os nós ligados daqui em diante
+// (fs.c liga todos os nós da árvore logo depois)
+void nameindex_start(NameIndex *x);
+
+// Chama fn para cada nó da subárvore de top (top incluído) cujo nome casa
+// com pattern: um nome exato, ou um glob com '*' (qualquer sequência,
+// inclusive vazia) e '?' (um caractere). Limpa os nomes sem nós e
+// intercala os nomes novos antes, se for a hora. Retorna quantos nós
+// casaram
+typedef void (*NameIndexFn)(struct Node *node, void *arg);
+size_t nameindex_find(NameIndex *x, struct NameTable *t, const char *pattern, struct Node *top,
+                      NameIndexFn fn, void *arg);
+
+// O glob usado pelo find, para quem procura sem o índice (benchmark)
+int nameindex_match(const char *pattern, const char *name, size_t len);
+
+// Esquece o índice sem tocar nos nomes, que o alocador já liberou
+// (destruição da árvore)
+void nameindex_reset(NameIndex *x);
+
+#endif // NAMEINDEX_H
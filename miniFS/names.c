@@ -0,0 +1,134 @@
+// miniFS/names.c
+
+#include <string.h>
+#include "names.h"
+#include "alloc.h"
+
+#define TOMBSTONE ((const char*)1)
+#define MIN_CAP 64
+
+static void rehash(NameTable *t, FsAllocator *alloc, size_t new_cap) {
+    NameSlot *slots = (NameSlot*)alloc_bytes(alloc, new_cap * sizeof(NameSlot));
+    memset(slots, 0, new_cap * sizeof(NameSlot));
+    size_t mask = new_cap - 1;
+    for (size_t i = 0; i < t->cap; i++) {
+        const char *s = t->slots[i].str;
+        if (s == NULL || s == TOMBSTONE) continue;
+        size_t j = t->slots[i].hash & mask;
+        while (slots[j].str != NULL) j = (j + 1) & mask;
+        slots[j] = t->slots[i];
+    }
+    if (t->slots) alloc_free_bytes(alloc, t->slots, t->cap * sizeof(NameSlot));
+    t->slots = slots;
+    t->cap = new_cap;
+    t->tombs = 0;
+}
+
+const char* names_intern(NameTable *t, const char *name, size_t len, unsigned int hash) {
+    return names_intern_in(t, t->alloc, name, len, hash);
+}
+
+const char* names_intern_in(NameTable *t, FsAllocator *alloc, const char *name, size_t len,
+                            unsigned int hash) {
+    if ((t->live + t->tombs + 1) * 4 > t->cap * 3) {
+        size_t new_cap = t->cap ? t->cap : MIN_CAP;
+        while ((t->live + 1) * 2 > new_cap) new_cap <<= 1;
+        rehash(t, alloc, new_cap);
+    }
+
+    size_t mask = t->cap - 1;
+    size_t i = hash & mask;
+    size_t free_slot = (size_t)-1;
+    while (t->slots[i].str != NULL) {
+        const char *s = t->slots[i].str;
+        if (s == TOMBSTONE) {
+            if (free_slot == (size_t)-1) free_slot = i;
+        } else if (t->slots[i].hash == hash && NAME_HEADER(s)->len == len &&
+                   memcmp(s, name, len) == 0) {
+            // Atômico: a carga de um diretório da imagem durante um cp
+            // paralelo interna nomes que os outros workers estão retendo
+            __atomic_fetch_add(&NAME_HEADER(s)->refs, 1, __ATOMIC_RELAXED);
+            return s;
+        }
+        i = (i + 1) & mask;
+    }
+    if (free_slot != (size_t)-1) {
+        i = free_slot;
+        t->tombs--;
+    }
+
+    NameHeader *h = (NameHeader*)alloc_bytes(alloc, sizeof(NameHeader) + len + 1);
+    h->refs = 1;
+    h->hash = hash;
+    h->len = (unsigned int)len;
+    h->pad = 0;
+    char *str = (char*)(h + 1);
+    memcpy(str, name, len);
+    str[len] = '\0';
+
+    t->slots[i].hash = hash;
+    t->slots[i].str = str;
+    t->live++;
+    t->bytes += len;
+    return str;
+}
+
+const char* names_lookup(const NameTable *t, const char *name, size_t len, unsigned int hash) {
+    if (t->cap == 0) return NULL;
+    size_t mask = t->cap - 1;
+    for (size_t i = hash & mask; t->slots[i].str != NULL; i = (i + 1) & mask) {
+        const char *s = t->slots[i].str;
+        if (s != TOMBSTONE && t->slots[i].hash == hash && NAME_HEADER(s)->len == len &&
+            memcmp(s, name, len) == 0) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+int names_equal(const char *str, const char *name, size_t len, unsigned int hash) {
+    const NameHeader *h = NAME_HEADER(str);
+    return h->hash == hash && h->len == len && memcmp(str, name, len) == 0;
+}
+
+const char* names_retain(const char *str) {
+    NAME_HEADER(str)->refs++;
+    return str;
+}
+
+void names_release(NameTable *t, const char *str) {
+    if (!str) return;
+    if (--NAME_HEADER(str)->refs > 0) return;
+    names_remove(t, str);
+}
+
+const char* names_retain_shared(const char *str) {
+    __atomic_fetch_add(&NAME_HEADER(str)->refs, 1, __ATOMIC_RELAXED);
+    return str;
+}
+
+int names_unref_shared(const char *str) {
+    return str && __atomic_sub_fetch(&NAME_HEADER(str)->refs, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+void names_remove(NameTable *t, const char *str) {
+    NameHeader *h = NAME_HEADER(str);
+    size_t mask = t->cap - 1;
+    size_t i = h->hash & mask;
+    while (t->slots[i].str != NULL) {
+        if (t->slots[i].str == str) {
+            t->slots[i].str = TOMBSTONE;
+            t->live--;
+            t->tombs++;
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    t->bytes -= h->len;
+    alloc_free_bytes(t->alloc, h, sizeof(NameHeader) + h->len + 1);
+}
+
+void names_reset(NameTable *t, struct FsAllocator *alloc) {
+    memset(t, 0, sizeof(NameTable));
+    t->alloc = alloc;
+}
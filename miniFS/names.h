@@ -0,0 +1,75 @@
+// miniFS/names.h
+
+#ifndef NAMES_H
+#define NAMES_H
+
+#include <stddef.h> // Para size_t
+
+struct FsAllocator;
+
+// Cabeçalho guardado na arena logo antes dos caracteres de cada nome
+// internado; o nó aponta para os caracteres (terminados em '\0')
+typedef struct NameHeader {
+    unsigned int refs;     // Quantos nós usam este nome
+    unsigned int hash;
+    unsigned int len;
+    unsigned int pad;
+} NameHeader;
+
+typedef struct {
+    unsigned int hash;
+    const char *str;       // NULL = vazio; um marcador especial indica remoção
+} NameSlot;
+
+// Tabela de nomes internados: cada nome distinto da árvore é guardado uma
+// única vez e compartilhado (com contagem de referências) pelos nós
+typedef struct NameTable {
+    struct FsAllocator *alloc;
+    NameSlot *slots;
+    size_t cap;            // Potência de 2 (0 enquanto vazia)
+    size_t live;
+    size_t tombs;
+    size_t bytes;          // Bytes de nomes distintos (sem cabeçalhos)
+} NameTable;
+
+#define NAME_HEADER(str) ((NameHeader*)(str) - 1)
+
+// Retorna o nome internado igual a name[0..len), criando-o se necessário,
+// e incrementa sua contagem de referências
+const char* names_intern(NameTable *t, const char *name, size_t len, unsigned int hash);
+
+// O mesmo, alocando o nome (e a tabela, se crescer) em alloc: usado pelos
+// workers da carga paralela, cada um com seu alocador local. Quem chama
+// garante que só uma thread altera a tabela por vez
+const char* names_intern_in(NameTable *t, struct FsAllocator *alloc, const char *name, size_t len,
+                            unsigned int hash);
+
+// Compara um nome internado com name[0..len) usando o hash e o tamanho do
+// cabeçalho dele, que nunca mudam: serve para quem lê um nó que pode estar
+// sendo renomeado (o ponteiro do nome é trocado de uma vez só)
+int names_equal(const char *str, const char *name, size_t len, unsigned int hash);
+
+// O nome internado igual a name[0..len), ou NULL se nenhum nó o usa (não
+// mexe na contagem)
+const char* names_lookup(const NameTable *t, const char *name, size_t len, unsigned int hash);
+
+// Nova referência para um nome já internado (ex.: cópia de um nó)
+const char* names_retain(const char *str);
+
+// Solta uma referência; o nome é removido da tabela quando ninguém mais o usa
+void names_release(NameTable *t, const char *str);
+
+// Para as tarefas paralelas de cp e rm -r, que mexem em contagens de nomes
+// compartilhados por nós de workers diferentes: só a contagem muda, com
+// operações atômicas. names_unref_shared retorna 1 quando soltou a última
+// referência; o nome então deve ser passado a names_remove, que altera a
+// tabela e só pode ser chamada por uma thread
+const char* names_retain_shared(const char *str);
+int names_unref_shared(const char *str);
+void names_remove(NameTable *t, const char *str);
+
+// Esquece a tabela sem liberar nada (a memória já foi devolvida junto com
+// o alocador da árvore)
+void names_reset(NameTable *t, struct FsAllocator *alloc);
+
+#endif // NAMES_H
@@ -1,18 +1,24 @@
 // miniFS/shell.c
 
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "shell.h"
 #include "fs.h"
 #include "utils.h"
+#include "metrics.h"
 
 #define MAX_INPUT 1024
 #define JSON_TREE_FILE "fs_tree.json"
+#define NDJSON_TREE_FILE "fs_tree.ndjson"
 
-void print_prompt() {
+void print_prompt(fs_t *fs) {
     char path_buffer[1024];
     char *final_path;
+    Node *root = fs_root(fs), *current_dir = fs_cwd(fs);
 
     if (current_dir == root) {
         final_path = "/";
@@ -38,71 +44,287 @@ void print_prompt() {
     printf("MiniFS:%s$ ", final_path);
 }
 
-void shell_loop() {
-    char input[MAX_INPUT];
-    int running = 1;
+// Comandos conhecidos. O nome é convertido em um id uma vez por linha, por
+// uma tabela hash montada na primeira chamada, e o id escolhe o caso do
+// switch em run_command
+typedef enum {
+    CMD_EXIT, CMD_MKDIR, CMD_TOUCH, CMD_LS, CMD_CD, CMD_PWD, CMD_RM, CMD_CAT,
+    CMD_MV, CMD_CP, CMD_TREE, CMD_MEMSTATS, CMD_CHECKPOINT, CMD_ECHO, CMD_STATS,
+    CMD_DEDUP, CMD_COMPRESS, CMD_FIND, CMD_GREP, CMD_DU, CMD_FSCK, CMD_COUNT
+} CommandId;
 
-    while (running) {
-        print_prompt();
-        if (!fgets(input, MAX_INPUT, stdin)) {
-            printf("\n"); // Handle Ctrl+D
-            break; 
-        }
+static const char *const command_names[CMD_COUNT] = {
+    "exit", "mkdir", "touch", "ls", "cd", "pwd", "rm", "cat",
+    "mv", "cp", "tree", "memstats", "checkpoint", "echo", "stats", "dedup",
+    "compress", "find", "grep", "du", "fsck"
+};
 
-        int argc = 0;
-        char** argv = split_string(input, &argc);
+#define COMMAND_SLOTS 64       // Potência de 2, bem maior que CMD_COUNT
 
-        if (argc == 0) {
-            free_tokens(argv);
-            continue;
-        }
+static unsigned char command_slots[COMMAND_SLOTS];  // id + 1; 0 = vazia
+static size_t command_lens[CMD_COUNT];
+static int commands_ready;
+
+static unsigned int command_hash(const char *name, size_t len) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)name[i]) * 16777619u;
+    return h;
+}
+
+static void commands_init(void) {
+    for (int id = 0; id < CMD_COUNT; id++) {
+        command_lens[id] = strlen(command_names[id]);
+        unsigned int slot = command_hash(command_names[id], command_lens[id]);
+        while (command_slots[slot & (COMMAND_SLOTS - 1)]) slot++;
+        command_slots[slot & (COMMAND_SLOTS - 1)] = (unsigned char)(id + 1);
+    }
+    commands_ready = 1;
+}
+
+int shell_command_id(const char *name, size_t len) {
+    if (!commands_ready) commands_init();
+    unsigned int slot = command_hash(name, len);
+    for (;; slot++) {
+        int id = command_slots[slot & (COMMAND_SLOTS - 1)] - 1;
+        if (id < 0) return -1;
+        if (command_lens[id] == len && memcmp(command_names[id], name, len) == 0) return id;
+    }
+}
+
+// Um -r ou -R (sem aspas) no primeiro argumento
+static int recursive_flag(const Tokens *t) {
+    const Token *a = &t->tok[1];
+    return t->count > 1 && !a->quoted && a->len == 2 && a->text[0] == '-' &&
+           (a->text[1] == 'r' || a->text[1] == 'R');
+}
+
+// Executa um comando já dividido em tokens. Retorna 0 para "exit"
+static int run_command(fs_t *fs, Tokens *t) {
+    int argc = t->count;
+    const Token *tok = t->tok;
 
-        char* cmd = argv[0];
-
-        if (strcmp(cmd, "exit") == 0) {
-            running = 0;
-        } else if (strcmp(cmd, "mkdir") == 0) {
-            if (argc > 1) fs_mkdir(argv[1]);
-            else fprintf(stderr, "mkdir: missing operand\n");
-        } else if (strcmp(cmd, "touch") == 0) {
-            if (argc > 1) fs_touch(argv[1]);
-            else fprintf(stderr, "touch: missing operand\n");
-        } else if (strcmp(cmd, "ls") == 0) {
-            fs_ls(argc > 1 ? argv[1] : "");
-        } else if (strcmp(cmd, "cd") == 0) {
-            if (argc > 1) fs_cd(argv[1]);
-            else fs_cd("/"); // cd para a raiz por padrão
-        } else if (strcmp(cmd, "pwd") == 0) {
-            fs_pwd();
-        } else if (strcmp(cmd, "rm") == 0) {
-            if (argc > 1) fs_rm(argv[1]);
-            else fprintf(stderr, "rm: missing operand\n");
-        } else if (strcmp(cmd, "cat") == 0) {
-            if (argc > 1) fs_cat(argv[1]);
-            else fprintf(stderr, "cat: missing operand\n");
-        } else if (strcmp(cmd, "mv") == 0) {
-            if (argc > 2) fs_mv(argv[1], argv[2]);
-            else fprintf(stderr, "Usage: mv <source> <destination>\n");
-        } else if (strcmp(cmd, "cp") == 0) {
-            if (argc > 2) fs_cp(argv[1], argv[2]);
-            else fprintf(stderr, "Usage: cp <source> <destination>\n");
-        } else if (strcmp(cmd, "tree") == 0) {
-            fs_export_tree_json(JSON_TREE_FILE);
-        } else if (strcmp(cmd, "echo") == 0) {
-            if (argc > 3 && strcmp(argv[argc - 2], ">") == 0) {
-                char content[MAX_INPUT] = "";
-                for (int i = 1; i < argc - 2; i++) {
-                    strcat(content, argv[i]);
-                    if (i < argc - 3) strcat(content, " ");
-                }
-                fs_echo(argv[argc - 1], content);
+    switch (shell_command_id(tok[0].text, tok[0].len)) {
+    case CMD_EXIT:
+        return 0;
+    case CMD_MKDIR:
+        if (argc > 1) fs_mkdir(fs, tok[1].text);
+        else fprintf(stderr, "mkdir: missing operand\n");
+        break;
+    case CMD_TOUCH:
+        if (argc > 1) fs_touch(fs, tok[1].text);
+        else fprintf(stderr, "touch: missing operand\n");
+        break;
+    case CMD_LS: {
+        // -l mostra os tamanhos, e os totais de cada diretório
+        int long_format = argc > 1 && !tok[1].quoted && strcmp(tok[1].text, "-l") == 0;
+        const char *path = argc > 1 + long_format ? tok[1 + long_format].text : "";
+        if (long_format) fs_ls_long(fs, path);
+        else fs_ls(fs, path);
+        break;
+    }
+    case CMD_CD:
+        if (argc > 1) fs_cd(fs, tok[1].text);
+        else fs_cd(fs, "/"); // cd para a raiz por padrão
+        break;
+    case CMD_PWD:
+        fs_pwd(fs);
+        break;
+    case CMD_RM: {
+        // -r apaga o diretório com tudo o que há dentro dele
+        int recursive = recursive_flag(t);
+        if (argc > 1 + recursive) {
+            if (recursive) fs_rm_recursive(fs, tok[2].text);
+            else fs_rm(fs, tok[1].text);
+        } else {
+            fprintf(stderr, "rm: missing operand\n");
+        }
+        break;
+    }
+    case CMD_CAT:
+        if (argc > 1) fs_cat(fs, tok[1].text);
+        else fprintf(stderr, "cat: missing operand\n");
+        break;
+    case CMD_MV:
+        if (argc > 2) fs_mv(fs, tok[1].text, tok[2].text);
+        else fprintf(stderr, "Usage: mv <source> <destination>\n");
+        break;
+    case CMD_CP: {
+        // Diretórios já são copiados com a subárvore; -r é aceito como no UNIX
+        int skip = recursive_flag(t);
+        if (argc > 2 + skip) fs_cp(fs, tok[1 + skip].text, tok[2 + skip].text);
+        else fprintf(stderr, "Usage: cp [-r] <source> <destination>\n");
+        break;
+    }
+    case CMD_TREE: {
+        // tree [-s] [-n] [-d <níveis>] [-o <arquivo>] [caminho]
+        ExportOptions opts = { -1, 0, 0 };
+        const char *file = NULL, *path = NULL;
+        int i = 1, bad = 0;
+        for (; i < argc && !tok[i].quoted && tok[i].text[0] == '-' && tok[i].len == 2; i++) {
+            char flag = tok[i].text[1];
+            if (flag == 's') opts.sizes = 1;
+            else if (flag == 'n') opts.ndjson = 1;
+            else if ((flag == 'd' || flag == 'o') && i + 1 < argc) {
+                i++;
+                if (flag == 'd') opts.max_depth = atoi(tok[i].text);
+                else file = tok[i].text;
             } else {
-                fprintf(stderr, "Usage: echo <content> > <filepath>\n");
+                bad = 1;
+                break;
             }
+        }
+        if (!bad && i < argc) path = tok[i++].text;
+        if (bad || i < argc || opts.max_depth < -1) {
+            fprintf(stderr, "Usage: tree [-s] [-n] [-d <depth>] [-o <file>] [path]\n");
+            break;
+        }
+        if (!file) file = opts.ndjson ? NDJSON_TREE_FILE : JSON_TREE_FILE;
+        fs_export_tree_json(fs, file, path, &opts);
+        break;
+    }
+    case CMD_MEMSTATS:
+        fs_memstats(fs);
+        break;
+    case CMD_CHECKPOINT:
+        fs_checkpoint(fs);
+        break;
+    case CMD_STATS:
+        // stats: tabela; stats -j [arquivo]: JSON; stats reset: zera tudo
+        if (argc == 1) {
+            metrics_print(stdout);
+        } else if (strcmp(tok[1].text, "reset") == 0 && argc == 2) {
+            metrics_reset();
+        } else if (strcmp(tok[1].text, "-j") == 0 && argc <= 3) {
+            FILE *out = argc == 3 ? fopen(tok[2].text, "w") : stdout;
+            if (!out) {
+                perror(tok[2].text);
+                break;
+            }
+            metrics_print_json(out);
+            if (out != stdout) fclose(out);
+        } else {
+            fprintf(stderr, "Usage: stats [-j [file]] | stats reset\n");
+        }
+        break;
+    case CMD_DEDUP:
+        // dedup: economia em memória e na última gravação; dedup on|off
+        if (argc == 1) {
+            fs_dedup_report(fs);
+        } else if (argc == 2 && (strcmp(tok[1].text, "on") == 0 || strcmp(tok[1].text, "off") == 0)) {
+            fs_set_dedup(fs, tok[1].text[1] == 'n');
+        } else {
+            fprintf(stderr, "Usage: dedup [on|off]\n");
+        }
+        break;
+    case CMD_COMPRESS:
+        // compress: codec e taxa atuais; compress off | compress <codec> [limite]
+        if (argc == 1) {
+            fs_compression_report(fs);
+        } else if (argc == 2 && strcmp(tok[1].text, "off") == 0) {
+            fs_set_compression(fs, NULL, 0);
+        } else if (argc <= 3) {
+            char *end = NULL;
+            unsigned long threshold = argc == 3 ? strtoul(tok[2].text, &end, 10) : FS_COMPRESS_THRESHOLD;
+            if (end && *end) fprintf(stderr, "Usage: compress [off | <codec> [threshold]]\n");
+            else fs_set_compression(fs, tok[1].text, threshold);
+        } else {
+            fprintf(stderr, "Usage: compress [off | <codec> [threshold]]\n");
+        }
+        break;
+    case CMD_FIND:
+        // find [dir] <pattern>: o padrão aceita '*' e '?' (entre aspas ou não)
+        if (argc == 2) fs_find(fs, ".", tok[1].text);
+        else if (argc == 3) fs_find(fs, tok[1].text, tok[2].text);
+        else fprintf(stderr, "Usage: find [dir] <pattern>\n");
+        break;
+    case CMD_GREP: {
+        // grep [-r] <pattern> <path>: o padrão é texto fixo (aspas para espaços)
+        int recursive = recursive_flag(t);
+        if (argc == 3 + recursive) fs_grep(fs, tok[2 + recursive].text, tok[1 + recursive].text, recursive);
+        else fprintf(stderr, "Usage: grep [-r] <pattern> <path>\n");
+        break;
+    }
+    case CMD_DU:
+        fs_du(fs, argc > 1 ? tok[1].text : "");
+        break;
+    case CMD_FSCK: {
+        long bad = fs_check_totals(fs);
+        if (bad == 0) printf("fsck: directory totals are consistent\n");
+        else printf("fsck: %ld directories with wrong totals\n", bad);
+        break;
+    }
+    case CMD_ECHO: {
+        const Token *op = argc > 3 ? &tok[argc - 2] : NULL;
+        int redirect = op && !op->quoted && op->text[0] == '>' &&
+                       (op->len == 1 || (op->len == 2 && op->text[1] == '>'));
+        if (redirect) {
+            // '>>' acrescenta ao final sem reescrever o arquivo
+            int append = op->len == 2;
+            const char *path = tok[argc - 1].text;
+            size_t len;
+            char *content = tokens_join(t, 1, argc - 2, &len);
+            if (append) fs_append(fs, path, content, len);
+            else fs_echo(fs, path, content);
         } else {
-            fprintf(stderr, "%s: command not found\n", cmd);
+            fprintf(stderr, "Usage: echo <content> > <filepath> | echo <content> >> <filepath>\n");
+        }
+        break;
+    }
+    default:
+        fprintf(stderr, "%s: command not found\n", tok[0].text);
+        break;
+    }
+    return 1;
+}
+
+// Divide e executa uma linha. Retorna 0 para "exit"; linhas vazias, e em
+// batch os comentários, não contam em *commands
+static int run_line(fs_t *fs, Tokens *t, char *line, int comments, long *commands) {
+    int count = tokens_split(t, line);
+    if (count < 0) {
+        fprintf(stderr, "syntax error: unterminated quote\n");
+        return 1;
+    }
+    if (count == 0 || (comments && !t->tok[0].quoted && t->tok[0].text[0] == '#')) return 1;
+    if (commands) (*commands)++;
+    return run_command(fs, t);
+}
+
+void shell_loop(fs_t *fs) {
+    char input[MAX_INPUT];
+    static Tokens tokens;  // Reaproveitados de um comando para o próximo
+
+    for (;;) {
+        print_prompt(fs);
+        if (!fgets(input, MAX_INPUT, stdin)) {
+            printf("\n"); // Handle Ctrl+D
+            break; 
         }
+        if (!run_line(fs, &tokens, input, 0, NULL)) break;
+    }
+    tokens_free(&tokens);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-        free_tokens(argv);
+long shell_batch(fs_t *fs, FILE *in) {
+    char input[MAX_INPUT];
+    Tokens tokens = {0};
+    long commands = 0;
+    double start = now_seconds();
+
+    while (fgets(input, MAX_INPUT, in)) {
+        if (!run_line(fs, &tokens, input, 1, &commands)) break;
     }
-}
\ No newline at end of file
+
+    double elapsed = now_seconds() - start;
+    tokens_free(&tokens);
+    fflush(stdout);
+    fprintf(stderr, "%ld commands in %.3f s (%.0f commands/s)\n", commands, elapsed,
+            elapsed > 0 ? commands / elapsed : 0.0);
+    return commands;
+}
@@ -3,6 +3,18 @@
 #ifndef SHELL_H
 #define SHELL_H
 
-void shell_loop();
+#include <stdio.h> // Para FILE
+#include "fs.h"    // Para fs_t
+
+void shell_loop(fs_t *fs);
+
+// Id de um comando do shell pelo nome (len bytes, sem '\0'), ou -1 se não
+// existe. Usado também pelo benchmark de parsing
+int shell_command_id(const char *name, size_t len);
+
+// Modo batch: executa os comandos lidos de in sem prompt, até o fim do
+// arquivo ou um "exit", e informa em stderr o total e os comandos por
+// segundo. Retorna quantos comandos foram executados
+long shell_batch(fs_t *fs, FILE *in);
 
 #endif // SHELL_H
\ No newline at end of file
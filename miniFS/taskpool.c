@@ -0,0 +1,197 @@
+// miniFS/taskpool.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "taskpool.h"
+#include "dirlock.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Fila dupla de um worker: o dono usa o fim, os ladrões o começo. As
+// seções críticas são de poucas instruções, e o dono quase nunca disputa
+// a trava com alguém
+typedef struct {
+    pthread_mutex_t mutex;
+    Task *tasks;
+    size_t head, tail;         // Tarefas em [head, tail)
+    size_t cap;
+} TaskQueue;
+
+typedef struct {
+    TaskPool *pool;
+    int id;
+} WorkerArg;
+
+struct TaskPool {
+    TaskFn fn;
+    void *ctx;
+    int workers;               // Máximo pedido
+    int active;                // Workers já criados (os ladrões só olham esses)
+    int spawned;
+    size_t pending;            // Tarefas agendadas e ainda não concluídas
+    TaskQueue queues[TASKPOOL_MAX_WORKERS];
+    TaskQueue pinned;          // Só o worker 0 consome
+    pthread_t threads[TASKPOOL_MAX_WORKERS];
+    WorkerArg args[TASKPOOL_MAX_WORKERS];
+};
+
+static void queue_push(TaskQueue *q, Task task) {
+    pthread_mutex_lock(&q->mutex);
+    if (q->tail == q->cap) {
+        if (q->head > 0) {
+            // Espaço liberado no começo por roubos: desloca antes de crescer
+            memmove(q->tasks, q->tasks + q->head, (q->tail - q->head) * sizeof(Task));
+            q->tail -= q->head;
+            q->head = 0;
+        }
+        if (q->tail == q->cap) {
+            size_t cap = q->cap ? q->cap * 2 : 64;
+            Task *grown = (Task*)realloc(q->tasks, cap * sizeof(Task));
+            if (!grown) { perror("Failed to grow task queue"); exit(1); }
+            q->tasks = grown;
+            q->cap = cap;
+        }
+    }
+    q->tasks[q->tail++] = task;
+    pthread_mutex_unlock(&q->mutex);
+}
+
+// Retira do fim (dono) ou do começo (ladrão)
+static int queue_take(TaskQueue *q, int from_head, Task *out) {
+    int found = 0;
+    pthread_mutex_lock(&q->mutex);
+    if (q->head < q->tail) {
+        *out = from_head ? q->tasks[q->head++] : q->tasks[--q->tail];
+        if (q->head == q->tail) q->head = q->tail = 0;
+        found = 1;
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return found;
+}
+
+void taskpool_push(TaskPool *pool, int worker, Task task) {
+    __atomic_fetch_add(&pool->pending, 1, __ATOMIC_RELAXED);
+    queue_push(&pool->queues[worker], task);
+}
+
+void taskpool_push_pinned(TaskPool *pool, Task task) {
+    __atomic_fetch_add(&pool->pending, 1, __ATOMIC_RELAXED);
+    queue_push(&pool->pinned, task);
+}
+
+// Tenta as filas dos outros workers a partir de uma vítima sorteada
+static int steal(TaskPool *pool, int id, unsigned int *seed, Task *out) {
+    int active = __atomic_load_n(&pool->active, __ATOMIC_ACQUIRE);
+    if (active < 2) return 0;
+    *seed = *seed * 1103515245u + 12345u;
+    int start = (int)((*seed >> 16) % (unsigned int)active);
+    for (int k = 0; k < active; k++) {
+        int victim = (start + k) % active;
+        if (victim != id && queue_take(&pool->queues[victim], 1, out)) return 1;
+    }
+    return 0;
+}
+
+static void* helper_main(void *arg);
+
+static void spawn_helpers(TaskPool *pool) {
+    pool->spawned = 1;
+    int created = 1;
+    for (int i = 1; i < pool->workers; i++) {
+        pool->args[i].pool = pool;
+        pool->args[i].id = i;
+        if (pthread_create(&pool->threads[i], NULL, helper_main, &pool->args[i]) != 0) break;
+        created++;
+        __atomic_store_n(&pool->active, created, __ATOMIC_RELEASE);
+    }
+}
+
+// Uma tarefa em andamento continua pendente, então ninguém sai enquanto
+// ela ainda pode agendar outras
+static void work(TaskPool *pool, int id) {
+    unsigned int seed = (unsigned int)id * 2654435761u + 1;
+    size_t done = 0;
+    for (;;) {
+        Task task;
+        if ((id == 0 && queue_take(&pool->pinned, 0, &task)) ||
+            queue_take(&pool->queues[id], 0, &task) || steal(pool, id, &seed, &task)) {
+            done += pool->fn(pool, id, task, pool->ctx);
+            __atomic_fetch_sub(&pool->pending, 1, __ATOMIC_ACQ_REL);
+            if (id == 0 && !pool->spawned && pool->workers > 1 && done >= TASKPOOL_SPAWN_AFTER &&
+                __atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0) {
+                spawn_helpers(pool);
+            }
+            continue;
+        }
+        if (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) == 0) return;
+        dirlock_pause();
+    }
+}
+
+static void* helper_main(void *arg) {
+    WorkerArg *w = (WorkerArg*)arg;
+    work(w->pool, w->id);
+    return NULL;
+}
+
+static TaskPool* pool_create(int workers, TaskFn fn, void *ctx) {
+    if (workers < 1) workers = 1;
+    if (workers > TASKPOOL_MAX_WORKERS) workers = TASKPOOL_MAX_WORKERS;
+    TaskPool *pool = (TaskPool*)calloc(1, sizeof(TaskPool));
+    if (!pool) { perror("Failed to allocate task pool"); exit(1); }
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->workers = workers;
+    pool->active = 1;
+    for (int i = 0; i < workers; i++) pthread_mutex_init(&pool->queues[i].mutex, NULL);
+    pthread_mutex_init(&pool->pinned.mutex, NULL);
+    return pool;
+}
+
+// Espera os outros workers e libera o pool
+static int pool_finish(TaskPool *pool) {
+    int workers = pool->workers;
+    int used = pool->active;
+    for (int i = 1; i < used; i++) pthread_join(pool->threads[i], NULL);
+    for (int i = 0; i < workers; i++) {
+        pthread_mutex_destroy(&pool->queues[i].mutex);
+        free(pool->queues[i].tasks);
+    }
+    pthread_mutex_destroy(&pool->pinned.mutex);
+    free(pool->pinned.tasks);
+    free(pool);
+    return used;
+}
+
+int taskpool_run(int workers, TaskFn fn, void *ctx, Task first) {
+    TaskPool *pool = pool_create(workers, fn, ctx);
+    taskpool_push(pool, 0, first);
+    work(pool, 0);
+    return pool_finish(pool);
+}
+
+int taskpool_run_all(int workers, TaskFn fn, void *ctx, const Task *tasks, size_t n) {
+    TaskPool *pool = pool_create(workers, fn, ctx);
+    for (size_t i = 0; i < n; i++) taskpool_push(pool, 0, tasks[i]);
+    if (n > 1 && pool->workers > 1) spawn_helpers(pool);
+    work(pool, 0);
+    return pool_finish(pool);
+}
+
+int taskpool_default_workers(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long n = (long)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (n < 1) n = 1;
+    return n > TASKPOOL_MAX_WORKERS ? TASKPOOL_MAX_WORKERS : (int)n;
+}
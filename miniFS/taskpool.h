@@ -0,0 +1,52 @@
+// miniFS/taskpool.h
+
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <stddef.h> // Para size_t
+
+// Pool de tarefas com roubo de trabalho (work stealing), para as operações
+// que percorrem subárvores inteiras (cp, rm -r, gravação e carga completa
+// da imagem). Cada worker tem sua
+// própria fila dupla: empilha e desempilha tarefas no fim, em
+// profundidade, o que mantém a fila curta; sem nada para fazer, rouba do
+// começo da fila de outro worker, onde estão as tarefas mais antigas (em
+// geral, as subárvores maiores).
+//
+// A thread que chama taskpool_run é o worker 0 e começa sozinha. Os outros
+// só são criados depois que ela processou TASKPOOL_SPAWN_AFTER unidades de
+// trabalho e ainda sobram tarefas, então operações pequenas não pagam a
+// criação de threads. Tarefas fixas (taskpool_push_pinned) só rodam no
+// worker 0, para o que não pode ser feito em paralelo.
+#define TASKPOOL_MAX_WORKERS 64
+#define TASKPOOL_SPAWN_AFTER 4096
+
+typedef struct {
+    void *a;
+    void *b;
+} Task;
+
+typedef struct TaskPool TaskPool;
+
+// Executa uma tarefa no worker indicado e retorna quantas unidades de
+// trabalho (ex.: nós) ela processou
+typedef size_t (*TaskFn)(TaskPool *pool, int worker, Task task, void *ctx);
+
+// Roda first e tudo o que ela agendar, com até workers threads (incluindo
+// a que chama). Retorna quantos workers chegaram a ser usados
+int taskpool_run(int workers, TaskFn fn, void *ctx, Task first);
+
+// Para poucas tarefas grandes (ex.: uma por subárvore da imagem): todas
+// entram na fila do worker 0, na ordem dada (o worker 0 começa pela
+// última, os outros roubam a partir da primeira), e os outros workers são
+// criados logo no início
+int taskpool_run_all(int workers, TaskFn fn, void *ctx, const Task *tasks, size_t n);
+
+// Agenda uma tarefa na fila do próprio worker (só de dentro de uma tarefa)
+void taskpool_push(TaskPool *pool, int worker, Task task);
+void taskpool_push_pinned(TaskPool *pool, Task task);
+
+// Número de processadores disponíveis (limitado a TASKPOOL_MAX_WORKERS)
+int taskpool_default_workers(void);
+
+#endif // TASKPOOL_H
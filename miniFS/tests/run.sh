@@ -0,0 +1,94 @@
+#!/bin/sh
+# miniFS/tests/run.sh
+#
+# Testes do shell: cada <nome>.txt é um script do modo batch, e
+# <nome>.out a saída esperada (stdout e stderr juntos, sem a linha final
+# com o tempo). Cada script roda num diretório vazio, sem imagem nem
+# journal. Uso: tests/run.sh [caminho do minifs] [nome...]
+#   gcc -o minifs main.c ... && tests/run.sh ./minifs
+# Um <nome>.txt sem <nome>.out grava a saída como esperada.
+#
+# Linhas que começam com '@' são do próprio run.sh e saem na saída como
+# estão, para marcar onde cada trecho começa:
+#   @run [VAR=valor ...]  termina a execução atual e inicia o minifs de novo
+#                         no mesmo diretório (a imagem e o journal ficam),
+#                         com essas variáveis de ambiente
+#   @sleep <segundos>     pausa entre dois comandos, com o minifs rodando
+#   @sh <comando>         termina a execução atual e roda o comando no
+#                         diretório do teste; a próxima usa o mesmo ambiente.
+#                         $TESTS é este diretório (imagens de versões
+#                         antigas, image_v*.dat, e com arquivos de várias
+#                         linhas, grep.dat) e $MINIFS o binário, para
+#                         gerar com awk conteúdos maiores que uma linha do
+#                         shell (1024 bytes)
+
+minifs=$(cd "$(dirname "${1:-./minifs}")" && pwd)/$(basename "${1:-./minifs}")
+[ $# -gt 0 ] && shift
+TESTS=$(cd "$(dirname "$0")" && pwd)
+MINIFS=$minifs
+export TESTS MINIFS
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# O ambiente de quem chama não vale nos testes
+unset MINIFS_SYNC_RECORDS MINIFS_SYNC_MS MINIFS_CHECKPOINT_MB MINIFS_CHECKPOINT_S
+unset MINIFS_DEDUP MINIFS_COMPRESS MINIFS_METRICS
+
+# Manda os comandos para o minifs, fazendo as pausas
+feed() {
+    while IFS= read -r line || [ -n "$line" ]; do
+        case "$line" in
+            "@sleep "*) sleep "${line#@sleep }" ;;
+            *) printf '%s\n' "$line" ;;
+        esac
+    done < "$1"
+}
+
+# Roda os comandos acumulados, se houver, com o ambiente do último @run
+flush() {
+    if [ -s "$work/cmds" ]; then
+        # shellcheck disable=SC2086 # As variáveis de @run são separadas por espaço
+        (cd "$work/fs" && feed "$work/cmds" | env $run_env "$minifs" -b 2>&1 | grep -v ' commands in ')
+    fi
+    : > "$work/cmds"
+}
+
+run_case() {
+    rm -rf "$work/fs"
+    mkdir "$work/fs"
+    run_env=
+    : > "$work/cmds"
+    while IFS= read -r line || [ -n "$line" ]; do
+        case "$line" in
+            "@run"*)
+                flush
+                printf '%s\n' "$line"
+                run_env=${line#@run}
+                ;;
+            "@sh "*)
+                flush
+                printf '%s\n' "$line"
+                (cd "$work/fs" && sh -c "${line#@sh }") 2>&1
+                ;;
+            *) printf '%s\n' "$line" >> "$work/cmds" ;;
+        esac
+    done < "$1"
+    flush
+}
+
+failed=0
+if [ $# -gt 0 ]; then names=$*; else names=$(cd "$TESTS" && ls *.txt | sed 's/\.txt$//'); fi
+for name in $names; do
+    run_case "$TESTS/$name.txt" > "$work/$name.actual"
+    if [ ! -f "$TESTS/$name.out" ]; then
+        # Caso novo: a saída vira a esperada (confira antes de gravar)
+        cp "$work/$name.actual" "$TESTS/$name.out"
+        echo "new  $name"
+    elif diff -u "$TESTS/$name.out" "$work/$name.actual"; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        failed=1
+    fi
+done
+exit $failed
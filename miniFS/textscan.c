@@ -0,0 +1,165 @@
+// miniFS/textscan.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "textscan.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// --- Núcleo ---
+
+// Um bloco de SCAN_WIDTH bytes por vez: scan_mask(a, b, x, y) tem o bit i
+// ligado quando a[i] == x e b[i] == y (x e y repetidos em todo o vetor)
+#if defined(__AVX2__)
+#define SCAN_WIDTH 32
+typedef __m256i ScanVec;
+#define scan_load(p) _mm256_loadu_si256((const __m256i*)(const void*)(p))
+#define scan_splat(c) _mm256_set1_epi8(c)
+#define scan_eq(a, x) ((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, x)))
+#define scan_mask(a, b, x, y) \
+    ((unsigned int)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, x), _mm256_cmpeq_epi8(b, y))))
+#elif defined(__SSE2__)
+#define SCAN_WIDTH 16
+typedef __m128i ScanVec;
+#define scan_load(p) _mm_loadu_si128((const __m128i*)(const void*)(p))
+#define scan_splat(c) _mm_set1_epi8(c)
+#define scan_eq(a, x) ((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(a, x)))
+#define scan_mask(a, b, x, y) \
+    ((unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, x), _mm_cmpeq_epi8(b, y))))
+#endif
+
+const char* textscan_find(const char *hay, size_t n, const char *needle, size_t m) {
+    if (m == 0) return hay;
+    if (m > n) return NULL;
+    if (m == 1) return (const char*)memchr(hay, needle[0], n);
+    size_t i = 0;
+#ifdef SCAN_WIDTH
+    ScanVec first = scan_splat(needle[0]), last = scan_splat(needle[m - 1]);
+    for (; i + m - 1 + SCAN_WIDTH <= n; i += SCAN_WIDTH) {
+        unsigned int mask = scan_mask(scan_load(hay + i), scan_load(hay + i + m - 1), first, last);
+        while (mask) {
+            const char *p = hay + i + (size_t)__builtin_ctz(mask);
+            if (memcmp(p + 1, needle + 1, m - 2) == 0) return p;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    // O resto (ou tudo, sem SIMD): o primeiro byte com memchr
+    const char *end = hay + n - m + 1; // Depois da última posição possível
+    for (const char *p = hay + i; p < end; p++) {
+        p = (const char*)memchr(p, needle[0], (size_t)(end - p));
+        if (!p) return NULL;
+        if (p[m - 1] == needle[m - 1] && memcmp(p + 1, needle + 1, m - 2) == 0) return p;
+    }
+    return NULL;
+}
+
+size_t textscan_count(const char *p, size_t n, char c) {
+    size_t count = 0, i = 0;
+#ifdef SCAN_WIDTH
+    ScanVec x = scan_splat(c);
+    for (; i + SCAN_WIDTH <= n; i += SCAN_WIDTH) count += (size_t)__builtin_popcount(scan_eq(scan_load(p + i), x));
+#endif
+    for (; i < n; i++) count += p[i] == c;
+    return count;
+}
+
+// Último byte igual a c em p[0..n), ou NULL (memrchr não é padrão)
+static const char* find_last(const char *p, size_t n, char c) {
+#ifdef SCAN_WIDTH
+    ScanVec x = scan_splat(c);
+    for (; n >= SCAN_WIDTH; n -= SCAN_WIDTH) {
+        unsigned int mask = scan_eq(scan_load(p + n - SCAN_WIDTH), x);
+        if (mask) return p + n - SCAN_WIDTH + (31 - __builtin_clz(mask));
+    }
+#endif
+    while (n > 0) {
+        if (p[--n] == c) return p + n;
+    }
+    return NULL;
+}
+
+// --- Linhas ---
+
+void textscan_begin(TextScan *s, const char *needle, size_t len, TextLineFn fn, void *arg) {
+    s->needle = needle;
+    s->len = len;
+    s->line = 0;
+    s->matches = 0;
+    s->carry_len = 0;
+    s->fn = fn;
+    s->arg = arg;
+}
+
+static void carry_append(TextScan *s, const char *data, size_t len) {
+    if (s->carry_len + len > s->carry_cap) {
+        size_t cap = s->carry_cap ? s->carry_cap : 256;
+        while (cap < s->carry_len + len) cap *= 2;
+        char *grown = (char*)realloc(s->carry, cap);
+        if (!grown) { perror("Failed to allocate line buffer"); exit(1); }
+        s->carry = grown;
+        s->carry_cap = cap;
+    }
+    memcpy(s->carry + s->carry_len, data, len);
+    s->carry_len += len;
+}
+
+// Procura em linhas inteiras: p está no começo de uma linha e end logo
+// depois de um '\n' (ou no fim do conteúdo). As quebras só são contadas
+// até cada linha que casa e no fim, não uma a uma
+static void scan_lines(TextScan *s, const char *p, const char *end) {
+    const char *counted = p;
+    while (p < end) {
+        const char *hit = textscan_find(p, (size_t)(end - p), s->needle, s->len);
+        if (!hit) break;
+        const char *start = hit;
+        while (start > p && start[-1] != '\n') start--;
+        const char *stop = (const char*)memchr(hit, '\n', (size_t)(end - hit));
+        if (!stop) stop = end;
+        s->line += textscan_count(counted, (size_t)(start - counted), '\n');
+        s->matches++;
+        s->fn(s->line + 1, start, (size_t)(stop - start), s->arg);
+        if (stop == end) return;
+        s->line++;
+        p = counted = stop + 1;
+    }
+    s->line += textscan_count(counted, (size_t)(end - counted), '\n');
+}
+
+void textscan_feed(TextScan *s, const char *data, size_t len) {
+    const char *p = data, *end = data + len;
+    if (s->carry_len) {
+        const char *nl = (const char*)memchr(p, '\n', len);
+        if (!nl) {
+            carry_append(s, p, len);
+            return;
+        }
+        carry_append(s, p, (size_t)(nl - p) + 1);
+        scan_lines(s, s->carry, s->carry + s->carry_len);
+        s->carry_len = 0;
+        p = nl + 1;
+    }
+    const char *last = find_last(p, (size_t)(end - p), '\n');
+    if (!last) {
+        carry_append(s, p, (size_t)(end - p));
+        return;
+    }
+    scan_lines(s, p, last + 1);
+    if (last + 1 < end) carry_append(s, last + 1, (size_t)(end - last - 1));
+}
+
+void textscan_end(TextScan *s) {
+    if (s->carry_len) scan_lines(s, s->carry, s->carry + s->carry_len);
+    s->carry_len = 0;
+}
+
+void textscan_free(TextScan *s) {
+    free(s->carry);
+    s->carry = NULL;
+    s->carry_cap = 0;
+}
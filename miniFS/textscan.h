@@ -0,0 +1,50 @@
+// miniFS/textscan.h
+
+#ifndef TEXTSCAN_H
+#define TEXTSCAN_H
+
+#include <stddef.h> // Para size_t
+
+// Busca de texto do grep: um núcleo de busca de substring e a divisão em
+// linhas de um conteúdo lido em pedaços (os chunks de um arquivo).
+//
+// O núcleo compara de uma vez 32 posições (AVX2) ou 16 (SSE2) com o
+// primeiro e o último byte do padrão, e só confere com memcmp as posições
+// em que os dois batem: num texto comum, quase nenhuma. Sem SSE2, o
+// primeiro byte é procurado com memchr. A versão é escolhida na
+// compilação, como o hash da deduplicação (-mavx2 ou -march=native liga a
+// de 32 bytes)
+
+// Primeira ocorrência de needle[0..m) em hay[0..n), ou NULL. m == 0 casa
+// no começo
+const char* textscan_find(const char *hay, size_t n, const char *needle, size_t m);
+
+// Quantos bytes iguais a c há em p[0..n)
+size_t textscan_count(const char *p, size_t n, char c);
+
+// Linha que contém o padrão: número (a partir de 1) e texto, sem o '\n'
+typedef void (*TextLineFn)(size_t line, const char *text, size_t len, void *arg);
+
+// Busca de um padrão num conteúdo entregue em pedaços. Uma linha partida
+// entre dois pedaços é juntada em carry (só ela é copiada); as outras são
+// procuradas direto nos bytes recebidos. O padrão não pode ter '\n'
+typedef struct {
+    const char *needle;
+    size_t len;
+    size_t line;           // Linhas já terminadas
+    size_t matches;        // Linhas que casaram
+    char *carry;           // Começo da linha ainda sem '\n'
+    size_t carry_len;
+    size_t carry_cap;
+    TextLineFn fn;
+    void *arg;
+} TextScan;
+
+// Começa um conteúdo novo (o buffer de carry é reaproveitado)
+void textscan_begin(TextScan *s, const char *needle, size_t len, TextLineFn fn, void *arg);
+void textscan_feed(TextScan *s, const char *data, size_t len);
+// A última linha, se o conteúdo não termina em '\n'
+void textscan_end(TextScan *s);
+void textscan_free(TextScan *s);
+
+#endif // TEXTSCAN_H
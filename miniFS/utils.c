@@ -1,47 +1,131 @@
 // miniFS/utils.c
 
+#define _POSIX_C_SOURCE 200809L // fsync
+
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <ctype.h>
 #include "utils.h"
 
-char* trim_whitespace(char* str) {
-    char *end;
-    while(isspace((unsigned char)*str)) str++;
-    if(*str == 0) return str;
-    end = str + strlen(str) - 1;
-    while(end > str && isspace((unsigned char)*end)) end--;
-    end[1] = '\0';
-    return str;
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static void push_token(Tokens *t, char *text, size_t len, int quoted) {
+    if (t->count == t->cap) {
+        int cap = t->cap ? t->cap * 2 : 16;
+        Token *grown = (Token*)realloc(t->tok, (size_t)cap * sizeof(Token));
+        if (!grown) { perror("Failed to allocate tokens"); exit(1); }
+        t->tok = grown;
+        t->cap = cap;
+    }
+    t->tok[t->count].text = text;
+    t->tok[t->count].len = len;
+    t->tok[t->count].quoted = quoted;
+    t->count++;
 }
 
-char** split_string(const char* input, int* count) {
-    char* str = strdup(input);
-    char* trimmed_str = trim_whitespace(str);
-    int initial_alloc = 10;
-    char** tokens = malloc(initial_alloc * sizeof(char*));
-    char* token;
-    *count = 0;
-
-    token = strtok(trimmed_str, " \t\n");
-    while (token != NULL) {
-        tokens[*count] = strdup(token);
-        (*count)++;
-        if (*count >= initial_alloc) {
-            initial_alloc *= 2;
-            tokens = realloc(tokens, initial_alloc * sizeof(char*));
+// r lê e w escreve; w nunca passa de r, porque cada aspa ou escape
+// removido só atrasa w, e o '\0' de um token cai sobre o separador lido
+int tokens_split(Tokens *t, char *line) {
+    char *r = line, *w = line;
+    t->count = 0;
+    for (;;) {
+        while (is_space(*r)) r++;
+        if (*r == '\0') return t->count;
+
+        char *start = w;
+        int quoted = 0;
+        while (*r != '\0' && !is_space(*r)) {
+            if (*r == '\'') {
+                quoted = 1;
+                r++;
+                while (*r != '\'') {
+                    if (*r == '\0') return -1;
+                    *w++ = *r++;
+                }
+                r++;
+            } else if (*r == '"') {
+                quoted = 1;
+                r++;
+                while (*r != '"') {
+                    if (*r == '\0') return -1;
+                    if (*r == '\\' && (r[1] == '"' || r[1] == '\\')) r++;
+                    *w++ = *r++;
+                }
+                r++;
+            } else if (*r == '\\' && r[1] != '\0') {
+                quoted = 1;
+                r++;
+                *w++ = *r++;
+            } else {
+                *w++ = *r++;
+            }
         }
-        token = strtok(NULL, " \t\n");
+
+        int end = *r == '\0';
+        push_token(t, start, (size_t)(w - start), quoted);
+        *w++ = '\0';
+        if (end) return t->count;
+        r++;
+    }
+}
+
+// Cada token é deslocado para logo depois do anterior: o destino nunca
+// passa do início do token, então basta um memmove por token
+char* tokens_join(Tokens *t, int first, int last, size_t *len) {
+    char *text = t->tok[first].text;
+    char *w = text + t->tok[first].len;
+    for (int i = first + 1; i < last; i++) {
+        *w++ = ' ';
+        memmove(w, t->tok[i].text, t->tok[i].len);
+        w += t->tok[i].len;
     }
-    tokens[*count] = NULL;
-    free(str);
-    return tokens;
+    *w = '\0';
+    *len = (size_t)(w - text);
+    return text;
+}
+
+void tokens_free(Tokens *t) {
+    free(t->tok);
+    memset(t, 0, sizeof(Tokens));
 }
 
-void free_tokens(char** tokens) {
-    if (!tokens) return;
-    for (int i = 0; tokens[i] != NULL; i++) {
-        free(tokens[i]);
+// --- Arquivos ---
+
+int sync_file(FILE *file) {
+    if (fflush(file) != 0) return -1;
+#ifdef _WIN32
+    return _commit(_fileno(file));
+#else
+    return fsync(fileno(file));
+#endif
+}
+
+void sync_parent_dir(const char *path) {
+#ifndef _WIN32
+    const char *slash = strrchr(path, '/');
+    char dir[4096];
+    if (!slash) {
+        strcpy(dir, ".");
+    } else {
+        size_t len = slash == path ? 1 : (size_t)(slash - path);
+        if (len >= sizeof(dir)) return;
+        memcpy(dir, path, len);
+        dir[len] = '\0';
     }
-    free(tokens);
-}
\ No newline at end of file
+    int fd = open(dir, O_RDONLY);
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
+#else
+    (void)path;
+#endif
+}
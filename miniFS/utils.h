@@ -3,11 +3,46 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-// Divide uma string de entrada em um array de tokens (palavras).
-// O chamador é responsável por liberar a memória com free_tokens.
-char** split_string(const char* input, int* count);
+#include <stddef.h> // Para size_t
+#include <stdio.h>  // Para FILE
 
-// Libera a memória alocada por split_string.
-void free_tokens(char** tokens);
+// Um token aponta para dentro da própria linha de comando, que é dividida
+// no lugar: cada token termina com um '\0' escrito sobre o separador, e as
+// aspas e barras de escape são removidas deslocando o texto para a
+// esquerda. Nada é copiado nem alocado por token.
+typedef struct {
+    char *text;
+    size_t len;
+    int quoted;            // Teve aspas ou escapes (um ">" entre aspas não é redirecionamento)
+} Token;
 
-#endif // UTILS_H
\ No newline at end of file
+// Reaproveitado de uma linha para a próxima (o array só cresce). Comece
+// com a estrutura zerada
+typedef struct {
+    Token *tok;
+    int count;
+    int cap;
+} Tokens;
+
+// Divide a linha em tokens separados por espaços e retorna quantos são, ou
+// -1 se uma aspa não foi fechada. Aceita '...' (literal), "..." (com \" e
+// \\) e \ antes de um caractere fora das aspas. A linha é modificada
+int tokens_split(Tokens *t, char *line);
+
+// Junta os tokens [first, last) com um espaço entre eles, no lugar, e
+// retorna o texto (que começa em tok[first].text). Exige first < last e
+// invalida os tokens juntados
+char* tokens_join(Tokens *t, int first, int last, size_t *len);
+
+// Libera a memória acumulada pela estrutura
+void tokens_free(Tokens *t);
+
+// Gravação segura da imagem e do journal: um arquivo novo é escrito em
+// '<path>.tmp', recebe sync_file e só então é renomeado por cima do antigo.
+// sync_file esvazia o buffer do FILE e força os dados para o disco;
+// sync_parent_dir força a entrada do diretório, sem a qual o rename pode
+// não sobreviver a uma queda (no Windows, não faz nada)
+int sync_file(FILE *file);
+void sync_parent_dir(const char *path);
+
+#endif // UTILS_H
@@ -22,6 +22,32 @@ STRUCTURE_COLOR = Fore.WHITE + Style.DIM
 ERROR_COLOR = Fore.RED
 INFO_COLOR = Fore.YELLOW
 
+def details(node):
+    """
+    Tamanho (tree -s) e marca de corte por profundidade (tree -d), se houver.
+    """
+    text = ""
+    if 'size' in node:
+        text += f" ({node['size']} bytes)"
+    if node.get('truncated'):
+        text += " ..."
+    return f"{STRUCTURE_COLOR}{text}{Style.RESET_ALL}" if text else ""
+
+def print_ndjson(f):
+    """
+    Imprime um nó por linha, à medida que as linhas são lidas (tree -n), sem
+    carregar o arquivo inteiro. A indentação vem da profundidade.
+    """
+    for line in f:
+        if not line.strip():
+            continue
+        node = json.loads(line)
+        is_dir = node.get('type') == 'directory'
+        icon, color = (DIR_ICON, DIR_COLOR) if is_dir else (FILE_ICON, FILE_COLOR)
+        path = node.get('path', '/')
+        name = path if node.get('depth', 0) == 0 else path.rsplit('/', 1)[-1]
+        print(f"{'    ' * node.get('depth', 0)}{color}{icon} {name}{Style.RESET_ALL}{details(node)}")
+
 def print_tree(node, prefix="", is_last=True):
     """
     Função recursiva para imprimir a árvore de diretórios.
@@ -38,7 +64,7 @@ def print_tree(node, prefix="", is_last=True):
         color = FILE_COLOR
 
     # Imprime a linha atual
-    print(f"{prefix}{STRUCTURE_COLOR}{connector}{Style.RESET_ALL}{color}{icon} {node.get('name', 'Unnamed')}{Style.RESET_ALL}")
+    print(f"{prefix}{STRUCTURE_COLOR}{connector}{Style.RESET_ALL}{color}{icon} {node.get('name', 'Unnamed')}{Style.RESET_ALL}{details(node)}")
 
     # Prepara o prefixo para os nós filhos
     child_prefix = prefix + ("    " if is_last else "│   ")
@@ -54,7 +80,7 @@ def main():
     """
     Função principal: carrega o JSON e inicia a impressão da árvore.
     """
-    json_path = 'fs_tree.json'
+    json_path = sys.argv[1] if len(sys.argv) > 1 else 'fs_tree.json'
     
     if not os.path.exists(json_path):
         print(f"{ERROR_COLOR}Erro: Arquivo '{json_path}' não encontrado.")
@@ -63,6 +89,9 @@ def main():
 
     try:
         with open(json_path, 'r', encoding='utf-8') as f:
+            if json_path.endswith('.ndjson'):
+                print_ndjson(f)
+                return
             # Verifica se o arquivo não está vazio
             content = f.read()
             if not content:
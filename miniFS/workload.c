@@ -0,0 +1,336 @@
+// miniFS/workload.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "workload.h"
+#include "fs.h"
+#include "metrics.h"
+
+#define SKEWED_FILES_PER_DIR 100   // Média, para escolher o número de diretórios
+#define SKEWED_MAX_DIRS 10000
+#define DEEP_FILES 2               // Arquivos em cada nível de uma cadeia
+#define REALISTIC_TOP_DIRS 8
+#define REALISTIC_MAX_DEPTH 10
+
+static const char *const shape_names[WORKLOAD_SHAPES] = { "wide", "deep", "skewed", "realistic" };
+static const char *const sizes_names[] = { "empty", "fixed", "uniform", "lognormal" };
+
+static const char *const words[] = {
+    "src", "lib", "include", "docs", "test", "build", "assets", "config", "data", "scripts",
+    "vendor", "tmp", "home", "user", "project", "module", "cache", "logs", "images", "notes",
+    "report", "backup", "download", "music", "photo", "draft", "release", "archive",
+};
+static const char *const extensions[] = {
+    ".c", ".h", ".txt", ".md", ".json", ".png", ".o", ".py", ".jpg", ".csv", "",
+};
+
+// Texto de onde saem os conteúdos dos arquivos (cada um começa em um ponto sorteado)
+static char pattern[WORKLOAD_MAX_FILE];
+static int pattern_ready;
+
+static unsigned long long mix(unsigned long long z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+unsigned long long workload_random(unsigned long long *state) {
+    *state += 0x9e3779b97f4a7c15ull;
+    return mix(*state);
+}
+
+static long random_below(unsigned long long *state, long n) {
+    return n > 0 ? (long)(workload_random(state) % (unsigned long long)n) : 0;
+}
+
+static double random_unit(unsigned long long *state) {
+    return (workload_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Aproximação da lognormal sem libm: o expoente (em base 2) é uma soma de
+// 4 uniformes, quase normal, com desvio 1,5; a parte fracionária é
+// interpolada linearmente entre duas potências de 2
+static double lognormal(unsigned long long *state, double median) {
+    double s = 0;
+    for (int i = 0; i < 4; i++) s += random_unit(state);
+    s = (s - 2.0) * 2.6;
+    int e = (int)s;
+    if (s < e) e--;
+    double value = median * (1.0 + (s - e));
+    for (; e > 0; e--) value *= 2.0;
+    for (; e < 0; e++) value *= 0.5;
+    return value;
+}
+
+const char* workload_shape_name(WorkloadShape shape) {
+    return (unsigned int)shape < WORKLOAD_SHAPES ? shape_names[shape] : "?";
+}
+
+int workload_parse_shape(const char *text, WorkloadShape *out) {
+    for (int s = 0; s < WORKLOAD_SHAPES; s++) {
+        if (strcmp(text, shape_names[s]) == 0) {
+            *out = (WorkloadShape)s;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int workload_parse_sizes(const char *text, WorkloadSizes *sizes, size_t *param) {
+    const char *colon = strchr(text, ':');
+    size_t name_len = colon ? (size_t)(colon - text) : strlen(text);
+    for (int s = SIZES_EMPTY; s <= SIZES_LOGNORMAL; s++) {
+        if (strlen(sizes_names[s]) != name_len || strncmp(text, sizes_names[s], name_len) != 0) continue;
+        if (s == SIZES_EMPTY) {
+            if (colon) return -1;
+            *sizes = SIZES_EMPTY;
+            *param = 0;
+            return 0;
+        }
+        if (!colon || !colon[1]) return -1;
+        char *end;
+        unsigned long long n = strtoull(colon + 1, &end, 10);
+        if (*end == 'k' || *end == 'K') { n *= 1024; end++; }
+        else if (*end == 'm' || *end == 'M') { n *= 1024 * 1024; end++; }
+        if (*end || n > WORKLOAD_MAX_FILE) return -1;
+        *sizes = (WorkloadSizes)s;
+        *param = (size_t)n;
+        return 0;
+    }
+    return -1;
+}
+
+void workload_format_sizes(WorkloadSizes sizes, size_t param, char *buf, size_t cap) {
+    if (sizes == SIZES_EMPTY) snprintf(buf, cap, "empty");
+    else snprintf(buf, cap, "%s:%zu", sizes_names[sizes], param);
+}
+
+// --- Plano ---
+
+static long add_dir(Workload *w, long parent, long *cap) {
+    if (w->dir_count == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        WorkloadDir *grown = (WorkloadDir*)realloc(w->dirs, (size_t)*cap * sizeof(WorkloadDir));
+        if (!grown) { perror("Failed to plan workload"); exit(1); }
+        w->dirs = grown;
+    }
+    WorkloadDir *d = &w->dirs[w->dir_count];
+    d->parent = parent;
+    d->first_file = 0;
+    d->files = 0;
+    return w->dir_count++;
+}
+
+// Os arquivos são numerados na ordem dos diretórios
+static void assign_files(Workload *w) {
+    w->file_count = 0;
+    for (long d = 0; d < w->dir_count; d++) {
+        w->dirs[d].first_file = w->file_count;
+        w->file_count += w->dirs[d].files;
+    }
+    w->file_dir = (long*)malloc((size_t)(w->file_count > 0 ? w->file_count : 1) * sizeof(long));
+    if (!w->file_dir) { perror("Failed to plan workload"); exit(1); }
+    for (long d = 0; d < w->dir_count; d++) {
+        for (long f = 0; f < w->dirs[d].files; f++) w->file_dir[w->dirs[d].first_file + f] = d;
+    }
+}
+
+static void plan_wide(Workload *w, long nodes, long *cap) {
+    for (long left = nodes; left > 0;) {
+        long d = add_dir(w, -1, cap);
+        left--;
+        w->dirs[d].files = left < WORKLOAD_WIDE_FILES ? left : WORKLOAD_WIDE_FILES;
+        left -= w->dirs[d].files;
+    }
+}
+
+static void plan_deep(Workload *w, long nodes, long *cap) {
+    long parent = -1;
+    int depth = 0;
+    for (long left = nodes; left > 0;) {
+        if (depth == WORKLOAD_DEEP_DEPTH) { parent = -1; depth = 0; }
+        long d = add_dir(w, parent, cap);
+        left--;
+        w->dirs[d].files = left < DEEP_FILES ? left : DEEP_FILES;
+        left -= w->dirs[d].files;
+        parent = d;
+        depth++;
+    }
+}
+
+static void plan_skewed(Workload *w, long nodes, long *cap) {
+    long dirs = nodes / SKEWED_FILES_PER_DIR;
+    if (dirs < 1) dirs = 1;
+    if (dirs > SKEWED_MAX_DIRS) dirs = SKEWED_MAX_DIRS;
+    if (dirs > nodes) dirs = nodes;
+    long files = nodes - dirs;
+    double harmonic = 0;
+    for (long k = 1; k <= dirs; k++) harmonic += 1.0 / k;
+    long given = 0;
+    for (long k = 1; k <= dirs; k++) {
+        long d = add_dir(w, -1, cap);
+        w->dirs[d].files = (long)(files / (k * harmonic));
+        given += w->dirs[d].files;
+    }
+    if (dirs > 0) w->dirs[0].files += files - given; // Sobra do arredondamento
+}
+
+// Em largura: cada diretório, na ordem em que foi criado, recebe arquivos
+// e subdiretórios (em média 2, nenhum no último nível) até acabar o
+// orçamento. A fila nunca esvazia antes disso: quando o último da fila
+// fica sem subdiretórios, entra mais um diretório no primeiro nível
+static void plan_realistic(Workload *w, long nodes, unsigned long long *rng, long *cap) {
+    long depth_cap = 1024;
+    int *depth = (int*)malloc((size_t)depth_cap * sizeof(int));
+    if (!depth) { perror("Failed to plan workload"); exit(1); }
+    long left = nodes;
+    for (int i = 0; i < REALISTIC_TOP_DIRS && left > 0; i++, left--) {
+        long d = add_dir(w, -1, cap);
+        depth[d] = 1;
+    }
+    for (long d = 0; d < w->dir_count && left > 0; d++) {
+        long files = (long)lognormal(rng, 6.0);
+        if (files > 1000) files = 1000;
+        if (files > left) files = left;
+        w->dirs[d].files = files;
+        left -= files;
+
+        long subdirs = 0;
+        if (depth[d] < REALISTIC_MAX_DEPTH) {
+            while (random_unit(rng) < 0.66) subdirs++;
+        }
+        if (subdirs > left) subdirs = left;
+        long parent = d;
+        if (subdirs == 0 && d == w->dir_count - 1 && left > 0) {
+            subdirs = 1;
+            if (depth[d] == REALISTIC_MAX_DEPTH) parent = -1;
+        }
+        for (long s = 0; s < subdirs; s++, left--) {
+            long child = add_dir(w, parent, cap);
+            if (child == depth_cap) {
+                depth_cap *= 2;
+                int *grown = (int*)realloc(depth, (size_t)depth_cap * sizeof(int));
+                if (!grown) { perror("Failed to plan workload"); exit(1); }
+                depth = grown;
+            }
+            depth[child] = parent < 0 ? 1 : depth[d] + 1;
+        }
+    }
+    free(depth);
+}
+
+void workload_plan(Workload *w, const WorkloadOptions *opts, const char *base) {
+    memset(w, 0, sizeof(Workload));
+    w->opts = *opts;
+    w->base = base;
+    unsigned long long rng = opts->seed;
+    long cap = 0;
+    switch (opts->shape) {
+        case WORKLOAD_WIDE:      plan_wide(w, opts->nodes, &cap); break;
+        case WORKLOAD_DEEP:      plan_deep(w, opts->nodes, &cap); break;
+        case WORKLOAD_SKEWED:    plan_skewed(w, opts->nodes, &cap); break;
+        case WORKLOAD_REALISTIC: plan_realistic(w, opts->nodes, &rng, &cap); break;
+        default: break;
+    }
+    assign_files(w);
+}
+
+// --- Nomes e caminhos ---
+
+// Os nomes levam o índice do nó, então são únicos na árvore inteira
+static int node_name(const Workload *w, int is_dir, long index, char *buf, size_t cap) {
+    if (w->opts.shape != WORKLOAD_REALISTIC) return snprintf(buf, cap, is_dir ? "d%ld" : "f%ld", index);
+    unsigned long long h = mix(((unsigned long long)index << 1 | (unsigned long long)is_dir) ^ w->opts.seed);
+    const char *word = words[h % (sizeof(words) / sizeof(words[0]))];
+    if (is_dir) return snprintf(buf, cap, "%s%ld", word, index);
+    return snprintf(buf, cap, "%s_%ld%s", word, index,
+                    extensions[(h >> 32) % (sizeof(extensions) / sizeof(extensions[0]))]);
+}
+
+size_t workload_dir_path(const Workload *w, long dir, char *buf, size_t cap) {
+    long chain[WORKLOAD_DEEP_DEPTH];
+    int n = 0;
+    for (long d = dir; d >= 0; d = w->dirs[d].parent) {
+        if (n == WORKLOAD_DEEP_DEPTH) return 0;
+        chain[n++] = d;
+    }
+    size_t len = strlen(w->base);
+    if (len + 1 >= cap) return 0;
+    memcpy(buf, w->base, len + 1);
+    while (n > 0) {
+        if (len + 1 >= cap) return 0;
+        buf[len++] = '/';
+        int k = node_name(w, 1, chain[--n], buf + len, cap - len);
+        if (k < 0 || (size_t)k >= cap - len) return 0;
+        len += (size_t)k;
+    }
+    return len;
+}
+
+size_t workload_file_path(const Workload *w, long file, char *buf, size_t cap) {
+    size_t len = workload_dir_path(w, w->file_dir[file], buf, cap);
+    if (len == 0 || len + 1 >= cap) return 0;
+    buf[len++] = '/';
+    int k = node_name(w, 0, file, buf + len, cap - len);
+    if (k < 0 || (size_t)k >= cap - len) return 0;
+    return len + (size_t)k;
+}
+
+// --- Criação ---
+
+static void fill_pattern(void) {
+    if (pattern_ready) return;
+    unsigned long long rng = 1;
+    for (size_t i = 0; i < sizeof(pattern); i++) {
+        unsigned long long r = workload_random(&rng) % 32;
+        pattern[i] = r < 26 ? (char)('a' + r) : r < 31 ? ' ' : '\n';
+    }
+    pattern_ready = 1;
+}
+
+static size_t file_size(const Workload *w, unsigned long long *rng) {
+    double size;
+    switch (w->opts.sizes) {
+        case SIZES_FIXED:     size = (double)w->opts.size_param; break;
+        case SIZES_UNIFORM:   size = (double)random_below(rng, 2 * (long)w->opts.size_param + 1); break;
+        case SIZES_LOGNORMAL: size = lognormal(rng, (double)w->opts.size_param); break;
+        default:              size = 0; break;
+    }
+    return size > WORKLOAD_MAX_FILE ? WORKLOAD_MAX_FILE : (size_t)size;
+}
+
+long workload_build(fs_t *fs, Workload *w, unsigned long long *lat) {
+    char path[WORKLOAD_PATH_MAX];
+    unsigned long long rng = mix(w->opts.seed ^ 0x6a09e667f3bcc909ull); // Independente do plano
+    long ops = 0;
+    fill_pattern();
+    w->bytes = 0;
+    fs_mkdir(fs, w->base);
+    for (long d = 0; d < w->dir_count; d++) {
+        if (!workload_dir_path(w, d, path, sizeof(path))) continue;
+        unsigned long long t0 = metrics_ticks();
+        fs_mkdir(fs, path);
+        if (lat) lat[ops] = metrics_ticks() - t0;
+        ops++;
+
+        for (long f = w->dirs[d].first_file; f < w->dirs[d].first_file + w->dirs[d].files; f++) {
+            if (!workload_file_path(w, f, path, sizeof(path))) continue;
+            size_t size = file_size(w, &rng);
+            const char *data = pattern + random_below(&rng, (long)(WORKLOAD_MAX_FILE - size + 1));
+            t0 = metrics_ticks();
+            if (size == 0) fs_touch(fs, path);
+            else fs_write(fs, path, 0, data, size);
+            if (lat) lat[ops] = metrics_ticks() - t0;
+            ops++;
+            w->bytes += size;
+        }
+    }
+    return ops;
+}
+
+void workload_free(Workload *w) {
+    free(w->dirs);
+    free(w->file_dir);
+    memset(w, 0, sizeof(Workload));
+}
@@ -0,0 +1,105 @@
+// miniFS/workload.h
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stddef.h> // Para size_t
+#include "fs.h"     // Para fs_t
+
+// Gerador de árvores sintéticas para os benchmarks. A árvore é planejada
+// antes (só índices: cada diretório guarda o pai e a faixa dos seus
+// arquivos) e criada depois pela API do FS, então os caminhos de qualquer
+// nó podem ser remontados a qualquer momento sem guardar nenhuma string.
+// Tudo sai de um gerador pseudoaleatório com semente: a mesma semente gera
+// a mesma árvore, com os mesmos tamanhos, em qualquer máquina.
+//
+// Formatos:
+//   wide:      um nível de diretórios com WORKLOAD_WIDE_FILES arquivos cada;
+//   deep:      cadeias de WORKLOAD_DEEP_DEPTH diretórios aninhados, com
+//              poucos arquivos em cada nível;
+//   skewed:    um nível de diretórios com tamanhos da lei de Zipf (o k-ésimo
+//              tem 1/k dos arquivos do primeiro): poucos enormes e muitos
+//              pequenos;
+//   realistic: uma árvore aleatória parecida com uma pasta de projetos,
+//              com número de subdiretórios e de arquivos variável,
+//              profundidade limitada e nomes de tamanhos variados.
+#define WORKLOAD_WIDE_FILES 10000
+#define WORKLOAD_DEEP_DEPTH 128
+#define WORKLOAD_MAX_FILE (1024 * 1024) // Tamanho máximo de um arquivo gerado
+#define WORKLOAD_PATH_MAX 4096          // Cabe o caminho mais longo (formato deep)
+
+typedef enum {
+    WORKLOAD_WIDE,
+    WORKLOAD_DEEP,
+    WORKLOAD_SKEWED,
+    WORKLOAD_REALISTIC,
+    WORKLOAD_SHAPES
+} WorkloadShape;
+
+// Distribuição dos tamanhos dos arquivos, com o parâmetro size_param:
+//   empty:       arquivos vazios (só fs_touch);
+//   fixed:N      todos com N bytes;
+//   uniform:N    de 0 a 2N bytes (média N);
+//   lognormal:N  mediana N, com cauda longa (alguns arquivos dezenas de
+//                vezes maiores), como os tamanhos de arquivos reais
+typedef enum {
+    SIZES_EMPTY,
+    SIZES_FIXED,
+    SIZES_UNIFORM,
+    SIZES_LOGNORMAL
+} WorkloadSizes;
+
+typedef struct {
+    WorkloadShape shape;
+    long nodes;                // Diretórios + arquivos, sem contar a base
+    WorkloadSizes sizes;
+    size_t size_param;
+    unsigned long long seed;
+} WorkloadOptions;
+
+typedef struct {
+    long parent;               // -1 = diretório base
+    long first_file;           // Arquivos [first_file, first_file + files)
+    long files;
+} WorkloadDir;
+
+typedef struct {
+    WorkloadOptions opts;
+    const char *base;          // Diretório criado para a árvore (ex.: "/gen")
+    WorkloadDir *dirs;         // Pais sempre antes dos filhos
+    long dir_count;
+    long *file_dir;            // Diretório de cada arquivo
+    long file_count;
+    size_t bytes;              // Total escrito por workload_build
+} Workload;
+
+// Nome do formato ("wide", ...) e o inverso (-1 se desconhecido)
+const char* workload_shape_name(WorkloadShape shape);
+int workload_parse_shape(const char *text, WorkloadShape *out);
+
+// "lognormal:4096" e afins (o tamanho aceita os sufixos k e m). Retorna -1
+// se o texto não for válido
+int workload_parse_sizes(const char *text, WorkloadSizes *sizes, size_t *param);
+void workload_format_sizes(WorkloadSizes sizes, size_t param, char *buf, size_t cap);
+
+// Planeja a árvore (não toca no FS)
+void workload_plan(Workload *w, const WorkloadOptions *opts, const char *base);
+
+// Cria a base e a árvore planejada em fs, cada diretório seguido dos seus
+// arquivos. Se lat não for NULL, recebe a duração de cada operação (em
+// ticks de metrics_ticks), na ordem em que foram feitas. Retorna quantas
+// operações foram feitas (dir_count + file_count)
+long workload_build(fs_t *fs, Workload *w, unsigned long long *lat);
+
+// Caminho absoluto de um diretório ou arquivo do plano. Retorna o tamanho
+// ou 0 se não couber em cap
+size_t workload_dir_path(const Workload *w, long dir, char *buf, size_t cap);
+size_t workload_file_path(const Workload *w, long file, char *buf, size_t cap);
+
+// Gerador pseudoaleatório (splitmix64) usado pelo plano, exposto para que
+// os benchmarks sorteiem nós de forma igualmente reprodutível
+unsigned long long workload_random(unsigned long long *state);
+
+void workload_free(Workload *w);
+
+#endif // WORKLOAD_H